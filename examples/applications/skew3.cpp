@@ -45,6 +45,9 @@ namespace stream = stxxl::stream;
 // 1 GiB ram used by external data structures / 1 MiB block size
 internal_size_type ram_use = 1024 * 1024 * 1024;
 
+// run merging and run formation of consecutive sorts on separate threads
+bool use_async = false;
+
 // alphabet data type
 typedef unsigned char alphabet_type;
 
@@ -971,6 +974,44 @@ public:
         typedef build_sa<offset_array_it_rg, isa_second_type, isa_second_type> buildSA_type;
         typedef make_pairs<buildSA_type, counter_stream_type> precompute_isa_type;
 
+        // split (i, n_i) into mod1 and mod2 pairs, returns their number
+        template <typename NamesInputType>
+        static size_type split_mod12(NamesInputType& names_input,
+                                     mod12_sorter_type& m1_sorter, mod12_sorter_type& m2_sorter)
+        {
+            size_type concat_length = 0;
+            while (!names_input.empty()) {
+                const skew_pair_type& tmp = *names_input;
+                if (tmp.first & 1) {
+                    m2_sorter.push(tmp); // sorter #2
+                }
+                else {
+                    m1_sorter.push(tmp); // sorter #1
+                }
+                ++names_input;
+                concat_length++;
+            }
+            return concat_length;
+        }
+
+        // split (SA12, i) into pairs of the mod1 and the mod2 part
+        template <typename ISAInputType>
+        static void split_isa(ISAInputType& isa_pairs, offset_type mod2_pos, offset_type special,
+                              mod12_sorter_type& isa1_pair, mod12_sorter_type& isa2_pair)
+        {
+            while (!isa_pairs.empty()) {
+                const skew_pair_type& tmp = *isa_pairs;
+                if (tmp.first < mod2_pos) {
+                    if (tmp.first + special < mod2_pos) // else: special sentinel tuple is dropped
+                        isa1_pair.push(tmp);            // sorter #1
+                }
+                else {
+                    isa2_pair.push(tmp);                // sorter #2
+                }
+                ++isa_pairs;
+            }
+        }
+
         // Real recursive skew3 implementation
         // This part is the core of the skew algorithm and runs all class objects in their respective order
         template <typename RecInputType>
@@ -1009,18 +1050,14 @@ public:
             naming_input_type names_input(sort_mod12_input, unique);
 
             // create (i, s^12[i])
-            size_type concat_length = 0; // holds length of current S_12
-            while (!names_input.empty()) {
-                const skew_pair_type& tmp = *names_input;
-                if (tmp.first & 1) {
-                    m2_sorter.push(tmp); // sorter #2
-                }
-                else {
-                    m1_sorter.push(tmp); // sorter #1
-                }
-                ++names_input;
-                concat_length++;
+            size_type concat_length;     // holds length of current S_12
+            if (use_async) {
+                // merge and name on a separate thread, while forming runs here
+                stream::async_pipe<naming_input_type> names_pipe(names_input);
+                concat_length = split_mod12(names_pipe, m1_sorter, m2_sorter);
             }
+            else
+                concat_length = split_mod12(names_input, m1_sorter, m2_sorter);
 
             std::cout << "recursion string length = " << concat_length << std::endl;
 
@@ -1048,17 +1085,13 @@ public:
                 mod12_sorter_type isa1_pair(mod12cmp(), ram_use / 5);
                 mod12_sorter_type isa2_pair(mod12cmp(), ram_use / 5);
 
-                while (!isa_pairs.empty()) {
-                    const skew_pair_type& tmp = *isa_pairs;
-                    if (tmp.first < mod2_pos) {
-                        if (tmp.first + special < mod2_pos) // else: special sentinel tuple is dropped
-                            isa1_pair.push(tmp);            // sorter #1
-                    }
-                    else {
-                        isa2_pair.push(tmp);                // sorter #2
-                    }
-                    ++isa_pairs;
+                if (use_async) {
+                    // merge the suffix array of the recursion on a separate thread
+                    stream::async_pipe<precompute_isa_type> isa_pipe(isa_pairs);
+                    split_isa(isa_pipe, mod2_pos, special, isa1_pair, isa2_pair);
                 }
+                else
+                    split_isa(isa_pairs, mod2_pos, special, isa1_pair, isa2_pair);
 
                 delete recType;
 
@@ -1288,7 +1321,13 @@ int process(const std::string& input_filename, const std::string& output_filenam
     output_vector.resize(size);
 
     // write suffix array stream into output vector
-    stream::materialize(skew, output_vector.begin(), output_vector.end());
+    if (use_async) {
+        // merge the final suffix array on a separate thread
+        stream::async_pipe<skew_type> skew_pipe(skew);
+        stream::materialize(skew_pipe, output_vector.begin(), output_vector.end());
+    }
+    else
+        stream::materialize(skew, output_vector.begin(), output_vector.end());
 
     std::cout << "output size = " << output_vector.size() << std::endl;
     std::cout << (stxxl::stats_data(*Stats) - stats_begin); // print i/o statistics
@@ -1375,6 +1414,9 @@ int main(int argc, char* argv[])
                  "Cut input text to given size, e.g. 2 GiB.");
     cp.add_bytes('M', "memuse", ram_use,
                  "Amount of RAM to use, default: 1 GiB.");
+    cp.add_flag('a', "async", use_async,
+                "Pipeline consecutive sorts with stream::async_pipe, so that "
+                "merging runs on a separate thread.");
     cp.add_uint('w', "wordsize", wordsize,
                 "Set word size of suffix array to 32, 40 or 64 bit, "
                 "default: 32-bit.");
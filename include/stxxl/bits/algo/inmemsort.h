@@ -18,6 +18,7 @@
 #include <stxxl/bits/common/simple_vector.h>
 #include <stxxl/bits/io/request_operations.h>
 #include <stxxl/bits/algo/adaptor.h>
+#include <stxxl/bits/algo/radix_sort.h>
 #include <stxxl/bits/mng/adaptor.h>
 #include <stxxl/bits/parallel.h>
 
@@ -44,10 +45,9 @@ void stl_in_memory_sort(ExtIterator first, ExtIterator last, StrictWeakOrdering
 
     unsigned_type last_block_correction = last.block_offset() ? (block_type::size - last.block_offset()) : 0;
     check_sort_settings();
-    potentially_parallel::
-    sort(make_element_iterator(blocks.begin(), first.block_offset()),
-         make_element_iterator(blocks.begin(), nblocks * block_type::size - last_block_correction),
-         cmp);
+    potentially_radix_sort(make_element_iterator(blocks.begin(), first.block_offset()),
+                           make_element_iterator(blocks.begin(), nblocks * block_type::size - last_block_correction),
+                           cmp);
 
     for (i = 0; i < nblocks; ++i)
         reqs[i] = blocks[i].write(*(first.bid() + i));
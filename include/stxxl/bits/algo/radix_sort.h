@@ -0,0 +1,338 @@
+/***************************************************************************
+ *  include/stxxl/bits/algo/radix_sort.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_ALGO_RADIX_SORT_HEADER
+#define STXXL_ALGO_RADIX_SORT_HEADER
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/parallel.h>
+#include <stxxl/bits/common/types.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup stlalgo
+//! \{
+
+//! Determines whether a comparator exposes the key by which it orders.
+//!
+//! Such a comparator declares <tt>typedef KeyType key_type;</tt> with an
+//! unsigned integral KeyType and a method <tt>key_type key_of(const
+//! ValueType& v) const</tt>, such that <tt>cmp(a, b) == (cmp.key_of(a) <
+//! cmp.key_of(b))</tt>. The run formation of the sorters then sorts by
+//! radix_sort() instead of comparisons.
+template <class CompareType, class ValueType>
+class has_key_of
+{
+    typedef char yes_type;
+    struct no_type { char c[2]; };
+
+    template <class C, typename C::key_type (C::*)(const ValueType&) const>
+    struct check_type { };
+
+    template <class C>
+    static yes_type test(check_type<C, & C::key_of>*);
+    template <class C>
+    static no_type test(...);
+
+    template <class C, bool HasKeyOf>
+    struct unsigned_key
+    {
+        enum { value = false };
+    };
+
+    template <class C>
+    struct unsigned_key<C, true>
+    {
+        typedef std::numeric_limits<typename C::key_type> limits;
+        enum { value = limits::is_integer && !limits::is_signed };
+    };
+
+public:
+    enum { value = unsigned_key<CompareType, (sizeof(test<CompareType>(0)) == sizeof(yes_type))>::value };
+};
+
+/*! \internal
+ */
+namespace radix_sort_local {
+
+enum {
+    //! bits of the digits of large ranges, whose buckets are written far
+    //! apart
+    large_digit_bits = 8,
+    //! ranges at least this large use large digits, and are counted and
+    //! recursed on in parallel
+    large_size = 1 << 16,
+    //! smaller ranges use digits of up to this many bits, such that their
+    //! buckets hold about 2^bucket_bits elements
+    small_digit_bits = 12,
+    bucket_bits = 2,
+    //! ranges smaller than this are sorted by comparisons
+    small_size = 64,
+    //! number of evenly spaced positions at which potentially_radix_sort()
+    //! checks whether the input is presorted
+    presorted_samples = 256
+};
+
+//! number of bits of the digit to distribute n elements by
+inline unsigned digit_width(unsigned_type n)
+{
+    if (n >= large_size)
+        return large_digit_bits;
+
+    unsigned log_n = 0;
+    while ((n >> (log_n + 1)) != 0)
+        ++log_n;
+    if (log_n <= bucket_bits)
+        return 1;
+    return std::min<unsigned>(log_n - bucket_bits, small_digit_bits);
+}
+
+template <class KeyType>
+inline unsigned_type digit(KeyType key, unsigned shift, unsigned_type mask)
+{
+    return (unsigned_type)(key >> shift) & mask;
+}
+
+//! count the digits at shift of the keys of [begin,end)
+template <class Iterator, class KeyCompare>
+void count_digits(Iterator begin, Iterator end, const KeyCompare& cmp,
+                  unsigned shift, unsigned_type* count, unsigned_type buckets)
+{
+    std::fill(count, count + buckets, 0);
+    for ( ; begin != end; ++begin)
+        ++count[digit(cmp.key_of(*begin), shift, buckets - 1)];
+}
+
+//! permute the elements in place into the buckets of their digits at shift,
+//! given the bucket sizes, using head as work space (American flag sort)
+template <class Iterator, class KeyCompare>
+void permute(Iterator begin, const KeyCompare& cmp, unsigned shift,
+             const unsigned_type* count, unsigned_type* head,
+             unsigned_type buckets)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type value_type;
+
+    const unsigned_type mask = buckets - 1;
+    for (unsigned_type i = 0, sum = 0; i < buckets; ++i)
+    {
+        head[i] = sum;
+        sum += count[i];
+    }
+
+    // move each element to the next free slot of its bucket, carrying the
+    // element found there on, until one for the current bucket turns up
+    for (unsigned_type b = 0, tail = 0; b < buckets; ++b)
+    {
+        tail += count[b];
+        while (head[b] < tail)
+        {
+            value_type v = begin[head[b]];
+            unsigned_type d = digit(cmp.key_of(v), shift, mask);
+            while (d != b)
+            {
+                std::swap(v, begin[head[d]++]);
+                d = digit(cmp.key_of(v), shift, mask);
+            }
+            begin[head[b]++] = v;
+        }
+    }
+}
+
+//! sort the elements of [begin,end), whose keys agree except in the lowest
+//! bits, by MSD radix sort
+template <class Iterator, class KeyCompare>
+void msd_sort(Iterator begin, Iterator end, const KeyCompare& cmp,
+              unsigned bits)
+{
+    const unsigned_type n = end - begin;
+    if (n < small_size)
+    {
+        std::sort(begin, end, cmp);
+        return;
+    }
+
+    const unsigned width = std::min<unsigned>(bits, digit_width(n));
+    const unsigned_type buckets = (unsigned_type)1 << width;
+    const unsigned shift = bits - width;
+
+    // counts and work space of the permutation
+    std::vector<unsigned_type> count(2 * buckets);
+    count_digits(begin, end, cmp, shift, &count[0], buckets);
+
+    if (count[digit(cmp.key_of(*begin), shift, buckets - 1)] != n)
+        permute(begin, cmp, shift, &count[0], &count[buckets], buckets);
+
+    if (shift == 0)
+        return;
+
+    for (unsigned_type i = 0; i < buckets; ++i)
+    {
+        msd_sort(begin, begin + count[i], cmp, shift);
+        begin += count[i];
+    }
+}
+
+} // namespace radix_sort_local
+
+//! Sorts [begin,end) by in-place MSD radix sort on the keys exposed by the
+//! comparator, see has_key_of.
+//!
+//! Digits are distributed in place by American flag sort, eight bits wide
+//! while the buckets are large and wider once they fit in the cache, such
+//! that the buckets become small at once.
+//! Leading bits in which all keys agree are skipped, and buckets of fewer
+//! than 64 elements are sorted by comparisons. Besides the input, only the
+//! bucket counters are allocated. With OpenMP, large inputs are counted with
+//! per-thread histograms and the buckets of the first digit are sorted in
+//! parallel.
+template <class RandomAccessIterator, class KeyCompare>
+void radix_sort(RandomAccessIterator begin, RandomAccessIterator end,
+                KeyCompare cmp)
+{
+    using namespace radix_sort_local;
+    typedef typename KeyCompare::key_type key_type;
+
+    const unsigned_type n = end - begin;
+    if (n < small_size)
+    {
+        std::sort(begin, end, cmp);
+        return;
+    }
+
+    // find the bits in which the keys differ
+    const key_type first = cmp.key_of(*begin);
+    key_type diff = 0;
+    for (RandomAccessIterator it = begin; it != end; ++it)
+        diff |= cmp.key_of(*it) ^ first;
+    if (diff == 0)
+        return;
+
+    // the number of low bits in which the keys differ
+    unsigned bits = 0;
+    while (bits < (unsigned)std::numeric_limits<key_type>::digits && (diff >> bits) != 0)
+        ++bits;
+
+#if STXXL_PARALLEL
+    const int_type num_threads = omp_get_max_threads();
+    if (num_threads > 1 && n >= large_size)
+    {
+        const unsigned width = std::min<unsigned>(bits, large_digit_bits);
+        const unsigned_type buckets = (unsigned_type)1 << width;
+        const unsigned shift = bits - width;
+
+        // count with a histogram per thread
+        std::vector<unsigned_type> thread_count(num_threads * buckets, 0);
+#pragma omp parallel num_threads(num_threads)
+        {
+            const unsigned_type t = omp_get_thread_num(), p = omp_get_num_threads();
+            count_digits(begin + n * t / p, begin + n * (t + 1) / p,
+                         cmp, shift, &thread_count[t * buckets], buckets);
+        }
+
+        std::vector<unsigned_type> count(buckets, 0), start(buckets);
+        for (unsigned_type i = 0, sum = 0; i < buckets; ++i)
+        {
+            for (int_type t = 0; t < num_threads; ++t)
+                count[i] += thread_count[t * buckets + i];
+            start[i] = sum;
+            sum += count[i];
+        }
+
+        permute(begin, cmp, shift, &count[0], &thread_count[0], buckets);
+        if (shift == 0)
+            return;
+
+#pragma omp parallel for schedule(dynamic)
+        for (int_type i = 0; i < (int_type)buckets; ++i)
+        {
+            msd_sort(begin + start[i], begin + start[i] + count[i],
+                     cmp, shift);
+        }
+        return;
+    }
+#endif
+
+    msd_sort(begin, end, cmp, bits);
+}
+
+namespace radix_sort_local {
+
+//! whether [begin,end) looks ascending or descending: the elements at evenly
+//! spaced positions and their successors are all in the same order
+template <class Iterator, class CompareType>
+bool is_presorted(Iterator begin, Iterator end, const CompareType& cmp)
+{
+    const unsigned_type n = end - begin;
+    if (n < 2 * presorted_samples)
+        return false;
+
+    bool ascending = true, descending = true;
+    Iterator prev = begin;
+    for (unsigned_type i = 0; i < presorted_samples && (ascending || descending); ++i)
+    {
+        Iterator it = begin + (n - 1) / presorted_samples * i;
+        if (cmp(*(it + 1), *it) || cmp(*it, *prev))
+            ascending = false;
+        if (cmp(*it, *(it + 1)) || cmp(*prev, *it))
+            descending = false;
+        prev = it;
+    }
+    return ascending || descending;
+}
+
+template <bool Radix>
+struct sorter
+{
+    template <class Iterator, class CompareType>
+    static void sort(Iterator begin, Iterator end, CompareType cmp)
+    {
+        potentially_parallel::sort(begin, end, cmp);
+    }
+};
+
+template <>
+struct sorter<true>
+{
+    template <class Iterator, class CompareType>
+    static void sort(Iterator begin, Iterator end, CompareType cmp)
+    {
+        // comparison sorts are nearly linear on presorted input, the radix
+        // sort is not order-adaptive
+        if (is_presorted(begin, end, cmp))
+            potentially_parallel::sort(begin, end, cmp);
+        else
+            radix_sort(begin, end, cmp);
+    }
+};
+
+} // namespace radix_sort_local
+
+//! Sorts [begin,end) by radix_sort() if the comparator exposes its key (see
+//! has_key_of), and by potentially_parallel::sort() otherwise, or if a
+//! sample shows the input to be already ascending or descending.
+template <class RandomAccessIterator, class CompareType>
+void potentially_radix_sort(RandomAccessIterator begin,
+                            RandomAccessIterator end, CompareType cmp)
+{
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+    radix_sort_local::sorter<has_key_of<CompareType, value_type>::value>::sort(begin, end, cmp);
+}
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_ALGO_RADIX_SORT_HEADER
+// vim: et:ts=4:sw=4
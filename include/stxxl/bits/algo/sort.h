@@ -18,6 +18,7 @@
 
 #include <functional>
 
+#include <stxxl/bits/mng/bid_extent.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/common/rand.h>
 #include <stxxl/bits/mng/adaptor.h>
@@ -36,6 +37,7 @@
 #include <stxxl/bits/algo/run_cursor.h>
 #include <stxxl/bits/algo/losertree.h>
 #include <stxxl/bits/algo/inmemsort.h>
+#include <stxxl/bits/algo/radix_sort.h>
 #include <stxxl/bits/parallel.h>
 #include <stxxl/bits/common/is_sorted.h>
 
@@ -48,16 +50,19 @@ STXXL_BEGIN_NAMESPACE
  */
 namespace sort_local {
 
+//! Reads the next input blocks into the buffers of an extent once the
+//! extent is written.
 template <typename BlockType, typename BidType>
 struct read_next_after_write_completed
 {
     typedef BlockType block_type;
-    block_type* block;
-    BidType bid;
-    request_ptr* req;
+    block_type* blocks;
+    BidType* bids;
+    int_type nblocks;
+    request_ptr* reqs;
     void operator () (request* /*completed_req*/)
     {
-        * req = block->read(bid);
+        read_extents(blocks, bids, bids + nblocks, reqs);
     }
 };
 
@@ -78,6 +83,7 @@ create_runs(
     typedef RunType run_type;
 
     typedef typename block_type::bid_type bid_type;
+    typedef trigger_entry_iterator<typename run_type::iterator> run_bid_iterator;
     STXXL_VERBOSE1("stxxl::create_runs nruns=" << nruns << " m=" << _m);
 
     int_type m2 = _m / 2;
@@ -103,20 +109,16 @@ create_runs(
     assert(run_size == m2);
 
     for (i = 0; i < run_size; ++i)
-    {
-        STXXL_VERBOSE1("stxxl::create_runs posting read " << Blocks1[i].elem);
         bids1[i] = *(it++);
-        read_reqs1[i] = Blocks1[i].read(bids1[i]);
-    }
+    STXXL_VERBOSE1("stxxl::create_runs posting reads " << Blocks1[0].elem);
+    read_extents(Blocks1, bids1, bids1 + run_size, read_reqs1);
 
     run_size = runs[1]->size();
 
     for (i = 0; i < run_size; ++i)
-    {
-        STXXL_VERBOSE1("stxxl::create_runs posting read " << Blocks2[i].elem);
         bids2[i] = *(it++);
-        read_reqs2[i] = Blocks2[i].read(bids2[i]);
-    }
+    STXXL_VERBOSE1("stxxl::create_runs posting reads " << Blocks2[0].elem);
+    read_extents(Blocks2, bids2, bids2 + run_size, read_reqs2);
 
     for (int_type k = 0; k < nruns - 1; ++k)
     {
@@ -133,10 +135,9 @@ create_runs(
             bm->delete_block(bids1[i]);
 
         check_sort_settings();
-        potentially_parallel::
-        sort(make_element_iterator(Blocks1, 0),
-             make_element_iterator(Blocks1, run_size * block_type::size),
-             cmp);
+        potentially_radix_sort(make_element_iterator(Blocks1, 0),
+                               make_element_iterator(Blocks1, run_size * block_type::size),
+                               cmp);
 
         STXXL_VERBOSE1("stxxl::create_runs start waiting write_reqs");
         if (k > 0)
@@ -146,18 +147,33 @@ create_runs(
         int_type runplus2size = (k < nruns - 2) ? runs[k + 2]->size() : 0;
         for (i = 0; i < m2; ++i)
         {
-            STXXL_VERBOSE1("stxxl::create_runs posting write " << Blocks1[i].elem);
             (*run)[i].value = Blocks1[i][0];
+            if (i < runplus2size)
+                bids1[i] = *(it++);
+        }
+
+        // write the run by extents, the buffers of an extent are refilled
+        // with the run after the next one when the extent is written
+        for (i = 0; i < m2; )
+        {
+            STXXL_VERBOSE1("stxxl::create_runs posting write " << Blocks1[i].elem);
+            run_bid_iterator first = make_bid_iterator(run->begin() + i);
+            int_type n = extent_end(first, make_bid_iterator(run->end())) - first;
+            request_ptr req;
             if (i >= runplus2size) {
-                write_reqs[i] = Blocks1[i].write((*run)[i].bid);
+                req = write_extent(Blocks1 + i, (*run)[i].bid, n);
             }
             else
             {
-                next_run_reads[i].block = Blocks1 + i;
-                next_run_reads[i].req = read_reqs1 + i;
-                bids1[i] = next_run_reads[i].bid = *(it++);
-                write_reqs[i] = Blocks1[i].write((*run)[i].bid, next_run_reads[i]);
+                next_run_reads[i].blocks = Blocks1 + i;
+                next_run_reads[i].bids = bids1 + i;
+                next_run_reads[i].nblocks = STXXL_MIN(i + n, runplus2size) - i;
+                next_run_reads[i].reqs = read_reqs1 + i;
+                req = write_extent(Blocks1 + i, (*run)[i].bid, n, next_run_reads[i]);
             }
+            for (int_type j = 0; j < n; ++j)
+                write_reqs[i + j] = req;
+            i += n;
         }
         std::swap(Blocks1, Blocks2);
         std::swap(bids1, bids2);
@@ -173,21 +189,19 @@ create_runs(
         bm->delete_block(bids1[i]);
 
     check_sort_settings();
-    potentially_parallel::
-    sort(make_element_iterator(Blocks1, 0),
-         make_element_iterator(Blocks1, run_size * block_type::size),
-         cmp);
+    potentially_radix_sort(make_element_iterator(Blocks1, 0),
+                           make_element_iterator(Blocks1, run_size * block_type::size),
+                           cmp);
 
     STXXL_VERBOSE1("stxxl::create_runs start waiting write_reqs");
     wait_all(write_reqs, m2);
     STXXL_VERBOSE1("stxxl::create_runs finish waiting write_reqs");
 
     for (i = 0; i < run_size; ++i)
-    {
-        STXXL_VERBOSE1("stxxl::create_runs posting write " << Blocks1[i].elem);
         (*run)[i].value = Blocks1[i][0];
-        write_reqs[i] = Blocks1[i].write((*run)[i].bid);
-    }
+    STXXL_VERBOSE1("stxxl::create_runs posting writes " << Blocks1[0].elem);
+    write_extents(Blocks1, make_bid_iterator(run->begin()),
+                  make_bid_iterator(run->begin() + run_size), write_reqs);
 
     STXXL_VERBOSE1("stxxl::create_runs start waiting write_reqs");
     wait_all(write_reqs, run_size);
@@ -133,6 +133,8 @@ class addressable_priority_queue
 public:
     //! Type of handle to an entry. For use with insert and remove.
     typedef meta_iterator handle;
+    //! Iterator over the (priority, element) pairs, top element first.
+    typedef typename container_type::const_iterator const_iterator;
 
     //! Create an empty queue.
     addressable_priority_queue() { }
@@ -196,6 +198,14 @@ public:
         vals.erase(vals.begin());
         return e;
     }
+
+    //! Iterator to the top element.
+    const_iterator begin() const
+    { return vals.begin(); }
+
+    //! Iterator behind the last element.
+    const_iterator end() const
+    { return vals.end(); }
 };
 
 STXXL_END_NAMESPACE
@@ -18,6 +18,7 @@
 #include <cassert>
 #include <stxxl/bits/verbose.h>
 #include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/common/numa.h>
 
 #ifndef STXXL_VERBOSE_ALIGNED_ALLOC
 #define STXXL_VERBOSE_ALIGNED_ALLOC STXXL_VERBOSE2
@@ -28,11 +29,17 @@ STXXL_BEGIN_NAMESPACE
 template <typename MustBeInt>
 struct aligned_alloc_settings {
     static bool may_use_realloc;
+    //! prefer the NUMA node of the allocating thread for the buffer pages,
+    //! enabled by the block_manager if disks are bound to NUMA nodes.
+    static bool numa_local;
 };
 
 template <typename MustBeInt>
 bool aligned_alloc_settings<MustBeInt>::may_use_realloc = true;
 
+template <typename MustBeInt>
+bool aligned_alloc_settings<MustBeInt>::numa_local = false;
+
 // meta_info_size > 0 is needed for array allocations that have overhead
 //
 //                      meta_info
@@ -101,6 +108,11 @@ inline void * aligned_alloc(size_t size, size_t meta_info_size = 0)
     }
 
     *(((char**)result) - 1) = buffer;
+
+    // otherwise the pages land on the node of the I/O thread that first
+    // touches them with direct I/O
+    if (aligned_alloc_settings<int>::numa_local)
+        numa::bind_memory_local(result, size);
     STXXL_VERBOSE2(
         "stxxl::aligned_alloc<" << Alignment << ">(), allocated at " <<
         (void*)buffer << " returning " << (void*)result);
@@ -0,0 +1,61 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/numa.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_NUMA_HEADER
+#define STXXL_COMMON_NUMA_HEADER
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/namespace.h>
+
+#include <cstddef>
+#include <string>
+
+#if STXXL_HAVE_LIBNUMA
+ #include <pthread.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! Helpers to place I/O threads and memory on NUMA nodes. Without libnuma
+//! (STXXL_HAVE_LIBNUMA) the machine is treated as a single node and all
+//! placement calls do nothing.
+namespace numa {
+
+//! node number meaning "no NUMA placement"
+static const int NO_NODE = -1;
+
+//! number of NUMA nodes of the machine, 1 if unknown
+unsigned int num_nodes();
+
+//! NUMA node of the CPU the calling thread currently runs on, or NO_NODE
+int current_node();
+
+//! NUMA node the block device holding path is attached to, or NO_NODE if
+//! unknown. Looks up /sys/dev/block/<major>:<minor> on Linux.
+int device_node(const std::string& path);
+
+#if STXXL_HAVE_LIBNUMA
+//! restrict the thread to the CPUs of node, returns false on failure
+bool bind_thread(pthread_t thread, int node);
+#endif
+
+//! prefer node for the pages in [ptr, ptr + size) which are not yet
+//! faulted in. Only pages lying completely in the range are affected.
+void bind_memory(void* ptr, size_t size, int node);
+
+//! prefer the node of the calling thread for the pages in [ptr, ptr + size)
+void bind_memory_local(void* ptr, size_t size);
+
+} // namespace numa
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_NUMA_HEADER
+// vim: et:ts=4:sw=4
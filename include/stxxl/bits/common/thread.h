@@ -0,0 +1,126 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/thread.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_THREAD_HEADER
+#define STXXL_COMMON_THREAD_HEADER
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+#if STXXL_STD_THREADS
+ #include <thread>
+#elif STXXL_BOOST_THREADS
+ #include <boost/bind.hpp>
+ #include <boost/thread/thread.hpp>
+#elif STXXL_POSIX_THREADS
+ #include <pthread.h>
+ #include <unistd.h>
+
+ #include <stxxl/bits/common/error_handling.h>
+#else
+ #error "Thread implementation not detected."
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! A joinable thread running a plain function, on top of the configured
+//! thread implementation. The thread is joined at the latest by the
+//! destructor.
+class thread : private noncopyable
+{
+public:
+    typedef void* (* function_type)(void*);
+
+private:
+#if STXXL_STD_THREADS
+    std::thread* m_thread;
+#elif STXXL_BOOST_THREADS
+    boost::thread* m_thread;
+#else
+    pthread_t m_thread;
+    bool m_running;
+#endif
+
+public:
+    //! construct without starting a thread
+    thread()
+#if STXXL_STD_THREADS || STXXL_BOOST_THREADS
+        : m_thread(NULL)
+#else
+        : m_running(false)
+#endif
+    { }
+
+    //! join the thread if it is still running
+    ~thread()
+    {
+        join();
+    }
+
+    //! start a thread running func(arg)
+    void start(function_type func, void* arg)
+    {
+        join();
+#if STXXL_STD_THREADS
+        m_thread = new std::thread(func, arg);
+#elif STXXL_BOOST_THREADS
+        m_thread = new boost::thread(boost::bind(func, arg));
+#else
+        STXXL_CHECK_PTHREAD_CALL(pthread_create(&m_thread, NULL, func, arg));
+        m_running = true;
+#endif
+    }
+
+    //! wait for the thread to finish, does nothing if none was started
+    void join()
+    {
+#if STXXL_STD_THREADS || STXXL_BOOST_THREADS
+        if (!m_thread)
+            return;
+        m_thread->join();
+        delete m_thread;
+        m_thread = NULL;
+#else
+        if (!m_running)
+            return;
+        STXXL_CHECK_PTHREAD_CALL(pthread_join(m_thread, NULL));
+        m_running = false;
+#endif
+    }
+
+    //! whether a thread was started and not joined yet
+    bool running() const
+    {
+#if STXXL_STD_THREADS || STXXL_BOOST_THREADS
+        return m_thread != NULL;
+#else
+        return m_running;
+#endif
+    }
+
+    //! number of threads the hardware runs concurrently, at least one
+    static unsigned hardware_concurrency()
+    {
+#if STXXL_STD_THREADS
+        unsigned n = std::thread::hardware_concurrency();
+#elif STXXL_BOOST_THREADS
+        unsigned n = boost::thread::hardware_concurrency();
+#else
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        return n > 0 ? (unsigned)n : 1;
+    }
+};
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_THREAD_HEADER
+// vim: et:ts=4:sw=4
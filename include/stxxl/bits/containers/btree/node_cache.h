@@ -13,10 +13,13 @@
 #ifndef STXXL_CONTAINERS_BTREE_NODE_CACHE_HEADER
 #define STXXL_CONTAINERS_BTREE_NODE_CACHE_HEADER
 
+#include <algorithm>
+
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/compat/hash_map.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/containers/pager.h>
 #include <stxxl/bits/common/error_handling.h>
@@ -82,6 +85,8 @@ private:
     std::vector<bool> m_fixed;
     std::vector<bool> m_dirty;
     std::vector<int_type> m_free_nodes;
+    //! nodes deleted to return memory to the memory_arbiter
+    std::vector<int_type> m_retired_nodes;
     typedef typename compat_hash_map<bid_type, int_type, bid_hash>::result hash_map_type;
 
     //typedef std::map<bid_type,int_type,bid_comp> BID2node_type;
@@ -91,6 +96,8 @@ private:
     pager_type m_pager;
     block_manager* m_bm;
     alloc_strategy_type m_alloc_strategy;
+    //! the cache's share of the memory budget
+    memory_consumer m_memory;
 
     int64 n_found;
     int64 n_not_found;
@@ -106,7 +113,82 @@ private:
         for (typename std::vector<node_type*>::const_iterator it = m_nodes.begin();
              it != m_nodes.end(); ++it)
         {
-            (*it)->m_btree = b;
+            if (*it)
+                (*it)->m_btree = b;
+        }
+    }
+
+    //! Delete an unfixed node, which is written back if it is cached.
+    void retire_node(int_type node)
+    {
+        typename std::vector<int_type>::iterator it =
+            std::find(m_free_nodes.begin(), m_free_nodes.end(), node);
+        if (it != m_free_nodes.end())
+        {
+            m_free_nodes.erase(it);
+        }
+        else
+        {
+            if (m_reqs[node].valid())
+                m_reqs[node]->wait();
+            if (m_dirty[node])
+            {
+                m_nodes[node]->save();
+                ++n_written;
+            }
+            else
+                ++n_clean_forced;
+            m_bid2node.erase(m_nodes[node]->my_bid());
+        }
+
+        m_pager.remove(node);
+        delete m_nodes[node];
+        m_nodes[node] = NULL;
+        m_reqs[node] = request_ptr();
+        m_retired_nodes.push_back(node);
+        m_memory.release(block_type::raw_size);
+    }
+
+    //! Return memory reclaimed by the memory_arbiter by deleting free and
+    //! least recently used unfixed nodes, keeping at least three. If the
+    //! cache is full and memory is free, a deleted node is taken back.
+    void adapt_size()
+    {
+        uint64 reclaim = m_memory.reclaim();
+        if (reclaim > 0)
+        {
+            unsigned_type tries = size();
+            while (reclaim > 0 && size() - m_retired_nodes.size() > 3 && tries > 0)
+            {
+                int_type node;
+                if (!m_free_nodes.empty()) {
+                    node = m_free_nodes.back();
+                }
+                else {
+                    node = m_pager.kick();
+                    m_pager.hit(node);
+                    --tries;
+                    if (m_fixed[node])
+                        continue;
+                }
+                retire_node(node);
+                reclaim -= STXXL_MIN(reclaim, uint64(block_type::raw_size));
+            }
+            m_memory.reclaim_done();
+        }
+        else if (!m_retired_nodes.empty() && m_free_nodes.empty())
+        {
+            uint64 granted = m_memory.request(block_type::raw_size);
+            if (granted < block_type::raw_size) {
+                m_memory.release(granted);
+                return;
+            }
+            int_type node = m_retired_nodes.back();
+            m_retired_nodes.pop_back();
+            m_nodes[node] = new node_type(m_btree, m_cmp);
+            m_pager.insert(node);
+            m_fixed[node] = false;
+            m_free_nodes.push_back(node);
         }
     }
 
@@ -117,6 +199,7 @@ public:
         : m_btree(btree),
           m_cmp(cmp),
           m_bm(block_manager::get_instance()),
+          m_memory("btree::node_cache", true),
           n_found(0),
           n_not_found(0),
           n_created(0),
@@ -144,6 +227,8 @@ public:
 
         pager_type tmp_pager(nnodes);
         std::swap(m_pager, tmp_pager);
+
+        m_memory.reserve(nnodes * block_type::raw_size);
     }
 
     unsigned_type size() const
@@ -187,6 +272,8 @@ public:
     {
         ++n_created;
 
+        adapt_size();
+
         if (m_free_nodes.empty())
         {
             // need to kick a node
@@ -232,7 +319,7 @@ public:
 
             m_dirty[node2kick] = true;
 
-            assert(size() == m_bid2node.size() + m_free_nodes.size());
+            assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
             STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_new_node, need to kick node " << node2kick);
 
@@ -254,7 +341,7 @@ public:
 
         m_dirty[free_node] = true;
 
-        assert(size() == m_bid2node.size() + m_free_nodes.size());
+        assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
         STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_new_node, free node " << free_node << "available");
 
@@ -284,6 +371,8 @@ public:
 
         ++n_not_found;
 
+        adapt_size();
+
         // the node is not in cache
         if (m_free_nodes.empty())
         {
@@ -327,7 +416,7 @@ public:
 
             m_dirty[node2kick] = true;
 
-            assert(size() == m_bid2node.size() + m_free_nodes.size());
+            assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
             STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_node, need to kick node" << node2kick << " fix=" << fix);
 
@@ -348,7 +437,7 @@ public:
 
         m_dirty[free_node] = true;
 
-        assert(size() == m_bid2node.size() + m_free_nodes.size());
+        assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
         STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_node, free node " << free_node << "available, fix=" << fix);
 
@@ -377,6 +466,8 @@ public:
 
         ++n_not_found;
 
+        adapt_size();
+
         // the node is not in cache
         if (m_free_nodes.empty())
         {
@@ -419,7 +510,7 @@ public:
 
             m_dirty[node2kick] = false;
 
-            assert(size() == m_bid2node.size() + m_free_nodes.size());
+            assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
             STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_node, need to kick node" << node2kick << " fix=" << fix);
 
@@ -440,7 +531,7 @@ public:
 
         m_dirty[free_node] = false;
 
-        assert(size() == m_bid2node.size() + m_free_nodes.size());
+        assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
         STXXL_BTREE_CACHE_VERBOSE("btree::node_cache get_node, free node " << free_node << "available, fix=" << fix);
 
@@ -479,6 +570,8 @@ public:
         if (m_bid2node.find(bid) != m_bid2node.end())
             return;
 
+        adapt_size();
+
         // the node is not in cache
         if (m_free_nodes.empty())
         {
@@ -522,7 +615,7 @@ public:
 
             m_dirty[node2kick] = false;
 
-            assert(size() == m_bid2node.size() + m_free_nodes.size());
+            assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
             STXXL_BTREE_CACHE_VERBOSE("btree::node_cache prefetch_node, need to kick node" << node2kick << " ");
 
@@ -543,7 +636,7 @@ public:
 
         m_dirty[free_node] = false;
 
-        assert(size() == m_bid2node.size() + m_free_nodes.size());
+        assert(size() == m_bid2node.size() + m_free_nodes.size() + m_retired_nodes.size());
 
         STXXL_BTREE_CACHE_VERBOSE("btree::node_cache prefetch_node, free node " << free_node << "available");
 
@@ -566,6 +659,8 @@ public:
         obj.change_btree_pointers(obj.m_btree);
         std::swap(m_fixed, obj.m_fixed);
         std::swap(m_free_nodes, obj.m_free_nodes);
+        std::swap(m_retired_nodes, obj.m_retired_nodes);
+        m_memory.swap(obj.m_memory);
         std::swap(m_bid2node, obj.m_bid2node);
         std::swap(m_pager, obj.m_pager);
         std::swap(m_alloc_strategy, obj.m_alloc_strategy);
@@ -22,7 +22,9 @@
 #include <stxxl/bits/compat/hash_map.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/containers/pager.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 
+#include <algorithm>
 #include <vector>
 #include <list>
 
@@ -160,6 +162,9 @@ protected:
 
     enum { valid_all = block_type::size };
 
+    //! number of blocks kept when memory is reclaimed
+    enum { min_size = 4 };
+
     write_buffer_type write_buffer_;
 
     //! cached blocks
@@ -181,6 +186,11 @@ protected:
     bid_map_type bid_map_;
     pager_type pager_;
 
+    //! blocks deleted to return memory to the memory_arbiter
+    std::vector<unsigned_type> retired_blocks_;
+    //! the cache's share of the memory budget
+    memory_consumer memory_;
+
     /* statistics */
     int64 n_found;
     int64 n_not_found;
@@ -202,6 +212,7 @@ public:
           free_blocks_(cache_size),
           reqs_(cache_size),
           pager_(cache_size),
+          memory_("hash_map::block_cache", true),
           n_found(0),
           n_not_found(0),
           n_read(0),
@@ -214,6 +225,7 @@ public:
             blocks_[i] = new block_type();
             free_blocks_[i] = i;
         }
+        memory_.reserve(cache_size * block_type::raw_size);
     }
 
     //! Return cache-size
@@ -286,6 +298,82 @@ protected:
         free_blocks_.push_back(i_block2kick);
     }
 
+    //! Delete an unretained block, which is written back if dirty.
+    void retire_block(unsigned_type i_block)
+    {
+        typename std::vector<unsigned_type>::iterator it =
+            std::find(free_blocks_.begin(), free_blocks_.end(), i_block);
+        if (it != free_blocks_.end())
+        {
+            free_blocks_.erase(it);
+        }
+        else
+        {
+            if (valid_subblock_[i_block] == valid_all && reqs_[i_block].valid())
+                reqs_[i_block]->wait();
+
+            if (dirty_[i_block])
+            {
+                blocks_[i_block] =
+                    write_buffer_.write(blocks_[i_block], bids_[i_block]);
+                ++n_written;
+            }
+            else
+                ++n_clean_forced;
+
+            bid_map_.erase(bids_[i_block]);
+        }
+
+        pager_.remove(i_block);
+        delete blocks_[i_block];
+        blocks_[i_block] = NULL;
+        reqs_[i_block] = request_ptr();
+        retired_blocks_.push_back(i_block);
+        memory_.release(block_type::raw_size);
+    }
+
+    //! Return memory reclaimed by the memory_arbiter by deleting free and
+    //! least recently used unretained blocks, keeping at least min_size. If
+    //! the cache is full and memory is free, a deleted block is taken back.
+    void adapt_size()
+    {
+        uint64 reclaim = memory_.reclaim();
+        if (reclaim > 0)
+        {
+            unsigned_type tries = size();
+            while (reclaim > 0 && size() - retired_blocks_.size() > min_size && tries > 0)
+            {
+                unsigned_type i_block;
+                if (!free_blocks_.empty()) {
+                    i_block = free_blocks_.back();
+                }
+                else {
+                    i_block = pager_.kick();
+                    pager_.hit(i_block);
+                    --tries;
+                    if (retain_count_[i_block] > 0)
+                        continue;
+                }
+                retire_block(i_block);
+                reclaim -= STXXL_MIN(reclaim, uint64(block_type::raw_size));
+            }
+            memory_.reclaim_done();
+        }
+        else if (!retired_blocks_.empty() && free_blocks_.empty())
+        {
+            uint64 granted = memory_.request(block_type::raw_size);
+            if (granted < block_type::raw_size) {
+                memory_.release(granted);
+                return;
+            }
+            unsigned_type i_block = retired_blocks_.back();
+            retired_blocks_.pop_back();
+            blocks_[i_block] = new block_type();
+            pager_.insert(i_block);
+            free_blocks_.push_back(i_block);
+        }
+    }
+
 public:
     //! Retain a block in cache. Blocks, that are retained by at least one
     //! client, won't get kicked. Make sure to release all retained blocks
@@ -403,6 +491,8 @@ public:
         {
             n_not_found++;
 
+            adapt_size();
+
             if (free_blocks_.empty())
                 kick_block();
 
@@ -451,6 +541,8 @@ public:
         }
         // not even a subblock cached
         else {
+            adapt_size();
+
             if (free_blocks_.empty())
                 kick_block();
 
@@ -497,7 +589,8 @@ public:
                 reqs_[i]->wait();
             }
 
-            free_blocks_.push_back(i);
+            if (blocks_[i] != NULL)
+                free_blocks_.push_back(i);
         }
         bid_map_.clear();
     }
@@ -542,6 +635,8 @@ public:
 
         std::swap(bid_map_, obj.bid_map_);
         std::swap(pager_, obj.pager_);
+        std::swap(retired_blocks_, obj.retired_blocks_);
+        memory_.swap(obj.memory_);
 
         std::swap(n_found, obj.n_found);
         std::swap(n_not_found, obj.n_found);
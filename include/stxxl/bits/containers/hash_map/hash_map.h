@@ -19,6 +19,7 @@
 #include <stxxl/bits/noncopyable.h>
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 #include <stxxl/bits/common/tuple.h>
 #include <stxxl/bits/stream/stream.h>
 #include <stxxl/bits/stream/sort_stream.h>
@@ -163,6 +164,8 @@ protected:
     mutable external_size_type num_total_;
     //! desired load factor after rehashing
     float opt_load_factor_;
+    //! share of the memory budget for the internal-memory buffer
+    memory_consumer memory_;
 
 public:
     /*!
@@ -188,9 +191,11 @@ public:
           node_allocator_(a),
           oblivious_(false),
           num_total_(0),
-          opt_load_factor_(0.875)
+          opt_load_factor_(0.875),
+          memory_("hash_map")
     {
         max_buffer_size_ = buffer_size / sizeof(node_type);
+        memory_.reserve(max_buffer_size_ * sizeof(node_type));
     }
 
     /*!
@@ -224,9 +229,11 @@ public:
           node_allocator_(a),
           oblivious_(false),
           num_total_(0),
-          opt_load_factor_(0.875)
+          opt_load_factor_(0.875),
+          memory_("hash_map")
     {
         max_buffer_size_ = buffer_size / sizeof(node_type);
+        memory_.reserve(max_buffer_size_ * sizeof(node_type));
         insert(begin, end, mem_to_sort);
     }
 
@@ -587,6 +594,8 @@ public:
         std::swap(iterator_map_, obj.iterator_map_);
 
         std::swap(block_cache_, obj.block_cache_);
+
+        memory_.swap(obj.memory_);
     }
 
 protected:
@@ -1246,6 +1246,12 @@ public:
     //!    4: strassen_winograd_multiply, optimized pre- and postadditions (sometimes fast but unstable time and I/O complexity) \n
     //!    5: strassen_winograd_multiply_and_add_interleaved, optimized preadditions (sometimes fast but unstable time and I/O complexity) \n
     //!    6: multi_level_strassen_winograd_multiply_and_add_block_grained (sometimes fast but unstable time and I/O complexity)
+    //!
+    //! Available scheduling algorithms are: \n
+    //!    0: online LRU \n
+    //!    1: offline LFD \n
+    //!    2: offline LRU prefetching (default) \n
+    //!    3: offline LFD prefetching
     matrix_type multiply(const matrix_type& right, const int_type multiplication_algorithm = 1, const int_type scheduling_algorithm = 2) const
     {
         assert(width == right.height);
@@ -1303,6 +1309,11 @@ public:
                 new block_scheduler_algorithm_offline_lru_prefetching<swappable_block_type>(data->bs)
                 );
             break;
+        case 3:
+            delete data->bs.switch_algorithm_to(
+                new block_scheduler_algorithm_offline_lfd_prefetching<swappable_block_type>(data->bs)
+                );
+            break;
         default:
             STXXL_ERRMSG("invalid scheduling-algorithm number");
         }
@@ -1371,6 +1382,11 @@ public:
                 new block_scheduler_algorithm_offline_lru_prefetching<swappable_block_type>(data->bs)
                 );
             break;
+        case 3:
+            delete data->bs.switch_algorithm_to(
+                new block_scheduler_algorithm_offline_lfd_prefetching<swappable_block_type>(data->bs)
+                );
+            break;
         default:
             STXXL_ERRMSG("invalid scheduling-algorithm number");
         }
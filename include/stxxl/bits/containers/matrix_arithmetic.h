@@ -15,6 +15,7 @@
 
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/containers/matrix_low_level.h>
+#include <stxxl/bits/unused.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -73,7 +74,16 @@ struct matrix_operation_statistic_dataset
 
 struct matrix_operation_statistic
     : public singleton<matrix_operation_statistic>, public matrix_operation_statistic_dataset
-{ };
+{
+    //! Increment one of the counters, the block operations may run on several threads.
+    static void increment(int_type& counter)
+    {
+#if STXXL_PARALLEL
+#pragma omp atomic
+#endif
+        ++counter;
+    }
+};
 
 struct matrix_operation_statistic_data : public matrix_operation_statistic_dataset
 {
@@ -1029,6 +1039,21 @@ struct matrix_operations
     typedef row_vector<ValueType> row_vector_type;
     typedef typename column_vector_type::size_type vector_size_type;
 
+    //! Whether the loops over blocks run in parallel. The scheduler has to
+    //! serve concurrent requests, i.e. work online, and hold at least three
+    //! blocks per thread. Loops nested in a parallel loop run sequentially.
+    static bool parallel_block_loops(const block_scheduler_type& bs)
+    {
+#if STXXL_PARALLEL
+        const int_type num_threads = omp_get_max_threads();
+        return num_threads > 1 && ! omp_in_parallel() && bs.is_thread_safe()
+               && bs.get_max_internal_blocks() >= 3 * num_threads;
+#else
+        STXXL_UNUSED(bs);
+        return false;
+#endif
+    }
+
     // +-+-+-+ addition +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 
     struct addition
@@ -1071,12 +1096,19 @@ struct matrix_operations
                const swappable_block_matrix_type& A,
                const swappable_block_matrix_type& B, Op op = Op())
     {
-        for (size_type row = 0; row < C.get_height(); ++row)
-            for (size_type col = 0; col < C.get_width(); ++col)
-                element_op_swappable_block(
-                    C(row, col), C.is_transposed(), C.bs,
-                    A(row, col), A.is_transposed(), A.bs,
-                    B(row, col), B.is_transposed(), B.bs, op);
+        const int_type num_blocks = C.get_height() * C.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) \
+            if (parallel_block_loops(C.bs) && parallel_block_loops(A.bs) && parallel_block_loops(B.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            const size_type row = i / C.get_width(), col = i % C.get_width();
+            element_op_swappable_block(
+                C(row, col), C.is_transposed(), C.bs,
+                A(row, col), A.is_transposed(), A.bs,
+                B(row, col), B.is_transposed(), B.bs, op);
+        }
         return C;
     }
 
@@ -1086,11 +1118,18 @@ struct matrix_operations
     element_op(swappable_block_matrix_type& C,
                const swappable_block_matrix_type& A, Op op = Op())
     {
-        for (size_type row = 0; row < C.get_height(); ++row)
-            for (size_type col = 0; col < C.get_width(); ++col)
-                element_op_swappable_block(
-                    C(row, col), C.is_transposed(), C.bs,
-                    A(row, col), A.is_transposed(), A.bs, op);
+        const int_type num_blocks = C.get_height() * C.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) \
+            if (parallel_block_loops(C.bs) && parallel_block_loops(A.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            const size_type row = i / C.get_width(), col = i % C.get_width();
+            element_op_swappable_block(
+                C(row, col), C.is_transposed(), C.bs,
+                A(row, col), A.is_transposed(), A.bs, op);
+        }
         return C;
     }
 
@@ -1099,10 +1138,13 @@ struct matrix_operations
     static swappable_block_matrix_type&
     element_op(swappable_block_matrix_type& C, Op op = Op())
     {
-        for (size_type row = 0; row < C.get_height(); ++row)
-            for (size_type col = 0; col < C.get_width(); ++col)
-                element_op_swappable_block(
-                    C(row, col), C.bs, op);
+        const int_type num_blocks = C.get_height() * C.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(C.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+            element_op_swappable_block(
+                C(i / C.get_width(), i % C.get_width()), C.bs, op);
         return C;
     }
 
@@ -1115,14 +1157,14 @@ struct matrix_operations
         const swappable_block_identifier_type b, bool b_is_transposed, block_scheduler_type& bs_b, Op op = Op())
     {
         if (! bs_c.is_simulating())
-            ++matrix_operation_statistic::get_instance()->block_addition_calls;
+            matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_addition_calls);
         // check if zero-block (== ! initialized)
         if (! bs_a.is_initialized(a) && ! bs_b.is_initialized(b))
         {
             // => a and b are zero -> set c zero
             bs_c.deinitialize(c);
             if (! bs_c.is_simulating())
-                ++matrix_operation_statistic::get_instance()->block_additions_saved_through_zero;
+                matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_additions_saved_through_zero);
             return;
         }
         a_is_transposed = a_is_transposed != c_is_transposed;
@@ -1193,13 +1235,13 @@ struct matrix_operations
         const swappable_block_identifier_type a, const bool a_is_transposed, block_scheduler_type& bs_a, Op op = Op())
     {
         if (! bs_c.is_simulating())
-            ++matrix_operation_statistic::get_instance()->block_addition_calls;
+            matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_addition_calls);
         // check if zero-block (== ! initialized)
         if (! bs_a.is_initialized(a))
         {
             // => b is zero => nothing to do
             if (! bs_c.is_simulating())
-                ++matrix_operation_statistic::get_instance()->block_additions_saved_through_zero;
+                matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_additions_saved_through_zero);
             return;
         }
         const bool c_is_zero = ! bs_c.is_initialized(c);
@@ -1234,13 +1276,13 @@ struct matrix_operations
         const swappable_block_identifier_type c, block_scheduler_type& bs_c, Op op = Op())
     {
         if (! bs_c.is_simulating())
-            ++matrix_operation_statistic::get_instance()->block_addition_calls;
+            matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_addition_calls);
         // check if zero-block (== ! initialized)
         if (! bs_c.is_initialized(c))
         {
             // => c is zero => nothing to do
             if (! bs_c.is_simulating())
-                ++matrix_operation_statistic::get_instance()->block_additions_saved_through_zero;
+                matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_additions_saved_through_zero);
             return;
         }
         // acquire
@@ -1264,14 +1306,18 @@ struct matrix_operations
                                     swappable_block_matrix_type& s3,
                                     swappable_block_matrix_type& s4)
     {
-        for (size_type row = 0; row < a11.get_height(); ++row)
-            for (size_type col = 0; col < a11.get_width(); ++col)
-            {
-                op_swappable_block_nontransposed(s3, a11, subtraction(), a21, row, col);
-                op_swappable_block_nontransposed(s1, a21,    addition(), a22, row, col);
-                op_swappable_block_nontransposed(s2,  s1, subtraction(), a11, row, col);
-                op_swappable_block_nontransposed(s4, a12, subtraction(),  s2, row, col);
-            }
+        const int_type num_blocks = a11.get_height() * a11.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(a11.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            size_type row = i / a11.get_width(), col = i % a11.get_width();
+            op_swappable_block_nontransposed(s3, a11, subtraction(), a21, row, col);
+            op_swappable_block_nontransposed(s1, a21,    addition(), a22, row, col);
+            op_swappable_block_nontransposed(s2,  s1, subtraction(), a11, row, col);
+            op_swappable_block_nontransposed(s4, a12, subtraction(),  s2, row, col);
+        }
     }
 
     inline static void
@@ -1284,14 +1330,18 @@ struct matrix_operations
                                     swappable_block_matrix_type& t3,
                                     swappable_block_matrix_type& t4)
     {
-        for (size_type row = 0; row < b11.get_height(); ++row)
-            for (size_type col = 0; col < b11.get_width(); ++col)
-            {
-                op_swappable_block_nontransposed(t3, b22, subtraction(), b12, row, col);
-                op_swappable_block_nontransposed(t1, b12, subtraction(), b11, row, col);
-                op_swappable_block_nontransposed(t2, b22, subtraction(),  t1, row, col);
-                op_swappable_block_nontransposed(t4, b21, subtraction(),  t2, row, col);
-            }
+        const int_type num_blocks = b11.get_height() * b11.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(b11.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            size_type row = i / b11.get_width(), col = i % b11.get_width();
+            op_swappable_block_nontransposed(t3, b22, subtraction(), b12, row, col);
+            op_swappable_block_nontransposed(t1, b12, subtraction(), b11, row, col);
+            op_swappable_block_nontransposed(t2, b22, subtraction(),  t1, row, col);
+            op_swappable_block_nontransposed(t4, b21, subtraction(),  t2, row, col);
+        }
     }
 
     inline static void
@@ -1303,17 +1353,21 @@ struct matrix_operations
                                    swappable_block_matrix_type& p3,
                                    swappable_block_matrix_type& p5)
     {
-        for (size_type row = 0; row < c11.get_height(); ++row)
-            for (size_type col = 0; col < c11.get_width(); ++col)
-            {
-                op_swappable_block_nontransposed(c11,     addition(),  p1, row, col); // (u1)
-                op_swappable_block_nontransposed( p1,     addition(), c22, row, col); // (u2)
-                op_swappable_block_nontransposed( p5,     addition(),  p1, row, col); // (u3)
-                op_swappable_block_nontransposed(c21,     addition(),  p5, row, col); // (u4)
-                op_swappable_block_nontransposed(c22, p5, addition(),  p3, row, col); // (u5)
-                op_swappable_block_nontransposed( p1,     addition(),  p3, row, col); // (u6)
-                op_swappable_block_nontransposed(c12,     addition(),  p1, row, col); // (u7)
-            }
+        const int_type num_blocks = c11.get_height() * c11.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(c11.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            size_type row = i / c11.get_width(), col = i % c11.get_width();
+            op_swappable_block_nontransposed(c11,     addition(),  p1, row, col); // (u1)
+            op_swappable_block_nontransposed( p1,     addition(), c22, row, col); // (u2)
+            op_swappable_block_nontransposed( p5,     addition(),  p1, row, col); // (u3)
+            op_swappable_block_nontransposed(c21,     addition(),  p5, row, col); // (u4)
+            op_swappable_block_nontransposed(c22, p5, addition(),  p3, row, col); // (u5)
+            op_swappable_block_nontransposed( p1,     addition(),  p3, row, col); // (u6)
+            op_swappable_block_nontransposed(c12,     addition(),  p1, row, col); // (u7)
+        }
     }
 
     // calculates c1 += a; c2 += a
@@ -1323,16 +1377,20 @@ struct matrix_operations
                                    swappable_block_matrix_type& c2,
                                    const swappable_block_matrix_type& a, Op op = Op())
     {
-        for (size_type row = 0; row < a.get_height(); ++row)
-            for (size_type col = 0; col < a.get_width(); ++col)
-            {
-                element_op_swappable_block(
-                    c1(row, col), false, c1.bs,
-                    a(row, col), false, a.bs, op);
-                element_op_swappable_block(
-                    c2(row, col), false, c2.bs,
-                    a(row, col), false, a.bs, op);
-            }
+        const int_type num_blocks = a.get_height() * a.get_width();
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(a.bs))
+        #endif
+        for (int_type i = 0; i < num_blocks; ++i)
+        {
+            const size_type row = i / a.get_width(), col = i % a.get_width();
+            element_op_swappable_block(
+                c1(row, col), false, c1.bs,
+                a(row, col), false, a.bs, op);
+            element_op_swappable_block(
+                c2(row, col), false, c2.bs,
+                a(row, col), false, a.bs, op);
+        }
     }
 
     template <class Op>
@@ -1785,6 +1843,17 @@ struct matrix_operations
         if ((C.get_height() == 1) + (C.get_width() == 1) + (A.get_width() == 1) >= 2)
             return naive_multiply_and_add(A, B, C);
 
+        #if STXXL_PARALLEL
+        if (parallel_block_loops(C.bs) && parallel_block_loops(A.bs) && parallel_block_loops(B.bs))
+        {
+            // the recursive calls for different quarters of C become tasks
+            #pragma omp parallel
+            #pragma omp single
+            recursive_multiply_and_add_tasks(A, B, C);
+            return C;
+        }
+        #endif
+
         // partition matrix
         swappable_block_matrix_approximative_quarterer qa(A), qb(B), qc(C);
         // recursive multiplication
@@ -1801,6 +1870,50 @@ struct matrix_operations
         return C;
     }
 
+    #if STXXL_PARALLEL
+    //! calculates C = A * B + C like recursive_multiply_and_add, with one task
+    //! per quarter of C. Has to be called by one thread of a parallel region.
+    static void recursive_multiply_and_add_tasks(const swappable_block_matrix_type& A,
+                                                 const swappable_block_matrix_type& B,
+                                                 swappable_block_matrix_type& C)
+    {
+        // catch empty intervals
+        if (C.get_height() * C.get_width() * A.get_width() == 0)
+            return;
+        // base case
+        if ((C.get_height() == 1) + (C.get_width() == 1) + (A.get_width() == 1) >= 2)
+        {
+            naive_multiply_and_add(A, B, C);
+            return;
+        }
+
+        // partition matrix
+        swappable_block_matrix_approximative_quarterer qa(A), qb(B), qc(C);
+        // the two products added to a quarter of C are computed by the same task
+        #pragma omp task shared(qa, qb, qc)
+        {
+            recursive_multiply_and_add_tasks(qa.ul, qb.ul, qc.ul);
+            recursive_multiply_and_add_tasks(qa.ur, qb.dl, qc.ul);
+        }
+        #pragma omp task shared(qa, qb, qc)
+        {
+            recursive_multiply_and_add_tasks(qa.ur, qb.dr, qc.ur);
+            recursive_multiply_and_add_tasks(qa.ul, qb.ur, qc.ur);
+        }
+        #pragma omp task shared(qa, qb, qc)
+        {
+            recursive_multiply_and_add_tasks(qa.dl, qb.ur, qc.dr);
+            recursive_multiply_and_add_tasks(qa.dr, qb.dr, qc.dr);
+        }
+        #pragma omp task shared(qa, qb, qc)
+        {
+            recursive_multiply_and_add_tasks(qa.dr, qb.dl, qc.dl);
+            recursive_multiply_and_add_tasks(qa.dl, qb.ul, qc.dl);
+        }
+        #pragma omp taskwait
+    }
+    #endif
+
     //! calculates C = A * B + C
     // requires fitting dimensions
     static swappable_block_matrix_type&
@@ -1808,15 +1921,21 @@ struct matrix_operations
                            const swappable_block_matrix_type& B,
                            swappable_block_matrix_type& C)
     {
-        const size_type& n = C.get_height(),
-        & m = C.get_width(),
+        const size_type& m = C.get_width(),
         & l = A.get_width();
-        for (size_type i = 0; i < n; ++i)
-            for (size_type j = 0; j < m; ++j)
-                for (size_type k = 0; k < l; ++k)
-                    multiply_and_add_swappable_block(A(i, k), A.is_transposed(), A.bs,
-                                                     B(k, j), B.is_transposed(), B.bs,
-                                                     C(i, j), C.is_transposed(), C.bs);
+        // each thread computes whole blocks of C
+        const int_type num_blocks = C.get_height() * m;
+        #if STXXL_PARALLEL
+        #pragma omp parallel for schedule(dynamic) if (parallel_block_loops(C.bs))
+        #endif
+        for (int_type ij = 0; ij < num_blocks; ++ij)
+        {
+            const size_type i = ij / m, j = ij % m;
+            for (size_type k = 0; k < l; ++k)
+                multiply_and_add_swappable_block(A(i, k), A.is_transposed(), A.bs,
+                                                 B(k, j), B.is_transposed(), B.bs,
+                                                 C(i, j), C.is_transposed(), C.bs);
+        }
         return C;
     }
 
@@ -1826,13 +1945,13 @@ struct matrix_operations
         const swappable_block_identifier_type c, const bool c_is_transposed, block_scheduler_type& bs_c)
     {
         if (! bs_c.is_simulating())
-            ++matrix_operation_statistic::get_instance()->block_multiplication_calls;
+            matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_multiplication_calls);
         // check if zero-block (== ! initialized)
         if (! bs_a.is_initialized(a) || ! bs_b.is_initialized(b))
         {
             // => one factor is zero => product is zero
             if (! bs_c.is_simulating())
-                ++matrix_operation_statistic::get_instance()->block_multiplications_saved_through_zero;
+                matrix_operation_statistic::increment(matrix_operation_statistic::get_instance()->block_multiplications_saved_through_zero);
             return;
         }
         // acquire
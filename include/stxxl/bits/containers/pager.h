@@ -15,6 +15,7 @@
 #define STXXL_CONTAINERS_PAGER_HEADER
 
 #include <list>
+#include <vector>
 #include <cassert>
 
 #include <stxxl/bits/noncopyable.h>
@@ -42,12 +43,20 @@ class random_pager
 
     size_type num_pages;
     random_number<random_uniform_fast> rnd;
+    //! the pages which may be kicked, and the position of each in it
+    std::vector<size_type> pages, position;
 
 public:
-    random_pager(size_type num_pages = n_pages) : num_pages(num_pages) { }
+    random_pager(size_type num_pages = n_pages)
+        : num_pages(num_pages), pages(num_pages), position(num_pages)
+    {
+        for (size_type i = 0; i < size(); ++i)
+            pages[i] = position[i] = i;
+    }
+
     size_type kick()
     {
-        return rnd(size());
+        return pages[rnd(pages.size())];
     }
 
     void hit(size_type ipage)
@@ -55,6 +64,25 @@ public:
         STXXL_ASSERT(ipage < size());
     }
 
+    //! Take a page out of the replacement order, it is not kicked until it
+    //! is insert()ed again and must not be hit() meanwhile.
+    void remove(size_type ipage)
+    {
+        assert(ipage < size());
+        size_type last = pages.back();
+        pages[position[ipage]] = last;
+        position[last] = position[ipage];
+        pages.pop_back();
+    }
+
+    //! Put a removed page back into the replacement order.
+    void insert(size_type ipage)
+    {
+        assert(ipage < size());
+        position[ipage] = pages.size();
+        pages.push_back(ipage);
+    }
+
     size_type size() const
     {
         return num_pages;
@@ -91,6 +119,21 @@ public:
         history.splice(history.begin(), history, history_entry[ipage]);
     }
 
+    //! Take a page out of the replacement order, it is not kicked until it
+    //! is insert()ed again and must not be hit() meanwhile.
+    void remove(size_type ipage)
+    {
+        assert(ipage < size());
+        history.erase(history_entry[ipage]);
+    }
+
+    //! Put a removed page back as the most recently used one.
+    void insert(size_type ipage)
+    {
+        assert(ipage < size());
+        history_entry[ipage] = history.insert(history.begin(), ipage);
+    }
+
     void swap(lru_pager& obj)
     {
         history.swap(obj.history);
@@ -24,6 +24,7 @@
 #include <stxxl/bits/containers/pq_mergers.h>
 #include <stxxl/bits/containers/pq_int_merger.h>
 #include <stxxl/bits/containers/pq_ext_merger.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -162,6 +163,9 @@ protected:
     // total size not counting insert_heap and delete_buffer
     size_type size_;
 
+    // share of the memory budget
+    memory_consumer memory;
+
 private:
     void init();
 
@@ -379,7 +383,8 @@ priority_queue<ConfigType>::priority_queue(pool_type& pool_)
       pool_owned(false),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(pool)");
     init();
@@ -392,7 +397,8 @@ priority_queue<ConfigType>::priority_queue(prefetch_pool<block_type>& p_pool_, w
       pool_owned(true),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(p_pool, w_pool)");
     init();
@@ -404,7 +410,8 @@ priority_queue<ConfigType>::priority_queue(unsigned_type p_pool_mem, unsigned_ty
       pool_owned(true),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(pool sizes)");
     init();
@@ -430,6 +437,10 @@ void priority_queue<ConfigType>::init()
         group_buffers[i][N] = sentinel;                        // sentinel
         group_buffer_current_mins[i] = &(group_buffers[i][N]); // empty
     }
+
+    // account the internal arrays and an owned pool
+    memory.reserve(mem_cons() +
+                   (pool_owned ? (pool->size_write() + pool->size_prefetch()) * block_type::raw_size : 0));
 }
 
 template <class ConfigType>
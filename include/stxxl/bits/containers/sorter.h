@@ -15,6 +15,7 @@
 
 #include <stxxl/bits/deprecated.h>
 #include <stxxl/bits/stream/sort_stream.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -56,11 +57,15 @@ STXXL_BEGIN_NAMESPACE
  * \tparam CompareType type of comparison object used for sorting the runs
  * \tparam BlockSize   size of the external memory block in bytes, default is \c STXXL_DEFAULT_BLOCK_SIZE(ValTp)
  * \tparam AllocStr    parallel disk allocation strategy, default is \c STXXL_DEFAULT_ALLOC_STRATEGY
+ * \tparam RunsCreatorType type of the runs creator with push() method, e.g. \c
+ * stream::replacement_selection_runs_creator, default is \c stream::runs_creator
  */
 template <typename ValueType,
           typename CompareType,
           unsigned BlockSize = STXXL_DEFAULT_BLOCK_SIZE(ValueType),
-          class AllocStrategy = STXXL_DEFAULT_ALLOC_STRATEGY>
+          class AllocStrategy = STXXL_DEFAULT_ALLOC_STRATEGY,
+          class RunsCreatorType = stream::runs_creator<stream::use_push<ValueType>, CompareType,
+                                                       BlockSize, AllocStrategy> >
 class sorter : private noncopyable
 {
 public:
@@ -76,8 +81,7 @@ public:
     // *** Constructed Types
 
     //! runs creator type with push() method
-    typedef stream::runs_creator<stream::use_push<ValueType>, cmp_type,
-                                 block_size, alloc_strategy_type> runs_creator_type;
+    typedef RunsCreatorType runs_creator_type;
 
     //! corresponding runs merger type
     typedef stream::runs_merger<typename runs_creator_type::sorted_runs_type,
@@ -98,6 +102,17 @@ protected:
     //! runs merger reading items when in STATE_OUTPUT
     runs_merger_type m_runs_merger;
 
+    //! share of the memory budget, of the runs creator or merger
+    memory_consumer m_memory;
+
+    //! account the memory of the runs creator and/or merger
+    void set_memory_usage(bool creator, bool merger)
+    {
+        m_memory.release_all();
+        m_memory.reserve((creator ? m_runs_creator.memory_used() : 0) +
+                         (merger ? m_runs_merger.memory_used() : 0));
+    }
+
 public:
     //! \name Constructors
     //! \{
@@ -106,16 +121,21 @@ public:
     sorter(const cmp_type& cmp, unsigned_type memory_to_use)
         : m_state(STATE_INPUT),
           m_runs_creator(cmp, memory_to_use),
-          m_runs_merger(cmp, memory_to_use)
-    { }
+          m_runs_merger(cmp, memory_to_use),
+          m_memory("sorter")
+    {
+        set_memory_usage(true, false);
+    }
 
     //! Constructor variant with differently sizes runs_creator and runs_merger
     sorter(const cmp_type& cmp, unsigned_type creator_memory_to_use, unsigned_type merger_memory_to_use)
         : m_state(STATE_INPUT),
           m_runs_creator(cmp, creator_memory_to_use),
-          m_runs_merger(cmp, merger_memory_to_use)
-
-    { }
+          m_runs_merger(cmp, merger_memory_to_use),
+          m_memory("sorter")
+    {
+        set_memory_usage(true, false);
+    }
 
     //! \}
 
@@ -130,6 +150,7 @@ public:
 
         m_runs_creator.allocate();
         m_state = STATE_INPUT;
+        set_memory_usage(true, false);
     }
 
     //! Push another item (only callable during input state).
@@ -153,6 +174,7 @@ public:
         }
 
         m_runs_creator.deallocate();
+        m_memory.release_all();
     }
 
     //! Deallocate buffers and clear result.
@@ -165,6 +187,7 @@ public:
         }
 
         m_runs_creator.deallocate();
+        m_memory.release_all();
     }
 
     //! \}
@@ -183,6 +206,7 @@ public:
         m_runs_creator.deallocate();
         m_runs_merger.initialize(m_runs_creator.result());
         m_state = STATE_OUTPUT;
+        set_memory_usage(false, true);
     }
 
     //! Switch to output state, rewind() in case the output was already sorted.
@@ -204,6 +228,7 @@ public:
 
         m_runs_merger.initialize(m_runs_creator.result());
         m_state = STATE_OUTPUT;
+        set_memory_usage(true, true);
     }
 
     //! Rewind output stream to beginning.
@@ -19,6 +19,7 @@
 
 #include <stxxl/bits/deprecated.h>
 #include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/mng/bid_extent.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/common/simple_vector.h>
@@ -213,10 +214,7 @@ public:
 
             simple_vector<request_ptr> requests(blocks_per_page);
 
-            for (int i = 0; i < blocks_per_page; ++i, ++cur_bid)
-            {
-                requests[i] = (back_page + i)->write(*cur_bid);
-            }
+            write_extents(&*back_page, cur_bid, bids.end(), requests.begin());
 
             std::swap(back_page, front_page);
 
@@ -253,13 +251,7 @@ public:
 
             simple_vector<request_ptr> requests(blocks_per_page);
 
-            {
-                typename std::vector<bid_type>::const_iterator cur_bid = bids.end();
-                for (int i = blocks_per_page - 1; i >= 0; --i)
-                {
-                    requests[i] = (front_page + i)->read(*(--cur_bid));
-                }
-            }
+            read_extents(&*front_page, bids.end() - blocks_per_page, bids.end(), requests.begin());
 
             std::swap(front_page, back_page);
 
@@ -464,14 +456,14 @@ public:
             typename std::vector<bid_type>::iterator cur_bid = bids.end() - blocks_per_page;
             block_manager::get_instance()->new_blocks(alloc_strategy, cur_bid, bids.end(), cur_bid - bids.begin());
 
-            for (int i = 0; i < blocks_per_page; ++i, ++cur_bid)
+            for (int i = 0; i < blocks_per_page; ++i)
             {
                 if (requests[i].get())
                     requests[i]->wait();
-
-                requests[i] = (cache_buffers + i)->write(*cur_bid);
             }
 
+            write_extents(&*cache_buffers, cur_bid, bids.end(), requests.begin());
+
             std::swap(cache_buffers, overlap_buffers);
 
             bids.reserve(bids.size() + blocks_per_page);
@@ -511,9 +503,8 @@ public:
             if (bids.size() > blocks_per_page)
             {
                 STXXL_VERBOSE2("prefetching, size: " << m_size);
-                typename std::vector<bid_type>::const_iterator cur_bid = bids.end() - blocks_per_page;
-                for (int i = blocks_per_page - 1; i >= 0; --i)
-                    requests[i] = (overlap_buffers + i)->read(*(--cur_bid));
+                read_extents(&*overlap_buffers, bids.end() - 2 * blocks_per_page,
+                             bids.end() - blocks_per_page, requests.begin());
             }
 
             block_manager::get_instance()->delete_blocks(bids.end() - blocks_per_page, bids.end());
@@ -22,9 +22,12 @@
 
 #include <stxxl/bits/deprecated.h>
 #include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/mng/bid_extent.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/common/tmeta.h>
+#include <stxxl/bits/common/binary_buffer.h>
 #include <stxxl/bits/containers/pager.h>
 #include <stxxl/bits/common/is_sorted.h>
 #include <stxxl/bits/mng/buf_istream.h>
@@ -626,7 +629,7 @@ public:
     //! return iterator to BID containg current element
     bids_container_iterator bid() const
     {
-        return ((vector_type*)p_vector)->bid(offset);
+        return ((vector_type*)p_vector)->bid_unmodified(offset);
     }
 
     //! \}
@@ -916,10 +919,24 @@ private:
     mutable std::vector<int_type> m_page_to_slot;
     mutable simple_vector<int_type> m_slot_to_page;
     mutable std::queue<int_type> m_free_slots;
-    mutable simple_vector<block_type>* m_cache;
+    //! page buffer of each slot, NULL if the slot was released by shrinking
+    //! the page cache, empty if the page cache is not allocated
+    mutable std::vector<block_type*> m_cache;
+    //! number of slots with a page buffer
+    mutable unsigned_type m_numpages;
+    //! the page cache's share of the memory budget
+    mutable memory_consumer m_memory;
+    //! number of pages requested at construction
+    unsigned_type m_wanted_pages;
+    //! page faults since the last attempt to grow the page cache
+    mutable unsigned_type m_faults;
     file* m_from;
     block_manager* m_bm;
     bool m_exported;
+    //! name of the catalog root holding the blocks, empty if not persistent
+    std::string m_root;
+    //! whether blocks of m_root may have been written in place, see bid()
+    bool m_root_modified;
 
     size_type size_from_file_length(stxxl::uint64 file_length) const
     {
@@ -957,9 +974,13 @@ public:
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
           m_slot_to_page(npages),
-          m_cache(NULL),
+          m_numpages(npages),
+          m_memory("vector", true),
+          m_wanted_pages(npages),
+          m_faults(0),
           m_from(NULL),
-          m_exported(false)
+          m_exported(false),
+          m_root_modified(false)
     {
         m_bm = block_manager::get_instance();
 
@@ -971,9 +992,6 @@ public:
             m_page_to_slot[i] = on_disk;
         }
 
-        for (unsigned_type i = 0; i < numpages(); ++i)
-            m_free_slots.push(i);
-
         m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0);
     }
 
@@ -994,8 +1012,14 @@ public:
         std::swap(m_slot_to_page, obj.m_slot_to_page);
         std::swap(m_free_slots, obj.m_free_slots);
         std::swap(m_cache, obj.m_cache);
+        std::swap(m_numpages, obj.m_numpages);
+        m_memory.swap(obj.m_memory);
+        std::swap(m_wanted_pages, obj.m_wanted_pages);
+        std::swap(m_faults, obj.m_faults);
         std::swap(m_from, obj.m_from);
         std::swap(m_exported, obj.m_exported);
+        std::swap(m_root, obj.m_root);
+        std::swap(m_root_modified, obj.m_root_modified);
     }
 
     //! \}
@@ -1007,8 +1031,21 @@ public:
     void allocate_page_cache() const
     {
         //  numpages() might be zero
-        if (!m_cache && numpages() > 0)
-            m_cache = new simple_vector<block_type>(numpages() * page_size);
+        if (m_cache.empty() && numpages() > 0) {
+            // all pages are on disk, use the slots [0, numpages())
+            pager_type pager(m_slot_to_page.size());
+            std::swap(m_pager, pager);
+            m_cache.resize(m_slot_to_page.size(), NULL);
+            for (unsigned_type i = 0; i < m_cache.size(); ++i)
+            {
+                if (i < numpages())
+                    m_cache[i] = new block_type[page_size];
+                else
+                    m_pager.remove(i);
+            }
+            reset_free_slots();
+            m_memory.reserve(numpages() * page_bytes());
+        }
     }
 
     //! allows to free the cache, but you may not access any element until call
@@ -1016,8 +1053,8 @@ public:
     void deallocate_page_cache() const
     {
         flush();
-        delete m_cache;
-        m_cache = NULL;
+        delete_page_cache();
+        m_memory.release_all();
     }
 
     //! \name Size and Capacity
@@ -1180,11 +1217,7 @@ public:
         m_bids.clear();
         m_page_status.clear();
         m_page_to_slot.clear();
-        while (!m_free_slots.empty())
-            m_free_slots.pop();
-
-        for (unsigned_type i = 0; i < numpages(); ++i)
-            m_free_slots.push(i);
+        reset_free_slots();
     }
 
     //! \name Front and Back Access
@@ -1248,9 +1281,13 @@ public:
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
           m_slot_to_page(npages),
-          m_cache(NULL),
+          m_numpages(npages),
+          m_memory("vector", true),
+          m_wanted_pages(npages),
+          m_faults(0),
           m_from(from),
-          m_exported(false)
+          m_exported(false),
+          m_root_modified(false)
     {
         // initialize from file
         if (!block_type::has_only_data)
@@ -1271,9 +1308,6 @@ public:
             m_page_to_slot[i] = on_disk;
         }
 
-        for (unsigned_type i = 0; i < numpages(); ++i)
-            m_free_slots.push(i);
-
         // allocate blocks equidistantly and in-order
         size_type offset = 0;
         for (bids_container_iterator it = m_bids.begin();
@@ -1289,13 +1323,17 @@ public:
     vector(const vector& obj)
         : m_size(obj.size()),
           m_bids((size_t)div_ceil(obj.size(), block_type::size)),
-          m_pager(obj.numpages()),
+          m_pager(obj.m_wanted_pages),
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
-          m_slot_to_page(obj.numpages()),
-          m_cache(NULL),
+          m_slot_to_page(obj.m_wanted_pages),
+          m_numpages(obj.numpages()),
+          m_memory("vector", true),
+          m_wanted_pages(obj.m_wanted_pages),
+          m_faults(0),
           m_from(NULL),
-          m_exported(false)
+          m_exported(false),
+          m_root_modified(false)
     {
         assert(!obj.m_exported);
         m_bm = block_manager::get_instance();
@@ -1308,9 +1346,6 @@ public:
             m_page_to_slot[i] = on_disk;
         }
 
-        for (unsigned_type i = 0; i < numpages(); ++i)
-            m_free_slots.push(i);
-
         m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0);
 
         const_iterator inbegin = obj.begin();
@@ -1444,10 +1479,10 @@ public:
     //! Flushes the cache pages to the external memory.
     void flush() const
     {
-        simple_vector<bool> non_free_slots(numpages());
+        simple_vector<bool> non_free_slots(m_cache.size());
 
-        for (unsigned_type i = 0; i < numpages(); i++)
-            non_free_slots[i] = true;
+        for (unsigned_type i = 0; i < m_cache.size(); i++)
+            non_free_slots[i] = (m_cache[i] != NULL);
 
         while (!m_free_slots.empty())
         {
@@ -1455,8 +1490,10 @@ public:
             m_free_slots.pop();
         }
 
-        for (unsigned_type i = 0; i < numpages(); i++)
+        for (unsigned_type i = 0; i < m_cache.size(); i++)
         {
+            if (!m_cache[i])
+                continue;
             m_free_slots.push(i);
             int_type page_no = m_slot_to_page[i];
             if (non_free_slots[i])
@@ -1491,7 +1528,21 @@ public:
             STXXL_ERRMSG("Exception thrown in ~vector()");
         }
 
-        if (!m_exported)
+        if (!m_root.empty())
+        {
+            // the blocks belong to the catalog, store the final state
+            try
+            {
+                update_root();
+                m_bm->commit();
+            }
+            catch (std::exception& e)
+            {
+                STXXL_ERRMSG("Exception thrown in ~vector() committing root '" <<
+                             m_root << "': " << e.what());
+            }
+        }
+        else if (!m_exported)
         {
             if (m_from == NULL) {
                 m_bm->delete_blocks(m_bids.begin(), m_bids.end());
@@ -1511,7 +1562,7 @@ public:
                 }
             }
         }
-        delete m_cache;
+        delete_page_cache();
     }
 
     //! \}
@@ -1543,6 +1594,82 @@ public:
         return m_from;
     }
 
+    //! Store the vector under name in the catalog of the persistent block
+    //! manager and commit it. From then on, the blocks belong to the catalog:
+    //! the destructor commits the final state of the vector instead of freeing
+    //! them, and a later program run can attach to them with open().
+    void save(const std::string& name)
+    {
+        if (m_from != NULL || m_exported)
+            STXXL_THROW(std::runtime_error,
+                        "vector::save(): vectors mapped to files cannot be saved.");
+
+        flush();
+
+        if (!m_root.empty() && m_root != name)
+            m_bm->remove_root(m_root);
+
+        m_root = name;
+        update_root();
+        m_bm->commit();
+    }
+
+    //! Attach the empty vector to the root name stored by save() in this or
+    //! an earlier program run. Only the list of blocks is read.
+    void open(const std::string& name)
+    {
+        if (!m_bids.empty() || m_from != NULL)
+            STXXL_THROW(std::runtime_error,
+                        "vector::open(): the vector must be empty.");
+
+        std::string header;
+        bids_container_type bids(0);
+        if (!m_bm->get_root(name, header, bids))
+            STXXL_THROW(std::runtime_error,
+                        "vector::open(): no root named '" << name << "'.");
+
+        binary_reader br(header);
+        if (br.get_string() != "vector" ||
+            br.get<uint64>() != block_type::raw_size ||
+            br.get<uint64>() != sizeof(value_type))
+        {
+            STXXL_THROW(std::runtime_error,
+                        "vector::open(): root '" << name <<
+                        "' is not a vector of this type.");
+        }
+
+        size_type n = br.get<uint64>();
+        if ((uint64)bids.size() < div_ceil(n, block_type::size))
+            STXXL_THROW(std::runtime_error,
+                        "vector::open(): root '" << name << "' is truncated.");
+
+        m_bids.swap(bids);
+        unsigned_type new_pages = div_ceil(m_bids.size(), page_size);
+        m_page_status.assign(new_pages, valid_on_disk);
+        m_page_to_slot.assign(new_pages, on_disk);
+        m_size = n;
+        m_root = name;
+        m_root_modified = false;
+    }
+
+    //! Remove the vector from the catalog and commit it. The blocks belong to
+    //! the vector again and are freed with it.
+    void detach()
+    {
+        if (m_root.empty())
+            return;
+
+        m_bm->remove_root(m_root);
+        m_root.clear();
+        m_bm->commit();
+    }
+
+    //! Name of the catalog root the vector is stored under, or empty.
+    const std::string & get_root() const
+    {
+        return m_root;
+    }
+
     //! \}
 
     //! \name Capacity
@@ -1565,24 +1692,187 @@ public:
     //! Number of pages used by the pager.
     inline unsigned_type numpages() const
     {
-        return m_pager.size();
+        return m_numpages;
     }
 
     //! \}
 
 private:
-    bids_container_iterator bid(const size_type& offset)
+    //! bytes of one page in the cache
+    static uint64 page_bytes()
+    {
+        return uint64(page_size) * uint64(block_type::raw_size);
+    }
+
+    //! free the page buffers without writing them back
+    void delete_page_cache() const
+    {
+        for (unsigned_type i = 0; i < m_cache.size(); ++i)
+            delete[] m_cache[i];
+        m_cache.clear();
+    }
+
+    //! make all slots with a page buffer free
+    void reset_free_slots() const
+    {
+        while (!m_free_slots.empty())
+            m_free_slots.pop();
+        for (unsigned_type i = 0; i < m_cache.size(); ++i)
+        {
+            if (m_cache[i])
+                m_free_slots.push(i);
+        }
+    }
+
+    //! Release up to drop slots of the page cache, the free ones first, then
+    //! those whose pages the pager kicks. Other pages stay in their slots, so
+    //! references to them remain valid.
+    void shrink_page_cache(unsigned_type drop) const
+    {
+        std::queue<int_type> free_slots;
+        for ( ; !m_free_slots.empty(); m_free_slots.pop())
+        {
+            if (drop > 0) {
+                release_slot(m_free_slots.front());
+                --drop;
+            }
+            else
+                free_slots.push(m_free_slots.front());
+        }
+        std::swap(m_free_slots, free_slots);
+
+        for ( ; drop > 0; --drop)
+        {
+            int_type kicked_slot = m_pager.kick();
+            int_type page_no = m_slot_to_page[kicked_slot];
+            write_page(page_no, kicked_slot);
+            m_page_to_slot[page_no] = on_disk;
+            release_slot(kicked_slot);
+        }
+    }
+
+    //! Give up to add released slots a page buffer again, they become free.
+    void grow_page_cache(unsigned_type add) const
+    {
+        for (unsigned_type i = 0; i < m_cache.size() && add > 0; ++i)
+        {
+            if (m_cache[i])
+                continue;
+            m_cache[i] = new block_type[page_size];
+            m_pager.insert(i);
+            m_free_slots.push(i);
+            ++m_numpages;
+            --add;
+        }
+    }
+
+    //! free the page buffer of an unused slot
+    void release_slot(int_type slot) const
+    {
+        m_pager.remove(slot);
+        delete[] m_cache[slot];
+        m_cache[slot] = NULL;
+        --m_numpages;
+    }
+
+    //! Adapt the page cache to the memory budget before a page is loaded:
+    //! return memory reclaimed by the memory_arbiter, or grow back towards the
+    //! requested number of pages once per cache turnover if memory is free.
+    void adapt_page_cache() const
+    {
+        if (m_cache.empty())
+            return;
+
+        const uint64 reclaim = m_memory.reclaim();
+        if (reclaim > 0)
+        {
+            const unsigned_type old_pages = numpages();
+            const unsigned_type drop = (unsigned_type)div_ceil(reclaim, page_bytes());
+            const unsigned_type new_pages = (old_pages > drop) ? old_pages - drop : 1;
+            if (new_pages < old_pages)
+            {
+                STXXL_VERBOSE_VECTOR("adapt_page_cache(): shrinking from " << old_pages << " to " << new_pages << " pages");
+                shrink_page_cache(old_pages - new_pages);
+                m_memory.release((old_pages - new_pages) * page_bytes());
+            }
+            m_memory.reclaim_done();
+            m_faults = 0;
+        }
+        else if (numpages() < m_wanted_pages && m_free_slots.empty() &&
+                 ++m_faults >= numpages())
+        {
+            m_faults = 0;
+            uint64 granted = m_memory.request((m_wanted_pages - numpages()) * page_bytes());
+            unsigned_type add = (unsigned_type)(granted / page_bytes());
+            m_memory.release(granted - add * page_bytes());
+            if (add > 0)
+            {
+                STXXL_VERBOSE_VECTOR("adapt_page_cache(): growing from " << numpages() << " to " << numpages() + add << " pages");
+                grow_page_cache(add);
+            }
+        }
+    }
+
+    //! store the current blocks and size under m_root in the catalog
+    void update_root()
+    {
+        binary_buffer bb;
+        bb.put_string("vector");
+        bb.put<uint64>(block_type::raw_size);
+        bb.put<uint64>(sizeof(value_type));
+        bb.put<uint64>(m_size);
+        m_bm->set_root(m_root, bb.str(), m_bids.begin(), m_bids.end());
+        m_root_modified = false;
+    }
+
+    //! The blocks are about to be accessed directly, e.g. written in place by
+    //! a vector_bufwriter or stxxl::sort, mark the root modified in the
+    //! catalog.
+    void root_modified()
+    {
+        if (!m_root.empty() && !m_root_modified) {
+            m_bm->modify_root(m_root);
+            m_root_modified = true;
+        }
+    }
+
+    //! Before writing the blocks [first, last) of a page, replace those
+    //! referenced by the committed catalog with new blocks, such that the
+    //! committed state survives a crash.
+    void copy_on_write(int_type first, int_type last) const
+    {
+        bids_container_type& bids = const_cast<bids_container_type&>(m_bids);
+        if (!m_bm->is_committed(bids.begin() + first, bids.begin() + last))
+            return;
+
+        bids_container_type fresh(last - first);
+        m_bm->new_blocks(m_alloc_strategy, fresh.begin(), fresh.end(), first);
+        m_bm->delete_blocks(bids.begin() + first, bids.begin() + last);
+        std::copy(fresh.begin(), fresh.end(), bids.begin() + first);
+    }
+
+    bids_container_iterator bid_unmodified(const size_type& offset)
     {
         return (m_bids.begin() +
                 static_cast<typename bids_container_type::size_type>
                 (offset / block_type::size));
     }
-    bids_container_iterator bid(const blocked_index_type& offset)
+    bids_container_iterator bid_unmodified(const blocked_index_type& offset)
     {
         return (m_bids.begin() +
                 static_cast<typename bids_container_type::size_type>
                 (offset.get_block2() * PageSize + offset.get_block1()));
     }
+    bids_container_iterator bid(const size_type& offset)
+    {
+        root_modified();
+        return bid_unmodified(offset);
+    }
+    bids_container_iterator bid(const blocked_index_type& offset)
+    {
+        root_modified();
+        return bid_unmodified(offset);
+    }
     const_bids_container_iterator bid(const size_type& offset) const
     {
         return (m_bids.begin() +
@@ -1605,11 +1895,8 @@ private:
         request_ptr* reqs = new request_ptr[page_size];
         int_type block_no = page_no * page_size;
         int_type last_block = STXXL_MIN(block_no + page_size, int_type(m_bids.size()));
-        int_type i = cache_slot * page_size, j = 0;
-        for ( ; block_no < last_block; ++block_no, ++i, ++j)
-        {
-            reqs[j] = (*m_cache)[i].read(m_bids[block_no]);
-        }
+        read_extents(m_cache[cache_slot],
+                     m_bids.begin() + block_no, m_bids.begin() + last_block, reqs);
         assert(last_block - page_no * page_size > 0);
         wait_all(reqs, last_block - page_no * page_size);
         delete[] reqs;
@@ -1624,11 +1911,10 @@ private:
         int_type block_no = page_no * page_size;
         int_type last_block = STXXL_MIN(block_no + page_size, int_type(m_bids.size()));
         assert(block_no < last_block);
-        int_type i = cache_slot * page_size, j = 0;
-        for ( ; block_no < last_block; ++block_no, ++i, ++j)
-        {
-            reqs[j] = (*m_cache)[i].write(m_bids[block_no]);
-        }
+        if (!m_root.empty())
+            copy_on_write(block_no, last_block);
+        write_extents(m_cache[cache_slot],
+                      m_bids.begin() + block_no, m_bids.begin() + last_block, reqs);
         m_page_status[page_no] = valid_on_disk;
         assert(last_block - page_no * page_size > 0);
         wait_all(reqs, last_block - page_no * page_size);
@@ -1653,6 +1939,8 @@ private:
         int_type cache_slot = m_page_to_slot[page_no];
         if (cache_slot < 0)                        // == on_disk
         {
+            adapt_page_cache();
+
             if (m_free_slots.empty())              // has to kick
             {
                 int_type kicked_slot = m_pager.kick();
@@ -1667,7 +1955,7 @@ private:
 
                 m_page_status[page_no] = dirty;
 
-                return (*m_cache)[kicked_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return m_cache[kicked_slot][offset.get_block1()][offset.get_offset()];
             }
             else
             {
@@ -1681,14 +1969,14 @@ private:
 
                 m_page_status[page_no] = dirty;
 
-                return (*m_cache)[free_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return m_cache[free_slot][offset.get_block1()][offset.get_offset()];
             }
         }
         else
         {
             m_page_status[page_no] = dirty;
             m_pager.hit(cache_slot);
-            return (*m_cache)[cache_slot * page_size + offset.get_block1()][offset.get_offset()];
+            return m_cache[cache_slot][offset.get_block1()][offset.get_offset()];
         }
     }
 
@@ -1735,6 +2023,8 @@ private:
         int_type cache_slot = m_page_to_slot[page_no];
         if (cache_slot < 0)                        // == on_disk
         {
+            adapt_page_cache();
+
             if (m_free_slots.empty())              // has to kick
             {
                 int_type kicked_slot = m_pager.kick();
@@ -1747,7 +2037,7 @@ private:
                 write_page(old_page_no, kicked_slot);
                 read_page(page_no, kicked_slot);
 
-                return (*m_cache)[kicked_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return m_cache[kicked_slot][offset.get_block1()][offset.get_offset()];
             }
             else
             {
@@ -1759,13 +2049,13 @@ private:
 
                 read_page(page_no, free_slot);
 
-                return (*m_cache)[free_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return m_cache[free_slot][offset.get_block1()][offset.get_offset()];
             }
         }
         else
         {
             m_pager.hit(cache_slot);
-            return (*m_cache)[cache_slot * page_size + offset.get_block1()][offset.get_offset()];
+            return m_cache[cache_slot][offset.get_block1()][offset.get_offset()];
         }
     }
 
@@ -62,6 +62,7 @@ public:
     offset_type size();
     void set_size(offset_type newsize);
     void lock();
+    void flush();
     void serve(void* buffer, offset_type offset, size_type bytes,
                request::request_type type);
     const char * io_type() const;
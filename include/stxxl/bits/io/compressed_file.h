@@ -0,0 +1,171 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/compressed_file.h
+ *
+ *  a pseudo file compressing the blocks written to a backend file
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_COMPRESSED_FILE_HEADER
+#define STXXL_IO_COMPRESSED_FILE_HEADER
+
+#include <stxxl/bits/config.h>
+
+#ifndef STXXL_HAVE_COMPRESSED_FILE
+#if STXXL_HAVE_LZ4 || STXXL_HAVE_ZSTD || STXXL_HAVE_ZLIB
+ #define STXXL_HAVE_COMPRESSED_FILE 1
+#else
+ #define STXXL_HAVE_COMPRESSED_FILE 0
+#endif
+#endif
+
+#if STXXL_HAVE_COMPRESSED_FILE
+
+#include <map>
+#include <string>
+
+#include <stxxl/bits/io/disk_queued_file.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup fileimpl
+//! \{
+
+//! Implementation of file which transparently compresses the data written to
+//! a backend file.
+//!
+//! Each write request is compressed as one extent and stored at a free place
+//! of the backend file, an extent map translates logical to physical
+//! offsets. Writes partially overlapping existing extents merge them into one
+//! new extent. Reads decompress all overlapped extents; regions never
+//! written read as zeros. (De)compression runs in serve(), i.e. on the disk
+//! queue's worker thread, and is reported in stats.
+//!
+//! The extent map is only kept in memory, so a compressed_file is temporary:
+//! the backend file is truncated when it is opened, and its contents are
+//! lost when it is closed. Disks with the persistent option cannot be
+//! compressed.
+class compressed_file : public disk_queued_file
+{
+public:
+    //! compression codecs, availability depends on the libraries found
+    enum codec_type { CODEC_LZ4, CODEC_ZSTD, CODEC_ZLIB };
+
+protected:
+    //! location of a compressed extent in the backend file
+    struct extent
+    {
+        //! offset in the backend file
+        offset_type phys;
+        //! bytes reserved in the backend file, multiple of STXXL_BLOCK_ALIGN
+        size_type alloc;
+        //! bytes of compressed data, equal to raw if stored uncompressed
+        size_type stored;
+        //! logical length of the extent
+        size_type raw;
+    };
+
+    //! logical offset -> extent, non-overlapping
+    typedef std::map<offset_type, extent> extent_map_type;
+    //! physical offset -> size of free regions in the backend file
+    typedef std::map<offset_type, size_type> free_map_type;
+
+    //! the physical file used as backend
+    file* m_storage;
+    //! compression codec
+    codec_type m_codec;
+    //! logical size of the file
+    offset_type m_size;
+    //! end of the used region of the backend file
+    offset_type m_storage_end;
+    //! size of the backend file, grown in steps
+    offset_type m_storage_capacity;
+
+    //! sequentialize function calls
+    mutex m_mutex;
+
+    extent_map_type m_extents;
+    free_map_type m_free;
+
+    //! aligned scratch buffers for uncompressed and compressed data
+    char* m_raw_buffer, * m_z_buffer;
+    size_type m_raw_capacity, m_z_capacity;
+
+public:
+    //! Constructs file object.
+    //! \param backend_file file object used as storage backend, will be
+    //! deleted in ~compressed_file()
+    compressed_file(
+        file* backend_file,
+        codec_type codec,
+        int queue_id = DEFAULT_QUEUE,
+        int allocator_id = NO_ALLOCATOR,
+        unsigned int device_id = DEFAULT_DEVICE_ID);
+    ~compressed_file();
+
+    offset_type size();
+    void set_size(offset_type newsize);
+    void lock();
+    void flush();
+    void serve(void* buffer, offset_type offset, size_type bytes,
+               request::request_type type);
+    void discard(offset_type offset, offset_type size);
+    void close_remove();
+    const char * io_type() const;
+
+    //! Returns the codec used by this file.
+    codec_type get_codec() const
+    {
+        return m_codec;
+    }
+
+    //! Returns the number of bytes used in the backend file.
+    offset_type get_storage_size();
+
+    //! Parses a codec name (lz4, zstd or zlib), throws std::runtime_error if
+    //! the name is unknown or the codec was not available at build time.
+    static codec_type parse_codec(const std::string& name);
+
+    //! Returns whether the codec was available at build time.
+    static bool is_available(codec_type codec);
+
+    //! Returns the name of the codec.
+    static const char * codec_name(codec_type codec);
+
+protected:
+    void sread(char* buffer, offset_type offset, size_type bytes);
+    void swrite(const char* buffer, offset_type offset, size_type bytes);
+
+    //! decompress the extent into buffer, which must hold e.raw bytes
+    void read_extent(const extent& e, char* buffer);
+    //! compress buffer and store it as new extent at logical offset
+    void write_extent(const char* buffer, offset_type offset, size_type bytes);
+
+    //! reserve aligned space in the backend file
+    offset_type allocate(size_type size);
+    //! return space in the backend file, coalescing adjacent free regions
+    void deallocate(offset_type offset, size_type size);
+
+    //! grow an aligned scratch buffer to at least size bytes
+    static void reserve(char*& buffer, size_type& capacity, size_type size);
+
+    size_type compress_bound(size_type bytes) const;
+    //! returns compressed size or 0 if the data is incompressible
+    size_type compress(const char* src, size_type bytes,
+                       char* dst, size_type capacity) const;
+    void decompress(const char* src, size_type stored,
+                    char* dst, size_type raw) const;
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_COMPRESSED_FILE
+
+#endif // !STXXL_IO_COMPRESSED_FILE_HEADER
+// vim: et:ts=4:sw=4
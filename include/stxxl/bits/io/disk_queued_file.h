@@ -48,6 +48,9 @@ public:
         size_type bytes,
         const completion_handler& on_cmpl = completion_handler());
 
+    request_ptr aflush(
+        const completion_handler& on_cmpl = completion_handler());
+
     virtual int get_queue_id() const
     {
         return m_queue_id;
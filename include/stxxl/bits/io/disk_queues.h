@@ -20,11 +20,15 @@
 
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/singleton.h>
+#include <stxxl/bits/common/mutex.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iotrace.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/request_queue_impl_qwqr.h>
 #include <stxxl/bits/io/linuxaio_queue.h>
 #include <stxxl/bits/io/linuxaio_request.h>
+#include <stxxl/bits/io/io_uring_queue.h>
+#include <stxxl/bits/io/io_uring_request.h>
 #include <stxxl/bits/io/serving_request.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -43,34 +47,67 @@ class disk_queues : public singleton<disk_queues>
 
 protected:
     request_queue_map queues;
+
+    //! protects queues and m_priority_op, as requests are submitted by
+    //! several threads. The queues themselves are synchronized.
+    mutex m_mutex;
+
+    //! priority_op applied to all queues, including ones created later
+    request_queue::priority_op m_priority_op;
+
     disk_queues()
+        : m_priority_op(request_queue::WRITE)
     {
         stxxl::stats::get_instance(); // initialize stats before ourselves
+        stxxl::iotrace::get_instance(); // activates tracing via environment
     }
 
-public:
-    void add_request(request_ptr& req, DISKID disk)
+protected:
+    //! Returns the queue of the disk, creating it for the kind of req.
+    request_queue * get_or_create_queue(request_ptr& req, DISKID disk)
     {
-#ifdef STXXL_HACK_SINGLE_IO_THREAD
-        disk = 42;
-#endif
+        scoped_mutex_lock lock(m_mutex);
         request_queue_map::iterator qi = queues.find(disk);
+        if (qi != queues.end())
+            return qi->second;
+
+        // create new request queue
         request_queue* q;
-        if (qi == queues.end())
-        {
-            // create new request queue
 #if STXXL_HAVE_LINUXAIO_FILE
-            if (dynamic_cast<linuxaio_request*>(req.get()))
-                q = queues[disk] = new linuxaio_queue(
-                        dynamic_cast<linuxaio_file*>(req->get_file())->get_desired_queue_length()
-                        );
-            else
+        if (dynamic_cast<linuxaio_request*>(req.get()))
+            q = queues[disk] = new linuxaio_queue(
+                    dynamic_cast<linuxaio_file*>(req->get_file())->get_desired_queue_length()
+                    );
+        else
 #endif
-            q = queues[disk] = new request_queue_impl_qwqr();
-        }
+#if STXXL_HAVE_IO_URING_FILE
+        if (dynamic_cast<io_uring_request*>(req.get()))
+            q = get_io_uring_queue_locked(
+                disk,
+                dynamic_cast<io_uring_file*>(req->get_file())->get_desired_queue_length()
+                );
         else
-            q = qi->second;
+#endif
+        q = queues[disk] = new request_queue_impl_qwqr();
 
+        q->set_priority_op(m_priority_op);
+
+        // serve the disk from the NUMA node it is attached to
+        if (req->get_file()->get_numa_node() >= 0)
+            q->set_numa_node(req->get_file()->get_numa_node());
+
+        return q;
+    }
+
+public:
+    void add_request(request_ptr& req, DISKID disk)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
+#endif
+        request_queue* q = get_or_create_queue(req, disk);
+
+        iotrace::request_submitted(req.get());
         q->add_request(req);
     }
 
@@ -87,20 +124,61 @@ public:
 #ifdef STXXL_HACK_SINGLE_IO_THREAD
         disk = 42;
 #endif
-        if (queues.find(disk) != queues.end())
-            return queues[disk]->cancel_request(req);
-        else
-            return false;
+        request_queue* q = get_queue(disk);
+        return q ? q->cancel_request(req) : false;
+    }
+
+    //! Promote a request, which is then served before all other queued
+    //! requests of its disk which were not promoted. request::wait() does
+    //! this automatically, so reads a thread blocks on overtake prefetches
+    //! and bulk writes.
+    //! \param req request to promote
+    //! \param disk disk number for disk that \c req was scheduled on
+    //! \return \c true iff the request was still queued and got promoted
+    bool promote_request(request_ptr& req, DISKID disk)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
+#endif
+        request_queue* q = get_queue(disk);
+        return q ? q->promote_request(req) : false;
     }
 
     request_queue * get_queue(DISKID disk)
     {
-        if (queues.find(disk) != queues.end())
-            return queues[disk];
-        else
-            return NULL;
+        scoped_mutex_lock lock(m_mutex);
+        request_queue_map::iterator qi = queues.find(disk);
+        return qi != queues.end() ? qi->second : NULL;
+    }
+
+#if STXXL_HAVE_IO_URING_FILE
+    //! Returns the io_uring_queue for the given disk, it is created with the
+    //! desired queue length if it does not exist yet.
+    io_uring_queue * get_io_uring_queue(DISKID disk, int desired_queue_length)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
+#endif
+        scoped_mutex_lock lock(m_mutex);
+        return get_io_uring_queue_locked(disk, desired_queue_length);
+    }
+
+protected:
+    //! get_io_uring_queue() with m_mutex held
+    io_uring_queue * get_io_uring_queue_locked(DISKID disk, int desired_queue_length)
+    {
+        request_queue_map::iterator qi = queues.find(disk);
+        if (qi != queues.end())
+            return dynamic_cast<io_uring_queue*>(qi->second);
+
+        io_uring_queue* q = new io_uring_queue(desired_queue_length);
+        queues[disk] = q;
+        return q;
     }
 
+public:
+#endif
+
     ~disk_queues()
     {
         // deallocate all queues
@@ -115,6 +193,8 @@ public:
     //!                 - NONE, read and write requests are served by turns, alternately
     void set_priority_op(request_queue::priority_op op)
     {
+        scoped_mutex_lock lock(m_mutex);
+        m_priority_op = op;
         for (request_queue_map::iterator i = queues.begin(); i != queues.end(); i++)
             i->second->set_priority_op(op);
     }
@@ -76,17 +76,19 @@ public:
         TRUNC = 32,          //!< once file is opened its length becomes zero
         SYNC = 64,           //!< open the file with O_SYNC | O_DSYNC | O_RSYNC flags set
         NO_LOCK = 128,       //!< do not acquire an exclusive lock by default
-        REQUIRE_DIRECT = 256 //!< implies DIRECT, fail if opening with DIRECT flag does not work.
+        REQUIRE_DIRECT = 256, //!< implies DIRECT, fail if opening with DIRECT flag does not work.
+        DISCARD = 512         //!< release regions passed to discard() to the file system or device
     };
 
     static const int DEFAULT_QUEUE = -1;
     static const int DEFAULT_LINUXAIO_QUEUE = -2;
+    static const int DEFAULT_IO_URING_QUEUE = -3;
     static const int NO_ALLOCATOR = -1;
     static const unsigned int DEFAULT_DEVICE_ID = (unsigned int)(-1);
 
     //! Construct a new file, usually called by a subclass.
     file(unsigned int device_id = DEFAULT_DEVICE_ID)
-        : m_device_id(device_id)
+        : m_device_id(device_id), m_numa_node(-1)
     { }
 
     //! Schedules an asynchronous read request to the file.
@@ -110,9 +112,56 @@ public:
     virtual request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
                                const completion_handler& on_cmpl = completion_handler()) = 0;
 
+    //! Schedules an asynchronous flush request to the file, which makes all
+    //! writes submitted before it durable on the device. Later requests are
+    //! not held back by it.
+    //! \param on_cmpl I/O completion handler
+    //! \return \c request_ptr request object, which can be used to track the
+    //! status of the operation
+    virtual request_ptr aflush(const completion_handler& on_cmpl = completion_handler()) = 0;
+
     virtual void serve(void* buffer, offset_type offset, size_type bytes,
                        request::request_type type) = 0;
 
+    //! One memory buffer of a vectored I/O operation, see serve_vector().
+    struct io_vector
+    {
+        void* buffer;
+        size_type bytes;
+    };
+
+    //! Serves a contiguous file range starting at offset from/into multiple
+    //! buffers, e.g. for coalesced adjacent requests. The default
+    //! implementation calls serve() for each buffer.
+    virtual void serve_vector(const io_vector* vec, size_t count,
+                              offset_type offset, request::request_type type)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            serve(vec[i].buffer, offset, vec[i].bytes, type);
+            offset += vec[i].bytes;
+        }
+    }
+
+    //! Returns true if serve_vector() transfers all buffers with a single
+    //! system call, hence coalescing adjacent requests is worthwhile.
+    virtual bool has_vector_io() const
+    {
+        return false;
+    }
+
+    //! Returns true if a single request may span several adjacent blocks,
+    //! i.e. the file maps offsets linearly, see read_extents(). Files storing
+    //! each block separately return false.
+    virtual bool supports_extents() const
+    {
+        return true;
+    }
+
+    //! Writes the data cached for the file by the operating system to the
+    //! device, called by the I/O thread serving a FLUSH request. The default
+    //! implementation does nothing, for files without a persistent backend.
+    virtual void flush() { }
+
     //! Changes the size of the file.
     //! \param newsize new file size
     virtual void set_size(offset_type newsize) = 0;
@@ -177,6 +226,25 @@ public:
         return m_device_id;
     }
 
+protected:
+    //! NUMA node the device is attached to, -1 if unknown
+    int m_numa_node;
+
+public:
+    //! Returns the NUMA node of the file's device, -1 if unknown. The disk
+    //! queue's thread is pinned to this node.
+    int get_numa_node() const
+    {
+        return m_numa_node;
+    }
+
+    //! Sets the NUMA node of the file's device, must be called before the
+    //! first request is submitted.
+    void set_numa_node(int node)
+    {
+        m_numa_node = node;
+    }
+
 protected:
     //! count the number of requests referencing this file
     atomic_counted_object m_request_ref;
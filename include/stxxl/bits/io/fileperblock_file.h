@@ -13,6 +13,7 @@
 #ifndef STXXL_IO_FILEPERBLOCK_FILE_HEADER
 #define STXXL_IO_FILEPERBLOCK_FILE_HEADER
 
+#include <set>
 #include <string>
 #include <stxxl/bits/io/disk_queued_file.h>
 
@@ -33,6 +34,10 @@ private:
     bool lock_file_created;
     base_file_type lock_file;
 
+    //! blocks written since the last flush()
+    std::set<offset_type> unflushed_blocks;
+    mutex unflushed_mutex;
+
 protected:
     //! Constructs a file name for a given block.
     std::string filename_for_block(offset_type offset);
@@ -63,10 +68,17 @@ public:
 
     virtual void lock();
 
+    //! Reopens and flushes the files of all blocks written since the last
+    //! flush.
+    virtual void flush();
+
     //! Frees the specified region.
     //! Actually deletes the corresponding file if the whole thing is deleted.
     virtual void discard(offset_type offset, offset_type length);
 
+    //! every block is a file of its own
+    virtual bool supports_extents() const { return false; }
+
     //! Rename the file corresponding to the offset such that it is out of reach for deleting.
     virtual void export_files(offset_type offset, offset_type length, std::string filename);
 
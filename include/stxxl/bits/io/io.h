@@ -24,10 +24,14 @@
 #include <stxxl/bits/io/mem_file.h>
 #include <stxxl/bits/io/fileperblock_file.h>
 #include <stxxl/bits/io/wbtl_file.h>
+#include <stxxl/bits/io/compressed_file.h>
+#include <stxxl/bits/io/tiered_file.h>
 #include <stxxl/bits/io/linuxaio_file.h>
+#include <stxxl/bits/io/io_uring_file.h>
 #include <stxxl/bits/io/create_file.h>
 #include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iotrace.h>
 #include <stxxl/bits/namespace.h>
 
 //! \c STXXL library namespace
@@ -0,0 +1,91 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/io_uring_file.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_IO_URING_FILE_HEADER
+#define STXXL_IO_IO_URING_FILE_HEADER
+
+#include <stxxl/bits/config.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <stxxl/bits/io/ufs_file_base.h>
+#include <stxxl/bits/io/disk_queued_file.h>
+#include <stxxl/bits/io/io_uring_queue.h>
+
+STXXL_BEGIN_NAMESPACE
+
+class io_uring_queue;
+
+//! \addtogroup fileimpl
+//! \{
+
+//! Implementation of \c file based on the Linux io_uring kernel interface
+//! with shared submission and completion rings.
+class io_uring_file : public ufs_file_base, public disk_queued_file
+{
+    friend class io_uring_request;
+
+private:
+    int desired_queue_length;
+
+public:
+    //! Constructs file object
+    //! \param filename path of file
+    //! \param mode open mode, see \c stxxl::file::open_modes
+    //! \param queue_id disk queue identifier
+    //! \param allocator_id linked disk_allocator
+    //! \param device_id physical device identifier
+    //! \param desired_queue_length number of ring entries requested from kernel
+    io_uring_file(
+        const std::string& filename, int mode,
+        int queue_id = DEFAULT_IO_URING_QUEUE,
+        int allocator_id = NO_ALLOCATOR,
+        unsigned int device_id = DEFAULT_DEVICE_ID,
+        int desired_queue_length = 0)
+        : file(device_id),
+          ufs_file_base(filename, mode),
+          disk_queued_file(queue_id, allocator_id),
+          desired_queue_length(desired_queue_length)
+    { }
+
+    void serve(void* buffer, offset_type offset, size_type bytes,
+               request::request_type type);
+    request_ptr aread(void* buffer, offset_type pos, size_type bytes,
+                      const completion_handler& on_cmpl = completion_handler());
+    request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
+                       const completion_handler& on_cmpl = completion_handler());
+    request_ptr aflush(const completion_handler& on_cmpl = completion_handler());
+    const char * io_type() const;
+
+    int get_desired_queue_length() const
+    {
+        return desired_queue_length;
+    }
+
+    //! Register a long-lived I/O buffer (e.g. a pool allocated with
+    //! aligned_alloc) with the kernel. Requests lying completely inside a
+    //! registered buffer are issued as fixed-buffer operations, which saves
+    //! the kernel from pinning the user pages on every request.
+    //! \return false if the kernel does not support buffer registration or
+    //! all buffer slots are in use.
+    bool register_buffer(void* buffer, size_type bytes);
+
+    //! Release a buffer registered with register_buffer().
+    void unregister_buffer(void* buffer);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+
+#endif // !STXXL_IO_IO_URING_FILE_HEADER
+// vim: et:ts=4:sw=4
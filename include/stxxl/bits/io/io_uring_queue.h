@@ -0,0 +1,132 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/io_uring_queue.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_IO_URING_QUEUE_HEADER
+#define STXXL_IO_IO_URING_QUEUE_HEADER
+
+#include <stxxl/bits/io/io_uring_file.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <linux/io_uring.h>
+#include <list>
+#include <vector>
+
+#include <stxxl/bits/io/request_queue_impl_worker.h>
+#include <stxxl/bits/common/mutex.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Queue for io_uring_file(s)
+//!
+//! Only one queue exists in a program, i.e. it is a singleton.
+//!
+//! In contrast to linuxaio_queue, a single thread both submits and reaps
+//! requests: while it waits for completions inside the kernel, a poll on an
+//! eventfd is kept armed in the ring, which user threads signal when they add
+//! requests to an idle queue. All requests which arrived in the meantime are
+//! then submitted in one batch with a single io_uring_enter() call.
+class io_uring_queue : public request_queue_impl_worker
+{
+    friend class io_uring_request;
+
+    typedef io_uring_queue self_type;
+
+private:
+    //! ring file descriptor
+    int ring_fd;
+
+    //! \name Submission Queue Ring
+    //! \{
+    unsigned* sq_head, * sq_tail, * sq_ring_mask, * sq_array;
+    io_uring_sqe* sqes;
+    //! \}
+
+    //! \name Completion Queue Ring
+    //! \{
+    unsigned* cq_head, * cq_tail, * cq_ring_mask;
+    io_uring_cqe* cqes;
+    //! \}
+
+    //! mmap()ed regions of the rings
+    void* sq_ring_ptr, * cq_ring_ptr;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+
+    //! number of ring entries, i.e. max number of requests in the kernel
+    unsigned ring_entries;
+
+    //! eventfd used to wake up the worker thread
+    int event_fd;
+    //! buffer for reading eventfd counter via the ring
+    uint64 event_value;
+
+    //! storing io_uring_request* would drop ownership
+    typedef std::list<request_ptr> queue_type;
+
+    //! "waiting" requests have been submitted to this queue, but not yet to
+    //! the kernel, where they are "posted"
+    mutex waiting_mtx;
+    queue_type waiting_requests;
+    //! eventfd was already signaled, protected by waiting_mtx
+    bool worker_notified;
+
+    //! number of I/O requests posted to the kernel, only used by worker
+    unsigned num_posted;
+
+    //! registered fixed buffers, protected by buffer_mtx
+    mutex buffer_mtx;
+    std::vector<std::pair<char*, size_t> > fixed_buffers;
+    bool fixed_buffers_supported;
+
+    thread_type thread;
+    state<thread_state> thread_state;
+
+    static const unsigned max_fixed_buffers = 64;
+
+    static void * worker(void* arg);   // thread start callback
+    void process_requests();
+    void notify_worker();
+    io_uring_sqe * get_sqe();
+    void arm_event_poll();
+    int find_fixed_buffer(const void* buffer, size_t bytes);
+    //! reap completion events, returns true if the eventfd read completed
+    bool handle_completions();
+
+public:
+    //! Construct queue. Requests number of entries in the submission ring,
+    //! 0 means the default of 64.
+    io_uring_queue(int desired_queue_length = 0);
+
+    void add_request(request_ptr& req);
+    bool cancel_request(request_ptr& req);
+    void set_numa_node(int node)
+    {
+        bind_thread(thread, node);
+    }
+    ~io_uring_queue();
+
+    //! Register a fixed buffer with the ring, see
+    //! io_uring_file::register_buffer().
+    bool register_buffer(void* buffer, size_t bytes);
+    //! Unregister a fixed buffer.
+    void unregister_buffer(void* buffer);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+
+#endif // !STXXL_IO_IO_URING_QUEUE_HEADER
+// vim: et:ts=4:sw=4
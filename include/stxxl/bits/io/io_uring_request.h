@@ -0,0 +1,69 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/io_uring_request.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_IO_URING_REQUEST_HEADER
+#define STXXL_IO_IO_URING_REQUEST_HEADER
+
+#include <stxxl/bits/io/io_uring_file.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <linux/io_uring.h>
+#include <stxxl/bits/io/request_with_state.h>
+
+#define STXXL_VERBOSE_IO_URING(msg) STXXL_VERBOSE2(msg)
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Request for an io_uring_file.
+class io_uring_request : public request_with_state
+{
+    template <class base_file_type>
+    friend class fileperblock_file;
+    friend class io_uring_queue;
+
+    //! fill submission queue entry, fixed_index is -1 for unregistered
+    //! buffers.
+    void fill_sqe(io_uring_sqe* sqe, int fixed_index);
+
+public:
+    io_uring_request(
+        const completion_handler& on_cmpl,
+        file* file,
+        void* buffer,
+        offset_type offset,
+        size_type bytes,
+        request_type type)
+        : request_with_state(on_cmpl, file, buffer, offset, bytes, type)
+    {
+        assert(dynamic_cast<io_uring_file*>(file));
+        STXXL_VERBOSE_IO_URING("io_uring_request[" << this << "]" <<
+                               " io_uring_request" <<
+                               "(file=" << file << " buffer=" << buffer <<
+                               " offset=" << offset << " bytes=" << bytes <<
+                               " type=" << type << ")");
+    }
+
+    bool cancel();
+    //! called by io_uring_queue with the result of the kernel operation
+    void completed(bool posted, bool canceled, long result = 0);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+
+#endif // !STXXL_IO_IO_URING_REQUEST_HEADER
+// vim: et:ts=4:sw=4
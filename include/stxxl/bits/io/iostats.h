@@ -47,6 +47,8 @@ class stats : public singleton<stats>
     int64 volume_read, volume_written;          // number of bytes read/written
     unsigned c_reads, c_writes;                 // number of cached operations
     int64 c_volume_read, c_volume_written;      // number of bytes read/written from/to cache
+    int64 z_volume_raw, z_volume_stored;        // bytes before/after compression of written blocks
+    double t_compress, t_decompress;            // CPU seconds spent in (de)compression
     double t_reads, t_writes;                   // seconds spent in operations
     double p_reads, p_writes;                   // seconds spent in parallel operations
     double p_begin_read, p_begin_write;         // start time of parallel operation
@@ -63,7 +65,7 @@ class stats : public singleton<stats>
     int acc_waits;
     int acc_wait_read, acc_wait_write;
     double last_reset;
-    mutex read_mutex, write_mutex, io_mutex, wait_mutex;
+    mutex read_mutex, write_mutex, io_mutex, wait_mutex, compress_mutex;
 
     stats();
 
@@ -317,6 +319,32 @@ public:
         return c_volume_written;
     }
 
+    //! Returns number of bytes given to compressed files before compression.
+    int64 get_compressed_raw_volume() const
+    {
+        return z_volume_raw;
+    }
+
+    //! Returns number of bytes stored by compressed files after compression.
+    int64 get_compressed_stored_volume() const
+    {
+        return z_volume_stored;
+    }
+
+    //! Time spent compressing blocks written to compressed files.
+    //! \return seconds spent in compression
+    double get_compress_time() const
+    {
+        return t_compress;
+    }
+
+    //! Time spent decompressing blocks read from compressed files.
+    //! \return seconds spent in decompression
+    double get_decompress_time() const
+    {
+        return t_decompress;
+    }
+
     //! Time that would be spent in read syscalls if all parallel reads were serialized.
     //! \return seconds spent in reading
     double get_read_time() const
@@ -394,6 +422,8 @@ public:
     void read_canceled(unsigned_type size_);
     void read_finished();
     void read_cached(unsigned_type size_);
+    void compressed(unsigned_type raw_size, unsigned_type stored_size, double seconds);
+    void decompressed(double seconds);
     void wait_started(wait_op_type wait_op);
     void wait_finished(wait_op_type wait_op);
 };
@@ -419,6 +449,16 @@ inline void stats::read_cached(unsigned_type size_)
     STXXL_UNUSED(size_);
 }
 inline void stats::read_finished() { }
+inline void stats::compressed(unsigned_type raw_size, unsigned_type stored_size, double seconds)
+{
+    STXXL_UNUSED(raw_size);
+    STXXL_UNUSED(stored_size);
+    STXXL_UNUSED(seconds);
+}
+inline void stats::decompressed(double seconds)
+{
+    STXXL_UNUSED(seconds);
+}
 #endif
 #ifdef STXXL_DO_NOT_COUNT_WAIT_TIME
 inline void stats::wait_started(wait_op_type) { }
@@ -435,6 +475,10 @@ class stats_data
     unsigned c_reads, c_writes;
     //! number of bytes read/written from/to cache
     int64 c_volume_read, c_volume_written;
+    //! bytes before/after compression of written blocks
+    int64 z_volume_raw, z_volume_stored;
+    //! seconds spent in (de)compression
+    double t_compress, t_decompress;
     //! seconds spent in operations
     double t_reads, t_writes;
     //! seconds spent in parallel operations
@@ -456,6 +500,10 @@ public:
           c_writes(0),
           c_volume_read(0),
           c_volume_written(0),
+          z_volume_raw(0),
+          z_volume_stored(0),
+          t_compress(0.0),
+          t_decompress(0.0),
           t_reads(0.0),
           t_writes(0.0),
           p_reads(0.0),
@@ -476,6 +524,10 @@ public:
           c_writes(s.get_cached_writes()),
           c_volume_read(s.get_cached_read_volume()),
           c_volume_written(s.get_cached_written_volume()),
+          z_volume_raw(s.get_compressed_raw_volume()),
+          z_volume_stored(s.get_compressed_stored_volume()),
+          t_compress(s.get_compress_time()),
+          t_decompress(s.get_decompress_time()),
           t_reads(s.get_read_time()),
           t_writes(s.get_write_time()),
           p_reads(s.get_pread_time()),
@@ -498,6 +550,10 @@ public:
         s.c_writes = c_writes + a.c_writes;
         s.c_volume_read = c_volume_read + a.c_volume_read;
         s.c_volume_written = c_volume_written + a.c_volume_written;
+        s.z_volume_raw = z_volume_raw + a.z_volume_raw;
+        s.z_volume_stored = z_volume_stored + a.z_volume_stored;
+        s.t_compress = t_compress + a.t_compress;
+        s.t_decompress = t_decompress + a.t_decompress;
         s.t_reads = t_reads + a.t_reads;
         s.t_writes = t_writes + a.t_writes;
         s.p_reads = p_reads + a.p_reads;
@@ -521,6 +577,10 @@ public:
         s.c_writes = c_writes - a.c_writes;
         s.c_volume_read = c_volume_read - a.c_volume_read;
         s.c_volume_written = c_volume_written - a.c_volume_written;
+        s.z_volume_raw = z_volume_raw - a.z_volume_raw;
+        s.z_volume_stored = z_volume_stored - a.z_volume_stored;
+        s.t_compress = t_compress - a.t_compress;
+        s.t_decompress = t_decompress - a.t_decompress;
         s.t_reads = t_reads - a.t_reads;
         s.t_writes = t_writes - a.t_writes;
         s.p_reads = p_reads - a.p_reads;
@@ -573,6 +633,26 @@ public:
         return c_volume_written;
     }
 
+    int64 get_compressed_raw_volume() const
+    {
+        return z_volume_raw;
+    }
+
+    int64 get_compressed_stored_volume() const
+    {
+        return z_volume_stored;
+    }
+
+    double get_compress_time() const
+    {
+        return t_compress;
+    }
+
+    double get_decompress_time() const
+    {
+        return t_decompress;
+    }
+
     double get_read_time() const
     {
         return t_reads;
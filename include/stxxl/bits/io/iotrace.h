@@ -0,0 +1,220 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/iotrace.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_IOTRACE_HEADER
+#define STXXL_IO_IOTRACE_HEADER
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/singleton.h>
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup iolayer
+//!
+//! \{
+
+//! Histogram of latencies with logarithmically sized buckets: bucket 0 counts
+//! latencies below 1 microsecond, bucket i > 0 those in [2^(i-1), 2^i)
+//! microseconds.
+class latency_histogram
+{
+public:
+    static const unsigned num_buckets = 40;
+
+protected:
+    uint64 m_buckets[num_buckets];
+    uint64 m_count;
+    double m_sum, m_max;
+
+public:
+    latency_histogram();
+
+    //! add one latency given in seconds
+    void add(double latency);
+
+    latency_histogram& operator += (const latency_histogram& other);
+
+    uint64 count() const { return m_count; }
+
+    //! average latency in seconds
+    double average() const { return m_count ? m_sum / (double)m_count : 0.0; }
+
+    //! maximum latency in seconds
+    double max() const { return m_max; }
+
+    uint64 bucket(unsigned i) const { return m_buckets[i]; }
+
+    //! exclusive upper bound of bucket i in seconds
+    static double bucket_limit(unsigned i);
+
+    //! upper bound of the bucket containing the given quantile (0..1) in
+    //! seconds, capped at the maximum.
+    double quantile(double q) const;
+
+    //! print one summary line and the non-empty buckets
+    void print(std::ostream& os, const std::string& title) const;
+};
+
+//! Records per-request I/O timing: per-disk latency histograms, queue depth
+//! and, optionally, a ring buffer trace of individual requests.
+//!
+//! Tracing is off by default and then costs a single test of a static flag
+//! per request. It is switched on programmatically via start(), or by setting
+//! the environment variable STXXLIOTRACE to a file name. In the latter case
+//! the trace (of at most STXXLIOTRACESIZE requests, default 1Mi) is written
+//! to that file at program exit and a summary is logged. The file can be
+//! converted to Chrome trace / Perfetto JSON with "stxxl_tool iotrace".
+//!
+//! \remarks is a singleton
+class iotrace : public singleton<iotrace>
+{
+    friend class singleton<iotrace>;
+
+public:
+    //! One traced request, timestamps in seconds since start of tracing.
+    struct entry
+    {
+        unsigned int disk;
+        request_interface::request_type type;
+        bool canceled;
+        uint64 offset, size;
+        double submit, start, complete;
+    };
+
+    //! Statistics of one disk, identified by the file's device id.
+    struct disk_stats
+    {
+        //! time from submission to completion
+        latency_histogram read_latency, write_latency;
+        //! time from start of the I/O to completion
+        latency_histogram read_service, write_service;
+
+        //! current and maximum number of submitted, unfinished requests
+        unsigned_type depth, max_depth;
+        //! integral of queue depth over time, and its last update
+        double depth_integral, depth_time, first_time;
+
+        disk_stats();
+
+        //! change queue depth at time now
+        void set_depth(unsigned_type new_depth, double now);
+
+        //! time-weighted average queue depth
+        double average_depth() const;
+    };
+
+    typedef std::map<unsigned int, disk_stats> disk_map_type;
+
+private:
+    //! tested in the hooks, hence cheap if tracing is off
+    static volatile bool s_active;
+
+    mutex m_mutex;
+
+    //! timestamp of start()
+    double m_begin;
+
+    disk_map_type m_disks;
+
+    //! ring buffer of traced requests, and total number recorded
+    std::vector<entry> m_ring;
+    uint64 m_ring_pos;
+
+    //! file to write trace to on exit
+    std::string m_dump_path;
+
+    iotrace();
+    ~iotrace();
+
+    void submitted(request* req);
+    void started(request* req);
+    void completed(request* req, bool canceled);
+
+public:
+    //! \name Control
+    //! \{
+
+    //! Start collecting histograms and queue depths, resets previous data.
+    //! \param trace_entries size of the request trace ring buffer, 0 = off
+    void start(size_t trace_entries = 0);
+
+    //! Stop collecting. The data remains available.
+    void stop();
+
+    static bool is_active() { return s_active; }
+
+    //! \}
+
+    //! \name Hooks called by the I/O layer
+    //! \{
+
+    //! request is handed to a disk queue
+    static void request_submitted(request* req)
+    {
+        if (s_active) get_instance()->submitted(req);
+    }
+
+    //! I/O operation of request begins
+    static void request_started(request* req)
+    {
+        if (s_active) get_instance()->started(req);
+    }
+
+    //! request finished or was canceled
+    static void request_completed(request* req, bool canceled)
+    {
+        if (s_active) get_instance()->completed(req, canceled);
+    }
+
+    //! \}
+
+    //! \name Results
+    //! \{
+
+    //! copy of the per-disk statistics
+    disk_map_type get_disk_stats();
+
+    //! traced requests (at most trace_entries latest) in completion order
+    std::vector<entry> get_trace();
+
+    //! print histograms and queue depths of all disks
+    static void print_summary(std::ostream& os, const disk_map_type& disks);
+
+    //! calculate per-disk statistics from a trace
+    static disk_map_type summarize(const std::vector<entry>& trace);
+
+    //! write trace as text, one request per line
+    static void write_trace(std::ostream& os, const std::vector<entry>& trace);
+
+    //! read trace written by write_trace(), returns false on parse errors
+    static bool read_trace(std::istream& is, std::vector<entry>& trace);
+
+    //! write trace in Chrome trace event JSON format, which is also read by
+    //! Perfetto: one async slice per request with a nested slice for the
+    //! actual I/O, and a queue depth counter per disk.
+    static void write_chrome_trace(std::ostream& os, const std::vector<entry>& trace);
+
+    //! \}
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_IOTRACE_HEADER
+// vim: et:ts=4:sw=4
@@ -64,6 +64,7 @@ public:
                       const completion_handler& on_cmpl = completion_handler());
     request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
                        const completion_handler& on_cmpl = completion_handler());
+    request_ptr aflush(const completion_handler& on_cmpl = completion_handler());
     const char * io_type() const;
 
     int get_desired_queue_length() const
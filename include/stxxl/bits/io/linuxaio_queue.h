@@ -87,6 +87,11 @@ public:
     void add_request(request_ptr& req);
     bool cancel_request(request_ptr& req);
     void complete_request(request_ptr& req);
+    void set_numa_node(int node)
+    {
+        bind_thread(post_thread, node);
+        bind_thread(wait_thread, node);
+    }
     ~linuxaio_queue();
 };
 
@@ -58,6 +58,10 @@ public:
     }
 
     bool post();
+    //! Submits a FLUSH request as IOCB_CMD_FDSYNC, or flushes synchronously
+    //! if the kernel or file system lacks asynchronous fsync.
+    //! \returns false if the request was served synchronously
+    bool post_flush();
     bool cancel();
     bool cancel_aio();
     void completed(bool posted, bool canceled);
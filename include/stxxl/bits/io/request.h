@@ -38,6 +38,7 @@ class file;
 class request : virtual public request_interface, public atomic_counted_object
 {
     friend class linuxaio_queue;
+    friend class iotrace;
 
 protected:
     completion_handler m_on_complete;
@@ -50,6 +51,10 @@ protected:
     size_type m_bytes;
     request_type m_type;
 
+    //! timestamps of submission and start of I/O, set only while iotrace is
+    //! active
+    double m_submit_time, m_start_time;
+
 public:
     request(const completion_handler& on_compl,
             file* file,
@@ -66,6 +71,9 @@ public:
     size_type get_size() const { return m_bytes; }
     request_type get_type() const { return m_type; }
 
+    //! Returns "READ", "WRITE" or "FLUSH".
+    static const char * type_name(request_type type);
+
     void check_alignment() const;
 
     std::ostream & print(std::ostream& out) const;
@@ -38,7 +38,10 @@ class request_interface : private noncopyable
 public:
     typedef stxxl::external_size_type offset_type;
     typedef stxxl::internal_size_type size_type;
-    enum request_type { READ, WRITE };
+    //! Type of a request. FLUSH writes the data cached for the file to the
+    //! device and completes after all writes submitted before it to the
+    //! same queue.
+    enum request_type { READ, WRITE, FLUSH };
 
 public:
     virtual bool add_waiter(onoff_switch* sw) = 0;
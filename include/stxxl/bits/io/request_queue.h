@@ -33,6 +33,12 @@ public:
     virtual bool cancel_request(request_ptr& req) = 0;
     virtual ~request_queue() { }
     virtual void set_priority_op(priority_op p) { STXXL_UNUSED(p); }
+    //! Serve the request before all other queued requests which were not
+    //! promoted, e.g. because a thread is blocked waiting for it. Returns
+    //! false if not supported or the request is no longer queued.
+    virtual bool promote_request(request_ptr& req) { STXXL_UNUSED(req); return false; }
+    //! Pin the queue's threads to the CPUs of a NUMA node.
+    virtual void set_numa_node(int node) { STXXL_UNUSED(node); }
 };
 
 //! \}
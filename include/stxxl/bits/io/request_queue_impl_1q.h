@@ -59,6 +59,10 @@ public:
     }
     void add_request(request_ptr& req);
     bool cancel_request(request_ptr& req);
+    void set_numa_node(int node)
+    {
+        bind_thread(m_thread, node);
+    }
     ~request_queue_impl_1q();
 };
 
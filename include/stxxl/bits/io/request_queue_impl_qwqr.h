@@ -16,11 +16,32 @@
 #ifndef STXXL_IO_REQUEST_QUEUE_IMPL_QWQR_HEADER
 #define STXXL_IO_REQUEST_QUEUE_IMPL_QWQR_HEADER
 
-#include <list>
+#include <set>
+#include <utility>
 
 #include <stxxl/bits/io/request_queue_impl_worker.h>
+#include <stxxl/bits/io/serving_request.h>
 #include <stxxl/bits/common/mutex.h>
 
+#ifndef STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+#if STXXL_DEBUG_ASSERTIONS
+#define STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION 1
+#else
+#define STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION 0
+#endif
+#endif
+
+#ifndef STXXL_QWQR_COALESCE_MAX_REQUESTS
+//! maximum number of adjacent requests served with one vectored I/O call,
+//! 1 disables coalescing.
+#define STXXL_QWQR_COALESCE_MAX_REQUESTS 64
+#endif
+
+#ifndef STXXL_QWQR_COALESCE_MAX_BYTES
+//! maximum total size of coalesced requests
+#define STXXL_QWQR_COALESCE_MAX_BYTES (16 * 1024 * 1024)
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 //! \addtogroup reqlayer
@@ -29,41 +50,134 @@ STXXL_BEGIN_NAMESPACE
 //! Implementation of a local request queue having two queues, one for read and
 //! one for write requests, thus having two threads. This is the default
 //! implementation.
+//!
+//! Submission is lock-free: producers push serving_request objects onto an
+//! intrusive stack using compare-and-swap, without allocating list nodes. The
+//! worker thread detaches the whole stack at once, reverses it into a private
+//! FIFO, and serves the batch. The worker sleeps on the semaphore only when
+//! all queues are empty, hence producers touch the semaphore's mutex only to
+//! wake up an idle worker. Canceling marks the queued request, which the
+//! worker then skips.
+//!
+//! The worker picks the next request in this order: promoted requests (e.g.
+//! those a thread is blocked on in request::wait()), then the oldest read or
+//! write whose deadline expired, then according to the priority_op: READ
+//! first, WRITE first, or alternating (NONE). FLUSH requests are queued with
+//! the writes and never promoted, so they are served after all writes
+//! submitted before them.
+//!
+//! If the file supports vectored I/O (file::has_vector_io()), following
+//! requests of the same type which continue the picked one on the same file
+//! are dequeued as well and served with a single file::serve_vector() call.
 class request_queue_impl_qwqr : public request_queue_impl_worker
 {
 private:
     typedef request_queue_impl_qwqr self;
-    typedef std::list<request_ptr> queue_type;
 
-    mutex m_write_mutex;
-    mutex m_read_mutex;
-    queue_type m_write_queue;
-    queue_type m_read_queue;
+    //! intrusive FIFO owned by the worker thread
+    struct fifo_type
+    {
+        serving_request* head, * tail;
+        fifo_type() : head(NULL), tail(NULL) { }
+    };
+
+    //! submission stacks, pushed by producers, detached by the worker
+    serving_request* volatile m_write_stack;
+    serving_request* volatile m_read_stack;
+
+    //! requests detached from the submission stacks, in submission order
+    fifo_type m_write_queue;
+    fifo_type m_read_queue;
+
+    //! stack and FIFO of promoted requests, which are also still contained in
+    //! the read or write queues.
+    serving_request* volatile m_urgent_stack;
+    fifo_type m_urgent_queue;
+
+    //! current scheduling mode
+    volatile priority_op m_priority_op;
+
+    //! maximum time in seconds a read/write request should wait in the
+    //! queue before it is served regardless of the priority_op.
+    double m_read_deadline, m_write_deadline;
+
+    //! set by the worker before sleeping on m_sem, cleared by the thread
+    //! which wakes it up
+    volatile int m_worker_sleeping;
 
     state<thread_state> m_thread_state;
     thread_type m_thread;
     semaphore m_sem;
 
-    static const priority_op m_priority_op = WRITE;
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    //! (file, offset) pairs of queued requests, for detecting conflicts
+    typedef std::multiset<std::pair<file*, request::offset_type> > pending_type;
+    mutex m_pending_mutex;
+    pending_type m_pending_reads, m_pending_writes;
+#endif
+
+    //! pointer to the intrusive link field used by a stack and fifo
+    typedef serving_request* serving_request::* link_type;
 
     static void * worker(void* arg);
 
+    //! push request onto submission stack
+    static void push(serving_request* volatile* stack, serving_request* req,
+                     link_type next);
+
+    //! detach submission stack and append it to the fifo
+    static void refill(serving_request* volatile* stack, fifo_type& fifo,
+                       link_type next);
+
+    //! pop head of fifo, returns an empty request_ptr if it was canceled or
+    //! already dequeued from another fifo.
+    request_ptr pop_front(fifo_type& fifo, link_type next);
+
+    //! pop next request which was not canceled from fifo, refilling from the
+    //! submission stack if empty. Returns an empty request_ptr if none.
+    request_ptr dequeue(serving_request* volatile* stack, fifo_type& fifo,
+                        link_type next);
+
+    //! pop next request from a read/write fifo only if it continues prev on
+    //! the same file and is at most max_bytes large.
+    request_ptr dequeue_adjacent(serving_request* volatile* stack, fifo_type& fifo,
+                                 const request_ptr& prev, request::size_type max_bytes);
+
+    //! select the next request to serve according to the scheduling policy
+    request_ptr next_request(bool& write_phase);
+
+    //! wake up worker if it is sleeping
+    void notify_worker();
+
 public:
     // \param n max number of requests simultaneously submitted to disk
     request_queue_impl_qwqr(int n = 1);
 
-    // in a multi-threaded setup this does not work as intended
-    // also there were race conditions possible
-    // and actually an old value was never restored once a new one was set ...
-    // so just disable it and all it's nice implications
+    //! Change the scheduling mode, takes effect with the next request the
+    //! worker picks.
     void set_priority_op(priority_op op)
     {
-        //_priority_op = op;
-        STXXL_UNUSED(op);
+        m_priority_op = op;
+    }
+    //! Set deadlines in seconds after which queued reads/writes are served
+    //! before all other non-promoted requests. Defaults: 0.5 s and 5 s.
+    void set_deadlines(double read_deadline, double write_deadline)
+    {
+        m_read_deadline = read_deadline;
+        m_write_deadline = write_deadline;
     }
     void add_request(request_ptr& req);
     bool cancel_request(request_ptr& req);
+    bool promote_request(request_ptr& req);
+    void set_numa_node(int node)
+    {
+        bind_thread(m_thread, node);
+    }
     ~request_queue_impl_qwqr();
+
+    //! true if submission is implemented with atomic operations instead of
+    //! mutexes
+    static bool is_lock_free();
 };
 
 //! \}
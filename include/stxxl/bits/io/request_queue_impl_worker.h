@@ -56,6 +56,12 @@ protected:
 protected:
     void start_thread(void* (*worker)(void*), void* arg, thread_type& t, state<thread_state>& s);
     void stop_thread(thread_type& t, state<thread_state>& s, semaphore& sem);
+    //! join a worker thread which was already told to terminate, used by
+    //! queues that are not woken up via a semaphore.
+    void join_thread(thread_type& t, state<thread_state>& s);
+    //! pin a running worker thread to the CPUs of a NUMA node, does nothing
+    //! without libnuma.
+    void bind_thread(thread_type& t, int node);
 };
 
 //! \}
@@ -29,6 +29,30 @@ class serving_request : public request_with_state
     friend class request_queue_impl_qwqr;
     friend class request_queue_impl_1q;
 
+protected:
+    //! \name Intrusive Hook for request_queue_impl_qwqr
+    //! \{
+
+    //! states of the request inside the lock-free submission queue
+    enum queue_state { NOT_QUEUED = 0, QUEUED = 1, CANCELED = 2, DEQUEUED = 3 };
+
+    //! next request in the queue's submission stack or worker FIFO
+    serving_request* m_queue_next;
+
+    //! queue_state, modified only by atomic compare-and-swap
+    volatile int m_queue_state;
+
+    //! next request in the queue's stack or FIFO of promoted requests
+    serving_request* m_urgent_next;
+
+    //! set once the request was promoted, modified only by compare-and-swap
+    volatile int m_promoted;
+
+    //! timestamp of submission to the queue, used for deadlines
+    double m_queue_time;
+
+    //! \}
+
 public:
     serving_request(
         const completion_handler& on_cmpl,
@@ -41,6 +65,11 @@ public:
 protected:
     virtual void serve();
 
+    //! Serve adjacent requests of the same type on the same file, which
+    //! cover one contiguous range in order, with a single
+    //! file::serve_vector() call, and complete all of them.
+    static void serve_coalesced(serving_request* const* reqs, size_t count);
+
 public:
     const char * io_type() const;
 };
@@ -46,6 +46,12 @@ public:
     { }
     void serve(void* buffer, offset_type offset, size_type bytes,
                request::request_type type);
+#if STXXL_HAVE_PREADV
+    //! Serves all buffers with preadv()/pwritev().
+    void serve_vector(const io_vector* vec, size_t count,
+                      offset_type offset, request::request_type type);
+    bool has_vector_io() const { return true; }
+#endif
     const char * io_type() const;
 };
 
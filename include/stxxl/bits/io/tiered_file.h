@@ -0,0 +1,194 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/tiered_file.h
+ *
+ *  a pseudo file keeping hot blocks of a slow file on a fast tier
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_TIERED_FILE_HEADER
+#define STXXL_IO_TIERED_FILE_HEADER
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <stxxl/bits/io/disk_queued_file.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup fileimpl
+//! \{
+
+//! Implementation of file which keeps the working set of a slow file on a
+//! fast tier (flash or memory).
+//!
+//! The slow file holds the complete address space, offsets of the tiered file
+//! are offsets in the slow file, so block identities never change. Written
+//! blocks are placed on the fast tier. When it runs full, cold blocks are
+//! demoted to the slow file, chosen by LRU or CLOCK (second chance). Blocks
+//! read from the slow file are promoted after a number of repeated reads.
+//! Requests overlapping cached blocks without matching them demote these
+//! first. All transfers run synchronously in serve(), i.e. on the disk queue's
+//! worker thread. flush() and the destructor write all dirty blocks back to
+//! the slow file, so the fast tier may be volatile.
+class tiered_file : public disk_queued_file
+{
+public:
+    //! replacement policy of the fast tier
+    enum policy_type { POLICY_LRU, POLICY_CLOCK };
+
+    //! counters of the tiering decisions
+    struct counters
+    {
+        //! requests served by the fast tier
+        uint64 hits;
+        //! requests served by the slow file
+        uint64 misses;
+        //! blocks copied to the fast tier after repeated reads
+        uint64 promotions;
+        //! blocks evicted from the fast tier
+        uint64 demotions;
+        //! dirty blocks written to the slow file on demotion or flush
+        uint64 writebacks;
+    };
+
+protected:
+    //! a block on the fast tier
+    struct entry
+    {
+        //! offset in the fast tier file
+        offset_type fast;
+        //! length of the block
+        size_type bytes;
+        //! block differs from the copy in the slow file
+        bool dirty;
+        //! accessed since the CLOCK hand passed
+        bool referenced;
+        //! position in m_order
+        std::list<offset_type>::iterator order;
+    };
+
+    //! offset -> block on the fast tier, non-overlapping
+    typedef std::map<offset_type, entry> entry_map_type;
+    //! offset in the fast tier -> size of free regions
+    typedef std::map<offset_type, size_type> free_map_type;
+    //! offset -> reads of a block not on the fast tier
+    typedef std::map<offset_type, unsigned int> read_map_type;
+
+    //! the file holding all blocks
+    file* m_slow;
+    //! the file caching hot blocks
+    file* m_fast;
+    //! bytes usable on the fast tier
+    offset_type m_fast_capacity;
+    //! replacement policy
+    policy_type m_policy;
+    //! reads of a block after which it is promoted
+    unsigned int m_promote_reads;
+    //! logical size of the file
+    offset_type m_size;
+
+    //! sequentialize function calls
+    mutex m_mutex;
+
+    entry_map_type m_entries;
+    free_map_type m_free;
+    read_map_type m_reads;
+
+    //! offsets of cached blocks, LRU: least recently used first, CLOCK:
+    //! in the order the hand passes them
+    std::list<offset_type> m_order;
+
+    //! aligned scratch buffer for demotions
+    char* m_buffer;
+    size_type m_buffer_capacity;
+
+    counters m_counters;
+
+public:
+    //! Constructs file object.
+    //! \param slow_file file object holding all blocks
+    //! \param fast_file file object used as fast tier
+    //! \param fast_capacity bytes used of fast_file
+    //! \param policy replacement policy of the fast tier
+    //! \param promote_reads reads of a block on the slow file after which it
+    //! is copied to the fast tier, 0 disables promotion
+    //! Both files are deleted in ~tiered_file(), fast_file is removed.
+    tiered_file(
+        file* slow_file, file* fast_file,
+        offset_type fast_capacity,
+        policy_type policy = POLICY_CLOCK,
+        unsigned int promote_reads = 2,
+        int queue_id = DEFAULT_QUEUE,
+        int allocator_id = NO_ALLOCATOR,
+        unsigned int device_id = DEFAULT_DEVICE_ID);
+    ~tiered_file();
+
+    offset_type size();
+    void set_size(offset_type newsize);
+    void lock();
+    void flush();
+    void serve(void* buffer, offset_type offset, size_type bytes,
+               request::request_type type);
+    void discard(offset_type offset, offset_type size);
+    void close_remove();
+    const char * io_type() const;
+
+    //! Returns the counters of the tiering decisions.
+    counters get_counters();
+
+    //! Returns the number of bytes of blocks on the fast tier.
+    offset_type get_fast_usage();
+
+    //! Parses a policy name (lru or clock), throws std::runtime_error if the
+    //! name is unknown.
+    static policy_type parse_policy(const std::string& name);
+
+    //! Returns the name of the policy.
+    static const char * policy_name(policy_type policy);
+
+protected:
+    void sread(char* buffer, offset_type offset, size_type bytes);
+    void swrite(const char* buffer, offset_type offset, size_type bytes);
+
+    //! mark the block as recently used
+    void touch(entry& e);
+
+    //! place a block on the fast tier, evicting others, returns false if it
+    //! does not fit at all
+    bool insert(const char* buffer, offset_type offset, size_type bytes,
+                bool dirty);
+
+    //! write the block to the slow file if it is dirty, keeping it cached
+    void write_back(entry_map_type::iterator it);
+
+    //! write all dirty blocks to the slow file
+    void write_back_all();
+
+    //! move the block to the slow file and drop it from the fast tier
+    void demote(entry_map_type::iterator it);
+
+    //! demote all blocks overlapping [offset, offset + bytes) except one
+    //! matching exactly, which is returned, or m_entries.end()
+    entry_map_type::iterator isolate(offset_type offset, size_type bytes);
+
+    //! choose the block to evict according to the policy
+    entry_map_type::iterator victim();
+
+    //! reserve space on the fast tier, returns false if no free region fits
+    bool allocate(size_type size, offset_type& offset);
+    //! return space on the fast tier, coalescing adjacent free regions
+    void deallocate(offset_type offset, size_type size);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_TIERED_FILE_HEADER
+// vim: et:ts=4:sw=4
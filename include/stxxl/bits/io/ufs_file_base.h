@@ -49,6 +49,11 @@ public:
     offset_type size();
     void set_size(offset_type newsize);
     void lock();
+    //! fdatasync() the file, fsync() where unavailable
+    void flush();
+    //! with DISCARD: punch a hole into the region, or discard it on a raw
+    //! device, where supported
+    void discard(offset_type offset, offset_type size);
     const char * io_type() const;
     void close_remove();
     //! unlink file without closing it.
@@ -88,9 +88,12 @@ public:
     offset_type size();
     void set_size(offset_type newsize);
     void lock();
+    void flush();
     void serve(void* buffer, offset_type offset, size_type bytes,
                request::request_type type);
     void discard(offset_type offset, offset_type size);
+    //! blocks are remapped one by one
+    bool supports_extents() const { return false; }
     const char * io_type() const;
 
 private:
@@ -0,0 +1,240 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/bid_extent.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_BID_EXTENT_HEADER
+#define STXXL_MNG_BID_EXTENT_HEADER
+
+#include <iomanip>
+#include <iterator>
+#include <ostream>
+#include <vector>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/unused.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/completion_handler.h>
+#include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/mng/bid.h>
+
+#ifndef STXXL_MNG_EXTENT_IO
+//! issue one request per extent in read_extents() and write_extents()
+#define STXXL_MNG_EXTENT_IO 1
+#endif // STXXL_MNG_EXTENT_IO
+
+#ifndef STXXL_MNG_MAX_EXTENT_BYTES
+//! maximum number of bytes transferred by one extent request
+#define STXXL_MNG_MAX_EXTENT_BYTES (64 * 1024 * 1024)
+#endif // STXXL_MNG_MAX_EXTENT_BYTES
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! A run of blocks allocated adjacently on one file, given by file, offset
+//! and length.
+struct bid_extent
+{
+    file* storage;           //!< pointer to the file of the extent
+    stxxl::int64 offset;     //!< offset of the first block within the file
+    stxxl::int64 size;       //!< length of the extent in bytes
+
+    bid_extent() : storage(NULL), offset(0), size(0)
+    { }
+
+    bid_extent(file* s, stxxl::int64 o, stxxl::int64 sz)
+        : storage(s), offset(o), size(sz)
+    { }
+
+    //! number of blocks of BlockSize bytes in the extent
+    template <unsigned BlockSize>
+    unsigned_type num_blocks() const
+    {
+        return (unsigned_type)(size / BlockSize);
+    }
+
+    //! the i-th block of BlockSize bytes in the extent
+    template <unsigned BlockSize>
+    BID<BlockSize> bid(unsigned_type i) const
+    {
+        return BID<BlockSize>(storage, offset + (stxxl::int64)i * BlockSize);
+    }
+};
+
+inline std::ostream& operator << (std::ostream& s, const bid_extent& e)
+{
+    std::ios state(NULL);
+    state.copyfmt(s);
+
+    s << "[" << e.storage << "|";
+    if (e.storage)
+        s << e.storage->get_allocator_id();
+    else
+        s << "?";
+    s << "]0x" << std::hex << std::setfill('0') << std::setw(8) << e.offset << "/0x" << std::setw(8) << e.size << std::dec;
+
+    s.copyfmt(state);
+    return s;
+}
+
+//! Group the BIDs [bidbegin, bidend) into extents of blocks which are
+//! adjacent on one file, in the order of the BIDs, and append them to
+//! extents.
+template <class BIDIterator>
+void make_extents(BIDIterator bidbegin, BIDIterator bidend,
+                  std::vector<bid_extent>& extents)
+{
+    for ( ; bidbegin != bidend; ++bidbegin)
+    {
+        if (!extents.empty() && bidbegin->storage == extents.back().storage &&
+            bidbegin->offset == extents.back().offset + extents.back().size)
+            extents.back().size += bidbegin->size;
+        else
+            extents.push_back(bid_extent(bidbegin->storage, bidbegin->offset, bidbegin->size));
+    }
+}
+
+//! Write the BIDs of all blocks of BlockSize bytes in the extents
+//! [begin, end) to out.
+template <unsigned BlockSize, class ExtentIterator, class BIDIterator>
+BIDIterator extents_to_bids(ExtentIterator begin, ExtentIterator end,
+                            BIDIterator out)
+{
+    for ( ; begin != end; ++begin)
+    {
+        const unsigned_type n = begin->template num_blocks<BlockSize>();
+        for (unsigned_type i = 0; i < n; ++i, ++out)
+            *out = begin->template bid<BlockSize>(i);
+    }
+    return out;
+}
+
+//! Return the end of the extent starting at bidbegin, which can be
+//! transferred with one request: the longest prefix of [bidbegin, bidend) of
+//! blocks adjacent on one file supporting extents, at most
+//! STXXL_MNG_MAX_EXTENT_BYTES long.
+template <class BIDIterator>
+BIDIterator extent_end(BIDIterator bidbegin, BIDIterator bidend)
+{
+    if (bidbegin == bidend)
+        return bidend;
+
+    file* storage = bidbegin->storage;
+    stxxl::int64 next = bidbegin->offset + bidbegin->size;
+    stxxl::int64 bytes = bidbegin->size;
+    ++bidbegin;
+
+#if STXXL_MNG_EXTENT_IO
+    if (!storage->supports_extents())
+        return bidbegin;
+
+    for ( ; bidbegin != bidend; ++bidbegin)
+    {
+        if (bidbegin->storage != storage || bidbegin->offset != next ||
+            bytes + bidbegin->size > STXXL_MNG_MAX_EXTENT_BYTES)
+            break;
+        next += bidbegin->size;
+        bytes += bidbegin->size;
+    }
+#else
+    STXXL_UNUSED(storage);
+    STXXL_UNUSED(next);
+    STXXL_UNUSED(bytes);
+    STXXL_UNUSED(bidend);
+#endif
+
+    return bidbegin;
+}
+
+//! Read nblocks adjacent blocks starting at bid into the array blocks with
+//! one request.
+template <class BlockType>
+request_ptr read_extent(BlockType* blocks, const typename BlockType::bid_type& bid,
+                        unsigned_type nblocks,
+                        const completion_handler& on_cmpl = completion_handler())
+{
+    STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:read   " << FMT_BID(bid) << " x" << std::dec << nblocks);
+    return bid.storage->aread(blocks, bid.offset, nblocks * BlockType::raw_size, on_cmpl);
+}
+
+//! Write the array blocks of nblocks blocks to the adjacent blocks starting
+//! at bid with one request.
+template <class BlockType>
+request_ptr write_extent(BlockType* blocks, const typename BlockType::bid_type& bid,
+                         unsigned_type nblocks,
+                         const completion_handler& on_cmpl = completion_handler())
+{
+    STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:write  " << FMT_BID(bid) << " x" << std::dec << nblocks);
+    return bid.storage->awrite(blocks, bid.offset, nblocks * BlockType::raw_size, on_cmpl);
+}
+
+/*! Reads the blocks [bidbegin, bidend) into the array blocks, with one
+ *! request per extent of adjacent blocks, see extent_end().
+ *! \param blocks array of at least bidend - bidbegin blocks
+ *! \param reqs the request of the i-th block is stored in reqs[i], blocks
+ *! of one extent share the request
+ *! \param on_cmpl completion handler, called once per request
+ *! \return the number of requests issued
+ */
+template <class BlockType, class BIDIterator>
+unsigned_type read_extents(BlockType* blocks, BIDIterator bidbegin, BIDIterator bidend,
+                           request_ptr* reqs,
+                           const completion_handler& on_cmpl = completion_handler())
+{
+    unsigned_type nreqs = 0;
+    while (bidbegin != bidend)
+    {
+        BIDIterator last = extent_end(bidbegin, bidend);
+        const unsigned_type n = std::distance(bidbegin, last);
+        request_ptr req = read_extent(blocks, *bidbegin, n, on_cmpl);
+        for (unsigned_type i = 0; i < n; ++i)
+            *reqs++ = req;
+        blocks += n;
+        bidbegin = last;
+        ++nreqs;
+    }
+    return nreqs;
+}
+
+/*! Writes the array blocks to the blocks [bidbegin, bidend), with one
+ *! request per extent of adjacent blocks, see extent_end().
+ *! \param blocks array of at least bidend - bidbegin blocks
+ *! \param reqs the request of the i-th block is stored in reqs[i], blocks
+ *! of one extent share the request
+ *! \param on_cmpl completion handler, called once per request
+ *! \return the number of requests issued
+ */
+template <class BlockType, class BIDIterator>
+unsigned_type write_extents(BlockType* blocks, BIDIterator bidbegin, BIDIterator bidend,
+                            request_ptr* reqs,
+                            const completion_handler& on_cmpl = completion_handler())
+{
+    unsigned_type nreqs = 0;
+    while (bidbegin != bidend)
+    {
+        BIDIterator last = extent_end(bidbegin, bidend);
+        const unsigned_type n = std::distance(bidbegin, last);
+        request_ptr req = write_extent(blocks, *bidbegin, n, on_cmpl);
+        for (unsigned_type i = 0; i < n; ++i)
+            *reqs++ = req;
+        blocks += n;
+        bidbegin = last;
+        ++nreqs;
+    }
+    return nreqs;
+}
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_BID_EXTENT_HEADER
+// vim: et:ts=4:sw=4
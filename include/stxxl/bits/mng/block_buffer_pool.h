@@ -0,0 +1,217 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/block_buffer_pool.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_BLOCK_BUFFER_POOL_HEADER
+#define STXXL_MNG_BLOCK_BUFFER_POOL_HEADER
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/singleton.h>
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/request.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! A pool of internal memory for block buffers, mapped once at startup.
+//!
+//! The pool is backed by huge pages, either transparent huge pages or
+//! hugetlbfs pages of 2 MiB or 1 GiB, is pre-faulted and optionally locked
+//! into memory. Buffers are carved out best-fit, freed buffers are coalesced
+//! and recycled. All typed_block allocations, i.e. the buffers of write_pool,
+//! prefetch_pool, the sorters and the containers, go through the global pool
+//! and fall back to aligned_alloc() when it is exhausted or disabled.
+//!
+//! The global pool is configured by the environment variable
+//! STXXL_BUFFER_POOL="size[,option...]", e.g. "4GiB,hugetlb,mlock", with the
+//! options thp (default), hugetlb, hugetlb1g, normal, noprefault and mlock.
+//! Without it, the global pool is disabled.
+//!
+//! \remarks is a singleton, which is never destroyed as blocks may be freed
+//! late during program exit
+class block_buffer_pool : public singleton<block_buffer_pool, false>
+{
+    friend class singleton<block_buffer_pool, false>;
+
+public:
+    //! backing pages of the pool
+    enum page_type {
+        //! small pages of the system
+        PAGES_NORMAL,
+        //! transparent huge pages requested with madvise()
+        PAGES_THP,
+        //! 2 MiB hugetlbfs pages mapped with MAP_HUGETLB
+        PAGES_HUGETLB,
+        //! 1 GiB hugetlbfs pages mapped with MAP_HUGETLB
+        PAGES_HUGETLB_1G
+    };
+
+    //! granularity and alignment of the buffers
+    static const size_t alignment = STXXL_BLOCK_ALIGN;
+
+protected:
+    //! start -> size of free chunks, offsets relative to m_base
+    typedef std::map<uint64, uint64> free_map_type;
+    //! (size, start) of free chunks
+    typedef std::set<std::pair<uint64, uint64> > size_index_type;
+    //! returned pointer -> (chunk start, chunk size)
+    typedef std::map<const char*, std::pair<uint64, uint64> > used_map_type;
+
+    mutable mutex m_mutex;
+
+    //! the mapped area, NULL if disabled
+    char* m_base;
+    //! size of the mapped area
+    uint64 m_size;
+    //! backing pages actually used
+    page_type m_pages;
+    //! whether the area is locked into memory
+    bool m_locked;
+
+    free_map_type m_free;
+    size_index_type m_free_by_size;
+    used_map_type m_used;
+
+    //! bytes of the chunks handed out
+    uint64 m_used_bytes;
+    //! maximum of m_used_bytes
+    uint64 m_peak_bytes;
+    //! number of allocations served by the pool
+    uint64 m_hits;
+    //! number of allocations that did not fit into the pool
+    uint64 m_misses;
+
+    //! configure from the environment variable STXXL_BUFFER_POOL
+    block_buffer_pool();
+
+    //! map, pre-fault and lock the area
+    void init(uint64 size, page_type pages, bool prefault, bool lock);
+
+    //! expects m_mutex to be locked
+    void insert_chunk(uint64 start, uint64 size)
+    {
+        m_free[start] = size;
+        m_free_by_size.insert(std::make_pair(size, start));
+    }
+
+    //! expects m_mutex to be locked
+    void erase_chunk(free_map_type::iterator chunk)
+    {
+        m_free_by_size.erase(std::make_pair(chunk->second, chunk->first));
+        m_free.erase(chunk);
+    }
+
+public:
+    //! Map a pool of size bytes (rounded up to the page size). If the pages
+    //! are not available, it falls back to transparent huge pages, then to
+    //! normal pages.
+    block_buffer_pool(uint64 size, page_type pages = PAGES_THP,
+                      bool prefault = true, bool lock = false);
+
+    ~block_buffer_pool();
+
+    //! Whether the pool has memory.
+    bool enabled() const
+    {
+        return m_base != NULL;
+    }
+
+    //! Whether ptr was allocated from the pool.
+    bool contains(const void* ptr) const
+    {
+        return (const char*)ptr >= m_base && (const char*)ptr < m_base + m_size;
+    }
+
+    //! Allocate size bytes aligned to alignment with meta_info_size bytes in
+    //! front, see aligned_alloc().
+    //! \return the buffer or NULL if the pool has no chunk large enough
+    void * allocate(size_t size, size_t meta_info_size = 0);
+
+    //! Return a buffer of the pool.
+    void deallocate(void* ptr);
+
+    //! Size of the mapped area.
+    uint64 get_size() const
+    {
+        return m_size;
+    }
+
+    //! Backing pages actually used.
+    page_type get_pages() const
+    {
+        return m_pages;
+    }
+
+    //! Whether the area is locked into memory.
+    bool is_locked() const
+    {
+        return m_locked;
+    }
+
+    //! Bytes currently handed out.
+    uint64 get_used() const;
+
+    //! Maximum of bytes handed out at once.
+    uint64 get_peak() const;
+
+    //! Number of allocations served by the pool.
+    uint64 get_hits() const;
+
+    //! Number of allocations that fell back to aligned_alloc().
+    uint64 get_misses() const;
+
+    //! Parse a page type name: normal, thp, hugetlb or hugetlb1g.
+    static bool parse_pages(const std::string& name, page_type& pages);
+
+    //! Name of a page type.
+    static const char * pages_name(page_type pages);
+
+    //! Print size, pages and usage of the pool.
+    void print_stats(std::ostream& o) const;
+};
+
+//! Allocate a block buffer from the global block_buffer_pool, or with
+//! aligned_alloc() if it does not fit.
+inline void * block_buffer_alloc(size_t size, size_t meta_info_size = 0)
+{
+    block_buffer_pool* pool = block_buffer_pool::get_instance();
+    if (pool->enabled()) {
+        void* result = pool->allocate(size, meta_info_size);
+        if (result)
+            return result;
+    }
+    return aligned_alloc<STXXL_BLOCK_ALIGN>(size, meta_info_size);
+}
+
+//! Free a block buffer allocated by block_buffer_alloc().
+inline void block_buffer_dealloc(void* ptr)
+{
+    block_buffer_pool* pool = block_buffer_pool::get_instance();
+    if (pool->contains(ptr))
+        pool->deallocate(ptr);
+    else
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
+}
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_BLOCK_BUFFER_POOL_HEADER
+// vim: et:ts=4:sw=4
@@ -23,7 +23,9 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <cstdlib>
 
@@ -39,11 +41,13 @@
 #include <stxxl/bits/noncopyable.h>
 #include <stxxl/bits/singleton.h>
 #include <stxxl/bits/mng/bid.h>
+#include <stxxl/bits/mng/bid_extent.h>
 #include <stxxl/bits/mng/disk_allocator.h>
 #include <stxxl/bits/mng/block_alloc.h>
 #include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/common/mutex.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -51,6 +55,15 @@ STXXL_BEGIN_NAMESPACE
 #define STXXL_MNG_COUNT_ALLOCATION 1
 #endif // STXXL_MNG_COUNT_ALLOCATION
 
+#ifndef STXXL_MNG_THREAD_CACHE
+#define STXXL_MNG_THREAD_CACHE 1
+#endif // STXXL_MNG_THREAD_CACHE
+
+#ifndef STXXL_MNG_THREAD_CACHE_BYTES
+//! bytes reserved at once per thread, disk and block size
+#define STXXL_MNG_THREAD_CACHE_BYTES (8 * 1024 * 1024)
+#endif // STXXL_MNG_THREAD_CACHE_BYTES
+
 //! \addtogroup mnglayer
 //! \{
 
@@ -79,6 +92,145 @@ class block_manager : public singleton<block_manager>
     uint64 m_maximum_allocation;
 #endif // STXXL_MNG_COUNT_ALLOCATION
 
+#if STXXL_MNG_THREAD_CACHE
+public:
+    //! Blocks reserved by one thread. Small allocations are served from it
+    //! and deleted blocks are put back, so threads allocating concurrently
+    //! only contend on the disk allocators when a cache runs empty or full.
+    //! Blocks are handed out in ascending address order, such that
+    //! consecutive allocations stay contiguous also after deletions.
+    struct thread_cache
+    {
+        //! owning block manager, NULL after it was destroyed
+        block_manager* bm;
+        //! free offsets per disk and block size, sorted descending, the
+        //! lowest (next) block at the back
+        std::vector<std::map<unsigned, std::vector<int64> > > blocks;
+        //! taken by the owning thread, and by other threads draining the
+        //! cache when the disks run out of space
+        stxxl::mutex mutex;
+    };
+
+    //! release and free the cache of an exiting thread
+    static void thread_cache_exit(void* ptr);
+
+private:
+    //! caches of all threads which allocated blocks
+    std::set<thread_cache*> m_thread_caches;
+
+    //! return the cache of the calling thread, creating it on first use
+    thread_cache& get_thread_cache();
+
+    //! return all blocks in tc to the disk allocators, returns whether it
+    //! held any
+    bool release_thread_cache(thread_cache& tc);
+
+    //! return the blocks cached by all threads to the disk allocators,
+    //! returns whether any were cached
+    bool drain_thread_caches();
+
+    //! number of blocks of block_size reserved at once, 0 if not cached
+    static unsigned_type thread_cache_blocks(unsigned block_size)
+    {
+        unsigned_type n = block_size ? STXXL_MNG_THREAD_CACHE_BYTES / block_size : 0;
+        return (n >= 2) ? n : 0;
+    }
+
+    template <unsigned BlockSize>
+    void cached_new_blocks(size_t disk, BIDArray<BlockSize>& bids);
+
+    template <unsigned BlockSize>
+    void cached_delete_block(size_t disk, int64 offset);
+
+    //! discard the blocks of block_size at the offsets [begin, end) and
+    //! return them to the disk allocator
+    void return_blocks(size_t disk, const int64* begin, const int64* end,
+                       unsigned block_size);
+#endif // STXXL_MNG_THREAD_CACHE
+
+    //! whether deleted blocks of block_size are put into the thread caches,
+    //! which discard them only when returning them to the disk allocators
+    static bool is_thread_cached(unsigned block_size)
+    {
+#if STXXL_MNG_THREAD_CACHE
+        return thread_cache_blocks(block_size) != 0;
+#else
+        STXXL_UNUSED(block_size);
+        return false;
+#endif // STXXL_MNG_THREAD_CACHE
+    }
+
+    //! allocate bl[i] blocks on each disk i, releasing all of them if any
+    //! disk runs out of space
+    template <unsigned BlockSize>
+    void new_disk_blocks(const simple_vector<int_type>& bl,
+                         simple_vector<BIDArray<BlockSize> >& disk_bids);
+
+    //! a block referenced by a root of the catalog
+    struct root_block
+    {
+        unsigned int disk;
+        int64 offset;
+        unsigned int size;
+
+        bool operator < (const root_block& b) const
+        {
+            return disk < b.disk || (disk == b.disk && offset < b.offset);
+        }
+    };
+
+    //! a named root: an opaque container header and the container's blocks
+    struct root_type
+    {
+        std::string header;
+        std::vector<root_block> blocks;
+        //! blocks may have been written in place since the root was set
+        bool modified;
+
+        root_type() : modified(false) { }
+    };
+
+    typedef std::map<std::string, root_type> root_map_type;
+
+    //! whether the disks are persistent and the catalog is maintained
+    bool m_persistent;
+
+    //! catalog of named roots
+    root_map_type m_roots;
+
+    //! protects m_roots and the committed catalog
+    mutable mutex m_catalog_mutex;
+
+    //! sequence number of the last committed catalog
+    uint64 m_catalog_seq;
+
+    //! offsets of the blocks on the first disk holding the committed catalog
+    std::vector<int64> m_catalog_blocks;
+
+    //! blocks referenced by the committed catalog, sorted
+    std::vector<root_block> m_committed;
+
+    //! deleted blocks still referenced by the committed catalog, they are
+    //! released after the next commit() not referencing them
+    std::vector<root_block> m_pending_free;
+
+    //! read the last committed catalog and reserve all blocks it references
+    void load_catalog();
+
+    //! commit() with m_catalog_mutex held
+    void commit_locked();
+
+    //! collect the blocks of all roots into m_committed
+    void collect_committed();
+
+    //! whether the block is referenced by the committed catalog, with
+    //! m_catalog_mutex held
+    bool is_committed_locked(int disk, int64 offset) const;
+
+    //! If the block is referenced by the committed catalog, put it on the
+    //! pending free list instead of releasing it and return true.
+    bool defer_release(int disk, int64 offset, unsigned int size);
+
 protected:
     template <class BIDType, class DiskAssignFunctor, class BIDIteratorClass>
     void new_blocks_int(
@@ -87,13 +239,39 @@ protected:
         unsigned_type offset,
         BIDIteratorClass out);
 
+    //! return the block to the thread cache, or to its disk allocator after
+    //! the caller discarded it
+    template <unsigned BLK_SIZE>
+    void release_block(const BID<BLK_SIZE>& bid);
+
+    //! a region of a disk to be discarded
+    struct discard_region
+    {
+        int disk;
+        int64 offset, size;
+
+        bool operator < (const discard_region& b) const
+        {
+            return disk < b.disk || (disk == b.disk && offset < b.offset);
+        }
+    };
+
+    //! discard the regions, merging adjacent ones of the same disk into one
+    //! call
+    void discard_regions(std::vector<discard_region>& regions);
+
 public:
     //! return total number of bytes available in all disks
     uint64 get_total_bytes() const;
 
-    //! Return total number of free disk allocations
+    //! Return total number of free disk allocations. Blocks reserved in the
+    //! caches of threads are not free.
     uint64 get_free_bytes() const;
 
+    //! Return the blocks reserved by the calling thread to the disks. This
+    //! happens automatically when the thread exits.
+    void release_thread_cache();
+
     //! Allocates new blocks.
     //!
     //! Allocates new blocks according to the strategy
@@ -152,9 +330,49 @@ public:
         new_blocks_int<BID<BLK_SIZE> >(1, functor, offset, &bid);
     }
 
+    //! Allocates new blocks like new_blocks() and returns them as extents.
+    //!
+    //! The \b nblocks blocks are distributed by \b functor and allocated
+    //! contiguously on each disk where possible. Runs of blocks which were
+    //! placed adjacently on one disk are appended to \b extents as one
+    //! extent, in the order of the blocks. With a single disk or a
+    //! single_disk strategy, one extent usually covers all blocks.
+    //! \param nblocks the number of blocks to allocate
+    //! \param functor object of model of \b allocation_strategy concept
+    //! \param extents the extents are appended to this vector
+    //! \param offset advance for \b functor to line up partial allocations
+    //!
+    //! The \c BlockType template parameter defines the type of block to allocate
+    template <class BlockType, class DiskAssignFunctor>
+    void new_extents(
+        const unsigned_type nblocks,
+        const DiskAssignFunctor& functor,
+        std::vector<bid_extent>& extents,
+        unsigned_type offset = 0)
+    {
+        typedef typename BlockType::bid_type bid_type;
+        simple_vector<bid_type> bids(nblocks);
+        new_blocks_int<bid_type>(nblocks, functor, offset, bids.begin());
+        make_extents(bids.begin(), bids.end(), extents);
+    }
+
+    //! Deallocates the blocks of BlockSize bytes in the extents
+    //! [begin, end), e.g. allocated by new_extents().
+    template <unsigned BlockSize, class ExtentIterator>
+    void delete_extents(ExtentIterator begin, ExtentIterator end)
+    {
+        for ( ; begin != end; ++begin)
+        {
+            BIDArray<BlockSize> bids(begin->template num_blocks<BlockSize>());
+            extents_to_bids<BlockSize>(begin, begin + 1, bids.begin());
+            delete_blocks(bids.begin(), bids.end());
+        }
+    }
+
     //! Deallocates blocks.
     //!
-    //! Deallocates blocks in the range [ \b bidbegin, \b bidend)
+    //! Deallocates blocks in the range [ \b bidbegin, \b bidend). Runs of
+    //! adjacent blocks on the same disk are discarded with one call.
     //! \param bidbegin iterator object of \b bid_iterator concept
     //! \param bidend iterator object of \b bid_iterator concept
     template <class BIDIteratorClass>
@@ -165,8 +383,82 @@ public:
     template <unsigned BLK_SIZE>
     void delete_block(const BID<BLK_SIZE>& bid);
 
+    //! Schedules a flush request on every disk, which completes after all
+    //! writes submitted to the disk before, and makes them durable.
+    //! \param requests the flush requests are appended to this vector
+    //! \param on_cmpl I/O completion handler called for each disk
+    void aflush(std::vector<request_ptr>& requests,
+                const completion_handler& on_cmpl = completion_handler());
+
+    //! Makes all writes submitted before durable on all disks and waits for
+    //! it, a synchronous durability point e.g. for checkpoints.
+    void flush();
+
     ~block_manager();
 
+    //! \name Catalog of Persistent Roots
+    //!
+    //! If the disks are configured as persistent, containers can be stored
+    //! under a name together with a header describing them. On startup, the
+    //! block manager reads the last committed catalog from the first disk and
+    //! marks the blocks of all roots as allocated, all other space is free.
+    //! Blocks of a root are owned by the catalog until the root is removed.
+    //!
+    //! Blocks referenced by the committed catalog are not reused before the
+    //! next commit: deleting them only puts them on a pending free list.
+    //! Their contents however are only preserved if they are not written in
+    //! place, i.e. copy-on-write as done by stxxl::vector for its pages, see
+    //! is_committed(). Otherwise only the state at the last commit() is
+    //! durable: the owner calls modify_root() before writing in place, and
+    //! after a crash get_root() refuses the root.
+    //! \{
+
+    //! return true if the disks are persistent and roots can be stored
+    bool is_persistent() const
+    { return m_persistent; }
+
+    //! Store the blocks [bidbegin, bidend) and header under name, replacing
+    //! a root of the same name. The change is durable after commit().
+    template <class BIDIteratorClass>
+    void set_root(const std::string& name, const std::string& header,
+                  BIDIteratorClass bidbegin, BIDIteratorClass bidend);
+
+    //! Retrieve header and blocks of the root name. Returns false if there is
+    //! no such root, throws std::runtime_error if the block size differs or
+    //! the root was modified in place since it was set.
+    template <class BIDContainer>
+    bool get_root(const std::string& name, std::string& header,
+                  BIDContainer& bids) const;
+
+    //! return true if a root of the given name exists
+    bool has_root(const std::string& name) const;
+
+    //! Remove the root name from the catalog. Its blocks are not freed, they
+    //! belong to the caller again.
+    bool remove_root(const std::string& name);
+
+    //! return the names of all roots
+    std::vector<std::string> get_root_names() const;
+
+    //! Announce that blocks of the root name are about to be written in
+    //! place. If the root was set unmodified, a catalog marking it modified
+    //! is committed first, so that after a crash the partially overwritten
+    //! root is detected. set_root() marks it unmodified again.
+    void modify_root(const std::string& name);
+
+    //! Return true if any of the blocks [bidbegin, bidend) is referenced by
+    //! the committed catalog. Such blocks have to be copied to new blocks
+    //! before they are changed, to keep the committed state intact.
+    template <class BIDIteratorClass>
+    bool is_committed(BIDIteratorClass bidbegin, BIDIteratorClass bidend) const;
+
+    //! Write the catalog to the first disk and make it durable together
+    //! with all writes submitted before. A crash leaves either the previous
+    //! or the new catalog.
+    void commit();
+
+    //! \}
+
 #if STXXL_MNG_COUNT_ALLOCATION
     //! return total requested allocation in bytes
     uint64 get_total_allocation() const
@@ -206,15 +498,26 @@ void block_manager::new_blocks_int(
         bl[disk]++;
     }
 
-    // allocate blocks on disks
-
     for (unsigned_type i = 0; i < ndisks; ++i)
     {
         if (bl[i])
-        {
             disk_bids[i].resize(bl[i]);
-            disk_allocators[i]->new_blocks(disk_bids[i]);
-        }
+    }
+
+    // allocate blocks on disks
+
+    try {
+        new_disk_blocks(bl, disk_bids);
+    }
+    catch (bad_ext_alloc&) {
+#if STXXL_MNG_THREAD_CACHE
+        // other threads may hold the missing space in their caches
+        if (!drain_thread_caches())
+            throw;
+        new_disk_blocks(bl, disk_bids);
+#else
+        throw;
+#endif // STXXL_MNG_THREAD_CACHE
     }
 
     bl.memzero();
@@ -235,6 +538,44 @@ void block_manager::new_blocks_int(
 #endif // STXXL_MNG_COUNT_ALLOCATION
 }
 
+template <unsigned BlockSize>
+void block_manager::new_disk_blocks(const simple_vector<int_type>& bl,
+                                    simple_vector<BIDArray<BlockSize> >& disk_bids)
+{
+    for (unsigned_type i = 0; i < ndisks; ++i)
+    {
+        if (!bl[i])
+            continue;
+
+        try {
+#if STXXL_MNG_THREAD_CACHE
+            if ((unsigned_type)bl[i] < thread_cache_blocks(BlockSize)) {
+                cached_new_blocks(i, disk_bids[i]);
+                continue;
+            }
+#endif // STXXL_MNG_THREAD_CACHE
+            disk_allocators[i]->new_blocks(disk_bids[i]);
+        }
+        catch (bad_ext_alloc&) {
+            // release the blocks already taken on the previous disks
+            for (unsigned_type j = 0; j < i; ++j)
+            {
+                for (unsigned_type k = 0; k < (unsigned_type)bl[j]; ++k)
+                {
+#if STXXL_MNG_THREAD_CACHE
+                    if ((unsigned_type)bl[j] < thread_cache_blocks(BlockSize)) {
+                        cached_delete_block<BlockSize>(j, disk_bids[j][k].offset);
+                        continue;
+                    }
+#endif // STXXL_MNG_THREAD_CACHE
+                    disk_allocators[j]->delete_block(disk_bids[j][k]);
+                }
+            }
+            throw;
+        }
+    }
+}
+
 template <unsigned BlockSize>
 void block_manager::delete_block(const BID<BlockSize>& bid)
 {
@@ -244,25 +585,197 @@ void block_manager::delete_block(const BID<BlockSize>& bid)
     }
     if (!bid.is_managed())
         return;  // self managed disk
-    STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:delete " << FMT_BID(bid));
     assert(bid.storage->get_allocator_id() >= 0);
+    if (m_persistent &&
+        defer_release(bid.storage->get_allocator_id(), bid.offset, bid.size))
+        return;
+    // discard before the region can be allocated again
+    if (!is_thread_cached(BlockSize))
+        disk_files[bid.storage->get_allocator_id()]->discard(bid.offset, bid.size);
+    release_block(bid);
+}
+
+template <unsigned BlockSize>
+void block_manager::release_block(const BID<BlockSize>& bid)
+{
+    STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:delete " << FMT_BID(bid));
+#if STXXL_MNG_THREAD_CACHE
+    if (thread_cache_blocks(BlockSize))
+        cached_delete_block<BlockSize>(bid.storage->get_allocator_id(), bid.offset);
+    else
+#endif  // STXXL_MNG_THREAD_CACHE
     disk_allocators[bid.storage->get_allocator_id()]->delete_block(bid);
-    disk_files[bid.storage->get_allocator_id()]->discard(bid.offset, bid.size);
 
 #if STXXL_MNG_COUNT_ALLOCATION
     m_current_allocation -= BlockSize;
 #endif // STXXL_MNG_COUNT_ALLOCATION
 }
 
+#if STXXL_MNG_THREAD_CACHE
+template <unsigned BlockSize>
+void block_manager::cached_new_blocks(size_t disk, BIDArray<BlockSize>& bids)
+{
+    thread_cache& tc = get_thread_cache();
+    scoped_mutex_lock lock(tc.mutex);
+    std::vector<int64>& cache = tc.blocks[disk][BlockSize];
+
+    if (cache.size() < bids.size())
+    {
+        // reserve a contiguous batch
+        BIDArray<BlockSize> batch(thread_cache_blocks(BlockSize));
+        try {
+            disk_allocators[disk]->new_blocks(batch);
+        }
+        catch (bad_ext_alloc&) {
+            // too little space left to reserve ahead
+            disk_allocators[disk]->new_blocks(bids);
+            return;
+        }
+        for (size_t j = 0; j < batch.size(); ++j)
+            cache.push_back(batch[j].offset);
+        std::sort(cache.begin(), cache.end(), std::greater<int64>());
+    }
+
+    for (size_t j = 0; j < bids.size(); ++j) {
+        bids[j].offset = cache.back();
+        cache.pop_back();
+    }
+}
+
+template <unsigned BlockSize>
+void block_manager::cached_delete_block(size_t disk, int64 offset)
+{
+    thread_cache& tc = get_thread_cache();
+    scoped_mutex_lock lock(tc.mutex);
+    std::vector<int64>& cache = tc.blocks[disk][BlockSize];
+
+    cache.insert(std::lower_bound(cache.begin(), cache.end(), offset,
+                                  std::greater<int64>()), offset);
+
+    // return the blocks at the highest addresses
+    const size_t batch = thread_cache_blocks(BlockSize);
+    if (cache.size() > 2 * batch) {
+        return_blocks(disk, &cache[0], &cache[0] + batch, BlockSize);
+        cache.erase(cache.begin(), cache.begin() + batch);
+    }
+}
+#endif // STXXL_MNG_THREAD_CACHE
+
 template <class BIDIteratorClass>
 void block_manager::delete_blocks(
     const BIDIteratorClass& bidbegin,
     const BIDIteratorClass& bidend)
 {
+    typedef typename std::iterator_traits<BIDIteratorClass>::value_type bid_type;
+
+    // discard the blocks before any of the regions can be allocated again,
+    // also merging adjacent blocks of striped or interleaved BIDs. Blocks put
+    // into the thread cache are discarded when they leave it.
+    const bool cached = is_thread_cached(bid_type::t_size);
+    std::vector<discard_region> regions;
+    std::vector<bid_type> released;
     for (BIDIteratorClass it = bidbegin; it != bidend; it++)
     {
-        delete_block(*it);
+        if (!it->valid() || !it->is_managed())
+            continue;
+
+        discard_region r;
+        r.disk = it->storage->get_allocator_id();
+        r.offset = it->offset;
+        r.size = it->size;
+
+        if (m_persistent && defer_release(r.disk, r.offset, it->size))
+            continue;
+
+        if (!cached)
+            regions.push_back(r);
+        released.push_back(*it);
+    }
+    discard_regions(regions);
+
+    for (size_t i = 0; i < released.size(); ++i)
+        release_block(released[i]);
+}
+
+template <class BIDIteratorClass>
+void block_manager::set_root(const std::string& name, const std::string& header,
+                             BIDIteratorClass bidbegin, BIDIteratorClass bidend)
+{
+    if (!m_persistent)
+        STXXL_THROW(std::runtime_error,
+                    "block_manager::set_root(): the disks are not persistent.");
+
+    root_type root;
+    root.header = header;
+    root.blocks.reserve(std::distance(bidbegin, bidend));
+
+    for (BIDIteratorClass it = bidbegin; it != bidend; ++it)
+    {
+        if (!it->valid() || !it->is_managed())
+            STXXL_THROW(std::runtime_error,
+                        "block_manager::set_root(): block is not managed.");
+
+        root_block b;
+        b.disk = it->storage->get_allocator_id();
+        b.offset = it->offset;
+        b.size = it->size;
+        root.blocks.push_back(b);
+    }
+
+    scoped_mutex_lock lock(m_catalog_mutex);
+    std::swap(m_roots[name], root);
+}
+
+template <class BIDContainer>
+bool block_manager::get_root(const std::string& name, std::string& header,
+                             BIDContainer& bids) const
+{
+    scoped_mutex_lock lock(m_catalog_mutex);
+
+    root_map_type::const_iterator it = m_roots.find(name);
+    if (it == m_roots.end())
+        return false;
+
+    const root_type& root = it->second;
+
+    if (root.modified)
+        STXXL_THROW(std::runtime_error,
+                    "block_manager::get_root(): root '" << name <<
+                    "' was written in place after its last commit, e.g. by a "
+                    "program that crashed, its contents are undefined.");
+
+    header = root.header;
+    bids.resize(root.blocks.size());
+    for (size_t i = 0; i < root.blocks.size(); ++i)
+    {
+        if (root.blocks[i].size != bids[i].size)
+            STXXL_THROW(std::runtime_error,
+                        "block_manager::get_root(): root '" << name <<
+                        "' has blocks of " << root.blocks[i].size << " bytes.");
+
+        bids[i].storage = disk_files[root.blocks[i].disk];
+        bids[i].offset = root.blocks[i].offset;
+    }
+
+    return true;
+}
+
+template <class BIDIteratorClass>
+bool block_manager::is_committed(BIDIteratorClass bidbegin,
+                                 BIDIteratorClass bidend) const
+{
+    if (!m_persistent)
+        return false;
+
+    scoped_mutex_lock lock(m_catalog_mutex);
+
+    for (BIDIteratorClass it = bidbegin; it != bidend; ++it)
+    {
+        if (it->valid() && it->is_managed() &&
+            is_committed_locked(it->storage->get_allocator_id(), it->offset))
+            return true;
     }
+    return false;
 }
 
 // in bytes
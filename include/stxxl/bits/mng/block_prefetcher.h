@@ -15,14 +15,24 @@
 #ifndef STXXL_MNG_BLOCK_PREFETCHER_HEADER
 #define STXXL_MNG_BLOCK_PREFETCHER_HEADER
 
+#include <algorithm>
 #include <vector>
 #include <queue>
+#include <cmath>
 
 #include <stxxl/bits/common/onoff_switch.h>
+#include <stxxl/bits/common/timer.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/noncopyable.h>
 
+#ifndef STXXL_PREFETCH_ADAPTIVE
+//! Default of the adaptive prefetch depth in buf_istream and
+//! buf_istream_reverse, define to 1 to enable it for all scans.
+#define STXXL_PREFETCH_ADAPTIVE 0
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 //! \addtogroup schedlayer
@@ -32,14 +42,19 @@ class set_switch_handler
 {
     onoff_switch& switch_;
     completion_handler on_compl;
+    double* finished;
 
 public:
-    set_switch_handler(onoff_switch& _switch, const completion_handler& on_compl)
-        : switch_(_switch), on_compl(on_compl)
+    set_switch_handler(onoff_switch& _switch, const completion_handler& on_compl,
+                       double* finished = NULL)
+        : switch_(_switch), on_compl(on_compl), finished(finished)
     { }
 
     void operator () (request* req)
     {
+        // record the completion time before waking up the waiter
+        if (finished)
+            *finished = timestamp();
         // call before setting switch to on, otherwise, user has no way to wait
         // for the completion handler to be executed
         on_compl(req);
@@ -51,6 +66,13 @@ public:
 //!
 //! \c block_prefetcher overlaps I/Os with consumption of read data.
 //! Utilizes optimal asynchronous prefetch scheduling (by Peter Sanders et.al.)
+//!
+//! In adaptive mode, the number of prefetch buffers is only the memory budget.
+//! The prefetcher measures the completion latency of its reads and the time
+//! the consumer spends on each block, and keeps about latency / consumption
+//! time + 1 reads in flight (Little's law), at least one per disk. Buffers are
+//! allocated when the depth grows and freed when it shrinks. Otherwise all
+//! buffers are allocated at once in one array.
 template <typename BlockType, typename BidIteratorType>
 class block_prefetcher : private noncopyable
 {
@@ -70,9 +92,13 @@ protected:
     unsigned_type nextread;
     unsigned_type nextconsume;
 
+    //! maximum number of read buffers
     const int_type nreadblocks;
 
-    block_type* read_buffers;
+    //! the read buffers if not adaptive
+    block_type* buffer_array;
+    //! read buffers, NULL if currently not allocated
+    block_type** read_buffers;
     request_ptr* read_reqs;
     bid_type* read_bids;
 
@@ -81,8 +107,114 @@ protected:
 
     completion_handler do_after_fetch;
 
+    //! indexes of unallocated read buffers, adaptive mode only
+    std::vector<int_type> free_buffers;
+
+    //! adapt the number of in-flight reads
+    const bool adaptive;
+    //! lower bound of the depth in adaptive mode
+    int_type min_depth;
+    //! number of buffers aimed at
+    int_type depth;
+    //! number of allocated buffers
+    int_type nbuffers;
+
+    //! issue and completion times of the reads, adaptive mode only
+    double* read_issued;
+    double* read_finished;
+    //! moving averages of the read latency and the consumption time per block
+    double read_latency;
+    double consume_time;
+    //! time the last block was handed to the consumer
+    double last_return;
+
+    //! update a moving average with a new sample
+    static void add_sample(double& avg, double sample)
+    {
+        avg = (avg < 0.0) ? sample : avg + (sample - avg) / 8.0;
+    }
+
+    //! allocate an unused buffer, returns its index
+    int_type add_buffer()
+    {
+        assert(!free_buffers.empty());
+        int_type ibuffer = free_buffers.back();
+        free_buffers.pop_back();
+        read_buffers[ibuffer] = new block_type;
+        ++nbuffers;
+        return ibuffer;
+    }
+
+    //! free a buffer returned by the consumer
+    void remove_buffer(int_type ibuffer)
+    {
+        delete read_buffers[ibuffer];
+        read_buffers[ibuffer] = NULL;
+        free_buffers.push_back(ibuffer);
+        --nbuffers;
+    }
+
+    //! index of a buffer handed out to the consumer
+    int_type buffer_number(block_type* buffer) const
+    {
+        if (!adaptive)
+            return buffer - buffer_array;
+        return std::find(read_buffers, read_buffers + nreadblocks, buffer) - read_buffers;
+    }
+
+    //! read the next block of the prefetch sequence into buffer ibuffer
+    void issue_read(int_type ibuffer)
+    {
+        assert(ibuffer >= 0 && ibuffer < nreadblocks);
+        int_type next_2_prefetch = prefetch_seq[nextread++];
+        STXXL_VERBOSE1("block_prefetcher: prefetching block " << next_2_prefetch);
+
+        assert((next_2_prefetch < int_type(seq_length)) && (next_2_prefetch >= 0));
+        assert(!completed[next_2_prefetch].is_on());
+
+        pref_buffer[next_2_prefetch] = ibuffer;
+        read_bids[ibuffer] = *(consume_seq_begin + next_2_prefetch);
+        STXXL_VERBOSE1("block_prefetcher: reading block " << next_2_prefetch <<
+                       " @ " << read_buffers[ibuffer] <<
+                       " @ " << read_bids[ibuffer]);
+        if (adaptive)
+            read_issued[ibuffer] = timestamp();
+        read_reqs[ibuffer] = read_buffers[ibuffer]->read(
+            read_bids[ibuffer],
+            set_switch_handler(*(completed + next_2_prefetch), do_after_fetch,
+                               adaptive ? read_finished + ibuffer : NULL)
+            );
+    }
+
+    //! recompute the depth from the measured latency and consumption time
+    void adapt_depth()
+    {
+        add_sample(consume_time, timestamp() - last_return);
+        if (read_latency < 0.0)
+            return;
+
+        int_type target = nreadblocks;
+        if (consume_time > 0.0 && read_latency / consume_time < double(nreadblocks))
+            target = int_type(std::ceil(read_latency / consume_time)) + 1;
+        target = STXXL_MAX(min_depth, STXXL_MIN(target, nreadblocks));
+
+        if (target != depth)
+            STXXL_VERBOSE1("block_prefetcher: depth " << depth << " -> " << target <<
+                           " latency=" << read_latency << " consume=" << consume_time);
+        depth = target;
+    }
+
     block_type * wait(int_type iblock)
     {
+        // a smaller depth than the prefetch schedule was computed for may
+        // leave the block unscheduled, then more buffers are needed.
+        while (pref_buffer[iblock] < 0)
+        {
+            assert(adaptive && nbuffers < nreadblocks);
+            issue_read(add_buffer());
+            depth = STXXL_MAX(depth, nbuffers);
+        }
+
         STXXL_VERBOSE1("block_prefetcher: waiting block " << iblock);
         {
             stats::scoped_wait_timer wait_timer(stats::WAIT_OP_READ);
@@ -93,7 +225,12 @@ protected:
         int_type ibuffer = pref_buffer[iblock];
         STXXL_VERBOSE1("block_prefetcher: returning buffer " << ibuffer);
         assert(ibuffer >= 0 && ibuffer < nreadblocks);
-        return (read_buffers + ibuffer);
+        if (adaptive)
+        {
+            add_sample(read_latency, read_finished[ibuffer] - read_issued[ibuffer]);
+            last_return = timestamp();
+        }
+        return read_buffers[ibuffer];
     }
 
 public:
@@ -102,50 +239,74 @@ public:
     //! \param _cons_end \c bid_iterator pointing to the \c bid of the ( \b last + 1 ) block of consumption sequence
     //! \param _pref_seq gives the prefetch order, is a pointer to the integer array that contains
     //!        the indices of the blocks in the consumption sequence
-    //! \param _prefetch_buf_size amount of prefetch buffers to use
+    //! \param _prefetch_buf_size amount of prefetch buffers to use, the
+    //!        maximum in adaptive mode
     //! \param do_after_fetch unknown
+    //! \param _adaptive adapt the number of in-flight reads to the observed
+    //!        read latency and consumption time
     block_prefetcher(
         bid_iterator_type _cons_begin,
         bid_iterator_type _cons_end,
         int_type* _pref_seq,
         int_type _prefetch_buf_size,
-        completion_handler do_after_fetch = completion_handler())
+        completion_handler do_after_fetch = completion_handler(),
+        bool _adaptive = false)
         : consume_seq_begin(_cons_begin),
           consume_seq_end(_cons_end),
           seq_length(_cons_end - _cons_begin),
           prefetch_seq(_pref_seq),
-          nextread(STXXL_MIN(unsigned_type(_prefetch_buf_size), seq_length)),
+          nextread(0),
           nextconsume(0),
-          nreadblocks(nextread),
-          do_after_fetch(do_after_fetch)
+          nreadblocks(STXXL_MIN(unsigned_type(_prefetch_buf_size), seq_length)),
+          buffer_array(NULL),
+          do_after_fetch(do_after_fetch),
+          adaptive(_adaptive),
+          min_depth(nreadblocks),
+          depth(nreadblocks),
+          nbuffers(0),
+          read_issued(NULL),
+          read_finished(NULL),
+          read_latency(-1.0),
+          consume_time(-1.0),
+          last_return(0.0)
     {
         STXXL_VERBOSE1("block_prefetcher: seq_length=" << seq_length);
         STXXL_VERBOSE1("block_prefetcher: _prefetch_buf_size=" << _prefetch_buf_size);
         assert(seq_length > 0);
         assert(_prefetch_buf_size > 0);
-        int_type i;
-        read_buffers = new block_type[nreadblocks];
+        read_buffers = new block_type*[nreadblocks];
         read_reqs = new request_ptr[nreadblocks];
         read_bids = new bid_type[nreadblocks];
         pref_buffer = new int_type[seq_length];
 
+        std::fill(read_buffers, read_buffers + nreadblocks, (block_type*)NULL);
         std::fill(pref_buffer, pref_buffer + seq_length, -1);
 
         completed = new onoff_switch[seq_length];
 
-        for (i = 0; i < nreadblocks; ++i)
+        if (adaptive)
+        {
+            // start with two reads per disk, keep at least one
+            const int_type ndisks = config::get_instance()->disks_number();
+            min_depth = STXXL_MIN(nreadblocks, ndisks);
+            depth = STXXL_MIN(nreadblocks, 2 * ndisks);
+            read_issued = new double[nreadblocks];
+            read_finished = new double[nreadblocks];
+
+            for (int_type i = nreadblocks; i > 0; )
+                free_buffers.push_back(--i);
+
+            while (nbuffers < depth)
+                issue_read(add_buffer());
+        }
+        else
         {
-            assert(prefetch_seq[i] < int_type(seq_length));
-            assert(prefetch_seq[i] >= 0);
-            read_bids[i] = *(consume_seq_begin + prefetch_seq[i]);
-            STXXL_VERBOSE1("block_prefetcher: reading block " << i <<
-                           " prefetch_seq[" << i << "]=" << prefetch_seq[i] <<
-                           " @ " << &read_buffers[i] <<
-                           " @ " << read_bids[i]);
-            read_reqs[i] = read_buffers[i].read(
-                read_bids[i],
-                set_switch_handler(*(completed + prefetch_seq[i]), do_after_fetch));
-            pref_buffer[prefetch_seq[i]] = i;
+            buffer_array = new block_type[nreadblocks];
+            for (nbuffers = 0; nbuffers < nreadblocks; ++nbuffers)
+            {
+                read_buffers[nbuffers] = buffer_array + nbuffers;
+                issue_read(nbuffers);
+            }
         }
     }
     //! Pulls next unconsumed block from the consumption sequence.
@@ -162,28 +323,29 @@ public:
     //! \return \c false if there are no blocks to prefetch left, \c true if consumption sequence is not emptied
     bool block_consumed(block_type*& buffer)
     {
-        int_type ibuffer = buffer - read_buffers;
+        int_type ibuffer = buffer_number(buffer);
+        assert(ibuffer >= 0 && ibuffer < nreadblocks);
         STXXL_VERBOSE1("block_prefetcher: buffer " << ibuffer << " consumed");
         if (read_reqs[ibuffer].valid())
             read_reqs[ibuffer]->wait();
 
         read_reqs[ibuffer] = NULL;
 
-        if (nextread < seq_length)
+        if (adaptive)
+        {
+            adapt_depth();
+
+            if (nbuffers > depth || nextread >= seq_length)
+                remove_buffer(ibuffer);
+            else
+                issue_read(ibuffer);
+
+            while (nbuffers < depth && nextread < seq_length)
+                issue_read(add_buffer());
+        }
+        else if (nextread < seq_length)
         {
-            assert(ibuffer >= 0 && ibuffer < nreadblocks);
-            int_type next_2_prefetch = prefetch_seq[nextread++];
-            STXXL_VERBOSE1("block_prefetcher: prefetching block " << next_2_prefetch);
-
-            assert((next_2_prefetch < int_type(seq_length)) && (next_2_prefetch >= 0));
-            assert(!completed[next_2_prefetch].is_on());
-
-            pref_buffer[next_2_prefetch] = ibuffer;
-            read_bids[ibuffer] = *(consume_seq_begin + next_2_prefetch);
-            read_reqs[ibuffer] = read_buffers[ibuffer].read(
-                read_bids[ibuffer],
-                set_switch_handler(*(completed + next_2_prefetch), do_after_fetch)
-                );
+            issue_read(ibuffer);
         }
 
         if (nextconsume >= seq_length)
@@ -207,6 +369,32 @@ public:
         return nextconsume;
     }
 
+    //! Number of allocated read buffers, the prefetch depth chosen in adaptive
+    //! mode.
+    int_type prefetch_depth() const
+    {
+        return nbuffers;
+    }
+
+    //! Maximum number of buffers, the memory budget of adaptive mode.
+    int_type max_prefetch_depth() const
+    {
+        return nreadblocks;
+    }
+
+    //! Moving average of the read latency in seconds, adaptive mode only.
+    double get_read_latency() const
+    {
+        return read_latency;
+    }
+
+    //! Moving average of the consumer's time per block in seconds, adaptive
+    //! mode only.
+    double get_consume_time() const
+    {
+        return consume_time;
+    }
+
     //! Frees used memory.
     ~block_prefetcher()
     {
@@ -214,11 +402,20 @@ public:
             if (read_reqs[i].valid())
                 read_reqs[i]->wait();
 
+        if (adaptive)
+        {
+            for (int_type i = 0; i < nreadblocks; ++i)
+                delete read_buffers[i];
+        }
+        delete[] buffer_array;
+
         delete[] read_reqs;
         delete[] read_bids;
         delete[] completed;
         delete[] pref_buffer;
         delete[] read_buffers;
+        delete[] read_issued;
+        delete[] read_finished;
     }
 };
 
@@ -20,6 +20,11 @@
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/common/addressable_queues.h>
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/exceptions.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/parallel.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -51,7 +56,15 @@ protected:
     static unsigned_type disk_allocation_offset;
 
     void get_external_block()
-    { block_manager::get_instance()->new_block(striping(), external_data, ++disk_allocation_offset); }
+    {
+        unsigned_type offset;
+        // blocks may be evicted by several threads at once
+#if STXXL_PARALLEL
+#pragma omp atomic capture
+#endif
+        offset = ++disk_allocation_offset;
+        block_manager::get_instance()->new_block(striping(), external_data, offset);
+    }
 
     void free_external_block()
     {
@@ -245,6 +258,12 @@ class block_scheduler_algorithm_online_lru;
 //! This will only work for algorithms with deterministic, data oblivious access patterns.
 //! In simulation mode, no I/O is performed; the data provided is accessible but undefined.
 //! In execute mode, it does caching, prefetching, and possibly other optimizations.
+//!
+//! In simple mode, acquire, release, deinitialize, initialize,
+//! extract_external_block and is_initialized may be called concurrently by
+//! several threads, see is_thread_safe(). Allocating and freeing
+//! swappable_blocks, flushing and switching the algorithm have to be done
+//! while no other thread uses the scheduler.
 //! \tparam SwappableBlockType Type of swappable_blocks to manage. Can be some specialized subclass.
 template <class SwappableBlockType>
 class block_scheduler : private noncopyable
@@ -302,6 +321,8 @@ protected:
     friend class block_scheduler_algorithm;
 
     const int_type max_internal_blocks;
+    //! protects remaining_internal_blocks, internal_blocks_blocks and free_internal_blocks
+    mutex free_internal_blocks_mutex;
     int_type remaining_internal_blocks;
     //! Stores pointers to arrays of internal_blocks. Used to deallocate them only.
     std::stack<internal_block_type*> internal_blocks_blocks;
@@ -319,6 +340,7 @@ protected:
     //! \return Pointer to the internal_block. NULL if none available.
     internal_block_type * get_free_internal_block()
     {
+        scoped_mutex_lock lock(free_internal_blocks_mutex);
         if (! free_internal_blocks.empty())
         {
             // => there are internal_blocks in the free-list
@@ -346,7 +368,10 @@ protected:
 
     //! Return an internal_block to the freelist.
     void return_free_internal_block(internal_block_type* iblock)
-    { free_internal_blocks.push(iblock); }
+    {
+        scoped_mutex_lock lock(free_internal_blocks_mutex);
+        free_internal_blocks.push(iblock);
+    }
 
 public:
     //! Create a block_scheduler with empty prediction sequence in simple mode.
@@ -472,6 +497,14 @@ public:
     bool is_simulating() const
     { return algo->is_simulating(); }
 
+    //! Returns if the current algorithm serves acquire and release from several threads at once.
+    bool is_thread_safe() const
+    { return algo->is_thread_safe(); }
+
+    //! Returns the number of internal_blocks the scheduler may use at most.
+    int_type get_max_internal_blocks() const
+    { return max_internal_blocks; }
+
     //! Switch the used algorithm, e.g. to simulation etc..
     //! \param new_algo Pointer to the new algorithm object. Has to be instantiated to the block scheduler (or the old algorithm object).
     //! \return Pointer to the old algorithm object.
@@ -497,6 +530,7 @@ public:
     void flush()
     {
         std::vector<request_ptr> requests;
+        algo->complete_io();
         while (! algo->evictable_blocks_empty())
         {
             swappable_block_identifier_type sbid = algo->evictable_blocks_pop();
@@ -548,18 +582,31 @@ protected:
     { bs.return_free_internal_block(iblock); }
 
 public:
+    //! The new algorithm takes over the evictable blocks of the current one,
+    //! whose I/O is completed first.
     block_scheduler_algorithm(block_scheduler_type& bs)
         : bs(bs),
           swappable_blocks(bs.swappable_blocks)
-    { }
+    {
+        if (bs.algo)
+            bs.algo->complete_io();
+    }
 
     block_scheduler_algorithm(block_scheduler_algorithm* old)
         : bs(old->bs),
           swappable_blocks(bs.swappable_blocks)
-    { }
+    {
+        if (bs.algo)
+            bs.algo->complete_io();
+    }
 
     virtual ~block_scheduler_algorithm() { }
 
+    //! Complete the asynchronous I/O started by the algorithm on its own, such
+    //! that all blocks not acquired are evictable. Called before the
+    //! evictable blocks are flushed or taken over by another algorithm.
+    virtual void complete_io() { }
+
     virtual bool evictable_blocks_empty() = 0;
     virtual swappable_block_identifier_type evictable_blocks_pop() = 0;
     virtual void swappable_blocks_resize(swappable_block_identifier_type /*size*/) { }
@@ -576,11 +623,22 @@ public:
     virtual void explicit_timestep() { }
     virtual bool is_simulating() const
     { return false; }
+    virtual bool is_thread_safe() const
+    { return false; }
     virtual const prediction_sequence_type & get_prediction_sequence() const
     { return prediction_sequence; }
 };
 
 //! Block scheduling algorithm caching via the least recently used policy (online).
+//!
+//! Acquire and release may be called concurrently by several threads. The
+//! swappable_blocks are distributed over shards by their identifier, each
+//! shard has its own lock and its own queue of evictable blocks. Free
+//! internal_blocks are taken from the victim's shard first, then from the
+//! other shards round-robin, so the eviction order is least recently used per
+//! shard. Reading and writing blocks is done without holding a lock; a block
+//! under I/O is marked busy and other threads requesting it wait for the I/O
+//! to complete.
 template <class SwappableBlockType>
 class block_scheduler_algorithm_online_lru : public block_scheduler_algorithm<SwappableBlockType>
 {
@@ -597,134 +655,317 @@ protected:
     using block_scheduler_algorithm_type::get_free_internal_block_from_block_scheduler;
     using block_scheduler_algorithm_type::return_free_internal_block_to_block_scheduler;
 
-    //! Holds swappable blocks, whose internal block can be freed, i.e. that are internal but unacquired.
-    addressable_fifo_queue<swappable_block_identifier_type> evictable_blocks;
+    //! Lock and evictable blocks of the swappable_blocks with identifiers equal modulo the number of shards.
+    struct shard
+    {
+        mutex mtx;
+        //! signaled when a block of the shard is no longer busy.
+        condition_variable cond;
+        //! Holds swappable blocks, whose internal block can be freed, i.e. that are internal but unacquired.
+        addressable_fifo_queue<swappable_block_identifier_type> evictable_blocks;
+    };
 
-    internal_block_type * get_free_internal_block()
+    mutable simple_vector<shard> shards;
+    //! Marks swappable blocks that are read or written by some thread, guarded by the lock of their shard.
+    std::vector<unsigned char> busy;
+
+    //! Threads waiting for an internal_block to become free or evictable.
+    int_type num_waiting;
+    //! Counts the internal_blocks that became free or evictable while threads were waiting.
+    int_type memory_epoch;
+    mutex memory_mutex;
+    condition_variable memory_cond;
+
+    static unsigned_type default_num_shards()
+    {
+#if STXXL_PARALLEL
+        const int threads = omp_get_max_threads();
+        return (threads > 1) ? 4 * threads : 1;
+#else
+        return 1;
+#endif
+    }
+
+    shard & get_shard(const swappable_block_identifier_type sbid) const
+    { return shards[sbid % shards.size()]; }
+
+    //! Wait until no other thread does I/O on the block. Expects the lock of its shard.
+    void wait_not_busy(const swappable_block_identifier_type sbid, scoped_mutex_lock& lock) const
+    {
+        shard& s = get_shard(sbid);
+        while (busy[sbid])
+            s.cond.wait(lock);
+    }
+
+    //! Wake up threads waiting in get_free_internal_block().
+    void notify_memory()
+    {
+#if STXXL_PARALLEL
+        int_type waiting;
+#pragma omp atomic read
+        waiting = num_waiting;
+        if (waiting == 0)
+            return;
+        scoped_mutex_lock lock(memory_mutex);
+        ++memory_epoch;
+        memory_cond.notify_all();
+#endif
+    }
+
+    //! Evict the least recently used block of one of the shards, starting at start_shard.
+    //! \return Pointer to the freed internal_block. NULL if no block is evictable.
+    internal_block_type * evict_block(const unsigned_type start_shard)
+    {
+        for (unsigned_type i = 0; i < shards.size(); ++i)
+        {
+            shard& s = shards[(start_shard + i) % shards.size()];
+            swappable_block_identifier_type victim;
+            {
+                scoped_mutex_lock lock(s.mtx);
+                if (s.evictable_blocks.empty())
+                    continue;
+                victim = s.evictable_blocks.pop();
+                busy[victim] = true;
+            }
+            // write back without holding the lock
+            internal_block_type* iblock = swappable_blocks[victim].detach_internal_block();
+            {
+                scoped_mutex_lock lock(s.mtx);
+                busy[victim] = false;
+                s.cond.notify_all();
+            }
+            return iblock;
+        }
+        return NULL;
+    }
+
+    internal_block_type * get_free_internal_block(const swappable_block_identifier_type sbid)
     {
         // try to get a free internal_block
         if (internal_block_type* iblock = get_free_internal_block_from_block_scheduler())
             return iblock;
         // evict block
-        assert(! evictable_blocks.empty()); // fails it there is not enough memory available
-        return swappable_blocks[evictable_blocks.pop()].detach_internal_block();
+        if (internal_block_type* iblock = evict_block(sbid % shards.size()))
+            return iblock;
+#if STXXL_PARALLEL
+        if (omp_in_parallel())
+        {
+            // all internal_blocks are acquired, wait for other threads to
+            // release some
+            int_type epoch;
+            {
+                scoped_mutex_lock lock(memory_mutex);
+#pragma omp atomic
+                ++num_waiting;
+                epoch = memory_epoch;
+            }
+            internal_block_type* iblock;
+            while (! (iblock = get_free_internal_block_from_block_scheduler())
+                   && ! (iblock = evict_block(sbid % shards.size())))
+            {
+                scoped_mutex_lock lock(memory_mutex);
+                while (epoch == memory_epoch)
+                    memory_cond.wait(lock);
+                epoch = memory_epoch;
+            }
+            {
+                scoped_mutex_lock lock(memory_mutex);
+#pragma omp atomic
+                --num_waiting;
+            }
+            return iblock;
+        }
+#endif
+        // fails if there is not enough memory available
+        STXXL_THROW(resource_error, "block_scheduler: all internal blocks are acquired, not enough internal memory.");
     }
 
     void return_free_internal_block(internal_block_type* iblock)
-    { return_free_internal_block_to_block_scheduler(iblock); }
+    {
+        return_free_internal_block_to_block_scheduler(iblock);
+        notify_memory();
+    }
 
     void init()
     {
+        busy.resize(swappable_blocks.size(), 0);
         if (get_algorithm_from_block_scheduler())
             while (! get_algorithm_from_block_scheduler()->evictable_blocks_empty())
-                evictable_blocks.insert(get_algorithm_from_block_scheduler()->evictable_blocks_pop());
+            {
+                const swappable_block_identifier_type sbid = get_algorithm_from_block_scheduler()->evictable_blocks_pop();
+                get_shard(sbid).evictable_blocks.insert(sbid);
+            }
     }
 
 public:
     block_scheduler_algorithm_online_lru(block_scheduler_type& bs)
-        : block_scheduler_algorithm_type(bs)
+        : block_scheduler_algorithm_type(bs),
+          shards(default_num_shards()),
+          num_waiting(0), memory_epoch(0)
     { init(); }
 
     block_scheduler_algorithm_online_lru(block_scheduler_algorithm_type* old)
-        : block_scheduler_algorithm_type(old)
+        : block_scheduler_algorithm_type(old),
+          shards(default_num_shards()),
+          num_waiting(0), memory_epoch(0)
     { init(); }
 
     virtual ~block_scheduler_algorithm_online_lru()
     {
-        if (! evictable_blocks.empty())
+        if (! evictable_blocks_empty())
             STXXL_ERRMSG("Destructing block_scheduler_algorithm_online that still holds evictable blocks. They get deinitialized.");
-        while (! evictable_blocks.empty())
+        while (! evictable_blocks_empty())
         {
-            SwappableBlockType& sblock = swappable_blocks[evictable_blocks.pop()];
+            SwappableBlockType& sblock = swappable_blocks[evictable_blocks_pop()];
             if (internal_block_type* iblock = sblock.deinitialize())
                 return_free_internal_block(iblock);
         }
     }
 
     virtual bool evictable_blocks_empty()
-    { return evictable_blocks.empty(); }
+    {
+        for (unsigned_type i = 0; i < shards.size(); ++i)
+            if (! shards[i].evictable_blocks.empty())
+                return false;
+        return true;
+    }
 
     virtual swappable_block_identifier_type evictable_blocks_pop()
-    { return evictable_blocks.pop(); }
+    {
+        for (unsigned_type i = 0; i < shards.size(); ++i)
+            if (! shards[i].evictable_blocks.empty())
+                return shards[i].evictable_blocks.pop();
+        assert(false);
+        return 0;
+    }
+
+    virtual void swappable_blocks_resize(swappable_block_identifier_type size)
+    { busy.resize(size, 0); }
 
     virtual internal_block_type & acquire(const swappable_block_identifier_type sbid, const bool uninitialized = false)
     {
         SwappableBlockType& sblock = swappable_blocks[sbid];
+        shard& s = get_shard(sbid);
         /* acquired => internal -> increase reference count
            internal but not acquired -> remove from evictable_blocks, increase reference count
            not internal => uninitialized or external -> get internal_block, increase reference count
            uninitialized -> fill with default value
            external -> read */
-        if (sblock.is_internal())
+        bool initialized;
         {
-            if (! sblock.is_acquired())
-                // not acquired yet -> remove from evictable_blocks
-                evictable_blocks.erase(sbid);
-            sblock.acquire();
+            scoped_mutex_lock lock(s.mtx);
+            wait_not_busy(sbid, lock);
+            if (sblock.is_internal())
+            {
+                if (! sblock.is_acquired())
+                    // not acquired yet -> remove from evictable_blocks
+                    s.evictable_blocks.erase(sbid);
+                return sblock.acquire();
+            }
+            // load the block without holding the lock
+            busy[sbid] = true;
+            initialized = sblock.is_initialized();
         }
-        else if (sblock.is_initialized())
+        //get internal_block
+        sblock.attach_internal_block(get_free_internal_block(sbid));
+        sblock.acquire();
+        if (initialized)
         {
             // => external but not internal
-            //get internal_block
-            sblock.attach_internal_block(get_free_internal_block());
             if (! uninitialized)
                 //load block synchronously
                 sblock.read_sync();
-            sblock.acquire();
         }
         else
         {
             // => ! sblock.is_initialized()
-            //get internal_block
-            sblock.attach_internal_block(get_free_internal_block());
-            sblock.acquire();
             //initialize new block
             if (! uninitialized)
                 sblock.fill_default();
         }
+        scoped_mutex_lock lock(s.mtx);
+        busy[sbid] = false;
+        s.cond.notify_all();
         return sblock.get_internal_block();
     }
 
     virtual void release(swappable_block_identifier_type sbid, const bool dirty)
     {
         SwappableBlockType& sblock = swappable_blocks[sbid];
-        sblock.make_dirty_if(dirty);
-        sblock.release();
-        if (! sblock.is_acquired())
+        shard& s = get_shard(sbid);
+        internal_block_type* iblock = NULL;
         {
+            scoped_mutex_lock lock(s.mtx);
+            sblock.make_dirty_if(dirty);
+            sblock.release();
+            if (sblock.is_acquired())
+                return;
             if (sblock.is_dirty() || sblock.is_external())
                 // => evictable, put in pq
-                evictable_blocks.insert(sbid);
+                s.evictable_blocks.insert(sbid);
             else
                 // => uninitialized, release internal block and put it in freelist
-                return_free_internal_block(sblock.detach_internal_block());
+                iblock = sblock.detach_internal_block();
         }
+        if (iblock)
+            return_free_internal_block(iblock);
+        else
+            notify_memory();
     }
 
     virtual void deinitialize(swappable_block_identifier_type sbid)
     {
         SwappableBlockType& sblock = swappable_blocks[sbid];
-        if (sblock.is_evictable())
-            evictable_blocks.erase(sbid);
-        if (internal_block_type* iblock = sblock.deinitialize())
+        shard& s = get_shard(sbid);
+        internal_block_type* iblock;
+        {
+            scoped_mutex_lock lock(s.mtx);
+            wait_not_busy(sbid, lock);
+            if (sblock.is_evictable())
+                s.evictable_blocks.erase(sbid);
+            iblock = sblock.deinitialize();
+        }
+        if (iblock)
             return_free_internal_block(iblock);
     }
 
     virtual void initialize(swappable_block_identifier_type sbid, external_block_type eblock)
     {
         SwappableBlockType& sblock = swappable_blocks[sbid];
+        scoped_mutex_lock lock(get_shard(sbid).mtx);
+        wait_not_busy(sbid, lock);
         sblock.initialize(eblock);
     }
 
     virtual external_block_type extract_external_block(swappable_block_identifier_type sbid)
     {
         SwappableBlockType& sblock = swappable_blocks[sbid];
-        if (sblock.is_evictable())
-            evictable_blocks.erase(sbid);
-        if (sblock.is_internal())
-            return_free_internal_block(sblock.detach_internal_block());
-        return sblock.extract_external_block();
+        shard& s = get_shard(sbid);
+        internal_block_type* iblock = NULL;
+        external_block_type eblock;
+        {
+            scoped_mutex_lock lock(s.mtx);
+            wait_not_busy(sbid, lock);
+            if (sblock.is_evictable())
+                s.evictable_blocks.erase(sbid);
+            if (sblock.is_internal())
+                iblock = sblock.detach_internal_block();
+            eblock = sblock.extract_external_block();
+        }
+        if (iblock)
+            return_free_internal_block(iblock);
+        return eblock;
+    }
+
+    virtual bool is_initialized(const swappable_block_identifier_type sbid) const
+    {
+        scoped_mutex_lock lock(get_shard(sbid).mtx);
+        wait_not_busy(sbid, lock);
+        return swappable_blocks[sbid].is_initialized();
     }
+
+    virtual bool is_thread_safe() const
+    { return true; }
 };
 
 //! Pseudo block scheduling algorithm only recording the request sequence.
@@ -1116,6 +1357,396 @@ public:
     }
 };
 
+//! Block scheduling algorithm caching via the longest forward distance policy
+//! and prefetching (offline).
+//!
+//! It walks the prediction sequence ahead of the requests and starts reading
+//! the blocks of upcoming acquires asynchronously, as long as the internal
+//! block it takes is not needed before, i.e. the victim chosen by longest
+//! forward distance is used later than the prefetched block. The blocks
+//! likely to be evicted next are written back asynchronously in advance, so
+//! that evicting them does not wait for I/O. The number of prefetched blocks
+//! and of writes in flight scales with the number of disks.
+template <class SwappableBlockType>
+class block_scheduler_algorithm_offline_lfd_prefetching
+    : public block_scheduler_algorithm_offline_lfd<SwappableBlockType>
+{
+protected:
+    typedef block_scheduler<SwappableBlockType> block_scheduler_type;
+    typedef block_scheduler_algorithm<SwappableBlockType> block_scheduler_algorithm_type;
+    typedef block_scheduler_algorithm_offline_lfd<SwappableBlockType> block_scheduler_algorithm_offline_lfd_type;
+    typedef typename block_scheduler_type::internal_block_type internal_block_type;
+    typedef typename block_scheduler_type::external_block_type external_block_type;
+    typedef typename block_scheduler_type::swappable_block_identifier_type swappable_block_identifier_type;
+    typedef typename block_scheduler_algorithm_type::time_type time_type;
+    typedef typename block_scheduler_type::prediction_sequence_type prediction_sequence_type;
+    typedef typename block_scheduler_type::block_scheduler_operation block_scheduler_operation;
+    typedef typename block_scheduler_algorithm_offline_lfd_type::priority priority;
+    typedef std::map<swappable_block_identifier_type, request_ptr> request_map_type;
+
+    //! a block read ahead, with its read request and the time of its acquire
+    struct prefetch_type
+    {
+        request_ptr req;
+        time_type time;
+    };
+    typedef std::map<swappable_block_identifier_type, prefetch_type> prefetch_map_type;
+
+    using block_scheduler_algorithm_type::bs;
+    using block_scheduler_algorithm_type::swappable_blocks;
+    using block_scheduler_algorithm_type::get_algorithm_from_block_scheduler;
+    using block_scheduler_algorithm_type::get_free_internal_block_from_block_scheduler;
+    using block_scheduler_algorithm_type::prediction_sequence;
+    using block_scheduler_algorithm_offline_lfd_type::evictable_blocks;
+    using block_scheduler_algorithm_offline_lfd_type::next_use;
+    using block_scheduler_algorithm_offline_lfd_type::return_free_internal_block;
+
+    //! Next operation to look at for prefetching.
+    typename prediction_sequence_type::iterator next_op_to_prefetch;
+    //! Blocks read ahead for an upcoming acquire.
+    prefetch_map_type prefetched_blocks;
+    //! Internal blocks written back ahead of their eviction, with their write request.
+    request_map_type written_blocks;
+    //! Next use of the evictable blocks, as in next_use.
+    std::vector<std::pair<bool, time_type> > next_use_of;
+
+    //! Maximum number of prefetched, not yet acquired blocks.
+    unsigned_type max_prefetched_blocks;
+    //! Maximum number of writes in flight.
+    unsigned_type max_written_blocks;
+
+    //! Remove the next operation from the prediction sequence if it matches.
+    //! \return false if the request deviates from the prediction sequence
+    bool consume(const block_scheduler_operation op, const swappable_block_identifier_type sbid)
+    {
+        if (prediction_sequence.empty()
+            || prediction_sequence.front().op != op || prediction_sequence.front().id != sbid)
+            return false;
+        if (next_op_to_prefetch == prediction_sequence.begin())
+            ++next_op_to_prefetch;
+        prediction_sequence.pop_front();
+        return true;
+    }
+
+    block_scheduler_algorithm_type * give_up()
+    {
+        STXXL_ERRMSG("block_scheduler_algorithm_offline_lfd_prefetching: request deviates from the prediction sequence. Switching to block_scheduler_algorithm_online.");
+        // switch algorithm, the new one takes over the evictable blocks
+        block_scheduler_algorithm_type* new_algo
+            = new block_scheduler_algorithm_online_lru<SwappableBlockType>(bs);
+        // and delete self
+        delete bs.switch_algorithm_to(new_algo);
+        return new_algo;
+    }
+
+    //! Wait for the write-back of the block, if any.
+    void wait_on_write(const swappable_block_identifier_type sbid)
+    {
+        typename request_map_type::iterator it = written_blocks.find(sbid);
+        if (it != written_blocks.end())
+        {
+            it->second->wait();
+            written_blocks.erase(it);
+        }
+    }
+
+    //! Wait for the prefetch of the block, if any.
+    //! \return if the block was prefetched
+    bool wait_on_prefetch(const swappable_block_identifier_type sbid)
+    {
+        typename prefetch_map_type::iterator it = prefetched_blocks.find(sbid);
+        if (it == prefetched_blocks.end())
+            return false;
+        it->second.req->wait();
+        prefetched_blocks.erase(it);
+        return true;
+    }
+
+    internal_block_type * get_free_internal_block()
+    {
+        // try to get a free internal_block
+        if (internal_block_type* iblock = get_free_internal_block_from_block_scheduler())
+            return iblock;
+        if (evictable_blocks.empty() && ! prefetched_blocks.empty())
+        {
+            // => all other blocks are acquired, take back the prefetched one
+            // acquired last
+            typename prefetch_map_type::const_iterator farthest = prefetched_blocks.begin();
+            for (typename prefetch_map_type::const_iterator it = prefetched_blocks.begin();
+                 it != prefetched_blocks.end(); ++it)
+            {
+                if (it->second.time > farthest->second.time)
+                    farthest = it;
+            }
+            const swappable_block_identifier_type sbid = farthest->first;
+            wait_on_prefetch(sbid);
+            return swappable_blocks[sbid].detach_internal_block();
+        }
+        // evict block
+        assert(! evictable_blocks.empty()); // fails it there is not enough memory available
+        const swappable_block_identifier_type victim = evictable_blocks.pop();
+        wait_on_write(victim);
+        return swappable_blocks[victim].detach_internal_block();
+    }
+
+    //! Start reading the blocks of upcoming acquires, then write back the
+    //! blocks to be evicted next.
+    void schedule_io()
+    {
+        while (next_op_to_prefetch != prediction_sequence.end()
+               && prefetched_blocks.size() < max_prefetched_blocks)
+        {
+            const swappable_block_identifier_type sbid = next_op_to_prefetch->id;
+            SwappableBlockType& sblock = swappable_blocks[sbid];
+            if (next_op_to_prefetch->op == block_scheduler_type::op_acquire
+                && ! sblock.is_internal() && sblock.is_initialized())
+            {
+                // => needs to be read, find an internal_block
+                internal_block_type* iblock = get_free_internal_block_from_block_scheduler();
+                if (! iblock)
+                {
+                    if (evictable_blocks.empty())
+                        break;
+                    const swappable_block_identifier_type victim = evictable_blocks.top();
+                    // do not evict a block that is used before the prefetched one
+                    if (next_use_of[victim].first && next_use_of[victim].second <= next_op_to_prefetch->time)
+                        break;
+                    typename request_map_type::iterator writing = written_blocks.find(victim);
+                    if (writing != written_blocks.end())
+                    {
+                        // wait for the write-back to complete, without blocking
+                        if (! writing->second->poll())
+                            break;
+                        written_blocks.erase(writing);
+                    }
+                    if (swappable_blocks[victim].is_dirty())
+                    {
+                        // write back first, take it later
+                        written_blocks[victim] = swappable_blocks[victim].clean_async();
+                        break;
+                    }
+                    evictable_blocks.pop();
+                    iblock = swappable_blocks[victim].detach_internal_block();
+                }
+                sblock.attach_internal_block(iblock);
+                prefetch_type& prefetch = prefetched_blocks[sbid];
+                prefetch.req = sblock.read_async();
+                prefetch.time = next_op_to_prefetch->time;
+            }
+            ++next_op_to_prefetch;
+        }
+        schedule_writes();
+    }
+
+    //! Write back dirty blocks among those to be evicted next.
+    void schedule_writes()
+    {
+        // forget completed writes
+        for (typename request_map_type::iterator it = written_blocks.begin(); it != written_blocks.end(); )
+        {
+            if (it->second->poll())
+                written_blocks.erase(it++);
+            else
+                ++it;
+        }
+        std::vector<swappable_block_identifier_type> to_write;
+        unsigned_type num_candidates = 0;
+        for (typename addressable_priority_queue<swappable_block_identifier_type, priority>::const_iterator
+             it = evictable_blocks.begin();
+             it != evictable_blocks.end() && num_candidates < max_written_blocks
+             && written_blocks.size() + to_write.size() < max_written_blocks;
+             ++it, ++num_candidates)
+        {
+            const swappable_block_identifier_type sbid = it->second;
+            // skip blocks that are deinitialized next
+            if (swappable_blocks[sbid].is_dirty() && ! written_blocks.count(sbid)
+                && (next_use_of[sbid].first || next_use_of[sbid].second != 0))
+                to_write.push_back(sbid);
+        }
+        // the priorities of the written blocks are not updated, clean only
+        // breaks ties
+        for (size_t i = 0; i < to_write.size(); ++i)
+            written_blocks[to_write[i]] = swappable_blocks[to_write[i]].clean_async();
+    }
+
+    void init(block_scheduler_algorithm_type* old_algo)
+    {
+        if (old_algo)
+            // copy prediction sequence
+            prediction_sequence = old_algo->get_prediction_sequence();
+        next_op_to_prefetch = prediction_sequence.begin();
+
+        // next use of the blocks that are evictable already
+        next_use_of.assign(swappable_blocks.size(), std::make_pair(false, time_type(1)));
+        std::vector<bool> seen(swappable_blocks.size(), false);
+        for (typename prediction_sequence_type::const_iterator it = prediction_sequence.begin();
+             it != prediction_sequence.end(); ++it)
+        {
+            if (seen[it->id])
+                continue;
+            seen[it->id] = true;
+            if (it->op == block_scheduler_type::op_acquire || it->op == block_scheduler_type::op_acquire_uninitialized)
+                next_use_of[it->id] = std::make_pair(true, it->time);
+            else if (it->op == block_scheduler_type::op_deinitialize)
+                next_use_of[it->id] = std::make_pair(false, time_type(0));
+        }
+
+        const unsigned_type num_disks = std::max<unsigned_type>(config::get_instance()->disks_number(), 1);
+        const unsigned_type half_memory = std::max<unsigned_type>(bs.get_max_internal_blocks() / 2, 1);
+        max_prefetched_blocks = std::min(prefetch_blocks_per_disk * num_disks, half_memory);
+        max_written_blocks = std::min(write_blocks_per_disk * num_disks, half_memory);
+
+        schedule_io();
+    }
+
+    //! Wait for all I/O and make the prefetched blocks evictable.
+    void deinit()
+    {
+        while (! prefetched_blocks.empty())
+        {
+            const swappable_block_identifier_type sbid = prefetched_blocks.begin()->first;
+            wait_on_prefetch(sbid);
+            evictable_blocks.insert(sbid, priority(swappable_blocks[sbid], std::make_pair(false, time_type(1))));
+        }
+        while (! written_blocks.empty())
+            wait_on_write(written_blocks.begin()->first);
+    }
+
+public:
+    //! tuning-parameter: prefetched blocks per disk.
+    static const unsigned_type prefetch_blocks_per_disk = 8;
+    //! tuning-parameter: writes in flight per disk.
+    static const unsigned_type write_blocks_per_disk = 4;
+
+    block_scheduler_algorithm_offline_lfd_prefetching(block_scheduler_type& bs)
+        : block_scheduler_algorithm_offline_lfd_type(bs)
+    { init(get_algorithm_from_block_scheduler()); }
+
+    // It is possible to keep an old simulation-algorithm object and reuse it's prediction sequence
+    block_scheduler_algorithm_offline_lfd_prefetching(block_scheduler_algorithm_type* old)
+        : block_scheduler_algorithm_offline_lfd_type(old)
+    { init(old); }
+
+    virtual ~block_scheduler_algorithm_offline_lfd_prefetching()
+    { deinit(); }
+
+    virtual void complete_io()
+    { deinit(); }
+
+    virtual void swappable_blocks_resize(swappable_block_identifier_type size)
+    { next_use_of.resize(size, std::make_pair(false, time_type(1))); }
+
+    virtual internal_block_type & acquire(const swappable_block_identifier_type sbid, const bool uninitialized = false)
+    {
+        if (! consume((uninitialized) ? block_scheduler_type::op_acquire_uninitialized : block_scheduler_type::op_acquire, sbid))
+            return give_up()->acquire(sbid, uninitialized);
+
+        SwappableBlockType& sblock = swappable_blocks[sbid];
+        if (wait_on_prefetch(sbid))
+        {
+            // => read ahead, internal but neither acquired nor evictable
+            sblock.acquire();
+        }
+        else if (sblock.is_internal())
+        {
+            if (! sblock.is_acquired())
+                // not acquired yet -> remove from evictable_blocks
+                evictable_blocks.erase(sbid);
+            // the caller must not modify the block while it is written back
+            wait_on_write(sbid);
+            sblock.acquire();
+        }
+        else if (sblock.is_initialized())
+        {
+            // => external but not internal
+            sblock.attach_internal_block(get_free_internal_block());
+            if (! uninitialized)
+                //load block synchronously
+                sblock.read_sync();
+            sblock.acquire();
+        }
+        else
+        {
+            // => ! sblock.is_initialized()
+            sblock.attach_internal_block(get_free_internal_block());
+            sblock.acquire();
+            //initialize new block
+            if (! uninitialized)
+                sblock.fill_default();
+        }
+        schedule_io();
+        return sblock.get_internal_block();
+    }
+
+    virtual void release(swappable_block_identifier_type sbid, const bool dirty)
+    {
+        if (! consume((dirty) ? block_scheduler_type::op_release_dirty : block_scheduler_type::op_release, sbid)
+            || next_use.empty())
+            return give_up()->release(sbid, dirty);
+
+        SwappableBlockType& sblock = swappable_blocks[sbid];
+        if (dirty)
+            // the write-back of the old content has to complete before the block is written again
+            wait_on_write(sbid);
+        next_use_of[sbid] = next_use.front();
+        sblock.make_dirty_if(dirty);
+        sblock.release();
+        if (! sblock.is_acquired())
+        {
+            if (sblock.is_dirty() || sblock.is_external())
+                // => evictable, put in pq
+                evictable_blocks.insert(sbid, priority(sblock, next_use.front()));
+            else
+                // => uninitialized, release internal block and put it in freelist
+                return_free_internal_block(sblock.detach_internal_block());
+        }
+        next_use.pop_front();
+        schedule_io();
+    }
+
+    virtual void deinitialize(swappable_block_identifier_type sbid)
+    {
+        if (! consume(block_scheduler_type::op_deinitialize, sbid))
+            return give_up()->deinitialize(sbid);
+
+        SwappableBlockType& sblock = swappable_blocks[sbid];
+        wait_on_prefetch(sbid);
+        // the external_block must not be freed while it is written
+        wait_on_write(sbid);
+        if (sblock.is_evictable())
+            evictable_blocks.erase(sbid);
+        if (internal_block_type* iblock = sblock.deinitialize())
+            return_free_internal_block(iblock);
+        schedule_io();
+    }
+
+    virtual void initialize(swappable_block_identifier_type sbid, external_block_type eblock)
+    {
+        if (! consume(block_scheduler_type::op_initialize, sbid))
+            return give_up()->initialize(sbid, eblock);
+
+        swappable_blocks[sbid].initialize(eblock);
+        schedule_io();
+    }
+
+    virtual external_block_type extract_external_block(swappable_block_identifier_type sbid)
+    {
+        if (! consume(block_scheduler_type::op_extract_external_block, sbid))
+            return give_up()->extract_external_block(sbid);
+
+        SwappableBlockType& sblock = swappable_blocks[sbid];
+        wait_on_prefetch(sbid);
+        wait_on_write(sbid);
+        if (sblock.is_evictable())
+            evictable_blocks.erase(sbid);
+        if (sblock.is_internal())
+            return_free_internal_block(sblock.detach_internal_block());
+        external_block_type eblock = sblock.extract_external_block();
+        schedule_io();
+        return eblock;
+    }
+};
+
 //! Block scheduling algorithm caching via the least recently used policy
 //! (offline), and prefetching in addition.
 template <class SwappableBlockType>
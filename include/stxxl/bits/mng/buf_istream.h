@@ -13,9 +13,12 @@
 #ifndef STXXL_MNG_BUF_ISTREAM_HEADER
 #define STXXL_MNG_BUF_ISTREAM_HEADER
 
+#include <algorithm>
+
 #include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/mng/block_prefetcher.h>
 #include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/algo/async_schedule.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -57,8 +60,12 @@ public:
     //! Constructs input stream object.
     //! \param begin \c bid_iterator pointing to the first block of the stream
     //! \param end \c bid_iterator pointing to the ( \b last + 1 ) block of the stream
-    //! \param nbuffers number of buffers for internal use
-    buf_istream(bid_iterator_type begin, bid_iterator_type end, unsigned_type nbuffers)
+    //! \param nbuffers number of buffers for internal use, the maximum if
+    //!        adaptive
+    //! \param adaptive adapt the number of prefetched blocks to the read
+    //!        latency and the consumption speed, see block_prefetcher
+    buf_istream(bid_iterator_type begin, bid_iterator_type end, unsigned_type nbuffers,
+                bool adaptive = STXXL_PREFETCH_ADAPTIVE)
         : current_elem(0)
 #ifdef BUF_ISTREAM_CHECK_END
           , not_finished(true)
@@ -78,7 +85,8 @@ public:
         compute_prefetch_schedule(begin, end, prefetch_seq,
                                   nbuffers, mdevid);
 
-        prefetcher = new prefetcher_type(begin, end, prefetch_seq, nbuffers);
+        prefetcher = new prefetcher_type(begin, end, prefetch_seq, nbuffers,
+                                         completion_handler(), adaptive);
 
         current_blk = prefetcher->pull_block();
     }
@@ -142,6 +150,40 @@ public:
         return *this;
     }
 
+    //! Copies the next n records to out and moves past them, block by block.
+    //! \pre at least n records are left in the stream
+    void read(typename block_type::value_type* out, unsigned_type n)
+    {
+        while (n > 0)
+        {
+#ifdef BUF_ISTREAM_CHECK_END
+            assert(not_finished);
+#endif
+            const unsigned_type k = STXXL_MIN<unsigned_type>(n, block_type::size - current_elem);
+            std::copy(current_blk->elem + current_elem, current_blk->elem + current_elem + k, out);
+            out += k;
+            n -= k;
+            current_elem += k;
+
+            if (current_elem >= block_type::size)
+            {
+                current_elem = 0;
+#ifdef BUF_ISTREAM_CHECK_END
+                not_finished = prefetcher->block_consumed(current_blk);
+#else
+                prefetcher->block_consumed(current_blk);
+#endif
+            }
+        }
+    }
+
+    //! Number of blocks currently prefetched, see
+    //! block_prefetcher::prefetch_depth().
+    int_type prefetch_depth() const
+    {
+        return prefetcher->prefetch_depth();
+    }
+
     //! Frees used internal objects.
     ~buf_istream()
     {
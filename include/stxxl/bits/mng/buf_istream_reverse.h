@@ -64,8 +64,12 @@ public:
     //! Constructs input stream object, reading [first,last) blocks in reverse.
     //! \param begin \c bid_iterator pointing to the first block of the stream
     //! \param end \c bid_iterator pointing to the ( \b last + 1 ) block of the stream
-    //! \param nbuffers number of buffers for internal use
-    buf_istream_reverse(bid_iterator_type begin, bid_iterator_type end, int_type nbuffers)
+    //! \param nbuffers number of buffers for internal use, the maximum if
+    //!        adaptive
+    //! \param adaptive adapt the number of prefetched blocks to the read
+    //!        latency and the consumption speed, see block_prefetcher
+    buf_istream_reverse(bid_iterator_type begin, bid_iterator_type end, int_type nbuffers,
+                        bool adaptive = STXXL_PREFETCH_ADAPTIVE)
         : current_elem(0),
 #ifdef BUF_ISTREAM_CHECK_END
           not_finished(true),
@@ -87,7 +91,8 @@ public:
                                   nbuffers, mdevid);
 
         // create stream prefetcher
-        prefetcher = new prefetcher_type(bids_.begin(), bids_.end(), prefetch_seq, nbuffers);
+        prefetcher = new prefetcher_type(bids_.begin(), bids_.end(), prefetch_seq, nbuffers,
+                                         completion_handler(), adaptive);
 
         // fetch block: last in sequence
         current_blk = prefetcher->pull_block();
@@ -153,6 +158,13 @@ public:
         return *this;
     }
 
+    //! Number of blocks currently prefetched, see
+    //! block_prefetcher::prefetch_depth().
+    int_type prefetch_depth() const
+    {
+        return prefetcher->prefetch_depth();
+    }
+
     //! Frees used internal objects.
     ~buf_istream_reverse()
     {
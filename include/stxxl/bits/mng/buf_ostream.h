@@ -94,6 +94,33 @@ public:
         return *this;
     }
 
+    //! Returns pointer to the current record, the next current_space()
+    //! records can be written there directly before calling advance().
+    typename block_type::value_type * current_ptr()
+    {
+        return current_blk->elem + current_elem;
+    }
+
+    //! Number of records left in the current block.
+    unsigned_type current_space() const
+    {
+        return block_type::size - current_elem;
+    }
+
+    //! Moves n records ahead, at most current_space(), writing out the block
+    //! when it is full.
+    self_type & advance(unsigned_type n)
+    {
+        assert(n <= current_space());
+        current_elem += n;
+        if (current_elem >= block_type::size)
+        {
+            current_elem = 0;
+            current_blk = writer.write(current_blk, *(current_bid++));
+        }
+        return *this;
+    }
+
     //! Fill current block with padding and flush
     self_type & fill(const_reference record)
     {
@@ -18,6 +18,9 @@
 
 #include <stxxl/bits/io/request_operations.h>
 #include <stxxl/bits/io/disk_queues.h>
+#include <stxxl/bits/mng/config.h>
+#include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/noncopyable.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -32,6 +35,12 @@ STXXL_BEGIN_NAMESPACE
 //! Encapsulates asynchronous buffered block writing engine.
 //!
 //! \c buffered_writer overlaps I/Os with filling of output buffer.
+//!
+//! Filled blocks are queued per disk, given by the device id of the BID's
+//! file, and written behind: each disk gets up to a budget of writes in
+//! flight, further blocks of the disk wait ordered by offset until one of its
+//! writes completes. Thus a busy disk does not hold back the writes to idle
+//! disks, and a new buffer is taken from whichever write completes first.
 template <typename BlockType>
 class buffered_writer : private noncopyable
 {
@@ -47,7 +56,7 @@ protected:
 
     std::vector<int_type> free_write_blocks;            // contains free write blocks
     std::vector<int_type> busy_write_blocks;            // blocks that are in writing, notice that if block is not in free_
-    // an not in busy then block is not yet filled
+    // an not in busy then block is not yet filled or waiting for its disk
 
     struct batch_entry
     {
@@ -64,16 +73,82 @@ protected:
     };
 
     typedef std::priority_queue<batch_entry, std::vector<batch_entry>, batch_entry_cmp> batch_type;
-    batch_type batch_write_blocks;      // sorted sequence of blocks to write
+
+    //! number of disks, blocks of files without a device id go to an extra
+    //! queue with index ndisks
+    const unsigned_type ndisks;
+    //! maximum number of writes in flight per disk
+    unsigned_type disk_budget;
+    //! sorted sequences of filled blocks waiting for their disk
+    simple_vector<batch_type> pending_write_blocks;
+    //! number of writes in flight per disk
+    simple_vector<unsigned_type> disk_writes;
+
+    //! queue index of the disk of bid
+    unsigned_type disk_of(const bid_type& bid) const
+    {
+        unsigned_type disk = bid.storage->get_device_id();
+        return (disk < ndisks) ? disk : ndisks;
+    }
+
+    //! start writes of pending blocks on disk while it is within the budget
+    void issue_writes(unsigned_type disk, unsigned_type budget)
+    {
+        batch_type& pending = pending_write_blocks[disk];
+        while (!pending.empty() && disk_writes[disk] < budget)
+        {
+            int_type ibuffer = pending.top().ibuffer;
+            pending.pop();
+
+            write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
+
+            busy_write_blocks.push_back(ibuffer);
+            ++disk_writes[disk];
+        }
+    }
+
+    //! free the buffer of the completed write busy_write_blocks[i] and
+    //! start the next pending write of its disk
+    void write_completed(unsigned_type i)
+    {
+        int_type ibuffer = busy_write_blocks[i];
+        busy_write_blocks.erase(busy_write_blocks.begin() + i);
+        free_write_blocks.push_back(ibuffer);
+
+        unsigned_type disk = disk_of(write_bids[ibuffer]);
+        --disk_writes[disk];
+        issue_writes(disk, disk_budget);
+    }
+
+    //! start all pending writes and wait for all writes
+    void write_all()
+    {
+        for (unsigned_type disk = 0; disk <= ndisks; ++disk)
+            issue_writes(disk, nwriteblocks);
+
+        for (std::vector<int_type>::const_iterator it =
+                 busy_write_blocks.begin();
+             it != busy_write_blocks.end(); it++)
+        {
+            write_reqs[*it]->wait();
+        }
+
+        busy_write_blocks.clear();
+        for (unsigned_type disk = 0; disk <= ndisks; ++disk)
+            disk_writes[disk] = 0;
+    }
 
 public:
     //! Constructs an object.
     //! \param write_buf_size number of write buffers to use
-    //! \param write_batch_size number of blocks to accumulate in
-    //!        order to flush write requests (bulk buffered writing)
+    //! \param write_batch_size number of blocks written in parallel, divided
+    //!        evenly among the disks as their budget, at least two per disk
     buffered_writer(unsigned_type write_buf_size, unsigned_type write_batch_size)
         : nwriteblocks((write_buf_size > 2) ? write_buf_size : 2),
-          writebatchsize(write_batch_size ? write_batch_size : 1)
+          writebatchsize(write_batch_size ? write_batch_size : 1),
+          ndisks(config::get_instance()->get_max_device_id()),
+          pending_write_blocks(ndisks + 1),
+          disk_writes(ndisks + 1)
     {
         write_buffers = new block_type[nwriteblocks];
         write_reqs = new request_ptr[nwriteblocks];
@@ -83,27 +158,28 @@ public:
         for (unsigned_type i = 0; i < nwriteblocks; i++)
             free_write_blocks.push_back(i);
 
+        disk_writes.memzero();
+        disk_budget = STXXL_MAX<unsigned_type>(2, div_ceil(writebatchsize, STXXL_MAX<unsigned_type>(ndisks, 1)));
+
         disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
     }
     //! Returns free block from the internal buffer pool.
     //! \return pointer to the block from the internal buffer pool
     block_type * get_free_block()
     {
-        int_type ibuffer;
-        for (std::vector<int_type>::iterator it = busy_write_blocks.begin();
-             it != busy_write_blocks.end(); ++it)
+        for (unsigned_type i = 0; i < busy_write_blocks.size(); )
         {
-            if (write_reqs[ibuffer = (*it)]->poll())
-            {
-                busy_write_blocks.erase(it);
-                free_write_blocks.push_back(ibuffer);
-
-                break;
-            }
+            if (write_reqs[busy_write_blocks[i]]->poll())
+                write_completed(i);
+            else
+                ++i;
         }
         if (UNLIKELY(free_write_blocks.empty()))
         {
+            // all buffers are filled: wait for the first write to complete
+            // on any disk
             int_type size = busy_write_blocks.size();
+            assert(size > 0);
             request_ptr* reqs = new request_ptr[size];
             int_type i = 0;
             for ( ; i < size; ++i)
@@ -111,13 +187,10 @@ public:
                 reqs[i] = write_reqs[busy_write_blocks[i]];
             }
             int_type completed = wait_any(reqs, size);
-            int_type completed_global = busy_write_blocks[completed];
             delete[] reqs;
-            busy_write_blocks.erase(busy_write_blocks.begin() + completed);
-
-            return (write_buffers + completed_global);
+            write_completed(completed);
         }
-        ibuffer = free_write_blocks.back();
+        int_type ibuffer = free_write_blocks.back();
         free_write_blocks.pop_back();
 
         return (write_buffers + ibuffer);
@@ -129,85 +202,48 @@ public:
     //! \return pointer to the new free block from the pool
     block_type * write(block_type* filled_block, const bid_type& bid)          // writes filled_block and returns a new block
     {
-        if (batch_write_blocks.size() >= writebatchsize)
-        {
-            // flush batch
-            while (!batch_write_blocks.empty())
-            {
-                int_type ibuffer = batch_write_blocks.top().ibuffer;
-                batch_write_blocks.pop();
-
-                if (write_reqs[ibuffer].valid())
-                    write_reqs[ibuffer]->wait();
-
-                write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
-
-                busy_write_blocks.push_back(ibuffer);
-            }
-        }
-        //    STXXL_MSG("Adding write request to batch");
-
         int_type ibuffer = filled_block - write_buffers;
         write_bids[ibuffer] = bid;
-        batch_write_blocks.push(batch_entry(bid.offset, ibuffer));
+
+        unsigned_type disk = disk_of(bid);
+        pending_write_blocks[disk].push(batch_entry(bid.offset, ibuffer));
+        issue_writes(disk, disk_budget);
 
         return get_free_block();
     }
     //! Flushes not yet written buffers.
     void flush()
     {
-        int_type ibuffer;
-        while (!batch_write_blocks.empty())
-        {
-            ibuffer = batch_write_blocks.top().ibuffer;
-            batch_write_blocks.pop();
-
-            if (write_reqs[ibuffer].valid())
-                write_reqs[ibuffer]->wait();
+        write_all();
 
-            write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
-
-            busy_write_blocks.push_back(ibuffer);
-        }
-        for (std::vector<int_type>::const_iterator it =
-                 busy_write_blocks.begin();
-             it != busy_write_blocks.end(); it++)
-        {
-            ibuffer = *it;
-            write_reqs[ibuffer]->wait();
-        }
-
-        assert(batch_write_blocks.empty());
         free_write_blocks.clear();
-        busy_write_blocks.clear();
 
         for (unsigned_type i = 0; i < nwriteblocks; i++)
             free_write_blocks.push_back(i);
     }
 
-    //! Flushes not yet written buffers and frees used memory.
-    ~buffered_writer()
+    //! Set the maximum number of writes in flight per disk, at least 1.
+    void set_disk_budget(unsigned_type budget)
     {
-        int_type ibuffer;
-        while (!batch_write_blocks.empty())
-        {
-            ibuffer = batch_write_blocks.top().ibuffer;
-            batch_write_blocks.pop();
+        disk_budget = STXXL_MAX<unsigned_type>(budget, 1);
+    }
 
-            if (write_reqs[ibuffer].valid())
-                write_reqs[ibuffer]->wait();
+    //! Returns the maximum number of writes in flight per disk.
+    unsigned_type get_disk_budget() const
+    {
+        return disk_budget;
+    }
 
-            write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
+    //! Returns the number of writes in flight.
+    unsigned_type get_writes_in_flight() const
+    {
+        return busy_write_blocks.size();
+    }
 
-            busy_write_blocks.push_back(ibuffer);
-        }
-        for (std::vector<int_type>::const_iterator it =
-                 busy_write_blocks.begin();
-             it != busy_write_blocks.end(); it++)
-        {
-            ibuffer = *it;
-            write_reqs[ibuffer]->wait();
-        }
+    //! Flushes not yet written buffers and frees used memory.
+    ~buffered_writer()
+    {
+        write_all();
 
         delete[] write_reqs;
         delete[] write_buffers;
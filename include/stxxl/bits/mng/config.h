@@ -100,9 +100,41 @@ public:
     //! unlink file immediately after opening (available on most Unix)
     bool unlink_on_open;
 
-    //! desired queue length for linuxaio_file and linuxaio_queue
+    //! release freed blocks to the file system (hole punching) or the device
+    //! (discard/TRIM), see file::DISCARD.
+    bool discard;
+
+    //! desired queue length for linuxaio_file/io_uring_file and their queues
     int queue_length;
 
+    //! NUMA node the disk is attached to: its queue thread is pinned to the
+    //! node. numa=-1 (default) -> detect the node of the block device,
+    //! numa=off -> no NUMA placement.
+    int numa_node;
+
+    //! value of numa_node for numa=off
+    static const int NUMA_OFF = -2;
+
+    //! compression codec (lz4, zstd or zlib): the file is wrapped into a
+    //! compressed_file. Empty (default) -> no compression.
+    std::string compress;
+
+    //! fast tier caching hot blocks of the disk: path of a file on flash or
+    //! "memory". The file is wrapped into a tiered_file. Empty (default) ->
+    //! no tiering.
+    std::string tier;
+
+    //! bytes used of the fast tier
+    uint64 tier_size;
+
+    //! replacement policy of the fast tier (lru or clock), empty -> clock
+    std::string tier_policy;
+
+    //! keep the blocks of the disk across program runs: the block manager
+    //! stores a catalog of named roots in a reserved region of the first
+    //! disk and rebuilds the free space from it on startup.
+    bool persistent;
+
     //! \}
 };
 
@@ -33,6 +33,7 @@
 #include <functional>
 #include <map>
 #include <ostream>
+#include <set>
 #include <utility>
 
 STXXL_BEGIN_NAMESPACE
@@ -40,35 +41,51 @@ STXXL_BEGIN_NAMESPACE
 //! \ingroup mnglayer
 //! \{
 
+//! Manages the free space of one disk. Free regions are kept in a map by
+//! offset, to coalesce adjacent regions, and in a set ordered by size and
+//! offset, to find the smallest region fitting a request (best fit) in
+//! O(log n).
 class disk_allocator : private noncopyable
 {
-    typedef std::pair<stxxl::int64, stxxl::int64> place;
-
-    struct first_fit : public std::binary_function<place, stxxl::int64, bool>
-    {
-        bool operator () (
-            const place& entry,
-            const stxxl::int64 size) const
-        {
-            return (entry.second >= size);
-        }
-    };
-
+    //! offset -> size of free regions
     typedef std::map<stxxl::int64, stxxl::int64> sortseq;
+    //! (size, offset) of free regions
+    typedef std::set<std::pair<stxxl::int64, stxxl::int64> > size_index;
 
-    stxxl::mutex mutex;
+    mutable stxxl::mutex mutex;
     sortseq free_space;
+    size_index free_by_size;
     stxxl::int64 free_bytes;
     stxxl::int64 disk_bytes;
     stxxl::int64 cfg_bytes;
     stxxl::file* storage;
     bool autogrow;
+    bool persistent;
 
     void dump() const;
 
-    void deallocation_error(
-        stxxl::int64 block_pos, stxxl::int64 block_size,
-        const sortseq::iterator& pred, const sortseq::iterator& succ) const;
+    // expect the mutex to be locked to prevent concurrent access
+    void insert_region(stxxl::int64 region_pos, stxxl::int64 region_size)
+    {
+        free_space[region_pos] = region_size;
+        free_by_size.insert(std::make_pair(region_size, region_pos));
+    }
+    void erase_region(sortseq::iterator region)
+    {
+        free_by_size.erase(std::make_pair(region->second, region->first));
+        free_space.erase(region);
+    }
+
+    //! find the smallest free region of at least size bytes, lowest offset
+    //! among equal sizes, or free_space.end()
+    sortseq::iterator best_fit(stxxl::int64 size)
+    {
+        size_index::const_iterator it =
+            free_by_size.lower_bound(std::make_pair(size, stxxl::int64(0)));
+        if (it == free_by_size.end())
+            return free_space.end();
+        return free_space.find(it->second);
+    }
 
     // expects the mutex to be locked to prevent concurrent access
     void add_free_region(stxxl::int64 block_pos, stxxl::int64 block_size);
@@ -90,15 +107,20 @@ public:
           disk_bytes(0),
           cfg_bytes(cfg.size),
           storage(storage),
-          autogrow(cfg.autogrow)
+          autogrow(cfg.autogrow),
+          persistent(cfg.persistent)
     {
-        // initial growth to configured file size
-        grow_file(cfg.size);
+        // initial growth to configured file size, persistent files keep the
+        // size they were grown to in earlier runs
+        if (persistent)
+            grow_file(std::max<int64>(cfg.size, storage->size()));
+        else
+            grow_file(cfg.size);
     }
 
     ~disk_allocator()
     {
-        if (disk_bytes > cfg_bytes) { // reduce to original size
+        if (disk_bytes > cfg_bytes && !persistent) { // reduce to original size
             storage->set_size(cfg_bytes);
         }
     }
@@ -118,6 +140,30 @@ public:
         return disk_bytes;
     }
 
+    //! return the number of free regions
+    size_t get_free_regions() const
+    {
+        scoped_mutex_lock lock(mutex);
+        return free_space.size();
+    }
+
+    //! return the size of the largest free region
+    int64 get_largest_free_region() const
+    {
+        scoped_mutex_lock lock(mutex);
+        return free_by_size.empty() ? 0 : free_by_size.rbegin()->first;
+    }
+
+    //! return the fraction of free bytes not in the largest free region,
+    //! 0 = unfragmented
+    double get_fragmentation() const
+    {
+        scoped_mutex_lock lock(mutex);
+        if (free_bytes == 0)
+            return 0.0;
+        return 1.0 - (double)free_by_size.rbegin()->first / (double)free_bytes;
+    }
+
     template <unsigned BlockSize>
     void new_blocks(BIDArray<BlockSize>& bids)
     {
@@ -147,6 +193,24 @@ public:
 
         add_free_region(bid.offset, bid.size);
     }
+
+    //! mark the free region [pos, pos + size) as allocated, e.g. when
+    //! blocks of an earlier run are restored. Throws bad_ext_alloc if any
+    //! part of it is not free.
+    void reserve(int64 pos, int64 size);
+
+    //! deallocate the blocks of block_size bytes at the offsets [begin, end)
+    void delete_blocks(const int64* begin, const int64* end, int64 block_size)
+    {
+        scoped_mutex_lock lock(mutex);
+
+        STXXL_VERBOSE2("disk_allocator::delete_blocks(size=" << block_size <<
+                       ", blocks: " << (end - begin) <<
+                       "), free:" << free_bytes << " total:" << disk_bytes);
+
+        for ( ; begin != end; ++begin)
+            add_free_region(*begin, block_size);
+    }
 };
 
 template <unsigned BlockSize>
@@ -187,9 +251,7 @@ void disk_allocator::new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end)
 
     // dump();
 
-    sortseq::iterator space;
-    space = std::find_if(free_space.begin(), free_space.end(),
-                         bind2nd(first_fit(), requested_size) _STXXL_FORCE_SEQUENTIAL);
+    sortseq::iterator space = best_fit(requested_size);
 
     if (space == free_space.end() && requested_size == BlockSize)
     {
@@ -206,17 +268,16 @@ void disk_allocator::new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end)
 
         grow_file(BlockSize);
 
-        space = std::find_if(free_space.begin(), free_space.end(),
-                             bind2nd(first_fit(), requested_size) _STXXL_FORCE_SEQUENTIAL);
+        space = best_fit(requested_size);
     }
 
     if (space != free_space.end())
     {
         stxxl::int64 region_pos = (*space).first;
         stxxl::int64 region_size = (*space).second;
-        free_space.erase(space);
+        erase_region(space);
         if (region_size > requested_size)
-            free_space[region_pos + requested_size] = region_size - requested_size;
+            insert_region(region_pos + requested_size, region_size - requested_size);
 
         for (stxxl::int64 pos = region_pos; begin != end; ++begin)
         {
@@ -240,7 +301,15 @@ void disk_allocator::new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end)
 
     BID<BlockSize>* middle = begin + ((end - begin) / 2);
     new_blocks(begin, middle);
-    new_blocks(middle, end);
+    try {
+        new_blocks(middle, end);
+    }
+    catch (bad_ext_alloc&) {
+        // give back the first half, the request failed as a whole
+        for ( ; begin != middle; ++begin)
+            delete_block(*begin);
+        throw;
+    }
 }
 
 //! \}
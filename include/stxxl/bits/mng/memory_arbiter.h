@@ -0,0 +1,197 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/memory_arbiter.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_MEMORY_ARBITER_HEADER
+#define STXXL_MNG_MEMORY_ARBITER_HEADER
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/singleton.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! A component's share of the process-wide memory budget of the
+//! memory_arbiter.
+//!
+//! Containers and algorithms hold a memory_consumer, request() internal
+//! memory from it and release() it again. The memory of a shrinkable
+//! consumer, i.e. a cache, may be reclaimed by the arbiter when other
+//! components need it: the consumer then returns reclaim() bytes at its next
+//! opportunity, e.g. on the next cache miss, and calls reclaim_done(). All
+//! memory still held is released by the destructor.
+class memory_consumer : private noncopyable
+{
+    friend class memory_arbiter;
+
+    //! component name used in the usage report
+    std::string m_name;
+    //! whether the arbiter may ask for memory back
+    bool m_shrinkable;
+    //! bytes currently held
+    uint64 m_granted;
+    //! bytes the arbiter asks back
+    uint64 m_reclaim;
+
+public:
+    //! register a new component with the arbiter
+    explicit memory_consumer(const std::string& name, bool shrinkable = false);
+
+    //! release all memory and unregister
+    ~memory_consumer();
+
+    //! Request bytes of internal memory. At least min_bytes are granted, even
+    //! if this exceeds the budget, in which case the shrinkable components
+    //! are asked to return the excess. The rest is granted only if it is free.
+    //! \return number of granted bytes, at least min(bytes, min_bytes)
+    uint64 request(uint64 bytes, uint64 min_bytes = 0);
+
+    //! Request exactly bytes of internal memory, see request().
+    void reserve(uint64 bytes)
+    {
+        request(bytes, bytes);
+    }
+
+    //! Return bytes of internal memory.
+    void release(uint64 bytes);
+
+    //! Return all internal memory held.
+    void release_all()
+    {
+        release(granted());
+    }
+
+    //! Bytes the arbiter asks this component to return.
+    uint64 reclaim() const;
+
+    //! Signal that the component returned what it could, clears a remaining
+    //! reclaim request.
+    void reclaim_done();
+
+    //! Bytes currently held.
+    uint64 granted() const;
+
+    //! Component name.
+    const std::string & name() const
+    {
+        return m_name;
+    }
+
+    //! Exchange the granted memory with another consumer of the same kind,
+    //! used by the swap() methods of containers.
+    void swap(memory_consumer& other);
+};
+
+//! Process-wide internal memory budget shared by all containers and
+//! algorithms.
+//!
+//! The limit is taken from the environment variable STXXL_MEMORY_LIMIT
+//! (e.g. "4GiB") or set with set_limit(), zero means unlimited: then all
+//! requests are granted and the arbiter only accounts the usage of the
+//! components. With a limit, requests beyond the free memory are reduced to
+//! their minimum, and if the granted memory then exceeds the limit, the excess
+//! is reclaimed from the shrinkable consumers in proportion to their share.
+//! Reclaiming is cooperative: caches shrink at their next access, so the
+//! limit may be exceeded temporarily.
+//!
+//! \remarks is a singleton
+class memory_arbiter : public singleton<memory_arbiter>
+{
+    friend class singleton<memory_arbiter>;
+    friend class memory_consumer;
+
+public:
+    //! usage of all components of the same name
+    struct usage
+    {
+        //! component name
+        std::string name;
+        //! number of registered components
+        unsigned_type count;
+        //! bytes currently held
+        uint64 granted;
+        //! maximum of bytes held at once
+        uint64 peak;
+        //! bytes currently asked back
+        uint64 reclaim;
+
+        usage()
+            : count(0), granted(0), peak(0), reclaim(0)
+        { }
+    };
+
+private:
+    typedef std::map<std::string, usage> usage_map_type;
+
+    //! protects all fields and the fields of the consumers
+    mutable mutex m_mutex;
+    //! memory limit in bytes, zero for unlimited
+    uint64 m_limit;
+    //! sum of granted bytes
+    uint64 m_granted;
+    //! maximum of m_granted
+    uint64 m_peak;
+    //! registered consumers
+    std::set<memory_consumer*> m_consumers;
+    //! usage by component name, also of unregistered components
+    usage_map_type m_usage;
+
+    memory_arbiter();
+
+    void add(memory_consumer* c);
+    void remove(memory_consumer* c);
+    uint64 request(memory_consumer* c, uint64 bytes, uint64 min_bytes);
+    void release(memory_consumer* c, uint64 bytes);
+
+    //! change the granted bytes of c, m_mutex must be held
+    void account(memory_consumer* c, uint64 bytes, bool add);
+    //! ask the shrinkable consumers for the excess over the limit, m_mutex
+    //! must be held
+    void distribute_reclaim();
+
+public:
+    //! Set the memory limit in bytes, zero means unlimited.
+    void set_limit(uint64 limit);
+
+    //! Memory limit in bytes, zero means unlimited.
+    uint64 get_limit() const;
+
+    //! Bytes currently granted to all components.
+    uint64 get_granted() const;
+
+    //! Maximum of bytes granted at once.
+    uint64 get_peak() const;
+
+    //! Bytes not granted, zero if over the limit or unlimited.
+    uint64 get_free() const;
+
+    //! Usage of each kind of component seen so far.
+    std::vector<usage> get_usage() const;
+
+    //! Print a table of the usage per component.
+    void print_usage(std::ostream& o) const;
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_MEMORY_ARBITER_HEADER
+// vim: et:ts=4:sw=4
@@ -20,7 +20,7 @@
 
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/io/request.h>
-#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/mng/block_buffer_pool.h>
 #include <stxxl/bits/mng/bid.h>
 
 #ifndef STXXL_VERBOSE_TYPED_BLOCK
@@ -304,8 +304,7 @@ public:
         unsigned_type meta_info_size = bytes % raw_size;
         STXXL_VERBOSE_TYPED_BLOCK("typed::block operator new[]: bytes=" << bytes << ", meta_info_size=" << meta_info_size);
 
-        void* result = aligned_alloc<STXXL_BLOCK_ALIGN>(
-            bytes - meta_info_size, meta_info_size);
+        void* result = block_buffer_alloc(bytes - meta_info_size, meta_info_size);
 
 #if STXXL_WITH_VALGRIND || STXXL_TYPED_BLOCK_INITIALIZE_ZERO
         memset(result, 0, bytes);
@@ -318,8 +317,7 @@ public:
         unsigned_type meta_info_size = bytes % raw_size;
         STXXL_VERBOSE_TYPED_BLOCK("typed::block operator new[]: bytes=" << bytes << ", meta_info_size=" << meta_info_size);
 
-        void* result = aligned_alloc<STXXL_BLOCK_ALIGN>(
-            bytes - meta_info_size, meta_info_size);
+        void* result = block_buffer_alloc(bytes - meta_info_size, meta_info_size);
 
 #if STXXL_WITH_VALGRIND || STXXL_TYPED_BLOCK_INITIALIZE_ZERO
         memset(result, 0, bytes);
@@ -334,12 +332,12 @@ public:
 
     static void operator delete (void* ptr)
     {
-        aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
+        block_buffer_dealloc(ptr);
     }
 
     static void operator delete[] (void* ptr)
     {
-        aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
+        block_buffer_dealloc(ptr);
     }
 
     static void operator delete (void*, void*)
@@ -0,0 +1,293 @@
+/***************************************************************************
+ *  include/stxxl/bits/stream/async_pipe.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_STREAM_ASYNC_PIPE_HEADER
+#define STXXL_STREAM_ASYNC_PIPE_HEADER
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/common/thread.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/stream/pull.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! Stream package subnamespace.
+namespace stream {
+
+//! \addtogroup streampack
+//! \{
+
+////////////////////////////////////////////////////////////////////////
+//     ASYNC PIPE                                                     //
+////////////////////////////////////////////////////////////////////////
+
+//! A stream stage which pulls its input on a separate thread.
+//!
+//! The upstream thread copies the elements of \c Input into blocks of
+//! block_bytes bytes and hands filled blocks over through a queue of at most
+//! num_blocks blocks, while the consuming thread reads them. Thus everything
+//! upstream (e.g. the runs_merger of a sort, with its reads and merging) runs
+//! concurrently with everything downstream (e.g. the runs_creator of the next
+//! sort, with its internal sorting and writes). The thread is started by the
+//! constructor, from then on the input must not be accessed by others until
+//! the pipe is empty or destroyed. Exceptions thrown upstream end the pipe
+//! and are rethrown to the consumer as std::runtime_error.
+//!
+//! \tparam Input type of the input stream
+template <class Input>
+class async_pipe : private noncopyable
+{
+public:
+    //! Standard stream typedef.
+    typedef typename Input::value_type value_type;
+
+    typedef async_pipe<Input> self_type;
+
+    //! Bulk stream typedef, see stream::pull().
+    typedef bulk_pull_tag pull_category;
+
+protected:
+    //! a block of elements handed over between the threads
+    struct buffer
+    {
+        value_type* data;
+        unsigned_type size;
+    };
+
+    typedef std::deque<buffer*> buffer_queue;
+
+    //! the input stream, accessed only by the upstream thread
+    Input& m_input;
+
+    //! number of elements in a block
+    unsigned_type m_block_items;
+
+    //! all blocks
+    simple_vector<buffer> m_buffers;
+
+    //! empty blocks to be filled and filled blocks to be consumed
+    buffer_queue m_free, m_full;
+
+    //! protects the queues and the flags below
+    mutex m_mutex;
+
+    //! signaled when a block is freed or the pipe is destroyed
+    condition_variable m_free_cond;
+
+    //! signaled when a block is filled or the upstream is done
+    condition_variable m_full_cond;
+
+    //! upstream thread has pushed its last block
+    bool m_done;
+
+    //! consumer is destroyed, upstream thread shall stop
+    bool m_abort;
+
+    //! message of an exception thrown upstream
+    std::string m_error;
+
+    //! block currently consumed, and position within it
+    mutable buffer* m_current;
+    mutable unsigned_type m_pos;
+
+    //! all blocks have been consumed
+    mutable bool m_finished;
+
+    //! the upstream thread
+    thread m_thread;
+
+    static void * worker(void* arg)
+    {
+        static_cast<self_type*>(arg)->produce();
+        return NULL;
+    }
+
+    //! upstream thread: fill blocks until the input is empty
+    void produce()
+    {
+        try
+        {
+            bool last = false;
+            while (!last)
+            {
+                buffer* b;
+                {
+                    scoped_mutex_lock lock(m_mutex);
+                    while (m_free.empty() && !m_abort)
+                        m_free_cond.wait(lock);
+                    if (m_abort)
+                        break;
+                    b = m_free.front();
+                    m_free.pop_front();
+                }
+
+                b->size = stream::pull(m_input, b->data, m_block_items);
+                last = m_input.empty();
+
+                scoped_mutex_lock lock(m_mutex);
+                if (b->size > 0)
+                {
+                    m_full.push_back(b);
+                    m_full_cond.notify_one();
+                }
+                else
+                    m_free.push_back(b);
+            }
+        }
+        catch (std::exception& e)
+        {
+            scoped_mutex_lock lock(m_mutex);
+            m_error = e.what();
+            if (m_error.empty())
+                m_error = "unknown error";
+        }
+
+        scoped_mutex_lock lock(m_mutex);
+        m_done = true;
+        m_full_cond.notify_one();
+    }
+
+    //! consumer: return the current block and take the next filled one
+    void fetch() const
+    {
+        self_type* self = const_cast<self_type*>(this);
+        scoped_mutex_lock lock(self->m_mutex);
+
+        if (m_current)
+        {
+            self->m_free.push_back(m_current);
+            self->m_free_cond.notify_one();
+            m_current = NULL;
+        }
+
+        while (self->m_full.empty() && !self->m_done)
+            self->m_full_cond.wait(lock);
+
+        if (!self->m_full.empty())
+        {
+            m_current = self->m_full.front();
+            self->m_full.pop_front();
+            m_pos = 0;
+        }
+        else
+        {
+            m_finished = true;
+            if (!m_error.empty())
+                STXXL_THROW(std::runtime_error, "upstream of async_pipe failed: " << m_error);
+        }
+    }
+
+public:
+    //! Start pulling input on a separate thread.
+    //! \param input input stream
+    //! \param block_bytes size of the blocks handed over, in bytes
+    //! \param num_blocks number of blocks, at least 2
+    async_pipe(Input& input, unsigned_type block_bytes = 1024 * 1024,
+               unsigned_type num_blocks = 4)
+        : m_input(input),
+          m_block_items(std::max<unsigned_type>(block_bytes / sizeof(value_type), 1)),
+          m_buffers(std::max<unsigned_type>(num_blocks, 2)),
+          m_done(false), m_abort(false),
+          m_current(NULL), m_pos(0), m_finished(false)
+    {
+        for (unsigned_type i = 0; i < m_buffers.size(); ++i)
+        {
+            m_buffers[i].data = new value_type[m_block_items];
+            m_buffers[i].size = 0;
+            m_free.push_back(&m_buffers[i]);
+        }
+
+        m_thread.start(worker, this);
+    }
+
+    //! Stop the upstream thread, after it has filled its current block.
+    ~async_pipe()
+    {
+        {
+            scoped_mutex_lock lock(m_mutex);
+            m_abort = true;
+            m_free_cond.notify_one();
+        }
+        m_thread.join();
+
+        for (unsigned_type i = 0; i < m_buffers.size(); ++i)
+            delete[] m_buffers[i].data;
+    }
+
+    //! Standard stream method.
+    const value_type& operator * () const
+    {
+        if (!m_current)
+            fetch();
+        assert(m_current);
+        return m_current->data[m_pos];
+    }
+
+    const value_type* operator -> () const
+    {
+        return &(operator * ());
+    }
+
+    //! Standard stream method.
+    self_type& operator ++ ()
+    {
+        if (!m_current)
+            fetch();
+        assert(m_current);
+        if (++m_pos == m_current->size)
+            fetch();
+        return *this;
+    }
+
+    //! Standard stream method.
+    bool empty() const
+    {
+        if (!m_current && !m_finished)
+            fetch();
+        return m_finished;
+    }
+
+    //! Bulk stream method, copies from the handed over blocks.
+    unsigned_type pull(value_type* out, unsigned_type max)
+    {
+        unsigned_type n = 0;
+        while (n < max && !empty())
+        {
+            const unsigned_type k = std::min(max - n, m_current->size - m_pos);
+            std::copy(m_current->data + m_pos, m_current->data + m_pos + k, out + n);
+            n += k;
+            m_pos += k;
+            if (m_pos == m_current->size)
+                fetch();
+        }
+        return n;
+    }
+};
+
+//! \}
+
+} // namespace stream
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_STREAM_ASYNC_PIPE_HEADER
+// vim: et:ts=4:sw=4
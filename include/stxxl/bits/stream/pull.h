@@ -0,0 +1,149 @@
+/***************************************************************************
+ *  include/stxxl/bits/stream/pull.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_STREAM_PULL_HEADER
+#define STXXL_STREAM_PULL_HEADER
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/common/types.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! Stream package subnamespace.
+namespace stream {
+
+//! \addtogroup streampack
+//! \{
+
+////////////////////////////////////////////////////////////////////////
+//     BULK PULL                                                      //
+////////////////////////////////////////////////////////////////////////
+
+//! Tag of streams which implement the bulk protocol natively.
+//!
+//! Such a stream declares <tt>typedef bulk_pull_tag pull_category;</tt> and a
+//! method <tt>unsigned_type pull(value_type* out, unsigned_type max)</tt>,
+//! which behaves like \c stream::pull().
+struct bulk_pull_tag { };
+
+//! Determines whether \c Stream implements the bulk protocol natively.
+template <class Stream>
+class has_bulk_pull
+{
+    typedef char yes_type;
+    struct no_type { char c[2]; };
+
+    template <class S>
+    static yes_type test(typename S::pull_category*);
+    template <class S>
+    static no_type test(...);
+
+public:
+    enum { value = (sizeof(test<Stream>(0)) == sizeof(yes_type)) };
+};
+
+//! Element-wise bulk pull for streams without a native one.
+template <class Stream, bool Native = has_bulk_pull<Stream>::value>
+struct bulk_puller
+{
+    typedef typename Stream::value_type value_type;
+
+    static unsigned_type pull(Stream& in, value_type* out, unsigned_type max)
+    {
+        unsigned_type n = 0;
+        while (n < max && !in.empty())
+        {
+            out[n++] = *in;
+            ++in;
+        }
+        return n;
+    }
+};
+
+template <class Stream>
+struct bulk_puller<Stream, true>
+{
+    typedef typename Stream::value_type value_type;
+
+    static unsigned_type pull(Stream& in, value_type* out, unsigned_type max)
+    {
+        return in.pull(out, max);
+    }
+};
+
+//! Copies the next (up to) max elements of a stream to out and advances the
+//! stream past them, using the native bulk method of the stream if it has
+//! one.
+//! \param in input stream
+//! \param out array of at least max elements
+//! \param max maximum number of elements to copy
+//! \return number of elements copied, less than max only if the stream is
+//! empty afterwards
+template <class Stream>
+unsigned_type pull(Stream& in, typename Stream::value_type* out,
+                   unsigned_type max)
+{
+    return bulk_puller<Stream>::pull(in, out, max);
+}
+
+//! Element-wise bulk pull converting to the value type of out, for streams
+//! without a native bulk pull or with a different value type.
+template <class Stream, class ValueType,
+          bool Native = has_bulk_pull<Stream>::value>
+struct converting_puller
+{
+    static unsigned_type pull(Stream& in, ValueType* out, unsigned_type max)
+    {
+        unsigned_type n = 0;
+        while (n < max && !in.empty())
+        {
+            out[n++] = *in;
+            ++in;
+        }
+        return n;
+    }
+};
+
+template <class Stream, class ValueType, class StreamValueType>
+struct native_converting_puller
+    : public converting_puller<Stream, ValueType, false>
+{ };
+
+template <class Stream, class ValueType>
+struct native_converting_puller<Stream, ValueType, ValueType>
+{
+    static unsigned_type pull(Stream& in, ValueType* out, unsigned_type max)
+    {
+        return in.pull(out, max);
+    }
+};
+
+template <class Stream, class ValueType>
+struct converting_puller<Stream, ValueType, true>
+    : public native_converting_puller<Stream, ValueType,
+                                      typename Stream::value_type>
+{ };
+
+//! Like \c stream::pull(), but out may have a value type to which the
+//! elements of the stream are converted.
+template <class Stream, class ValueType>
+unsigned_type pull_convert(Stream& in, ValueType* out, unsigned_type max)
+{
+    return converting_puller<Stream, ValueType>::pull(in, out, max);
+}
+
+//! \}
+
+} // namespace stream
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_STREAM_PULL_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,678 @@
+/***************************************************************************
+ *  include/stxxl/bits/stream/replacement_selection.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_STREAM_REPLACEMENT_SELECTION_HEADER
+#define STXXL_STREAM_REPLACEMENT_SELECTION_HEADER
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/parallel.h>
+#include <stxxl/bits/algo/radix_sort.h>
+#include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/stream/pull.h>
+#include <stxxl/bits/stream/sort_stream.h>
+
+STXXL_BEGIN_NAMESPACE
+
+namespace stream {
+
+//! \addtogroup streampack
+//! \{
+
+////////////////////////////////////////////////////////////////////////
+//     REPLACEMENT SELECTION                                          //
+////////////////////////////////////////////////////////////////////////
+
+//! Forms sorted runs by batched replacement selection.
+//!
+//! The memory is split into an input block, a workspace and a few write
+//! buffers. When the input block is full, it is partitioned at the last
+//! element written: the larger elements still belong to the current run, the
+//! smaller ones to the next run. Both parts are sorted and moved into the
+//! workspace as mini-runs tagged with their run number, and a loser tree over
+//! all mini-runs selects the next element to write. The workspace is managed
+//! in pages of 1/64 block, which are freed as soon as all their elements are
+//! written, such that the memory of written elements is soon available for
+//! new input. Runs are thus about twice as long as the memory on random
+//! input, and presorted input ends up in a single run.
+//!
+//! \tparam ValueType type of the elements
+//! \tparam CompareType type of comparison object used for sorting the runs
+//! \tparam BlockSize size of blocks used to store the runs
+//! \tparam AllocStr functor that defines allocation strategy for the runs
+template <class ValueType, class CompareType, unsigned BlockSize, class AllocStr>
+class basic_replacement_selection : private noncopyable
+{
+public:
+    typedef ValueType value_type;
+    typedef CompareType cmp_type;
+    typedef typed_block<BlockSize, value_type> block_type;
+
+    //! writes the selected elements as runs
+    typedef runs_creator<from_sorted_sequences<value_type>, cmp_type,
+                         BlockSize, AllocStr> output_type;
+
+    typedef typename output_type::sorted_runs_data_type sorted_runs_data_type;
+    typedef typename output_type::sorted_runs_type sorted_runs_type;
+
+    enum {
+        //! number of elements in a workspace page
+        page_size = (block_type::size >= 64) ? block_type::size / 64 : 1
+    };
+
+protected:
+    //! a sorted sequence of elements of one run in a chain of pages, empty
+    //! if size is zero, then its run is empty_run and its head the sentinel
+    struct mini_run
+    {
+        //! next element and end of its page
+        const value_type* head;
+        const value_type* page_end;
+        //! page of the next element
+        unsigned_type page;
+        //! number of elements left
+        unsigned_type size;
+        //! run number
+        unsigned_type run;
+    };
+
+    //! predicate of elements belonging to the next run
+    struct less_than
+    {
+        const CompareType& cmp;
+        const value_type& value;
+
+        less_than(const CompareType& c, const value_type& v) : cmp(c), value(v) { }
+
+        bool operator () (const value_type& a) const
+        {
+            return cmp(a, value);
+        }
+    };
+
+    //! comparator object to sort runs
+    CompareType m_cmp;
+
+    //! memory in blocks: input block and workspace
+    unsigned_type m_num_blocks;
+    block_type* m_blocks;
+
+    //! the workspace pages, the page following each page of a mini-run, and
+    //! the free pages
+    value_type* m_pages;
+    simple_vector<unsigned_type> m_next_page;
+    std::vector<unsigned_type> m_free_pages;
+
+    //! the mini-runs, their number is a power of two
+    std::vector<mini_run> m_mini_runs;
+    std::vector<unsigned_type> m_free_mini_runs;
+
+    //! loser tree over the mini-runs, m_entry[0] is the winner
+    std::vector<unsigned_type> m_entry;
+
+    //! head of the empty mini-runs, the maximum value
+    value_type m_sentinel;
+
+    //! last winner of the loser tree, and the number of times it has won in
+    //! succession
+    unsigned_type m_last_winner;
+    unsigned_type m_streak;
+
+    //! number of elements in the input block
+    unsigned_type m_fill;
+
+    //! run currently written, and the element written last
+    unsigned_type m_run;
+    value_type m_last;
+    bool m_has_last;
+
+    //! number of elements added
+    external_size_type m_elements;
+
+    //! writes the runs
+    output_type m_output;
+
+    //! run number of empty mini-runs
+    static const unsigned_type empty_run = (unsigned_type)(-1);
+
+    //! number of write buffers of the output, the remaining memory is the
+    //! input block and the workspace
+    static unsigned_type output_blocks(unsigned_type memsize)
+    {
+        return std::max<unsigned_type>(memsize / 8, 2);
+    }
+
+    value_type * page(unsigned_type i)
+    {
+        return m_pages + i * page_size;
+    }
+
+    //! mark a mini-run as empty
+    void clear_mini_run(mini_run& r)
+    {
+        r.head = &m_sentinel;
+        r.size = 0;
+        r.run = empty_run;
+    }
+
+    //! mini-run a is selected before mini-run b
+    bool less(unsigned_type a, unsigned_type b) const
+    {
+        const mini_run& x = m_mini_runs[a], & y = m_mini_runs[b];
+        if (x.run != y.run)
+            return x.run < y.run;
+        return m_cmp(*x.head, *y.head);
+    }
+
+    unsigned_type init_winner(unsigned_type root)
+    {
+        if (root >= m_mini_runs.size())
+            return root - m_mini_runs.size();
+
+        unsigned_type left = init_winner(2 * root);
+        unsigned_type right = init_winner(2 * root + 1);
+        if (less(right, left))
+        {
+            m_entry[root] = left;
+            return right;
+        }
+        else
+        {
+            m_entry[root] = right;
+            return left;
+        }
+    }
+
+    //! replay the games of mini-run i after its head has advanced
+    void update_on_advance(unsigned_type i)
+    {
+        unsigned_type winner = i;
+        for (unsigned_type node = (m_mini_runs.size() + i) / 2; node > 0; node /= 2)
+        {
+            if (less(m_entry[node], winner))
+                std::swap(m_entry[node], winner);
+        }
+        m_entry[0] = winner;
+    }
+
+    //! double the number of mini-runs
+    void grow_mini_runs()
+    {
+        const unsigned_type old_size = m_mini_runs.size();
+        m_mini_runs.resize(2 * old_size);
+        m_entry.resize(m_mini_runs.size());
+
+        for (unsigned_type i = m_mini_runs.size(); i > old_size; )
+        {
+            clear_mini_run(m_mini_runs[--i]);
+            m_free_mini_runs.push_back(i);
+        }
+    }
+
+    //! move the sorted elements [begin,end) of a run into the workspace
+    void add_mini_run(const value_type* begin, const value_type* end,
+                      unsigned_type run)
+    {
+        if (begin == end)
+            return;
+
+        if (m_free_mini_runs.empty())
+            grow_mini_runs();
+        mini_run& r = m_mini_runs[m_free_mini_runs.back()];
+        m_free_mini_runs.pop_back();
+
+        r.size = end - begin;
+        r.run = run;
+
+        unsigned_type* link = &r.page;
+        while (begin != end)
+        {
+            assert(!m_free_pages.empty());
+            *link = m_free_pages.back();
+            m_free_pages.pop_back();
+
+            const unsigned_type n = std::min<unsigned_type>(end - begin, page_size);
+            std::copy(begin, begin + n, page(*link));
+            begin += n;
+            link = &m_next_page[*link];
+        }
+
+        r.head = page(r.page);
+        r.page_end = r.head + std::min<unsigned_type>(r.size, page_size);
+    }
+
+    //! move the input block into the workspace, as mini-runs of the current
+    //! and the next run
+    void add_input()
+    {
+        // write elements until there are enough free pages
+        while (m_free_pages.size() < div_ceil(m_fill, page_size) + 1)
+            select();
+
+        value_type* begin = m_blocks[0].begin();
+        value_type* end = begin + m_fill;
+
+        // elements smaller than the last one written go into the next run
+        value_type* split = m_has_last ?
+                            std::partition(begin, end, less_than(m_cmp, m_last)) : begin;
+
+        check_sort_settings();
+        potentially_radix_sort(begin, split, m_cmp);
+        potentially_radix_sort(split, end, m_cmp);
+
+        add_mini_run(split, end, m_run);
+        add_mini_run(begin, split, m_run + 1);
+        m_fill = 0;
+
+        // new leaves may be anywhere in the tree, play all games anew
+        m_entry[0] = init_winner(1);
+        m_streak = 0;
+    }
+
+    //! the mini-run selected after the winner w, i.e. the best of the losers
+    //! on the path of w
+    unsigned_type runner_up(unsigned_type w) const
+    {
+        unsigned_type best = m_entry[(m_mini_runs.size() + w) / 2];
+        for (unsigned_type node = (m_mini_runs.size() + w) / 4; node > 0; node /= 2)
+        {
+            if (less(m_entry[node], best))
+                best = m_entry[node];
+        }
+        return best;
+    }
+
+    //! write the smallest element of the workspace, or if the same mini-run
+    //! keeps winning, all elements of its current page up to the next one of
+    //! another mini-run
+    void select()
+    {
+        const unsigned_type w = m_entry[0];
+        mini_run& r = m_mini_runs[w];
+        assert(r.size != 0);
+
+        if (r.run != m_run)
+        {
+            m_output.finish();
+            m_run = r.run;
+        }
+
+        const value_type* end = r.head + 1;
+        if (w != m_last_winner)
+        {
+            m_last_winner = w;
+            m_streak = 0;
+        }
+        else if (++m_streak >= 2)
+        {
+            // presorted input: the winner is followed by many of its own
+            // elements, find them by binary search instead of playing games
+            const mini_run& next = m_mini_runs[runner_up(w)];
+            end = (next.run != r.run) ? r.page_end :
+                  std::upper_bound(end, r.page_end, *next.head, m_cmp);
+        }
+
+        for (const value_type* it = r.head; it != end; ++it)
+            m_output.push(*it);
+        m_last = *(end - 1);
+        m_has_last = true;
+
+        if ((r.size -= end - r.head) == 0)
+        {
+            m_free_pages.push_back(r.page);
+            m_free_mini_runs.push_back(w);
+            clear_mini_run(r);
+        }
+        else if ((r.head = end) == r.page_end)
+        {
+            m_free_pages.push_back(r.page);
+            r.page = m_next_page[r.page];
+            r.head = page(r.page);
+            r.page_end = r.head + std::min<unsigned_type>(r.size, page_size);
+        }
+        update_on_advance(w);
+    }
+
+public:
+    //! Throws bad_parameter if the memory does not suffice.
+    static void check_memory(unsigned_type memory_to_use)
+    {
+        if (!(5 * BlockSize * sort_memory_usage_factor() <= memory_to_use)) {
+            throw bad_parameter("stxxl::replacement_selection_runs_creator<>: "
+                                "INSUFFICIENT MEMORY provided, "
+                                "please increase parameter 'memory_to_use'");
+        }
+    }
+
+    //! Allocates the workspace and write buffers.
+    //! \param cmp comparator object
+    //! \param memory_to_use memory amount that is allowed to used by the
+    //! sorter in bytes
+    basic_replacement_selection(CompareType cmp, unsigned_type memory_to_use)
+        : m_cmp(cmp),
+          m_num_blocks((check_memory(memory_to_use), memory_to_use / BlockSize / sort_memory_usage_factor())),
+          m_blocks(NULL),
+          m_sentinel(cmp.max_value()),
+          m_last_winner(0), m_streak(0),
+          m_fill(0),
+          m_run(0), m_has_last(false),
+          m_elements(0),
+          m_output(cmp, output_blocks(m_num_blocks) * BlockSize * sort_memory_usage_factor())
+    {
+        m_num_blocks -= output_blocks(m_num_blocks);
+        assert(m_num_blocks >= 3);
+
+        // the first block collects the input, the others are the workspace
+        m_blocks = new block_type[m_num_blocks];
+        m_pages = m_blocks[1].begin();
+
+        const unsigned_type num_pages = (m_num_blocks - 1) * block_type::size / page_size;
+        m_next_page.resize(num_pages);
+        for (unsigned_type i = num_pages; i > 0; )
+            m_free_pages.push_back(--i);
+
+        m_mini_runs.resize(64);
+        m_entry.resize(m_mini_runs.size());
+        for (unsigned_type i = m_mini_runs.size(); i > 0; )
+        {
+            clear_mini_run(m_mini_runs[--i]);
+            m_free_mini_runs.push_back(i);
+        }
+        m_entry[0] = init_winner(1);
+    }
+
+    ~basic_replacement_selection()
+    {
+        delete[] m_blocks;
+    }
+
+    //! Adds an element.
+    void push(const value_type& val)
+    {
+        m_blocks[0][m_fill] = val;
+        ++m_elements;
+        if (++m_fill == block_type::size)
+            add_input();
+    }
+
+    //! Adds elements of a stream, at most until the input block is full.
+    template <class Input>
+    void push_from(Input& input)
+    {
+        const unsigned_type n = stream::pull(
+            input, m_blocks[0].begin() + m_fill, block_type::size - m_fill);
+        m_elements += n;
+        if ((m_fill += n) == block_type::size)
+            add_input();
+    }
+
+    //! Number of elements added.
+    external_size_type size() const
+    {
+        return m_elements;
+    }
+
+    //! Writes all elements and returns the sorted runs, no more elements can
+    //! be added afterwards.
+    sorted_runs_type finish()
+    {
+        if (m_elements == m_fill)
+        {
+            // small input, do not flush it on the disk(s)
+            STXXL_VERBOSE1("basic_replacement_selection: Small input optimization, input length: " << m_elements);
+            value_type* begin = m_blocks[0].begin();
+            check_sort_settings();
+            potentially_radix_sort(begin, begin + m_fill, m_cmp);
+
+            sorted_runs_type result = m_output.result();
+            result->small_run.assign(begin, begin + m_fill);
+            result->elements = m_fill;
+            return result;
+        }
+
+        if (m_fill > 0)
+            add_input();
+
+        while (m_mini_runs[m_entry[0]].size != 0)
+            select();
+
+        sorted_runs_type result = m_output.result();
+        STXXL_VERBOSE1("basic_replacement_selection: " << m_elements << " elements in " << result->runs.size() << " runs");
+        return result;
+    }
+};
+
+//! Forms sorted runs of data from a stream by replacement selection, see
+//! basic_replacement_selection. Can be used as RunsCreatorType of \c
+//! stream::sort.
+//!
+//! \tparam Input type of the input stream
+//! \tparam CompareType type of comparison object used for sorting the runs
+//! \tparam BlockSize size of blocks used to store the runs
+//! \tparam AllocStr functor that defines allocation strategy for the runs
+template <
+    class Input,
+    class CompareType,
+    unsigned BlockSize = STXXL_DEFAULT_BLOCK_SIZE(typename Input::value_type),
+    class AllocStr = STXXL_DEFAULT_ALLOC_STRATEGY>
+class replacement_selection_runs_creator : private noncopyable
+{
+public:
+    typedef Input input_type;
+    typedef CompareType cmp_type;
+    typedef typename Input::value_type value_type;
+
+    typedef basic_replacement_selection<value_type, CompareType,
+                                        BlockSize, AllocStr> selection_type;
+
+    typedef typename selection_type::block_type block_type;
+    typedef typename selection_type::sorted_runs_data_type sorted_runs_data_type;
+    typedef typename selection_type::sorted_runs_type sorted_runs_type;
+
+protected:
+    //! reference to the input stream
+    Input& m_input;
+    //! comparator used to sort block groups
+    CompareType m_cmp;
+
+    //! stores the result (sorted runs) as smart pointer
+    sorted_runs_type m_result;
+    //! memory size in bytes to use
+    unsigned_type m_memory_to_use;
+    //! true iff result is already computed (used in 'result()' method)
+    bool m_result_computed;
+
+public:
+    //! Create the object.
+    //! \param input input stream
+    //! \param cmp comparator object
+    //! \param memory_to_use memory amount that is allowed to used by the
+    //! sorter in bytes
+    replacement_selection_runs_creator(Input& input, CompareType cmp,
+                                       unsigned_type memory_to_use)
+        : m_input(input),
+          m_cmp(cmp),
+          m_memory_to_use(memory_to_use),
+          m_result_computed(false)
+    {
+        selection_type::check_memory(memory_to_use);
+    }
+
+    //! Returns the sorted runs object.
+    //! \return Sorted runs object. The result is computed lazily, i.e. on the
+    //! first call, the memory is used only during the computation.
+    sorted_runs_type & result()
+    {
+        if (!m_result_computed)
+        {
+            selection_type selection(m_cmp, m_memory_to_use);
+            while (!m_input.empty())
+                selection.push_from(m_input);
+            m_result = selection.finish();
+            m_result_computed = true;
+#ifdef STXXL_PRINT_STAT_AFTER_RF
+            STXXL_MSG(*stats::get_instance());
+#endif          //STXXL_PRINT_STAT_AFTER_RF
+        }
+        return m_result;
+    }
+};
+
+//! Forms sorted runs of elements passed in push() method by replacement
+//! selection, see basic_replacement_selection. Can be used as
+//! RunsCreatorType of \c stxxl::sorter.
+//!
+//! \tparam ValueType type of values (parameter for \c use_push strategy)
+//! \tparam CompareType type of comparison object used for sorting the runs
+//! \tparam BlockSize size of blocks used to store the runs
+//! \tparam AllocStr functor that defines allocation strategy for the runs
+template <
+    class ValueType,
+    class CompareType,
+    unsigned BlockSize,
+    class AllocStr
+    >
+class replacement_selection_runs_creator<
+        use_push<ValueType>,
+        CompareType,
+        BlockSize,
+        AllocStr
+        >: private noncopyable
+{
+public:
+    typedef CompareType cmp_type;
+    typedef ValueType value_type;
+
+    typedef basic_replacement_selection<value_type, CompareType,
+                                        BlockSize, AllocStr> selection_type;
+
+    typedef typename selection_type::block_type block_type;
+    typedef typename selection_type::sorted_runs_data_type sorted_runs_data_type;
+    typedef typename selection_type::sorted_runs_type sorted_runs_type;
+    typedef sorted_runs_type result_type;
+
+private:
+    //! comparator object to sort runs
+    CompareType m_cmp;
+
+    //! stores the result (sorted runs) in a reference counted object
+    sorted_runs_type m_result;
+
+    //! memory size in bytes to use
+    const unsigned_type m_memory_to_use;
+
+    //! true after the result() method was called for the first time
+    bool m_result_computed;
+
+    //! workspace holding the elements until result()
+    selection_type* m_selection;
+
+public:
+    //! Creates the object.
+    //! \param cmp comparator object
+    //! \param memory_to_use memory amount that is allowed to used by the sorter in bytes
+    replacement_selection_runs_creator(CompareType cmp, unsigned_type memory_to_use)
+        : m_cmp(cmp),
+          m_memory_to_use(memory_to_use),
+          m_result_computed(false),
+          m_selection(NULL)
+    {
+        selection_type::check_memory(memory_to_use);
+        allocate();
+    }
+
+    ~replacement_selection_runs_creator()
+    {
+        delete m_selection;
+    }
+
+    //! Clear current state and remove all items.
+    void clear()
+    {
+        delete m_selection;
+        m_selection = NULL;
+        m_selection = new selection_type(m_cmp, m_memory_to_use);
+
+        m_result = NULL;
+        m_result_computed = false;
+    }
+
+    //! Allocates input buffers and clears result.
+    void allocate()
+    {
+        clear();
+    }
+
+    //! Deallocates input buffers but not the current result.
+    void deallocate()
+    {
+        result();       // finishes result
+
+        delete m_selection;
+        m_selection = NULL;
+    }
+
+    //! Adds new element to the sorter.
+    //! \param val value to be added
+    void push(const value_type& val)
+    {
+        assert(m_result_computed == false);
+        m_selection->push(val);
+    }
+
+    //! Returns the sorted runs object.
+    //! \return Sorted runs object.
+    //! \remark Returned object is intended to be used by \c runs_merger object as input
+    sorted_runs_type & result()
+    {
+        if (!m_result_computed)
+        {
+            m_result = m_selection->finish();
+            m_result_computed = true;
+#ifdef STXXL_PRINT_STAT_AFTER_RF
+            STXXL_MSG(*stats::get_instance());
+#endif          //STXXL_PRINT_STAT_AFTER_RF
+        }
+        return m_result;
+    }
+
+    //! number of items currently inserted.
+    external_size_type size() const
+    {
+        return m_result_computed ? m_result->elements : m_selection->size();
+    }
+
+    //! return comparator object.
+    const cmp_type & cmp() const
+    {
+        return m_cmp;
+    }
+
+    //! return memory size used (in bytes).
+    unsigned_type memory_used() const
+    {
+        return m_memory_to_use;
+    }
+};
+
+//! \}
+
+} // namespace stream
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_STREAM_REPLACEMENT_SELECTION_HEADER
+// vim: et:ts=4:sw=4
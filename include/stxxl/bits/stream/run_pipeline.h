@@ -0,0 +1,400 @@
+/***************************************************************************
+ *  include/stxxl/bits/stream/run_pipeline.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_STREAM_RUN_PIPELINE_HEADER
+#define STXXL_STREAM_RUN_PIPELINE_HEADER
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/parallel.h>
+#include <stxxl/bits/algo/adaptor.h>
+#include <stxxl/bits/algo/radix_sort.h>
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/simple_vector.h>
+#include <stxxl/bits/common/thread.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/disk_queues.h>
+#include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/mng/block_manager.h>
+
+#ifndef STXXL_OVERLAP_RUN_FORMATION
+//! sort the runs of the stream runs creators on a separate thread, while the
+//! next run is filled, see overlap_run_formation()
+#define STXXL_OVERLAP_RUN_FORMATION 1
+#endif // STXXL_OVERLAP_RUN_FORMATION
+
+STXXL_BEGIN_NAMESPACE
+
+namespace stream {
+
+//! \addtogroup streampack
+//! \{
+
+////////////////////////////////////////////////////////////////////////
+//     RUN FORMATION PIPELINE                                         //
+////////////////////////////////////////////////////////////////////////
+
+//! Whether run_pipeline sorts the runs on a separate thread: by default only
+//! if the hardware runs more than one thread. Setting the environment
+//! variable STXXL_OVERLAP_RUN_FORMATION to 1 or 0 forces it on or off for
+//! the pipelines created afterwards.
+inline bool overlap_run_formation()
+{
+    const char* env = getenv("STXXL_OVERLAP_RUN_FORMATION");
+    if (env && *env)
+        return atoi(env) != 0;
+    return thread::hardware_concurrency() > 1;
+}
+
+//! Pipeline of run buffers used by the runs creators: while one buffer is
+//! filled by the caller, the previously filled one is sorted by a separate
+//! thread and the one before is written to disk.
+//!
+//! The memory of memsize blocks is split into three run buffers. Sorting on a
+//! separate thread only pays off with a spare core, as the runs become a
+//! third of the memory instead of half. Hence if overlap_run_formation() is
+//! false, e.g. on a single core machine, or if the macro
+//! STXXL_OVERLAP_RUN_FORMATION is 0, there are two run buffers, the runs are
+//! sorted by submit() itself and only the writing overlaps with filling. A
+//! buffer is reused only after its run has been sorted and written. The runs
+//! are added to the result in the order they were submitted.
+//!
+//! \tparam SortedRunsData type of the sorted_runs the runs are added to
+//! \tparam CompareType type of comparison object used for sorting the runs
+//! \tparam AllocStr functor that defines allocation strategy for the runs
+template <class SortedRunsData, class CompareType, class AllocStr>
+class run_pipeline : private noncopyable
+{
+public:
+    typedef SortedRunsData sorted_runs_data_type;
+    typedef typename sorted_runs_data_type::block_type block_type;
+    typedef typename sorted_runs_data_type::run_type run_type;
+    typedef typename block_type::value_type value_type;
+
+    typedef typename element_iterator_traits<block_type, external_size_type>::element_iterator element_iterator;
+
+protected:
+    //! a run buffer with the state of its run
+    struct buffer
+    {
+        //! blocks of the buffer
+        block_type* blocks;
+        //! write requests of the blocks
+        request_ptr* write_reqs;
+        //! number of elements submitted
+        unsigned_type elements;
+        //! sorted runs the run is added to
+        sorted_runs_data_type* result;
+    };
+
+    typedef std::deque<buffer*> buffer_queue;
+
+    //! comparator used to sort the runs
+    CompareType m_cmp;
+
+    //! whether runs are sorted by the sort thread
+    bool m_overlap;
+
+    //! number of blocks of a buffer
+    unsigned_type m_buffer_blocks;
+
+    //! the run buffers, and the memory of all their blocks
+    simple_vector<buffer> m_buffers;
+    block_type* m_blocks;
+    request_ptr* m_write_reqs;
+
+    //! index of the buffer handed out by the last get_buffer()
+    unsigned_type m_current;
+
+    //! number of runs submitted since the last clear()
+    unsigned_type m_submitted;
+
+    //! submitted buffers waiting to be sorted, and number of submitted
+    //! buffers not processed yet
+    buffer_queue m_queue;
+    unsigned_type m_pending;
+
+    //! protects the queue and the state below
+    mutex m_mutex;
+
+    //! signaled when a buffer is submitted or the pipeline is destroyed
+    condition_variable m_work_cond;
+
+    //! signaled when a buffer has been processed
+    condition_variable m_done_cond;
+
+    //! the sort thread shall stop
+    bool m_abort;
+
+    //! message of an exception thrown while processing a run
+    std::string m_error;
+
+    //! the sort thread, started by the first submit()
+    thread m_thread;
+
+    static void * worker(void* arg)
+    {
+        static_cast<run_pipeline*>(arg)->work();
+        return NULL;
+    }
+
+    //! sort thread: process submitted buffers until aborted
+    void work()
+    {
+        while (true)
+        {
+            buffer* b;
+            {
+                scoped_mutex_lock lock(m_mutex);
+                while (m_queue.empty() && !m_abort)
+                    m_work_cond.wait(lock);
+                if (m_queue.empty())
+                    break;
+
+                b = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            std::string error = process_noexcept(b);
+
+            scoped_mutex_lock lock(m_mutex);
+            if (!error.empty() && m_error.empty())
+                m_error = error;
+            b->result = NULL;
+            --m_pending;
+            m_done_cond.notify_all();
+        }
+    }
+
+    //! process a buffer and return the message of an exception thrown
+    std::string process_noexcept(buffer* b)
+    {
+        try
+        {
+            process(b);
+        }
+        catch (std::exception& e)
+        {
+            std::string error = e.what();
+            return error.empty() ? std::string("unknown error") : error;
+        }
+        return std::string();
+    }
+
+    //! sort the run of a buffer, allocate its blocks and start writing
+    void process(buffer* b)
+    {
+        check_sort_settings();
+        potentially_radix_sort(make_element_iterator(b->blocks, 0),
+                               make_element_iterator(b->blocks, b->elements),
+                               m_cmp);
+
+        const unsigned_type run_blocks = div_ceil(b->elements, block_type::size);
+        run_type run(run_blocks);
+        block_manager::get_instance()->new_blocks(
+            AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
+
+        // fill the rest of the last block with max values
+        std::fill(make_element_iterator(b->blocks, b->elements),
+                  make_element_iterator(b->blocks, run_blocks * block_type::size),
+                  m_cmp.max_value());
+
+        for (unsigned_type i = 0; i < run_blocks; ++i)
+        {
+            run[i].value = b->blocks[i][0];
+            b->write_reqs[i] = b->blocks[i].write(run[i].bid);
+        }
+
+        // the result is only accessed by the sort thread until finish()
+        b->result->add_run(run, b->elements);
+    }
+
+    //! wait until all submitted buffers are processed, and stop the thread
+    //! on abort
+    void wait_idle(bool abort)
+    {
+        {
+            scoped_mutex_lock lock(m_mutex);
+            while (m_pending > 0)
+                m_done_cond.wait(lock);
+            if (abort)
+            {
+                m_abort = true;
+                m_work_cond.notify_one();
+            }
+        }
+        if (abort)
+            m_thread.join();
+    }
+
+    //! wait for the writes of a buffer
+    void wait_writes(buffer& b)
+    {
+        for (unsigned_type i = 0; i < m_buffer_blocks; ++i)
+        {
+            if (b.write_reqs[i].get())
+            {
+                b.write_reqs[i]->wait();
+                b.write_reqs[i] = NULL;
+            }
+        }
+    }
+
+public:
+    //! Allocate the run buffers.
+    //! \param cmp comparator object
+    //! \param memsize number of blocks of all buffers together, at least 2
+    run_pipeline(CompareType cmp, unsigned_type memsize)
+        : m_cmp(cmp),
+          m_overlap(STXXL_OVERLAP_RUN_FORMATION && memsize >= 3 &&
+                    overlap_run_formation()),
+          m_buffers(m_overlap ? 3 : 2),
+          m_current(0), m_submitted(0), m_pending(0), m_abort(false)
+    {
+        assert(memsize >= 2);
+        m_buffer_blocks = memsize / m_buffers.size();
+        m_blocks = new block_type[m_buffers.size() * m_buffer_blocks];
+        m_write_reqs = new request_ptr[m_buffers.size() * m_buffer_blocks];
+
+        for (unsigned_type i = 0; i < m_buffers.size(); ++i)
+        {
+            m_buffers[i].blocks = m_blocks + i * m_buffer_blocks;
+            m_buffers[i].write_reqs = m_write_reqs + i * m_buffer_blocks;
+            m_buffers[i].elements = 0;
+            m_buffers[i].result = NULL;
+        }
+    }
+
+    //! Stop the sort thread and wait for all writes before releasing the
+    //! buffers.
+    ~run_pipeline()
+    {
+        wait_idle(true);
+        for (unsigned_type i = 0; i < m_buffers.size(); ++i)
+            wait_writes(m_buffers[i]);
+
+        delete[] m_write_reqs;
+        delete[] m_blocks;
+    }
+
+    //! Number of elements of a run buffer.
+    unsigned_type buffer_size() const
+    {
+        return m_buffer_blocks * block_type::size;
+    }
+
+    //! Whether the runs are sorted on a separate thread.
+    bool overlapped() const
+    {
+        return m_overlap;
+    }
+
+    //! Number of runs submitted since the last clear().
+    unsigned_type submitted() const
+    {
+        return m_submitted;
+    }
+
+    //! Returns the blocks of the next run buffer to be filled, waits until
+    //! its previous run is sorted and written.
+    block_type * get_buffer()
+    {
+        m_current = (m_current + 1) % m_buffers.size();
+        buffer& b = m_buffers[m_current];
+        {
+            scoped_mutex_lock lock(m_mutex);
+            while (b.result != NULL)
+                m_done_cond.wait(lock);
+        }
+        wait_writes(b);
+        return b.blocks;
+    }
+
+    //! Returns the blocks of the run buffer handed out last.
+    block_type * current_buffer()
+    {
+        return m_buffers[m_current].blocks;
+    }
+
+    //! Sorts the elements of the run buffer handed out last (in the
+    //! background) and writes them to disk as a run of result.
+    //! \param elements number of elements in the buffer, at least one
+    //! \param result sorted runs the run is added to
+    void submit(unsigned_type elements, sorted_runs_data_type* result)
+    {
+        assert(elements > 0 && elements <= buffer_size());
+        buffer& b = m_buffers[m_current];
+        b.elements = elements;
+        ++m_submitted;
+
+        disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
+
+        if (m_overlap)
+        {
+            if (!m_thread.running())
+                m_thread.start(worker, this);
+
+            scoped_mutex_lock lock(m_mutex);
+            b.result = result;
+            m_queue.push_back(&b);
+            ++m_pending;
+            m_work_cond.notify_one();
+        }
+        else
+        {
+            b.result = result;
+            process(&b);
+            b.result = NULL;
+        }
+    }
+
+    //! Waits until all submitted runs have been sorted, added to their
+    //! results and written.
+    void finish()
+    {
+        wait_idle(false);
+        for (unsigned_type i = 0; i < m_buffers.size(); ++i)
+            wait_writes(m_buffers[i]);
+
+        // the sort thread is idle now
+        if (!m_error.empty())
+        {
+            std::string error;
+            std::swap(error, m_error);
+            STXXL_THROW(std::runtime_error, "run formation failed: " << error);
+        }
+    }
+
+    //! Waits for all submitted runs and starts counting them anew.
+    void clear()
+    {
+        finish();
+        m_submitted = 0;
+    }
+};
+
+//! \}
+
+} // namespace stream
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_STREAM_RUN_PIPELINE_HEADER
+// vim: et:ts=4:sw=4
@@ -24,7 +24,9 @@
 #include <stxxl/bits/algo/adaptor.h>
 #include <stxxl/bits/algo/run_cursor.h>
 #include <stxxl/bits/algo/losertree.h>
+#include <stxxl/bits/algo/radix_sort.h>
 #include <stxxl/bits/stream/sorted_runs.h>
+#include <stxxl/bits/stream/run_pipeline.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -67,6 +69,8 @@ public:
     typedef typename element_iterator_traits<block_type, external_size_type>::element_iterator element_iterator;
 
 protected:
+    typedef run_pipeline<sorted_runs_data_type, CompareType, AllocStr> run_pipeline_type;
+
     //! reference to the input stream
     Input& m_input;
     //! comparator used to sort block groups
@@ -80,43 +84,22 @@ private:
     //! true iff result is already computed (used in 'result()' method)
     bool m_result_computed;
 
-    //! Fetch data from input into blocks[first_idx,last_idx).
-    unsigned_type fetch(block_type* blocks,
-                        unsigned_type first_idx, unsigned_type last_idx)
-    {
-        element_iterator output = make_element_iterator(blocks, first_idx);
-        unsigned_type curr_idx = first_idx;
-        while (!m_input.empty() && curr_idx != last_idx) {
-            *output = *m_input;
-            ++m_input;
-            ++output;
-            ++curr_idx;
-        }
-        return curr_idx;
-    }
-
-    //! fill the rest of the block with max values
-    void fill_with_max_value(block_type* blocks, unsigned_type num_blocks,
-                             unsigned_type first_idx)
+    //! Fetch data from input into the blocks, at most max elements.
+    unsigned_type fetch(block_type* blocks, unsigned_type max)
     {
-        unsigned_type last_idx = num_blocks * block_type::size;
-        if (first_idx < last_idx) {
-            element_iterator curr = make_element_iterator(blocks, first_idx);
-            while (first_idx != last_idx) {
-                *curr = m_cmp.max_value();
-                ++curr;
-                ++first_idx;
-            }
-        }
+        unsigned_type n = 0;
+        for (unsigned_type i = 0; n < max && !m_input.empty(); ++i)
+            n += stream::pull(m_input, blocks[i].elem, block_type::size);
+        return n;
     }
 
     //! Sort a specific run, contained in a sequences of blocks.
     void sort_run(block_type* run, unsigned_type elements)
     {
         check_sort_settings();
-        potentially_parallel::sort(make_element_iterator(run, 0),
-                                   make_element_iterator(run, elements),
-                                   m_cmp);
+        potentially_radix_sort(make_element_iterator(run, 0),
+                               make_element_iterator(run, elements),
+                               m_cmp);
     }
 
     void compute_result();
@@ -163,188 +146,35 @@ public:
 
 //! Finish the results, i. e. create all runs.
 //!
-//! This is the main routine of this class.
+//! This is the main routine of this class. The runs are formed by a
+//! run_pipeline, which sorts and writes a run while the next one is fetched.
 template <class Input, class CompareType, unsigned BlockSize, class AllocStr>
 void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result()
 {
-    unsigned_type i = 0;
-    unsigned_type m2 = m_memsize / 2;
-    const unsigned_type el_in_run = m2 * block_type::size;     // # el in a run
-    STXXL_VERBOSE1("basic_runs_creator::compute_result m2=" << m2);
-    unsigned_type blocks1_length = 0, blocks2_length = 0;
-    block_type* Blocks1 = NULL;
-
-#ifndef STXXL_SMALL_INPUT_PSORT_OPT
-    Blocks1 = new block_type[m2 * 2];
-#else
-    // push input element into small_run vector in result until it is full
-    while (!input.empty() && blocks1_length != block_type::size)
-    {
-        m_result->small_run.push_back(*input);
-        ++input;
-        ++blocks1_length;
-    }
-
-    if (blocks1_length == block_type::size && !input.empty())
-    {
-        Blocks1 = new block_type[m2 * 2];
-        std::copy(m_result->small_run.begin(), m_result->small_run.end(),
-                  Blocks1[0].begin());
-        m_result->small_run.clear();
-    }
-    else
-    {
-        STXXL_VERBOSE1("basic_runs_creator: Small input optimization, input length: " << blocks1_length);
-        m_result->elements = blocks1_length;
-        check_sort_settings();
-        potentially_parallel::sort(m_result->small_run.begin(), m_result->small_run.end(), cmp);
-        return;
-    }
-#endif  //STXXL_SMALL_INPUT_PSORT_OPT
-
-    // the first block may be there already, now fetch until memsize is filled.
-    blocks1_length = fetch(Blocks1, blocks1_length, el_in_run);
-
-    // sort first run
-    sort_run(Blocks1, blocks1_length);
-
-    if (blocks1_length <= block_type::size && m_input.empty())
-    {
-        // small input, do not flush it on the disk(s)
-        STXXL_VERBOSE1("basic_runs_creator: Small input optimization, input length: " << blocks1_length);
-        assert(m_result->small_run.empty());
-        m_result->small_run.assign(Blocks1[0].begin(), Blocks1[0].begin() + blocks1_length);
-        m_result->elements = blocks1_length;
-        delete[] Blocks1;
-        return;
-    }
-
-    block_type* Blocks2 = Blocks1 + m2;
-    block_manager* bm = block_manager::get_instance();
-    request_ptr* write_reqs = new request_ptr[m2];
-    run_type run;
-
-    unsigned_type cur_run_size = div_ceil(blocks1_length, block_type::size);      // in blocks
-    run.resize(cur_run_size);
-    bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-    disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
-
-    // fill the rest of the last block with max values
-    fill_with_max_value(Blocks1, cur_run_size, blocks1_length);
-
-    for (i = 0; i < cur_run_size; ++i)
-    {
-        run[i].value = Blocks1[i][0];
-        write_reqs[i] = Blocks1[i].write(run[i].bid);
-    }
-    m_result->runs.push_back(run);
-    m_result->runs_sizes.push_back(blocks1_length);
-    m_result->elements += blocks1_length;
-
-    if (m_input.empty())
-    {
-        // return
-        wait_all(write_reqs, write_reqs + cur_run_size);
-        delete[] write_reqs;
-        delete[] Blocks1;
-        return;
-    }
-
-    STXXL_VERBOSE1("Filling the second part of the allocated blocks");
-    blocks2_length = fetch(Blocks2, 0, el_in_run);
-
-    if (m_input.empty())
-    {
-        // optimization if the whole set fits into both halves
-        // (re)sort internally and return
-        blocks2_length += el_in_run;
-        sort_run(Blocks1, blocks2_length);      // sort first an second run together
-        wait_all(write_reqs, write_reqs + cur_run_size);
-        bm->delete_blocks(make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-        cur_run_size = div_ceil(blocks2_length, block_type::size);
-        run.resize(cur_run_size);
-        bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-        // fill the rest of the last block with max values
-        fill_with_max_value(Blocks1, cur_run_size, blocks2_length);
-
-        assert(cur_run_size > m2);
-
-        for (i = 0; i < m2; ++i)
-        {
-            run[i].value = Blocks1[i][0];
-            write_reqs[i]->wait();
-            write_reqs[i] = Blocks1[i].write(run[i].bid);
-        }
-
-        request_ptr* write_reqs1 = new request_ptr[cur_run_size - m2];
-
-        for ( ; i < cur_run_size; ++i)
-        {
-            run[i].value = Blocks1[i][0];
-            write_reqs1[i - m2] = Blocks1[i].write(run[i].bid);
-        }
-
-        m_result->runs[0] = run;
-        m_result->runs_sizes[0] = blocks2_length;
-        m_result->elements = blocks2_length;
-
-        wait_all(write_reqs, write_reqs + m2);
-        delete[] write_reqs;
-        wait_all(write_reqs1, write_reqs1 + cur_run_size - m2);
-        delete[] write_reqs1;
-
-        delete[] Blocks1;
-
-        return;
-    }
-
-    // more than 2 runs can be filled, i. e. the general case
-
-    sort_run(Blocks2, blocks2_length);
-
-    cur_run_size = div_ceil(blocks2_length, block_type::size);      // in blocks
-    run.resize(cur_run_size);
-    bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-    for (i = 0; i < cur_run_size; ++i)
-    {
-        run[i].value = Blocks2[i][0];
-        write_reqs[i]->wait();
-        write_reqs[i] = Blocks2[i].write(run[i].bid);
-    }
-    assert((blocks2_length % el_in_run) == 0);
-
-    m_result->add_run(run, blocks2_length);
+    run_pipeline_type pipeline(m_cmp, m_memsize);
+    const unsigned_type el_in_run = pipeline.buffer_size();     // # el in a run
+    STXXL_VERBOSE1("basic_runs_creator::compute_result el_in_run=" << el_in_run);
 
     while (!m_input.empty())
     {
-        blocks1_length = fetch(Blocks1, 0, el_in_run);
-        sort_run(Blocks1, blocks1_length);
-        cur_run_size = div_ceil(blocks1_length, block_type::size);      // in blocks
-        run.resize(cur_run_size);
-        bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
+        block_type* blocks = pipeline.get_buffer();
+        const unsigned_type elements = fetch(blocks, el_in_run);
 
-        // fill the rest of the last block with max values (occurs only on the last run)
-        fill_with_max_value(Blocks1, cur_run_size, blocks1_length);
-
-        for (i = 0; i < cur_run_size; ++i)
+        if (pipeline.submitted() == 0 && elements <= block_type::size && m_input.empty())
         {
-            run[i].value = Blocks1[i][0];
-            write_reqs[i]->wait();
-            write_reqs[i] = Blocks1[i].write(run[i].bid);
+            // small input, do not flush it on the disk(s)
+            STXXL_VERBOSE1("basic_runs_creator: Small input optimization, input length: " << elements);
+            sort_run(blocks, elements);
+            assert(m_result->small_run.empty());
+            m_result->small_run.assign(blocks[0].begin(), blocks[0].begin() + elements);
+            m_result->elements = elements;
+            return;
         }
-        m_result->add_run(run, blocks1_length);
 
-        std::swap(Blocks1, Blocks2);
-        std::swap(blocks1_length, blocks2_length);
+        pipeline.submit(elements, m_result.get());
     }
 
-    wait_all(write_reqs, write_reqs + m2);
-    delete[] write_reqs;
-    delete[] ((Blocks1 < Blocks2) ? Blocks1 : Blocks2);
+    pipeline.finish();
 }
 
 //! Forms sorted runs of data from a stream.
@@ -433,7 +263,7 @@ private:
     //! comparator object to sort runs
     CompareType m_cmp;
 
-    typedef typename sorted_runs_data_type::run_type run_type;
+    typedef run_pipeline<sorted_runs_data_type, CompareType, AllocStr> run_pipeline_type;
 
     //! stores the result (sorted runs) in a reference counted object
     sorted_runs_type m_result;
@@ -444,98 +274,52 @@ private:
     //! memory size in numberr of blocks for internal use
     const unsigned_type m_memsize;
 
-    //! m_memsize / 2
-    const unsigned_type m_m2;
-
     //! true after the result() method was called for the first time
     bool m_result_computed;
 
+    //! run buffers, sorted and written in the background
+    run_pipeline_type* m_pipeline;
+
     //! total number of elements in a run
-    const unsigned_type m_el_in_run;
+    unsigned_type m_el_in_run;
 
-    //! current number of elements in the run m_blocks1
+    //! current number of elements in the run m_blocks
     internal_size_type m_cur_el;
 
-    //! accumulation buffer of size m_m2 blocks, half the available memory size
-    block_type* m_blocks1;
-
-    //! accumulation buffer that is currently being written to disk
-    block_type* m_blocks2;
+    //! number of elements in the submitted runs
+    external_size_type m_submitted_el;
 
-    //! reference to write requests transporting the last accumulation buffer
-    //! to disk
-    request_ptr* m_write_reqs;
-
-    //! run object containing block ids of the run being written to disk
-    run_type run;
+    //! accumulation buffer of the pipeline currently filled
+    block_type* m_blocks;
 
 protected:
-    //!  fill the rest of the block with max values
-    void fill_with_max_value(block_type* blocks, unsigned_type num_blocks,
-                             unsigned_type first_idx)
-    {
-        unsigned_type last_idx = num_blocks * block_type::size;
-        if (first_idx < last_idx) {
-            element_iterator curr = make_element_iterator(blocks, first_idx);
-            while (first_idx != last_idx) {
-                *curr = m_cmp.max_value();
-                ++curr;
-                ++first_idx;
-            }
-        }
-    }
-
     //! Sort a specific run, contained in a sequences of blocks.
     void sort_run(block_type* run, unsigned_type elements)
     {
         check_sort_settings();
-        potentially_parallel::sort(make_element_iterator(run, 0),
-                                   make_element_iterator(run, elements),
-                                   m_cmp);
+        potentially_radix_sort(make_element_iterator(run, 0),
+                               make_element_iterator(run, elements),
+                               m_cmp);
     }
 
     void compute_result()
     {
-        if (m_cur_el == 0)
-            return;
-
-        sort_run(m_blocks1, m_cur_el);
-
-        if (m_cur_el <= block_type::size && m_result->elements == 0)
+        if (m_cur_el > 0 && m_cur_el <= block_type::size && m_pipeline->submitted() == 0)
         {
             // small input, do not flush it on the disk(s)
             STXXL_VERBOSE1("runs_creator(use_push): Small input optimization, input length: " << m_cur_el);
-            m_result->small_run.assign(m_blocks1[0].begin(), m_blocks1[0].begin() + m_cur_el);
+            sort_run(m_blocks, m_cur_el);
+            m_result->small_run.assign(m_blocks[0].begin(), m_blocks[0].begin() + m_cur_el);
             m_result->elements = m_cur_el;
-            return;
         }
-
-        const unsigned_type cur_run_size = div_ceil(m_cur_el, block_type::size);         // in blocks
-        run.resize(cur_run_size);
-        block_manager* bm = block_manager::get_instance();
-        bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-        disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
-
-        // fill the rest of the last block with max values
-        fill_with_max_value(m_blocks1, cur_run_size, m_cur_el);
-
-        unsigned_type i = 0;
-        for ( ; i < cur_run_size; ++i)
+        else if (m_cur_el > 0)
         {
-            run[i].value = m_blocks1[i][0];
-            if (m_write_reqs[i].get())
-                m_write_reqs[i]->wait();
-
-            m_write_reqs[i] = m_blocks1[i].write(run[i].bid);
+            m_pipeline->submit(m_cur_el, m_result.get());
         }
-        m_result->add_run(run, m_cur_el);
 
-        for (i = 0; i < m_m2; ++i)
-        {
-            if (m_write_reqs[i].get())
-                m_write_reqs[i]->wait();
-        }
+        m_submitted_el += m_cur_el;
+        m_cur_el = 0;
+        m_pipeline->finish();
     }
 
 public:
@@ -546,10 +330,9 @@ public:
         : m_cmp(cmp),
           m_memory_to_use(memory_to_use),
           m_memsize(memory_to_use / BlockSize / sort_memory_usage_factor()),
-          m_m2(m_memsize / 2),
-          m_el_in_run(m_m2 * block_type::size),
-          m_blocks1(NULL), m_blocks2(NULL),
-          m_write_reqs(NULL)
+          m_pipeline(NULL),
+          m_el_in_run(0),
+          m_blocks(NULL)
     {
         sort_helper::verify_sentinel_strict_weak_ordering(m_cmp);
         if (!(2 * BlockSize * sort_memory_usage_factor() <= m_memory_to_use)) {
@@ -557,7 +340,7 @@ public:
                                 "INSUFFICIENT MEMORY provided, "
                                 "please increase parameter 'memory_to_use'");
         }
-        assert(m_m2 > 0);
+        assert(m_memsize >= 2);
 
         allocate();
     }
@@ -571,6 +354,9 @@ public:
     //! Clear current state and remove all items.
     void clear()
     {
+        // wait for the runs still being formed
+        m_pipeline->clear();
+
         if (!m_result)
             m_result = new sorted_runs_data_type;
         else
@@ -578,23 +364,17 @@ public:
 
         m_result_computed = false;
         m_cur_el = 0;
-
-        for (unsigned_type i = 0; i < m_m2; ++i)
-        {
-            if (m_write_reqs[i].get())
-                m_write_reqs[i]->cancel();
-        }
+        m_submitted_el = 0;
+        m_blocks = m_pipeline->get_buffer();
     }
 
     //! Allocates input buffers and clears result.
     void allocate()
     {
-        if (!m_blocks1)
+        if (!m_pipeline)
         {
-            m_blocks1 = new block_type[m_m2 * 2];
-            m_blocks2 = m_blocks1 + m_m2;
-
-            m_write_reqs = new request_ptr[m_m2];
+            m_pipeline = new run_pipeline_type(m_cmp, m_memsize);
+            m_el_in_run = m_pipeline->buffer_size();
         }
 
         clear();
@@ -605,13 +385,11 @@ public:
     {
         result();       // finishes result
 
-        if (m_blocks1)
+        if (m_pipeline)
         {
-            delete[] ((m_blocks1 < m_blocks2) ? m_blocks1 : m_blocks2);
-            m_blocks1 = m_blocks2 = NULL;
-
-            delete[] m_write_reqs;
-            m_write_reqs = NULL;
+            delete m_pipeline;
+            m_pipeline = NULL;
+            m_blocks = NULL;
         }
     }
 
@@ -622,36 +400,18 @@ public:
         assert(m_result_computed == false);
         if (LIKELY(m_cur_el < m_el_in_run))
         {
-            m_blocks1[m_cur_el / block_type::size][m_cur_el % block_type::size] = val;
+            m_blocks[m_cur_el / block_type::size][m_cur_el % block_type::size] = val;
             ++m_cur_el;
             return;
         }
 
         assert(m_el_in_run == m_cur_el);
-        m_cur_el = 0;
 
-        // sort and store m_blocks1
-        sort_run(m_blocks1, m_el_in_run);
-
-        const unsigned_type cur_run_blocks = div_ceil(m_el_in_run, block_type::size);        // in blocks
-        run.resize(cur_run_blocks);
-        block_manager* bm = block_manager::get_instance();
-        bm->new_blocks(AllocStr(), make_bid_iterator(run.begin()), make_bid_iterator(run.end()));
-
-        disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
-
-        for (unsigned_type i = 0; i < cur_run_blocks; ++i)
-        {
-            run[i].value = m_blocks1[i][0];
-            if (m_write_reqs[i].get())
-                m_write_reqs[i]->wait();
-
-            m_write_reqs[i] = m_blocks1[i].write(run[i].bid);
-        }
-
-        m_result->add_run(run, m_el_in_run);
-
-        std::swap(m_blocks1, m_blocks2);
+        // sort and store m_blocks in the background
+        m_pipeline->submit(m_el_in_run, m_result.get());
+        m_submitted_el += m_el_in_run;
+        m_cur_el = 0;
+        m_blocks = m_pipeline->get_buffer();
 
         push(val);
     }
@@ -675,7 +435,7 @@ public:
     //! number of items currently inserted.
     external_size_type size() const
     {
-        return m_result->elements + m_cur_el;
+        return m_submitted_el + m_cur_el;
     }
 
     //! return comparator object.
@@ -956,6 +716,9 @@ public:
     //! Standard stream typedef.
     typedef typename sorted_runs_data_type::value_type value_type;
 
+    //! Bulk stream typedef, see stream::pull().
+    typedef bulk_pull_tag pull_category;
+
 private:
     //! comparator object to sort runs
     value_cmp m_cmp;
@@ -1123,6 +886,12 @@ public:
         m_memory_to_use = memory_to_use;
     }
 
+    //! Return memory amount to use for the merger in bytes.
+    unsigned_type memory_used() const
+    {
+        return m_memory_to_use;
+    }
+
     //! Initialize the runs merger object with a new round of sorted_runs.
     void initialize(const sorted_runs_type& sruns)
     {
@@ -1322,6 +1091,32 @@ public:
         return *this;
     }
 
+    //! Bulk stream method, copies merged blocks out of the merge buffer.
+    unsigned_type pull(value_type* out, unsigned_type max)
+    {
+        unsigned_type n = 0;
+        while (n < max && !empty())
+        {
+            const unsigned_type k = STXXL_MIN<unsigned_type>(
+                max - n, unsigned_type(m_current_end - m_current_ptr));
+            std::copy(m_current_ptr, m_current_ptr + k, out + n);
+
+#if STXXL_CHECK_ORDER_IN_SORTS
+            assert(stxxl::is_sorted(out + n, out + n + k, m_cmp));
+            assert(!m_cmp(out[n], m_last_element));
+            m_last_element = out[n + k - 1];
+#endif      //STXXL_CHECK_ORDER_IN_SORTS
+
+            n += k;
+            m_current_ptr += k;
+            m_elements_remaining -= k;
+
+            if (m_current_ptr == m_current_end && !empty())
+                fill_buffer_block();
+        }
+        return n;
+    }
+
     //! Destructor.
     //! \remark Deallocates blocks of the input sorted runs object
     virtual ~basic_runs_merger()
@@ -1547,6 +1342,9 @@ public:
     //! Standard stream typedef.
     typedef typename Input::value_type value_type;
 
+    //! Bulk stream typedef, see stream::pull().
+    typedef bulk_pull_tag pull_category;
+
     //! Creates the object.
     //! \param in input stream
     //! \param c comparator object
@@ -1596,6 +1394,12 @@ public:
         ++merger;
         return *this;
     }
+
+    //! Bulk stream method, see stream::pull().
+    unsigned_type pull(value_type* out, unsigned_type max)
+    {
+        return merger.pull(out, max);
+    }
 };
 
 //! Computes sorted runs type from value type and block size.
@@ -22,6 +22,7 @@
 #include <stxxl/bits/common/error_handling.h>
 #include <stxxl/vector>
 #include <stxxl/bits/compat/unique_ptr.h>
+#include <stxxl/bits/stream/pull.h>
 
 #ifndef STXXL_VERBOSE_MATERIALIZE
 #define STXXL_VERBOSE_MATERIALIZE STXXL_VERBOSE3
@@ -128,6 +129,9 @@ public:
     //! Standard stream typedef.
     typedef typename std::iterator_traits<InputIterator>::value_type value_type;
 
+    //! Bulk stream typedef, see stream::pull().
+    typedef bulk_pull_tag pull_category;
+
     vector_iterator2stream(InputIterator begin, InputIterator end,
                            unsigned_type nbuffers = 0)
         : m_current(begin), m_end(end),
@@ -188,6 +192,23 @@ public:
     {
         return (m_current == m_end);
     }
+
+    //! Bulk stream method, copies whole blocks out of the read buffers.
+    unsigned_type pull(value_type* out, unsigned_type max)
+    {
+        const unsigned_type n = (unsigned_type)
+                                STXXL_MIN<uint64>(max, uint64(m_end - m_current));
+        if (n == 0)
+            return 0;
+
+        in->read(out, n);
+        m_current += n;
+        if (UNLIKELY(empty()))
+            delete_stream();
+
+        return n;
+    }
+
     virtual ~vector_iterator2stream()
     {
         delete_stream();          // not needed actually
@@ -522,10 +543,12 @@ materialize(StreamAlgorithm& in,
             }
         }
 
-        *outstream = *in;
-        ++outbegin;
-        ++outstream;
-        ++in;
+        // pull the rest of the block at once, directly into the write buffer
+        const unsigned_type got = pull_convert(
+            in, outstream.current_ptr(), (unsigned_type)
+            STXXL_MIN<uint64>(outstream.current_space(), uint64(outend - outbegin)));
+        outbegin += got;
+        outstream.advance(got);
     }
 
     ConstExtIterator const_out = outbegin;
@@ -607,11 +630,11 @@ materialize(StreamAlgorithm& in,
             }
         }
 
-        // tells the vector that the block was modified
-        *outstream = *in;
-        ++out;
-        ++outstream;
-        ++in;
+        // pull the rest of the block at once, directly into the write buffer
+        const unsigned_type got = pull_convert(
+            in, outstream.current_ptr(), outstream.current_space());
+        out += got;
+        outstream.advance(got);
     }
 
     ConstExtIterator const_out = out;
@@ -814,9 +837,20 @@ public:
     //! Standard stream typedef.
     typedef typename Operation::value_type value_type;
 
+    //! Bulk stream typedef, see stream::pull().
+    typedef bulk_pull_tag pull_category;
+
 private:
+    typedef typename Input1::value_type input_value_type;
+
+    //! number of input elements pulled at once by pull()
+    enum { pull_items = (sizeof(input_value_type) < 4096) ? 4096 / sizeof(input_value_type) : 1 };
+
     value_type current;
 
+    //! input elements pulled by pull()
+    std::vector<input_value_type> m_pull_buffer;
+
 public:
     //! Construction.
     transform(Operation& o, Input1& i1_) : op(o), i1(i1_)
@@ -851,6 +885,37 @@ public:
     {
         return i1.empty();
     }
+
+    //! Bulk stream method, pulls chunks of the input and applies the
+    //! operation to them in a tight loop.
+    unsigned_type pull(value_type* out, unsigned_type max)
+    {
+        if (max == 0 || empty())
+            return 0;
+
+        out[0] = current;
+        ++i1;
+        unsigned_type n = 1;
+
+        if (m_pull_buffer.empty())
+            m_pull_buffer.resize(pull_items);
+
+        while (n < max)
+        {
+            const unsigned_type want = STXXL_MIN<unsigned_type>(max - n, pull_items);
+            const unsigned_type got = stream::pull(i1, &m_pull_buffer[0], want);
+            for (unsigned_type i = 0; i < got; ++i)
+                out[n + i] = op(m_pull_buffer[i]);
+            n += got;
+            if (got < want)
+                break;
+        }
+
+        if (!empty())
+            current = op(*i1);
+
+        return n;
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -1529,6 +1594,7 @@ public:
 
 STXXL_END_NAMESPACE
 
+#include <stxxl/bits/stream/async_pipe.h>
 #include <stxxl/bits/stream/choose.h>
 #include <stxxl/bits/stream/unique.h>
 
@@ -0,0 +1,181 @@
+/***************************************************************************
+ *  lib/common/numa.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/numa.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/verbose.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if STXXL_HAVE_LIBNUMA
+ #include <numa.h>
+ #include <numaif.h>
+ #include <sched.h>
+#endif
+
+#ifdef __linux__
+ #include <sys/stat.h>
+ #include <sys/sysmacros.h>
+ #include <unistd.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+namespace numa {
+
+#if STXXL_HAVE_LIBNUMA
+//! libnuma must be probed once before calling other functions
+static bool available()
+{
+    static const bool avail = (numa_available() >= 0);
+    return avail;
+}
+#endif
+
+unsigned int num_nodes()
+{
+#if STXXL_HAVE_LIBNUMA
+    if (available())
+        return (unsigned int)numa_max_node() + 1;
+#endif
+    return 1;
+}
+
+int current_node()
+{
+#if STXXL_HAVE_LIBNUMA
+    if (available()) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0)
+            return numa_node_of_cpu(cpu);
+    }
+#endif
+    return NO_NODE;
+}
+
+#ifdef __linux__
+//! read a node number from a sysfs numa_node file, NO_NODE if unknown
+static int read_node_file(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    int node = NO_NODE;
+    if (!(in >> node) || node < 0)
+        return NO_NODE;
+    return node;
+}
+#endif
+
+int device_node(const std::string& path)
+{
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        // file may not exist yet, use the directory containing it
+        std::string::size_type slash = path.rfind('/');
+        std::string dir = (slash == std::string::npos) ? "." :
+                          (slash == 0) ? "/" : path.substr(0, slash);
+        if (stat(dir.c_str(), &st) != 0)
+            return NO_NODE;
+    }
+
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+
+    std::ostringstream sys;
+    sys << "/sys/dev/block/" << major(dev) << ":" << minor(dev);
+
+    // whole disk, partition (parent is the disk), and NVMe namespace (device
+    // is the controller, which is attached to the PCI device)
+    static const char* candidates[] = {
+        "/device/numa_node", "/../device/numa_node",
+        "/device/device/numa_node", "/../device/device/numa_node"
+    };
+
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i)
+    {
+        int node = read_node_file(sys.str() + candidates[i]);
+        if (node != NO_NODE)
+            return node;
+    }
+#else
+    STXXL_UNUSED(path);
+#endif
+    return NO_NODE;
+}
+
+#if STXXL_HAVE_LIBNUMA
+bool bind_thread(pthread_t thread, int node)
+{
+    if (!available() || node < 0 || node > numa_max_node())
+        return false;
+
+    struct bitmask* cpus = numa_allocate_cpumask();
+    if (numa_node_to_cpus(node, cpus) != 0) {
+        numa_free_cpumask(cpus);
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int i = 0; i < cpus->size && i < CPU_SETSIZE; ++i) {
+        if (numa_bitmask_isbitset(cpus, i))
+            CPU_SET(i, &set);
+    }
+    numa_free_cpumask(cpus);
+
+    int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rc != 0)
+        STXXL_ERRMSG("numa::bind_thread(): pthread_setaffinity_np() failed"
+                     " for node " << node << ": " << strerror(rc));
+    return rc == 0;
+}
+#endif
+
+void bind_memory(void* ptr, size_t size, int node)
+{
+#if STXXL_HAVE_LIBNUMA
+    if (!available() || node < 0 || node > numa_max_node())
+        return;
+
+    // only pages lying completely inside the buffer
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = div_ceil((size_t)ptr, page) * page;
+    size_t end = ((size_t)ptr + size) / page * page;
+    if (begin >= end)
+        return;
+
+    unsigned long nodemask[1024 / (8 * sizeof(unsigned long))] = { 0 };
+    nodemask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (mbind((void*)begin, end - begin, MPOL_PREFERRED,
+              nodemask, 1024, 0) != 0)
+        STXXL_VERBOSE1("numa::bind_memory(): mbind() failed: " << strerror(errno));
+#else
+    STXXL_UNUSED(ptr);
+    STXXL_UNUSED(size);
+    STXXL_UNUSED(node);
+#endif
+}
+
+void bind_memory_local(void* ptr, size_t size)
+{
+    int node = current_node();
+    if (node != NO_NODE)
+        bind_memory(ptr, size, node);
+}
+
+} // namespace numa
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
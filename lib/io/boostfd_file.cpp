@@ -24,6 +24,12 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/version.hpp>
 
+#if STXXL_WINDOWS
+ #include <windows.h>
+#else
+ #include <unistd.h>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 void boostfd_file::serve(void* buffer, offset_type offset, size_type bytes,
@@ -200,6 +206,18 @@ void boostfd_file::lock()
     // FIXME: is there no locking possible/needed/... for boostfd?
 }
 
+void boostfd_file::flush()
+{
+    // boost::iostreams has no sync for file descriptors, use the OS handle
+#if STXXL_WINDOWS
+    if (!FlushFileBuffers(m_file_des.handle()))
+        STXXL_THROW_WIN_LASTERROR(io_error, "FlushFileBuffers()");
+#else
+    if (::fsync(m_file_des.handle()) != 0)
+        STXXL_THROW_ERRNO(io_error, "fsync() fd=" << m_file_des.handle());
+#endif
+}
+
 STXXL_END_NAMESPACE
 
 #endif  // #if STXXL_HAVE_BOOSTFD_FILE
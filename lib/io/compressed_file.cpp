@@ -0,0 +1,522 @@
+/***************************************************************************
+ *  lib/io/compressed_file.cpp
+ *
+ *  a pseudo file compressing the blocks written to a backend file
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/compressed_file.h>
+
+#if STXXL_HAVE_COMPRESSED_FILE
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/verbose.h>
+#include <stxxl/aligned_alloc>
+
+#if STXXL_HAVE_LZ4
+ #include <lz4.h>
+#endif
+#if STXXL_HAVE_ZSTD
+ #include <zstd.h>
+#endif
+#if STXXL_HAVE_ZLIB
+ #include <zlib.h>
+#endif
+
+#ifndef STXXL_VERBOSE_COMPRESSED
+#define STXXL_VERBOSE_COMPRESSED STXXL_VERBOSE2
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! the backend file is grown in steps of this size
+static const file::offset_type compressed_file_grow_step = 16 * 1024 * 1024;
+
+static inline file::size_type align_up(file::size_type size)
+{
+    return div_ceil(size, STXXL_BLOCK_ALIGN) * STXXL_BLOCK_ALIGN;
+}
+
+compressed_file::compressed_file(
+    file* backend_file,
+    codec_type codec,
+    int queue_id, int allocator_id, unsigned int device_id)
+    : file(device_id),
+      disk_queued_file(queue_id, allocator_id),
+      m_storage(backend_file), m_codec(codec),
+      m_size(0), m_storage_end(0), m_storage_capacity(0),
+      m_raw_buffer(NULL), m_z_buffer(NULL),
+      m_raw_capacity(0), m_z_capacity(0)
+{
+    if (!is_available(codec))
+        STXXL_THROW(std::runtime_error, "compressed_file: codec "
+                    << codec_name(codec) << " is not available.");
+
+    // the extent map is not stored, data of an earlier use is unreadable
+    m_storage->set_size(0);
+}
+
+compressed_file::~compressed_file()
+{
+    if (m_raw_buffer)
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(m_raw_buffer);
+    if (m_z_buffer)
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(m_z_buffer);
+    delete m_storage;
+    m_storage = NULL;
+}
+
+void compressed_file::serve(void* buffer, offset_type offset, size_type bytes,
+                            request::request_type type)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    if (type == request::READ)
+        sread(static_cast<char*>(buffer), offset, bytes);
+    else
+        swrite(static_cast<const char*>(buffer), offset, bytes);
+}
+
+void compressed_file::lock()
+{
+    m_storage->lock();
+}
+
+void compressed_file::flush()
+{
+    // extents are written synchronously in serve()
+    m_storage->flush();
+}
+
+compressed_file::offset_type compressed_file::size()
+{
+    return m_size;
+}
+
+void compressed_file::set_size(offset_type newsize)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // drop extents lying completely beyond the new end
+    if (newsize < m_size)
+    {
+        extent_map_type::iterator it = m_extents.lower_bound(newsize);
+        while (it != m_extents.end())
+        {
+            deallocate(it->second.phys, it->second.alloc);
+            m_extents.erase(it++);
+        }
+    }
+
+    m_size = newsize;
+}
+
+void compressed_file::discard(offset_type offset, offset_type size)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // free extents completely inside the region, keep partially covered ones
+    extent_map_type::iterator it = m_extents.lower_bound(offset);
+    while (it != m_extents.end() && it->first + it->second.raw <= offset + size)
+    {
+        deallocate(it->second.phys, it->second.alloc);
+        m_extents.erase(it++);
+    }
+}
+
+void compressed_file::close_remove()
+{
+    m_storage->close_remove();
+}
+
+const char* compressed_file::io_type() const
+{
+    return "compressed";
+}
+
+compressed_file::offset_type compressed_file::get_storage_size()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_storage_end;
+}
+
+void compressed_file::sread(char* buffer, offset_type offset, size_type bytes)
+{
+    const offset_type end = offset + bytes;
+
+    // first extent overlapping [offset, end)
+    extent_map_type::iterator it = m_extents.upper_bound(offset);
+    if (it != m_extents.begin()) {
+        --it;
+        if (it->first + it->second.raw <= offset)
+            ++it;
+    }
+
+    offset_type pos = offset;
+    while (pos < end)
+    {
+        if (it == m_extents.end() || it->first >= end) {
+            // never written, reads as zeros
+            memset(buffer + (pos - offset), 0, (size_t)(end - pos));
+            break;
+        }
+        if (it->first > pos) {
+            memset(buffer + (pos - offset), 0, (size_t)(it->first - pos));
+            pos = it->first;
+        }
+
+        const extent& e = it->second;
+        const offset_type e_end = it->first + e.raw;
+
+        if (it->first >= offset && e_end <= end)
+        {
+            // extent completely inside the request: decompress in place
+            read_extent(e, buffer + (it->first - offset));
+        }
+        else
+        {
+            reserve(m_raw_buffer, m_raw_capacity, e.raw);
+            read_extent(e, m_raw_buffer);
+            memcpy(buffer + (pos - offset), m_raw_buffer + (pos - it->first),
+                   (size_t)(std::min(e_end, end) - pos));
+        }
+
+        pos = std::min(e_end, end);
+        ++it;
+    }
+}
+
+void compressed_file::swrite(const char* buffer, offset_type offset, size_type bytes)
+{
+    const offset_type end = offset + bytes;
+
+    // range of extents overlapping [offset, end)
+    extent_map_type::iterator first = m_extents.upper_bound(offset);
+    if (first != m_extents.begin()) {
+        --first;
+        if (first->first + first->second.raw <= offset)
+            ++first;
+    }
+    extent_map_type::iterator last = first;
+    offset_type lo = offset, hi = end;
+    bool partial = false;
+    while (last != m_extents.end() && last->first < end)
+    {
+        const offset_type e_end = last->first + last->second.raw;
+        if (last->first < offset || e_end > end) {
+            lo = std::min(lo, last->first);
+            hi = std::max(hi, e_end);
+            partial = true;
+        }
+        ++last;
+    }
+
+    if (partial)
+    {
+        STXXL_VERBOSE_COMPRESSED("compressed_file: merging extents around "
+                                 << offset << " into [" << lo << "," << hi << ")");
+
+        // merge the partially overwritten extents with the new data
+        reserve(m_raw_buffer, m_raw_capacity, (size_type)(hi - lo));
+        memset(m_raw_buffer, 0, (size_t)(hi - lo));
+        for (extent_map_type::iterator it = first; it != last; ++it)
+        {
+            if (it->first < offset || it->first + it->second.raw > end)
+                read_extent(it->second, m_raw_buffer + (it->first - lo));
+        }
+        memcpy(m_raw_buffer + (offset - lo), buffer, bytes);
+    }
+
+    for (extent_map_type::iterator it = first; it != last; ++it)
+        deallocate(it->second.phys, it->second.alloc);
+    m_extents.erase(first, last);
+
+    if (partial)
+        write_extent(m_raw_buffer, lo, (size_type)(hi - lo));
+    else
+        write_extent(buffer, offset, bytes);
+
+    if (hi > m_size)
+        m_size = hi;
+}
+
+void compressed_file::read_extent(const extent& e, char* buffer)
+{
+    reserve(m_z_buffer, m_z_capacity, e.alloc);
+    m_storage->serve(m_z_buffer, e.phys, e.alloc, request::READ);
+
+    if (e.stored == e.raw) {
+        // stored uncompressed
+        memcpy(buffer, m_z_buffer, e.raw);
+        return;
+    }
+
+    double start = timestamp();
+    decompress(m_z_buffer, e.stored, buffer, e.raw);
+    stats::get_instance()->decompressed(timestamp() - start);
+}
+
+void compressed_file::write_extent(const char* buffer, offset_type offset, size_type bytes)
+{
+    double start = timestamp();
+
+    size_type bound = compress_bound(bytes);
+    reserve(m_z_buffer, m_z_capacity, std::max(bound, align_up(bytes)));
+
+    size_type stored = compress(buffer, bytes, m_z_buffer, bound);
+    if (stored == 0 || align_up(stored) >= align_up(bytes)) {
+        // incompressible: store raw and save the decompression
+        memcpy(m_z_buffer, buffer, bytes);
+        stored = bytes;
+    }
+
+    extent e;
+    e.alloc = align_up(stored);
+    e.stored = stored;
+    e.raw = bytes;
+    memset(m_z_buffer + stored, 0, e.alloc - stored);
+
+    stats::get_instance()->compressed(bytes, stored, timestamp() - start);
+
+    e.phys = allocate(e.alloc);
+    m_storage->serve(m_z_buffer, e.phys, e.alloc, request::WRITE);
+
+    m_extents[offset] = e;
+}
+
+compressed_file::offset_type compressed_file::allocate(size_type size)
+{
+    // first fit
+    for (free_map_type::iterator it = m_free.begin(); it != m_free.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+
+        offset_type offset = it->first;
+        size_type rest = it->second - size;
+        m_free.erase(it);
+        if (rest > 0)
+            m_free[offset + size] = rest;
+        return offset;
+    }
+
+    offset_type offset = m_storage_end;
+    m_storage_end += size;
+
+    if (m_storage_end > m_storage_capacity)
+    {
+        m_storage_capacity =
+            div_ceil(m_storage_end, compressed_file_grow_step) * compressed_file_grow_step;
+        m_storage->set_size(m_storage_capacity);
+    }
+
+    return offset;
+}
+
+void compressed_file::deallocate(offset_type offset, size_type size)
+{
+    free_map_type::iterator succ = m_free.upper_bound(offset);
+
+    // merge with successor
+    if (succ != m_free.end() && offset + size == succ->first) {
+        size += succ->second;
+        m_free.erase(succ++);
+    }
+
+    // merge with predecessor
+    if (succ != m_free.begin()) {
+        free_map_type::iterator pred = succ;
+        --pred;
+        assert(pred->first + pred->second <= offset);
+        if (pred->first + pred->second == offset) {
+            offset = pred->first;
+            size += pred->second;
+            m_free.erase(pred);
+        }
+    }
+
+    if (offset + size == m_storage_end)
+        m_storage_end = offset;  // trailing free space is not tracked
+    else
+        m_free[offset] = size;
+}
+
+void compressed_file::reserve(char*& buffer, size_type& capacity, size_type size)
+{
+    if (capacity >= size)
+        return;
+
+    if (buffer)
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+    capacity = align_up(std::max(size, 2 * capacity));
+    buffer = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(capacity));
+}
+
+/******************************************************************************/
+// codecs
+
+bool compressed_file::is_available(codec_type codec)
+{
+    switch (codec) {
+#if STXXL_HAVE_LZ4
+    case CODEC_LZ4:
+        return true;
+#endif
+#if STXXL_HAVE_ZSTD
+    case CODEC_ZSTD:
+        return true;
+#endif
+#if STXXL_HAVE_ZLIB
+    case CODEC_ZLIB:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* compressed_file::codec_name(codec_type codec)
+{
+    switch (codec) {
+    case CODEC_LZ4:
+        return "lz4";
+    case CODEC_ZSTD:
+        return "zstd";
+    case CODEC_ZLIB:
+        return "zlib";
+    }
+    return "unknown";
+}
+
+compressed_file::codec_type compressed_file::parse_codec(const std::string& name)
+{
+    codec_type codec;
+
+    if (name == "lz4")
+        codec = CODEC_LZ4;
+    else if (name == "zstd")
+        codec = CODEC_ZSTD;
+    else if (name == "zlib")
+        codec = CODEC_ZLIB;
+    else
+        STXXL_THROW(std::runtime_error,
+                    "Unknown compression codec '" << name << "'.");
+
+    if (!is_available(codec))
+        STXXL_THROW(std::runtime_error,
+                    "Compression codec '" << name << "' is not available in "
+                    "this build of STXXL.");
+
+    return codec;
+}
+
+compressed_file::size_type compressed_file::compress_bound(size_type bytes) const
+{
+    switch (m_codec) {
+#if STXXL_HAVE_LZ4
+    case CODEC_LZ4:
+        return (size_type)LZ4_compressBound((int)bytes);
+#endif
+#if STXXL_HAVE_ZSTD
+    case CODEC_ZSTD:
+        return (size_type)ZSTD_compressBound(bytes);
+#endif
+#if STXXL_HAVE_ZLIB
+    case CODEC_ZLIB:
+        return (size_type)compressBound((uLong)bytes);
+#endif
+    default:
+        return bytes;
+    }
+}
+
+compressed_file::size_type compressed_file::compress(
+    const char* src, size_type bytes, char* dst, size_type capacity) const
+{
+    switch (m_codec) {
+#if STXXL_HAVE_LZ4
+    case CODEC_LZ4:
+    {
+        int r = LZ4_compress_default(src, dst, (int)bytes, (int)capacity);
+        return r > 0 ? (size_type)r : 0;
+    }
+#endif
+#if STXXL_HAVE_ZSTD
+    case CODEC_ZSTD:
+    {
+        size_t r = ZSTD_compress(dst, capacity, src, bytes, 1);
+        return ZSTD_isError(r) ? 0 : (size_type)r;
+    }
+#endif
+#if STXXL_HAVE_ZLIB
+    case CODEC_ZLIB:
+    {
+        uLongf len = (uLongf)capacity;
+        int r = compress2((Bytef*)dst, &len, (const Bytef*)src, (uLong)bytes, 1);
+        return r == Z_OK ? (size_type)len : 0;
+    }
+#endif
+    default:
+        STXXL_UNUSED(src);
+        STXXL_UNUSED(bytes);
+        STXXL_UNUSED(dst);
+        STXXL_UNUSED(capacity);
+        return 0;
+    }
+}
+
+void compressed_file::decompress(const char* src, size_type stored,
+                                 char* dst, size_type raw) const
+{
+    bool ok = false;
+
+    switch (m_codec) {
+#if STXXL_HAVE_LZ4
+    case CODEC_LZ4:
+        ok = (LZ4_decompress_safe(src, dst, (int)stored, (int)raw) == (int)raw);
+        break;
+#endif
+#if STXXL_HAVE_ZSTD
+    case CODEC_ZSTD:
+        ok = (ZSTD_decompress(dst, raw, src, stored) == raw);
+        break;
+#endif
+#if STXXL_HAVE_ZLIB
+    case CODEC_ZLIB:
+    {
+        uLongf len = (uLongf)raw;
+        ok = (uncompress((Bytef*)dst, &len, (const Bytef*)src, (uLong)stored) == Z_OK
+              && len == raw);
+        break;
+    }
+#endif
+    default:
+        STXXL_UNUSED(src);
+        STXXL_UNUSED(stored);
+        STXXL_UNUSED(dst);
+        STXXL_UNUSED(raw);
+        break;
+    }
+
+    if (!ok)
+        STXXL_THROW(io_error, "compressed_file: corrupt " << codec_name(m_codec)
+                    << " extent of " << stored << " bytes.");
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_COMPRESSED_FILE
+// vim: et:ts=4:sw=4
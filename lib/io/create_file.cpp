@@ -15,6 +15,7 @@
 
 #include <stxxl/bits/common/error_handling.h>
 #include <stxxl/bits/common/exceptions.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/io/create_file.h>
 #include <stxxl/bits/io/io.h>
 #include <stxxl/bits/mng/config.h>
@@ -39,7 +40,7 @@ file * create_file(const std::string& io_impl,
     return create_file(cfg, options, disk_allocator_id);
 }
 
-file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
+static file * create_file_impl(disk_config& cfg, int mode, int disk_allocator_id)
 {
     // apply disk_config settings to open mode
 
@@ -56,6 +57,9 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         break;
     }
 
+    if (cfg.discard)
+        mode |= file::DISCARD;
+
     // automatically enumerate disks as separate device ids
 
     if (cfg.device_id == file::DEFAULT_DEVICE_ID)
@@ -146,6 +150,41 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         return result;
     }
 #endif
+#if STXXL_HAVE_IO_URING_FILE
+    // io_uring can have the desired ring size, specified as queue_length=?
+    else if (cfg.io_impl == "io_uring")
+    {
+        // io_uring_queue is a singleton.
+        cfg.queue = file::DEFAULT_IO_URING_QUEUE;
+
+        ufs_file_base* result =
+            new io_uring_file(cfg.path, mode, cfg.queue, disk_allocator_id,
+                              cfg.device_id, cfg.queue_length);
+
+        result->lock();
+
+        // if marked as device but file is not -> throw!
+        if (cfg.raw_device && !result->is_device())
+        {
+            delete result;
+            STXXL_THROW(io_error, "Disk " << cfg.path << " was expected to be "
+                        "a raw block device, but it is a normal file!");
+        }
+
+        // if is raw_device -> get size and remove some flags.
+        if (result->is_device())
+        {
+            cfg.raw_device = true;
+            cfg.size = result->size();
+            cfg.autogrow = cfg.delete_on_exit = cfg.unlink_on_open = false;
+        }
+
+        if (cfg.unlink_on_open)
+            result->unlink();
+
+        return result;
+    }
+#endif
 #if STXXL_HAVE_MMAP_FILE
     else if (cfg.io_impl == "mmap")
     {
@@ -236,5 +275,65 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
                 "Unsupported disk I/O implementation '" << cfg.io_impl << "'.");
 }
 
+file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
+{
+    file* result = create_file_impl(cfg, mode, disk_allocator_id);
+
+    if (!cfg.tier.empty())
+    {
+        file* fast = NULL;
+        try {
+            tiered_file::policy_type policy =
+                tiered_file::parse_policy(
+                    cfg.tier_policy.empty() ? "clock" : cfg.tier_policy);
+
+            if (cfg.tier == "memory")
+                fast = new mem_file();
+            else
+                fast = new syscall_file(cfg.tier, mode, -1, -1);
+            fast->lock();
+
+            result = new tiered_file(result, fast, cfg.tier_size, policy, 2,
+                                     cfg.queue, disk_allocator_id, cfg.device_id);
+        }
+        catch (...) {
+            delete fast;
+            delete result;
+            throw;
+        }
+    }
+
+    if (!cfg.compress.empty())
+    {
+#if STXXL_HAVE_COMPRESSED_FILE
+        compressed_file::codec_type codec;
+        try {
+            codec = compressed_file::parse_codec(cfg.compress);
+        }
+        catch (...) {
+            delete result;
+            throw;
+        }
+        result = new compressed_file(result, codec, cfg.queue,
+                                     disk_allocator_id, cfg.device_id);
+        result->lock();
+#else
+        delete result;
+        STXXL_THROW(std::runtime_error,
+                    "Disk " << cfg.path << " requests compress=" << cfg.compress
+                            << ", but STXXL was built without compression libraries.");
+#endif
+    }
+
+    // detect the NUMA node of the device, unless configured
+    if (cfg.numa_node == -1 && numa::num_nodes() > 1)
+        cfg.numa_node = numa::device_node(cfg.path);
+
+    if (cfg.numa_node >= 0)
+        result->set_numa_node(cfg.numa_node);
+
+    return result;
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
@@ -49,5 +49,15 @@ request_ptr disk_queued_file::awrite(
     return req;
 }
 
+request_ptr disk_queued_file::aflush(const completion_handler& on_cmpl)
+{
+    request_ptr req(new serving_request(on_cmpl, this, NULL, 0, 0,
+                                        request::FLUSH));
+
+    disk_queues::get_instance()->add_request(req, get_queue_id());
+
+    return req;
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
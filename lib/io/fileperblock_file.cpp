@@ -83,6 +83,29 @@ void fileperblock_file<base_file_type>::serve(void* buffer, offset_type offset,
     base_file_type base_file(filename_for_block(offset), mode, get_queue_id());
     base_file.set_size(bytes);
     base_file.serve(buffer, 0, bytes, type);
+
+    if (type == request::WRITE) {
+        scoped_mutex_lock lock(unflushed_mutex);
+        unflushed_blocks.insert(offset);
+    }
+}
+
+template <class base_file_type>
+void fileperblock_file<base_file_type>::flush()
+{
+    std::set<offset_type> blocks;
+    {
+        scoped_mutex_lock lock(unflushed_mutex);
+        blocks.swap(unflushed_blocks);
+    }
+
+    for (typename std::set<offset_type>::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it)
+    {
+        base_file_type base_file(filename_for_block(*it), mode & ~TRUNC,
+                                 get_queue_id());
+        base_file.flush();
+    }
 }
 
 template <class base_file_type>
@@ -109,6 +132,10 @@ template <class base_file_type>
 void fileperblock_file<base_file_type>::discard(offset_type offset, offset_type length)
 {
     STXXL_UNUSED(length);
+    {
+        scoped_mutex_lock lock(unflushed_mutex);
+        unflushed_blocks.erase(offset);
+    }
 #ifdef STXXL_FILEPERBLOCK_NO_DELETE
     if (::truncate(filename_for_block(offset).c_str(), 0) != 0)
         STXXL_ERRMSG("truncate() error on path=" << filename_for_block(offset) << " error=" << strerror(errno));
@@ -125,6 +152,10 @@ void fileperblock_file<base_file_type>::export_files(offset_type offset, offset_
 {
     std::string original(filename_for_block(offset));
     filename.insert(0, original.substr(0, original.find_last_of("/") + 1));
+    {
+        scoped_mutex_lock lock(unflushed_mutex);
+        unflushed_blocks.erase(offset);
+    }
     if (::remove(filename.c_str()) != 0)
         STXXL_ERRMSG("remove() error on path=" << filename << " error=" << strerror(errno));
 
@@ -0,0 +1,89 @@
+/***************************************************************************
+ *  lib/io/io_uring_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/io_uring_file.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <stxxl/bits/io/io_uring_request.h>
+#include <stxxl/bits/io/disk_queues.h>
+
+STXXL_BEGIN_NAMESPACE
+
+request_ptr io_uring_file::aread(
+    void* buffer,
+    offset_type pos,
+    size_type bytes,
+    const completion_handler& on_cmpl)
+{
+    request_ptr req(new io_uring_request(on_cmpl, this, buffer, pos, bytes, request::READ));
+
+    disk_queues::get_instance()->add_request(req, get_queue_id());
+
+    return req;
+}
+
+request_ptr io_uring_file::awrite(
+    void* buffer,
+    offset_type pos,
+    size_type bytes,
+    const completion_handler& on_cmpl)
+{
+    request_ptr req(new io_uring_request(on_cmpl, this, buffer, pos, bytes, request::WRITE));
+
+    disk_queues::get_instance()->add_request(req, get_queue_id());
+
+    return req;
+}
+
+request_ptr io_uring_file::aflush(const completion_handler& on_cmpl)
+{
+    request_ptr req(new io_uring_request(on_cmpl, this, NULL, 0, 0, request::FLUSH));
+
+    disk_queues::get_instance()->add_request(req, get_queue_id());
+
+    return req;
+}
+
+void io_uring_file::serve(void* buffer, offset_type offset, size_type bytes,
+                          request::request_type type)
+{
+    // req need not be an io_uring_request
+    if (type == request::READ)
+        aread(buffer, offset, bytes)->wait();
+    else if (type == request::WRITE)
+        awrite(buffer, offset, bytes)->wait();
+    else
+        aflush()->wait();
+}
+
+const char* io_uring_file::io_type() const
+{
+    return "io_uring";
+}
+
+bool io_uring_file::register_buffer(void* buffer, size_type bytes)
+{
+    return disk_queues::get_instance()
+           ->get_io_uring_queue(get_queue_id(), desired_queue_length)
+           ->register_buffer(buffer, bytes);
+}
+
+void io_uring_file::unregister_buffer(void* buffer)
+{
+    disk_queues::get_instance()
+    ->get_io_uring_queue(get_queue_id(), desired_queue_length)
+    ->unregister_buffer(buffer);
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+// vim: et:ts=4:sw=4
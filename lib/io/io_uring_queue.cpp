@@ -0,0 +1,463 @@
+/***************************************************************************
+ *  lib/io/io_uring_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/io_uring_queue.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include <stxxl/bits/verbose.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iotrace.h>
+#include <stxxl/bits/io/io_uring_request.h>
+#include <stxxl/bits/parallel.h>
+
+#include <algorithm>
+#include <cstring>
+
+STXXL_BEGIN_NAMESPACE
+
+io_uring_queue::io_uring_queue(int desired_queue_length)
+    : ring_fd(-1), event_fd(-1), event_value(0),
+      worker_notified(false), num_posted(0),
+      fixed_buffers_supported(false),
+      thread_state(NOT_RUNNING)
+{
+    // default value, 64 entries per queue (i.e. usually per disk) should
+    // be enough
+    ring_entries = (desired_queue_length == 0) ? 64 : desired_queue_length;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd = (int)syscall(SYS_io_uring_setup, ring_entries, &params);
+    if (ring_fd < 0) {
+        STXXL_THROW_ERRNO(io_error, "io_uring_queue::io_uring_queue"
+                          " io_uring_setup() entries=" << ring_entries);
+    }
+
+    // kernel rounds to next power of two
+    ring_entries = params.sq_entries;
+
+    // map submission and completion rings, which may share one mapping
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring_ptr = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ptr == MAP_FAILED)
+        STXXL_THROW_ERRNO(io_error, "io_uring_queue::io_uring_queue mmap() sq ring");
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ptr = sq_ring_ptr;
+    }
+    else {
+        cq_ring_ptr = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring_ptr == MAP_FAILED)
+            STXXL_THROW_ERRNO(io_error, "io_uring_queue::io_uring_queue mmap() cq ring");
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+        mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+        STXXL_THROW_ERRNO(io_error, "io_uring_queue::io_uring_queue mmap() sqes");
+
+    char* sq = static_cast<char*>(sq_ring_ptr);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_ring_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ring_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_ring_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    event_fd = eventfd(0, EFD_CLOEXEC);
+    if (event_fd < 0)
+        STXXL_THROW_ERRNO(io_error, "io_uring_queue::io_uring_queue eventfd()");
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    // try to set up a sparse table of fixed buffers, which can be updated
+    // while the ring is in use (Linux >= 5.19).
+    {
+        io_uring_rsrc_register reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.nr = max_fixed_buffers;
+        reg.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS2,
+                    &reg, sizeof(reg)) == 0)
+        {
+            fixed_buffers_supported = true;
+            fixed_buffers.resize(max_fixed_buffers,
+                                 std::pair<char*, size_t>(NULL, 0));
+        }
+    }
+#endif
+
+    STXXL_MSG("Set up an io_uring queue with " << ring_entries << " entries"
+              << (fixed_buffers_supported ? " and fixed buffers." : "."));
+
+    start_thread(worker, static_cast<void*>(this), thread, thread_state);
+}
+
+io_uring_queue::~io_uring_queue()
+{
+    assert(thread_state() == RUNNING);
+    thread_state.set_to(TERMINATING);
+    notify_worker();
+    join_thread(thread, thread_state);
+
+    munmap(sqes, sqes_size);
+    if (cq_ring_ptr != sq_ring_ptr)
+        munmap(cq_ring_ptr, cq_ring_size);
+    munmap(sq_ring_ptr, sq_ring_size);
+    ::close(ring_fd);
+    ::close(event_fd);
+}
+
+void io_uring_queue::add_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+    if (thread_state() != RUNNING)
+        STXXL_ERRMSG("Request submitted to stopped queue.");
+    if (!dynamic_cast<io_uring_request*>(req.get()))
+        STXXL_ERRMSG("Non-io_uring request submitted to io_uring queue.");
+
+    bool notify;
+    {
+        scoped_mutex_lock lock(waiting_mtx);
+
+        waiting_requests.push_back(req);
+
+        // only the first request after a wake-up needs to signal the worker,
+        // later ones are picked up in the same batch.
+        notify = !worker_notified;
+        worker_notified = true;
+    }
+
+    if (notify) {
+        uint64 one = 1;
+        if (::write(event_fd, &one, sizeof(one)) != sizeof(one))
+            STXXL_THROW_ERRNO(io_error, "io_uring_queue::add_request write(eventfd)");
+    }
+}
+
+void io_uring_queue::notify_worker()
+{
+    {
+        scoped_mutex_lock lock(waiting_mtx);
+        if (worker_notified) return;
+        worker_notified = true;
+    }
+
+    uint64 one = 1;
+    if (::write(event_fd, &one, sizeof(one)) != sizeof(one))
+        STXXL_THROW_ERRNO(io_error, "io_uring_queue::notify_worker write(eventfd)");
+}
+
+bool io_uring_queue::cancel_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request canceled disk_queue.");
+    if (thread_state() != RUNNING)
+        STXXL_ERRMSG("Request canceled in stopped queue.");
+    if (!dynamic_cast<io_uring_request*>(req.get()))
+        STXXL_ERRMSG("Non-io_uring request submitted to io_uring queue.");
+
+    scoped_mutex_lock lock(waiting_mtx);
+
+    queue_type::iterator pos =
+        std::find(waiting_requests.begin(), waiting_requests.end(),
+                  req _STXXL_FORCE_SEQUENTIAL);
+    if (pos == waiting_requests.end())
+    {
+        // already posted to the kernel, those cannot be canceled reliably.
+        return false;
+    }
+
+    request_ptr r = *pos;
+    waiting_requests.erase(pos);
+    lock.unlock();
+
+    // polymorphic_downcast to io_uring_request,
+    // request is canceled, but was not yet posted.
+    dynamic_cast<io_uring_request*>(r.get())->completed(false, true);
+
+    return true;
+}
+
+bool io_uring_queue::register_buffer(void* buffer, size_t bytes)
+{
+    scoped_mutex_lock lock(buffer_mtx);
+
+    if (!fixed_buffers_supported)
+        return false;
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    for (unsigned i = 0; i < fixed_buffers.size(); ++i)
+    {
+        if (fixed_buffers[i].first != NULL) continue;
+
+        iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = bytes;
+
+        io_uring_rsrc_update2 upd;
+        memset(&upd, 0, sizeof(upd));
+        upd.offset = i;
+        upd.data = reinterpret_cast<__u64>(&iov);
+        upd.nr = 1;
+
+        if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS_UPDATE,
+                    &upd, sizeof(upd)) < 0)
+        {
+            STXXL_VERBOSE1("io_uring_queue::register_buffer() failed: " << strerror(errno));
+            return false;
+        }
+
+        fixed_buffers[i] = std::pair<char*, size_t>(static_cast<char*>(buffer), bytes);
+        return true;
+    }
+#else
+    STXXL_UNUSED(buffer);
+    STXXL_UNUSED(bytes);
+#endif
+
+    return false;
+}
+
+void io_uring_queue::unregister_buffer(void* buffer)
+{
+    scoped_mutex_lock lock(buffer_mtx);
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    for (unsigned i = 0; i < fixed_buffers.size(); ++i)
+    {
+        if (fixed_buffers[i].first != buffer) continue;
+
+        // an empty iovec clears the slot, in-flight requests keep their own
+        // reference to the kernel's buffer mapping.
+        iovec iov;
+        iov.iov_base = NULL;
+        iov.iov_len = 0;
+
+        io_uring_rsrc_update2 upd;
+        memset(&upd, 0, sizeof(upd));
+        upd.offset = i;
+        upd.data = reinterpret_cast<__u64>(&iov);
+        upd.nr = 1;
+
+        if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS_UPDATE,
+                    &upd, sizeof(upd)) < 0)
+        {
+            STXXL_THROW_ERRNO(io_error, "io_uring_queue::unregister_buffer()");
+        }
+
+        fixed_buffers[i] = std::pair<char*, size_t>(NULL, 0);
+        return;
+    }
+#else
+    STXXL_UNUSED(buffer);
+#endif
+}
+
+int io_uring_queue::find_fixed_buffer(const void* buffer, size_t bytes)
+{
+    if (!fixed_buffers_supported)
+        return -1;
+
+    scoped_mutex_lock lock(buffer_mtx);
+
+    const char* cbuffer = static_cast<const char*>(buffer);
+    for (unsigned i = 0; i < fixed_buffers.size(); ++i)
+    {
+        if (fixed_buffers[i].first != NULL &&
+            fixed_buffers[i].first <= cbuffer &&
+            cbuffer + bytes <= fixed_buffers[i].first + fixed_buffers[i].second)
+            return (int)i;
+    }
+    return -1;
+}
+
+// internal routines, run by the worker thread
+
+io_uring_sqe* io_uring_queue::get_sqe()
+{
+    // only the worker thread writes to the tail
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_ring_mask;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return &sqes[index];
+}
+
+void io_uring_queue::arm_event_poll()
+{
+    io_uring_sqe* sqe = get_sqe();
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = event_fd;
+    sqe->addr = reinterpret_cast<__u64>(&event_value);
+    sqe->len = sizeof(event_value);
+    sqe->user_data = 0;
+}
+
+bool io_uring_queue::handle_completions()
+{
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    bool event_done = false;
+
+    for ( ; head != tail; ++head)
+    {
+        const io_uring_cqe& cqe = cqes[head & *cq_ring_mask];
+
+        if (cqe.user_data == 0)
+        {
+            // eventfd was read, the wake-up poll needs to be rearmed.
+            event_value = 0;
+            event_done = true;
+            continue;
+        }
+
+        // unsigned_type is as long as a pointer, and like this, we avoid an icpc warning
+        request_ptr* r = reinterpret_cast<request_ptr*>(static_cast<unsigned_type>(cqe.user_data));
+        long res = cqe.res;
+        dynamic_cast<io_uring_request*>(r->get())->completed(true, false, res);
+        delete r;              // release auto_ptr reference
+        --num_posted;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    return event_done;
+}
+
+void io_uring_queue::process_requests()
+{
+    // whether the read on the eventfd is currently pending in the ring
+    bool event_armed = false;
+
+    for ( ; ; ) // as long as thread is running
+    {
+        queue_type batch;
+        {
+            scoped_mutex_lock lock(waiting_mtx);
+
+            // the eventfd read completed: reset notification, all requests
+            // added until now are contained in this batch.
+            if (!event_armed)
+                worker_notified = false;
+
+            // terminate if termination has been requested and all requests
+            // are done.
+            if (thread_state() == TERMINATING &&
+                waiting_requests.empty() && num_posted == 0)
+                break;
+
+            // take as many waiting requests as there are free ring entries,
+            // one is reserved for the eventfd read. A flush is only taken
+            // when all requests before it completed, IOSQE_IO_DRAIN would
+            // also wait for the pending eventfd read.
+            queue_type::iterator end = waiting_requests.begin();
+            for (unsigned n = num_posted;
+                 end != waiting_requests.end() && n + 1 < ring_entries; ++n)
+            {
+                if ((*end)->get_type() == request::FLUSH && n > 0)
+                    break;
+                ++end;
+            }
+
+            batch.splice(batch.end(), waiting_requests,
+                         waiting_requests.begin(), end);
+        }
+
+        // io_uring_enter() might take some time, so we have to remember the
+        // current time before the call.
+        double now = timestamp();
+
+        for (queue_type::iterator it = batch.begin(); it != batch.end(); ++it)
+        {
+            io_uring_request* req = dynamic_cast<io_uring_request*>(it->get());
+
+            req->fill_sqe(get_sqe(), find_fixed_buffer(req->get_buffer(), req->get_size()));
+            iotrace::request_started(req);
+
+            if (req->get_type() == request::READ)
+                stats::get_instance()->read_started(req->get_size(), now);
+            else if (req->get_type() == request::WRITE)
+                stats::get_instance()->write_started(req->get_size(), now);
+
+            ++num_posted;
+        }
+
+        if (!event_armed) {
+            arm_event_poll();
+            event_armed = true;
+        }
+
+        // submit all entries in the submission ring and wait for at least one
+        // completion, which may be the wake-up via eventfd.
+        unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+        long rc;
+        while ((rc = syscall(SYS_io_uring_enter, ring_fd, to_submit, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0)) < 0 &&
+               errno == EINTR)
+        {
+            // submission entries are only consumed on success
+        }
+
+        if (rc < 0 && errno != EBUSY && errno != EAGAIN) {
+            STXXL_THROW_ERRNO(io_error, "io_uring_queue::process_requests"
+                              " io_uring_enter() to_submit=" << to_submit);
+        }
+
+        if (handle_completions())
+            event_armed = false;
+    }
+}
+
+void* io_uring_queue::worker(void* arg)
+{
+    self_type* pthis = static_cast<self_type*>(arg);
+
+    pthis->process_requests();
+
+    pthis->thread_state.set_to(TERMINATED);
+
+#if STXXL_STD_THREADS && STXXL_MSVC >= 1700
+    // Workaround for deadlock bug in Visual C++ Runtime 2012 and 2013, see
+    // request_queue_impl_worker.cpp. -tb
+    ExitThread(NULL);
+#else
+    return NULL;
+#endif
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+// vim: et:ts=4:sw=4
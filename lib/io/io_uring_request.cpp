@@ -0,0 +1,143 @@
+/***************************************************************************
+ *  lib/io/io_uring_request.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/io_uring_request.h>
+
+#if STXXL_HAVE_IO_URING_FILE
+
+#include <stxxl/bits/io/disk_queues.h>
+#include <stxxl/bits/verbose.h>
+#include <stxxl/bits/common/error_handling.h>
+
+#include <unistd.h>
+#include <cstring>
+#include <sstream>
+
+STXXL_BEGIN_NAMESPACE
+
+void io_uring_request::fill_sqe(io_uring_sqe* sqe, int fixed_index)
+{
+    io_uring_file* uf = dynamic_cast<io_uring_file*>(m_file);
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (m_type == FLUSH) {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+    else if (fixed_index >= 0) {
+        sqe->opcode = (m_type == READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = (__u16)fixed_index;
+    }
+    else {
+        sqe->opcode = (m_type == READ) ? IORING_OP_READ : IORING_OP_WRITE;
+    }
+    sqe->fd = uf->file_des;
+    sqe->off = m_offset;
+    sqe->addr = static_cast<__u64>((unsigned long)(m_buffer));
+    sqe->len = (__u32)m_bytes;
+    // indirection, so the I/O system retains a counting_ptr reference
+    sqe->user_data = reinterpret_cast<__u64>(new request_ptr(this));
+
+    STXXL_VERBOSE_IO_URING("io_uring_request[" << this << "] fill_sqe()" <<
+                           " fixed_index=" << fixed_index);
+}
+
+void io_uring_request::completed(bool posted, bool canceled, long result)
+{
+    STXXL_VERBOSE_IO_URING("io_uring_request[" << this << "] completed(" <<
+                           posted << "," << canceled << "," << result << ")");
+
+    if (!canceled)
+    {
+        if (result < 0)
+        {
+            std::ostringstream msg;
+            msg << "Error in io_uring_request::completed :"
+                << " type=" << type_name(m_type)
+                << " offset=" << m_offset << " bytes=" << m_bytes
+                << " : " << strerror((int)-result);
+            error_occured(msg.str());
+        }
+        else if (static_cast<size_type>(result) < m_bytes)
+        {
+            // short transfer, e.g. reading past the end-of-file: serve the
+            // remainder synchronously like syscall_file does.
+            io_uring_file* uf = dynamic_cast<io_uring_file*>(m_file);
+            char* cbuffer = static_cast<char*>(m_buffer) + result;
+            offset_type offset = m_offset + result;
+            size_type bytes = m_bytes - (size_type)result;
+
+            while (bytes > 0)
+            {
+                ssize_t rc = (m_type == READ)
+                             ? ::pread(uf->file_des, cbuffer, bytes, offset)
+                             : ::pwrite(uf->file_des, cbuffer, bytes, offset);
+                if (rc < 0) {
+                    std::ostringstream msg;
+                    msg << "Error in io_uring_request::completed :"
+                        << " short transfer remainder offset=" << offset
+                        << " bytes=" << bytes << " : " << strerror(errno);
+                    error_occured(msg.str());
+                    break;
+                }
+                if (rc == 0) {
+                    if (m_type == READ) {
+                        // read request extends past end-of-file
+                        // fill reminder with zeroes
+                        memset(cbuffer, 0, bytes);
+                    }
+                    else {
+                        error_occured("Error in io_uring_request::completed :"
+                                      " pwrite() wrote zero bytes");
+                    }
+                    break;
+                }
+                bytes -= (size_type)rc;
+                offset += rc;
+                cbuffer += rc;
+            }
+        }
+
+        if (m_type == READ)
+            stats::get_instance()->read_finished();
+        else if (m_type == WRITE)
+            stats::get_instance()->write_finished();
+    }
+    else if (posted && m_type != FLUSH)
+    {
+        if (m_type == READ)
+            stats::get_instance()->read_canceled(m_bytes);
+        else
+            stats::get_instance()->write_canceled(m_bytes);
+    }
+    request_with_state::completed(canceled);
+}
+
+//! Cancel the request
+//!
+//! Routine is called by user, as part of the request interface. Only requests
+//! which were not yet posted to the kernel can be canceled.
+bool io_uring_request::cancel()
+{
+    STXXL_VERBOSE_IO_URING("io_uring_request[" << this << "] cancel()");
+
+    if (!m_file) return false;
+
+    request_ptr req(this);
+    io_uring_queue* queue = dynamic_cast<io_uring_queue*>(
+        disk_queues::get_instance()->get_queue(m_file->get_queue_id())
+        );
+    return queue->cancel_request(req);
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IO_URING_FILE
+// vim: et:ts=4:sw=4
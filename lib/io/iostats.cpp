@@ -35,6 +35,10 @@ stats::stats()
       c_writes(0),
       c_volume_read(0),
       c_volume_written(0),
+      z_volume_raw(0),
+      z_volume_stored(0),
+      t_compress(0.0),
+      t_decompress(0.0),
       t_reads(0.0),
       t_writes(0.0),
       p_reads(0.0),
@@ -102,6 +106,14 @@ void stats::reset()
 
         p_ios = 0.0;
     }
+    {
+        scoped_mutex_lock CompressLock(compress_mutex);
+
+        z_volume_raw = 0;
+        z_volume_stored = 0;
+        t_compress = 0.0;
+        t_decompress = 0.0;
+    }
     {
         scoped_mutex_lock WaitLock(wait_mutex);
 
@@ -246,6 +258,22 @@ void stats::read_cached(unsigned_type size_)
     ++c_reads;
     c_volume_read += size_;
 }
+
+void stats::compressed(unsigned_type raw_size, unsigned_type stored_size, double seconds)
+{
+    scoped_mutex_lock CompressLock(compress_mutex);
+
+    z_volume_raw += raw_size;
+    z_volume_stored += stored_size;
+    t_compress += seconds;
+}
+
+void stats::decompressed(double seconds)
+{
+    scoped_mutex_lock CompressLock(compress_mutex);
+
+    t_decompress += seconds;
+}
 #endif
 
 #ifndef STXXL_DO_NOT_COUNT_WAIT_TIME
@@ -390,6 +418,15 @@ std::ostream& operator << (std::ostream& o, const stats_data& s)
     o << " time spent in I/O (parallel I/O time)      : " << s.get_pio_time() << " s"
       << " @ " << ((double)(s.get_read_volume() + s.get_written_volume()) / 1048576.0 / s.get_pio_time()) << " MiB/s"
       << std::endl;
+    if (s.get_compressed_raw_volume()) {
+        o << " bytes written to compressed files          : " << hr(s.get_compressed_raw_volume(), "B") << std::endl;
+        o << " bytes stored after compression             : " << hr(s.get_compressed_stored_volume(), "B")
+          << " (ratio " << (double)s.get_compressed_raw_volume() / (double)s.get_compressed_stored_volume() << ")"
+          << std::endl;
+        o << " time spent in compression                  : " << s.get_compress_time() << " s" << std::endl;
+    }
+    if (s.get_decompress_time() != 0.0)
+        o << " time spent in decompression                : " << s.get_decompress_time() << " s" << std::endl;
 #else
     o << " n/a" << std::endl;
 #endif
@@ -0,0 +1,477 @@
+/***************************************************************************
+ *  lib/io/iotrace.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/iotrace.h>
+#include <stxxl/bits/io/file.h>
+#include <stxxl/bits/common/log.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/verbose.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+
+STXXL_BEGIN_NAMESPACE
+
+/******************************************************************************/
+// latency_histogram
+
+latency_histogram::latency_histogram()
+    : m_count(0), m_sum(0.0), m_max(0.0)
+{
+    std::fill(m_buckets, m_buckets + num_buckets, 0);
+}
+
+void latency_histogram::add(double latency)
+{
+    if (latency < 0.0) latency = 0.0;
+
+    // bucket index is one plus the floor of log2 of the latency in us
+    double us = latency * 1e6;
+    unsigned b = 0;
+    while (b + 1 < num_buckets && us >= 1.0) {
+        us /= 2.0;
+        ++b;
+    }
+
+    ++m_buckets[b];
+    ++m_count;
+    m_sum += latency;
+    m_max = std::max(m_max, latency);
+}
+
+latency_histogram& latency_histogram::operator += (const latency_histogram& other)
+{
+    for (unsigned i = 0; i < num_buckets; ++i)
+        m_buckets[i] += other.m_buckets[i];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+    return *this;
+}
+
+double latency_histogram::bucket_limit(unsigned i)
+{
+    return (double)((uint64)1 << i) * 1e-6;
+}
+
+double latency_histogram::quantile(double q) const
+{
+    if (m_count == 0) return 0.0;
+
+    uint64 rank = (uint64)(q * (double)m_count);
+    if (rank >= m_count) rank = m_count - 1;
+
+    uint64 seen = 0;
+    for (unsigned i = 0; i < num_buckets; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen > rank)
+            return std::min(bucket_limit(i), m_max);
+    }
+    return m_max;
+}
+
+void latency_histogram::print(std::ostream& os, const std::string& title) const
+{
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+
+    os << std::fixed << std::setprecision(3)
+       << "  " << title << ": " << m_count << " requests, avg "
+       << average() * 1e3 << " ms, p50 " << quantile(0.5) * 1e3
+       << " ms, p90 " << quantile(0.9) * 1e3
+       << " ms, p99 " << quantile(0.99) * 1e3
+       << " ms, max " << max() * 1e3 << " ms" << std::endl;
+
+    if (m_count != 0)
+    {
+        uint64 peak = *std::max_element(m_buckets, m_buckets + num_buckets);
+
+        for (unsigned i = 0; i < num_buckets; ++i)
+        {
+            if (m_buckets[i] == 0) continue;
+
+            os << "    < " << std::setw(12) << bucket_limit(i) * 1e3 << " ms "
+               << std::setw(10) << m_buckets[i] << " "
+               << std::string((size_t)(40 * m_buckets[i] / peak), '#')
+               << std::endl;
+        }
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+/******************************************************************************/
+// iotrace::disk_stats
+
+iotrace::disk_stats::disk_stats()
+    : depth(0), max_depth(0),
+      depth_integral(0.0), depth_time(0.0), first_time(0.0)
+{ }
+
+void iotrace::disk_stats::set_depth(unsigned_type new_depth, double now)
+{
+    if (depth_time == 0.0)
+        first_time = depth_time = now;
+
+    depth_integral += (double)depth * (now - depth_time);
+    depth_time = now;
+    depth = new_depth;
+    max_depth = std::max(max_depth, depth);
+}
+
+double iotrace::disk_stats::average_depth() const
+{
+    return (depth_time > first_time)
+           ? depth_integral / (depth_time - first_time) : 0.0;
+}
+
+/******************************************************************************/
+// iotrace
+
+volatile bool iotrace::s_active = false;
+
+iotrace::iotrace()
+    : m_begin(0.0), m_ring_pos(0)
+{
+    const char* path = getenv("STXXLIOTRACE");
+    if (path && *path)
+    {
+        // the logger must outlive us to print the summary on exit
+        logger::get_instance();
+
+        size_t entries = 1024 * 1024;
+        if (const char* size = getenv("STXXLIOTRACESIZE"))
+            entries = (size_t)strtoul(size, NULL, 10);
+
+        m_dump_path = path;
+        start(entries);
+    }
+}
+
+iotrace::~iotrace()
+{
+    if (!m_dump_path.empty())
+    {
+        stop();
+
+        std::ostringstream summary;
+        print_summary(summary, m_disks);
+        STXXL_MSG("I/O trace summary:\n" << summary.str());
+
+        std::vector<entry> trace = get_trace();
+        std::ofstream out(m_dump_path.c_str());
+        write_trace(out, trace);
+        if (!out.good())
+            STXXL_ERRMSG("Error writing I/O trace to " << m_dump_path);
+        else
+            STXXL_MSG("Wrote I/O trace of " << trace.size() <<
+                      " requests to " << m_dump_path);
+    }
+}
+
+void iotrace::start(size_t trace_entries)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    m_begin = timestamp();
+    m_disks.clear();
+    m_ring.clear();
+    m_ring.resize(trace_entries);
+    m_ring_pos = 0;
+
+    s_active = true;
+}
+
+void iotrace::stop()
+{
+    scoped_mutex_lock lock(m_mutex);
+    s_active = false;
+}
+
+void iotrace::submitted(request* req)
+{
+    scoped_mutex_lock lock(m_mutex);
+    if (!s_active) return;
+
+    double now = timestamp();
+    req->m_submit_time = now;
+    req->m_start_time = 0.0;
+
+    disk_stats& ds = m_disks[req->get_file()->get_device_id()];
+    ds.set_depth(ds.depth + 1, now);
+}
+
+void iotrace::started(request* req)
+{
+    scoped_mutex_lock lock(m_mutex);
+    req->m_start_time = timestamp();
+}
+
+void iotrace::completed(request* req, bool canceled)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // skip requests submitted before tracing started
+    if (!s_active || req->m_submit_time < m_begin)
+        return;
+
+    double now = timestamp();
+    double submit = req->m_submit_time;
+    double start = (req->m_start_time >= submit) ? req->m_start_time : submit;
+    req->m_submit_time = 0.0;
+
+    unsigned int disk = req->get_file()->get_device_id();
+    disk_stats& ds = m_disks[disk];
+    if (ds.depth > 0)
+        ds.set_depth(ds.depth - 1, now);
+
+    if (!canceled)
+    {
+        if (req->get_type() == request::READ) {
+            ds.read_latency.add(now - submit);
+            ds.read_service.add(now - start);
+        }
+        else if (req->get_type() == request::WRITE) {
+            ds.write_latency.add(now - submit);
+            ds.write_service.add(now - start);
+        }
+    }
+
+    if (!m_ring.empty())
+    {
+        entry& e = m_ring[m_ring_pos++ % m_ring.size()];
+        e.disk = disk;
+        e.type = req->get_type();
+        e.canceled = canceled;
+        e.offset = req->get_offset();
+        e.size = req->get_size();
+        e.submit = submit - m_begin;
+        e.start = start - m_begin;
+        e.complete = now - m_begin;
+    }
+}
+
+iotrace::disk_map_type iotrace::get_disk_stats()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_disks;
+}
+
+std::vector<iotrace::entry> iotrace::get_trace()
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    std::vector<entry> trace;
+    if (m_ring_pos <= m_ring.size()) {
+        trace.assign(m_ring.begin(), m_ring.begin() + (size_t)m_ring_pos);
+    }
+    else {
+        // ring wrapped around: oldest entry is at the write position
+        size_t pos = (size_t)(m_ring_pos % m_ring.size());
+        trace.assign(m_ring.begin() + pos, m_ring.end());
+        trace.insert(trace.end(), m_ring.begin(), m_ring.begin() + pos);
+    }
+    return trace;
+}
+
+void iotrace::print_summary(std::ostream& os, const disk_map_type& disks)
+{
+    for (disk_map_type::const_iterator it = disks.begin();
+         it != disks.end(); ++it)
+    {
+        const disk_stats& ds = it->second;
+
+        os << "disk " << it->first
+           << ": queue depth avg " << std::fixed << std::setprecision(2)
+           << ds.average_depth() << " max " << ds.max_depth
+           << std::endl;
+
+        ds.read_latency.print(os, "read latency ");
+        ds.read_service.print(os, "read service ");
+        ds.write_latency.print(os, "write latency");
+        ds.write_service.print(os, "write service");
+    }
+}
+
+//! a queue depth change at time t: +1 submission, -1 completion
+typedef std::pair<double, int> depth_event;
+
+//! collect queue depth changes of one disk, sorted by time
+static std::vector<depth_event>
+get_depth_events(const std::vector<iotrace::entry>& trace, unsigned int disk)
+{
+    std::vector<depth_event> events;
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        if (trace[i].disk != disk) continue;
+        events.push_back(depth_event(trace[i].submit, +1));
+        events.push_back(depth_event(trace[i].complete, -1));
+    }
+    // completions before submissions at equal times
+    std::sort(events.begin(), events.end());
+    return events;
+}
+
+iotrace::disk_map_type iotrace::summarize(const std::vector<entry>& trace)
+{
+    disk_map_type disks;
+
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const entry& e = trace[i];
+        disk_stats& ds = disks[e.disk];
+
+        if (e.canceled) continue;
+
+        if (e.type == request::READ) {
+            ds.read_latency.add(e.complete - e.submit);
+            ds.read_service.add(e.complete - e.start);
+        }
+        else if (e.type == request::WRITE) {
+            ds.write_latency.add(e.complete - e.submit);
+            ds.write_service.add(e.complete - e.start);
+        }
+    }
+
+    for (disk_map_type::iterator it = disks.begin(); it != disks.end(); ++it)
+    {
+        std::vector<depth_event> events = get_depth_events(trace, it->first);
+        int depth = 0;
+
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            depth = std::max(0, depth + events[i].second);
+            // avoid the zero timestamp that marks "not yet set"
+            it->second.set_depth(depth, events[i].first + 1e-9);
+        }
+    }
+
+    return disks;
+}
+
+void iotrace::write_trace(std::ostream& os, const std::vector<entry>& trace)
+{
+    os << "# stxxl iotrace" << std::endl
+       << "# disk type offset size submit start complete" << std::endl;
+
+    os << std::fixed << std::setprecision(9);
+
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const entry& e = trace[i];
+        char type = (e.type == request::READ) ? 'r' :
+                     (e.type == request::WRITE) ? 'w' : 'f';
+        if (e.canceled) type = (char)toupper(type);
+
+        os << e.disk << '\t' << type << '\t' << e.offset << '\t' << e.size
+           << '\t' << e.submit << '\t' << e.start << '\t' << e.complete
+           << '\n';
+    }
+}
+
+bool iotrace::read_trace(std::istream& is, std::vector<entry>& trace)
+{
+    std::string line;
+
+    if (!std::getline(is, line) || line != "# stxxl iotrace")
+        return false;
+
+    while (std::getline(is, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream ls(line);
+        entry e;
+        char type;
+        if (!(ls >> e.disk >> type >> e.offset >> e.size
+              >> e.submit >> e.start >> e.complete))
+            return false;
+
+        e.type = (tolower(type) == 'r') ? request::READ :
+                 (tolower(type) == 'w') ? request::WRITE : request::FLUSH;
+        e.canceled = (type == 'R' || type == 'W' || type == 'F');
+        trace.push_back(e);
+    }
+
+    return true;
+}
+
+void iotrace::write_chrome_trace(std::ostream& os, const std::vector<entry>& trace)
+{
+    // timestamps are in microseconds
+    os << std::fixed << std::setprecision(3);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+       << "\"args\":{\"name\":\"stxxl I/O\"}}";
+
+    disk_map_type disks;
+
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const entry& e = trace[i];
+        const char* name = (e.type == request::READ) ? "read" :
+                           (e.type == request::WRITE) ? "write" : "flush";
+        disks[e.disk];
+
+        std::ostringstream common;
+        common << "\"cat\":\"disk " << e.disk << "\",\"id\":" << i
+               << ",\"pid\":0,\"tid\":" << e.disk;
+
+        // outer slice: request lifetime from submission to completion
+        os << ",\n{\"name\":\"" << name << "\",\"ph\":\"b\","
+           << common.str() << ",\"ts\":" << e.submit * 1e6
+           << ",\"args\":{\"offset\":" << e.offset << ",\"size\":" << e.size
+           << (e.canceled ? ",\"canceled\":true" : "") << "}}";
+
+        // inner slice: actual I/O operation
+        if (!e.canceled) {
+            os << ",\n{\"name\":\"service\",\"ph\":\"b\"," << common.str()
+               << ",\"ts\":" << e.start * 1e6 << "}";
+            os << ",\n{\"name\":\"service\",\"ph\":\"e\"," << common.str()
+               << ",\"ts\":" << e.complete * 1e6 << "}";
+        }
+
+        os << ",\n{\"name\":\"" << name << "\",\"ph\":\"e\","
+           << common.str() << ",\"ts\":" << e.complete * 1e6 << "}";
+    }
+
+    // queue depth counter of each disk
+    for (disk_map_type::iterator it = disks.begin(); it != disks.end(); ++it)
+    {
+        std::vector<depth_event> events = get_depth_events(trace, it->first);
+        int depth = 0;
+
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            depth = std::max(0, depth + events[i].second);
+
+            // emit only the last change at each timestamp
+            if (i + 1 < events.size() && events[i + 1].first == events[i].first)
+                continue;
+
+            os << ",\n{\"name\":\"queue depth disk " << it->first
+               << "\",\"ph\":\"C\",\"pid\":0,\"ts\":" << events[i].first * 1e6
+               << ",\"args\":{\"depth\":" << depth << "}}";
+        }
+    }
+
+    os << "\n]}" << std::endl;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -45,14 +45,25 @@ request_ptr linuxaio_file::awrite(
     return req;
 }
 
+request_ptr linuxaio_file::aflush(const completion_handler& on_cmpl)
+{
+    request_ptr req(new linuxaio_request(on_cmpl, this, NULL, 0, 0, request::FLUSH));
+
+    disk_queues::get_instance()->add_request(req, get_queue_id());
+
+    return req;
+}
+
 void linuxaio_file::serve(void* buffer, offset_type offset, size_type bytes,
                           request::request_type type)
 {
     // req need not be an linuxaio_request
     if (type == request::READ)
         aread(buffer, offset, bytes)->wait();
-    else
+    else if (type == request::WRITE)
         awrite(buffer, offset, bytes)->wait();
+    else
+        aflush()->wait();
 }
 
 const char* linuxaio_file::io_type() const
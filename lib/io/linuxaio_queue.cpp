@@ -168,19 +168,43 @@ void linuxaio_queue::post_requests()
             num_free_events--; // might block because too many requests are posted
 
             // polymorphic_downcast
-            while (!dynamic_cast<linuxaio_request*>(req.get())->post())
+            linuxaio_request* areq = dynamic_cast<linuxaio_request*>(req.get());
+
+            if (areq->get_type() == request::FLUSH)
             {
-                // post failed, so first handle events to make queues (more)
-                // empty, then try again.
-
-                // wait for at least one event to complete, no time limit
-                long num_events = syscall(SYS_io_getevents, context, 1, max_events, events, NULL);
-                if (num_events < 0) {
-                    STXXL_THROW_ERRNO(io_error, "linuxaio_queue::post_requests"
-                                      " io_getevents() nr_events=" << num_events);
-                }
+                // the kernel does not order IOCB_CMD_FDSYNC after requests
+                // in flight: wait until all events are free again, i.e. all
+                // requests posted before completed.
+                for (int e = 1; e < max_events; ++e)
+                    num_free_events--;
+
+                bool posted = areq->post_flush();
+
+                for (int e = 1; e < max_events; ++e)
+                    num_free_events++;
 
-                handle_events(events, num_events, false);
+                if (!posted) {
+                    // served synchronously
+                    num_free_events++;
+                    continue;
+                }
+            }
+            else
+            {
+                while (!areq->post())
+                {
+                    // post failed, so first handle events to make queues
+                    // (more) empty, then try again.
+
+                    // wait for at least one event to complete, no time limit
+                    long num_events = syscall(SYS_io_getevents, context, 1, max_events, events, NULL);
+                    if (num_events < 0) {
+                        STXXL_THROW_ERRNO(io_error, "linuxaio_queue::post_requests"
+                                          " io_getevents() nr_events=" << num_events);
+                    }
+
+                    handle_events(events, num_events, false);
+                }
             }
 
             // request is finally posted
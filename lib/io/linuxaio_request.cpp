@@ -19,6 +19,7 @@
 #include <stxxl/bits/verbose.h>
 #include <stxxl/bits/common/error_handling.h>
 
+#include <cstring>
 #include <unistd.h>
 #include <sys/syscall.h>
 
@@ -29,7 +30,9 @@ void linuxaio_request::completed(bool posted, bool canceled)
     STXXL_VERBOSE_LINUXAIO("linuxaio_request[" << this << "] completed(" <<
                            posted << "," << canceled << ")");
 
-    if (!canceled)
+    if (m_type == FLUSH)
+        ;   // not counted as I/O volume
+    else if (!canceled)
     {
         if (m_type == READ)
             stats::get_instance()->read_finished();
@@ -54,7 +57,8 @@ void linuxaio_request::fill_control_block()
     // indirection, so the I/O system retains a counting_ptr reference
     cb.aio_data = reinterpret_cast<__u64>(new request_ptr(this));
     cb.aio_fildes = af->file_des;
-    cb.aio_lio_opcode = (m_type == READ) ? IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+    cb.aio_lio_opcode = (m_type == READ) ? IOCB_CMD_PREAD :
+                        (m_type == WRITE) ? IOCB_CMD_PWRITE : IOCB_CMD_FDSYNC;
     cb.aio_reqprio = 0;
     cb.aio_buf = static_cast<__u64>((unsigned long)(m_buffer));
     cb.aio_nbytes = m_bytes;
@@ -78,6 +82,7 @@ bool linuxaio_request::post()
     long success = syscall(SYS_io_submit, queue->get_io_context(), 1, &cb_pointer);
     if (success == 1)
     {
+        iotrace::request_started(this);
         if (m_type == READ)
             stats::get_instance()->read_started(m_bytes, now);
         else
@@ -90,6 +95,40 @@ bool linuxaio_request::post()
     return success == 1;
 }
 
+bool linuxaio_request::post_flush()
+{
+    STXXL_VERBOSE_LINUXAIO("linuxaio_request[" << this << "] post_flush()");
+
+    fill_control_block();
+    iocb* cb_pointer = &cb;
+    linuxaio_queue* queue = dynamic_cast<linuxaio_queue*>(
+        disk_queues::get_instance()->get_queue(m_file->get_queue_id())
+        );
+    long success = syscall(SYS_io_submit, queue->get_io_context(), 1, &cb_pointer);
+
+    iotrace::request_started(this);
+    if (success == 1)
+        return true;
+
+    // IOCB_CMD_FDSYNC is only supported since Linux 4.18 and not by all file
+    // systems (EINVAL): flush synchronously on the posting thread.
+    STXXL_VERBOSE_LINUXAIO("linuxaio_request[" << this << "] post_flush():"
+                           " io_submit() failed: " << strerror(errno));
+    delete reinterpret_cast<request_ptr*>(cb.aio_data);
+
+    try
+    {
+        m_file->flush();
+    }
+    catch (const io_error& ex)
+    {
+        error_occured(ex.what());
+    }
+
+    completed(false, false);
+    return false;
+}
+
 //! Cancel the request
 //!
 //! Routine is called by user, as part of the request interface.
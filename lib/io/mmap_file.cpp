@@ -57,6 +57,8 @@ void mmap_file::serve(void* buffer, offset_type offset, size_type bytes,
         else
         {
             memcpy(mem, buffer, bytes);
+            // start write-back now, flush() only has to wait for it
+            msync(mem, bytes, MS_ASYNC);
         }
         STXXL_THROW_ERRNO_NE_0(munmap(mem, bytes), io_error,
                                "munmap() failed");
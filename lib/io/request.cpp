@@ -30,7 +30,9 @@ request::request(
       m_buffer(buffer),
       m_offset(offset),
       m_bytes(bytes),
-      m_type(type)
+      m_type(type),
+      m_submit_time(0.0),
+      m_start_time(0.0)
 {
     STXXL_VERBOSE3_THIS("request::(...), ref_cnt=" << get_reference_count());
     m_file->add_request_ref();
@@ -66,12 +68,25 @@ void request::check_nref_failed(bool after)
                  " offset=" << m_offset <<
                  " buffer=" << m_buffer <<
                  " bytes=" << m_bytes <<
-                 " type=" << ((m_type == READ) ? "READ" : "WRITE") <<
+                 " type=" << type_name(m_type) <<
                  " file=" << m_file <<
                  " iotype=" << m_file->io_type()
                  );
 }
 
+const char* request::type_name(request_type type)
+{
+    switch (type) {
+    case READ:
+        return "READ";
+    case WRITE:
+        return "WRITE";
+    case FLUSH:
+        return "FLUSH";
+    }
+    return "UNKNOWN";
+}
+
 const char* request::io_type() const
 {
     return m_file->io_type();
@@ -83,7 +98,7 @@ std::ostream& request::print(std::ostream& out) const
     out << " Buffer address: " << static_cast<void*>(m_buffer);
     out << " File offset: " << m_offset;
     out << " Transfer size: " << m_bytes << " bytes";
-    out << " Type of transfer: " << ((m_type == READ) ? "READ" : "WRITE");
+    out << " Type of transfer: " << type_name(m_type);
     return out;
 }
 
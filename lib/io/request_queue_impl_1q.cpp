@@ -38,7 +38,8 @@ struct file_offset_match : public std::binary_function<request_ptr, request_ptr,
         const request_ptr& b) const
     {
         // matching file and offset are enough to cause problems
-        return (a->get_offset() == b->get_offset()) &&
+        return (a->get_type() != request::FLUSH) &&
+               (a->get_offset() == b->get_offset()) &&
                (a->get_file() == b->get_file());
     }
 };
@@ -60,6 +61,7 @@ void request_queue_impl_1q::add_request(request_ptr& req)
         STXXL_ERRMSG("Incompatible request submitted to running queue.");
 
 #if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    if (req->get_type() != request::FLUSH)
     {
         scoped_mutex_lock Lock(m_queue_mutex);
         if (std::find_if(m_queue.begin(), m_queue.end(),
@@ -13,85 +13,326 @@
  *  http://www.boost.org/LICENSE_1_0.txt)
  **************************************************************************/
 
-#include <algorithm>
-
 #include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/io/file.h>
 #include <stxxl/bits/io/request_queue_impl_qwqr.h>
 #include <stxxl/bits/io/serving_request.h>
-#include <stxxl/bits/parallel.h>
+
+#include <vector>
 
 #if STXXL_STD_THREADS && STXXL_MSVC >= 1700
  #include <windows.h>
 #endif
 
-#ifndef STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
-#define STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION 1
+#if STXXL_MSVC
+ #include <intrin.h>
+#endif
+
+#if STXXL_HAVE_SYNC_ADD_AND_FETCH || STXXL_MSVC
+ #define STXXL_QWQR_LOCK_FREE 1
+#else
+ #define STXXL_QWQR_LOCK_FREE 0
 #endif
 
 STXXL_BEGIN_NAMESPACE
 
-struct file_offset_match : public std::binary_function<request_ptr, request_ptr, bool>
+#if !STXXL_QWQR_LOCK_FREE
+//! no atomic intrinsics found, emulate compare-and-swap with a mutex (slow)
+static mutex s_cas_mutex;
+#endif
+
+//! atomic compare-and-swap of a pointer, implies a full memory barrier
+static inline bool
+cas_ptr(serving_request* volatile* ptr,
+        serving_request* oldval, serving_request* newval)
 {
-    bool operator () (
-        const request_ptr& a,
-        const request_ptr& b) const
-    {
-        // matching file and offset are enough to cause problems
-        return (a->get_offset() == b->get_offset()) &&
-               (a->get_file() == b->get_file());
-    }
-};
+#if STXXL_MSVC
+    return _InterlockedCompareExchangePointer(
+        (void* volatile*)ptr, newval, oldval) == oldval;
+#elif STXXL_HAVE_SYNC_ADD_AND_FETCH
+    return __sync_bool_compare_and_swap(ptr, oldval, newval);
+#else
+    scoped_mutex_lock lock(s_cas_mutex);
+    if (*ptr != oldval) return false;
+    *ptr = newval;
+    return true;
+#endif
+}
+
+//! atomic compare-and-swap of an int, implies a full memory barrier
+static inline bool
+cas_int(volatile int* ptr, int oldval, int newval)
+{
+#if STXXL_MSVC
+    return _InterlockedCompareExchange(
+        (volatile long*)ptr, newval, oldval) == oldval;
+#elif STXXL_HAVE_SYNC_ADD_AND_FETCH
+    return __sync_bool_compare_and_swap(ptr, oldval, newval);
+#else
+    scoped_mutex_lock lock(s_cas_mutex);
+    if (*ptr != oldval) return false;
+    *ptr = newval;
+    return true;
+#endif
+}
 
 request_queue_impl_qwqr::request_queue_impl_qwqr(int n)
-    : m_thread_state(NOT_RUNNING), m_sem(0)
+    : m_write_stack(NULL), m_read_stack(NULL), m_urgent_stack(NULL),
+      m_priority_op(WRITE),
+      m_read_deadline(0.5), m_write_deadline(5.0),
+      m_worker_sleeping(0),
+      m_thread_state(NOT_RUNNING), m_sem(0)
 {
     STXXL_UNUSED(n);
     start_thread(worker, static_cast<void*>(this), m_thread, m_thread_state);
 }
 
+bool request_queue_impl_qwqr::is_lock_free()
+{
+    return STXXL_QWQR_LOCK_FREE;
+}
+
+void request_queue_impl_qwqr::push(serving_request* volatile* stack,
+                                   serving_request* req, link_type next)
+{
+    serving_request* top;
+    do {
+        top = *stack;
+        req->*next = top;
+    } while (!cas_ptr(stack, top, req));
+}
+
+void request_queue_impl_qwqr::refill(serving_request* volatile* stack,
+                                     fifo_type& fifo, link_type next)
+{
+    // detach the whole stack
+    serving_request* top;
+    do {
+        top = *stack;
+        if (!top) return;
+    } while (!cas_ptr(stack, top, NULL));
+
+    // reverse it into submission order
+    serving_request* first = NULL, * last = top;
+    while (top) {
+        serving_request* below = top->*next;
+        top->*next = first;
+        first = top;
+        top = below;
+    }
+
+    if (fifo.tail)
+        fifo.tail->*next = first;
+    else
+        fifo.head = first;
+    fifo.tail = last;
+}
+
+request_ptr request_queue_impl_qwqr::pop_front(fifo_type& fifo, link_type next)
+{
+    serving_request* req = fifo.head;
+    fifo.head = req->*next;
+    if (!fifo.head)
+        fifo.tail = NULL;
+    req->*next = NULL;
+
+    // take over the reference held by the queue
+    request_ptr rp(req);
+    req->dec_reference();
+
+    if (!cas_int(&req->m_queue_state,
+                 serving_request::QUEUED, serving_request::DEQUEUED))
+    {
+        // request was canceled or already served after promotion, drop it.
+        return request_ptr();
+    }
+
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    if (req->get_type() != request::FLUSH)
+    {
+        scoped_mutex_lock Lock(m_pending_mutex);
+        pending_type& pending = (req->get_type() == request::READ)
+                                ? m_pending_reads : m_pending_writes;
+        pending.erase(pending.find(
+                          std::make_pair(req->get_file(), req->get_offset())));
+    }
+#endif
+    return rp;
+}
+
+request_ptr request_queue_impl_qwqr::dequeue(serving_request* volatile* stack,
+                                             fifo_type& fifo, link_type next)
+{
+    for ( ; ; )
+    {
+        if (!fifo.head) {
+            refill(stack, fifo, next);
+            if (!fifo.head)
+                return request_ptr();
+        }
+
+        request_ptr req = pop_front(fifo, next);
+        if (req.valid())
+            return req;
+    }
+}
+
+request_ptr request_queue_impl_qwqr::dequeue_adjacent(
+    serving_request* volatile* stack, fifo_type& fifo,
+    const request_ptr& prev, request::size_type max_bytes)
+{
+    for ( ; ; )
+    {
+        if (!fifo.head) {
+            refill(stack, fifo, &serving_request::m_queue_next);
+            if (!fifo.head)
+                return request_ptr();
+        }
+
+        serving_request* req = fifo.head;
+        if (req->m_queue_state == serving_request::QUEUED &&
+            (req->get_type() == request::FLUSH ||
+             req->get_file() != prev->get_file() ||
+             req->get_offset() != prev->get_offset() + prev->get_size() ||
+             req->get_size() > max_bytes))
+            return request_ptr();
+
+        // pops stale entries, or the adjacent one unless it was just canceled
+        request_ptr rp = pop_front(fifo, &serving_request::m_queue_next);
+        if (rp.valid())
+            return rp;
+    }
+}
+
+request_ptr request_queue_impl_qwqr::next_request(bool& write_phase)
+{
+    request_ptr req = dequeue(&m_urgent_stack, m_urgent_queue,
+                              &serving_request::m_urgent_next);
+    if (req.valid())
+        return req;
+
+    // serve the oldest request whose deadline expired
+    if (!m_read_queue.head)
+        refill(&m_read_stack, m_read_queue, &serving_request::m_queue_next);
+    if (!m_write_queue.head)
+        refill(&m_write_stack, m_write_queue, &serving_request::m_queue_next);
+
+    if (m_read_queue.head || m_write_queue.head)
+    {
+        double now = timestamp();
+
+        const bool read_expired = m_read_queue.head &&
+                                  now - m_read_queue.head->m_queue_time > m_read_deadline;
+        const bool write_expired = m_write_queue.head &&
+                                   now - m_write_queue.head->m_queue_time > m_write_deadline;
+
+        // if both expired, the one queued first
+        const bool write_first =
+            write_expired && (!read_expired ||
+                              m_write_queue.head->m_queue_time < m_read_queue.head->m_queue_time);
+
+        if (write_first)
+        {
+            req = dequeue(&m_write_stack, m_write_queue,
+                          &serving_request::m_queue_next);
+            if (req.valid())
+                return req;
+        }
+        if (read_expired)
+        {
+            req = dequeue(&m_read_stack, m_read_queue,
+                          &serving_request::m_queue_next);
+            if (req.valid())
+                return req;
+        }
+        if (write_expired && !write_first)
+        {
+            req = dequeue(&m_write_stack, m_write_queue,
+                          &serving_request::m_queue_next);
+            if (req.valid())
+                return req;
+        }
+    }
+
+    const priority_op op = m_priority_op;
+    if (op == READ)
+        write_phase = false;
+    else if (op == WRITE)
+        write_phase = true;
+
+    if (write_phase)
+    {
+        req = dequeue(&m_write_stack, m_write_queue, &serving_request::m_queue_next);
+        if (!req.valid())
+            req = dequeue(&m_read_stack, m_read_queue, &serving_request::m_queue_next);
+    }
+    else
+    {
+        req = dequeue(&m_read_stack, m_read_queue, &serving_request::m_queue_next);
+        if (!req.valid())
+            req = dequeue(&m_write_stack, m_write_queue, &serving_request::m_queue_next);
+    }
+
+    // alternate in fair mode
+    if (op == NONE)
+        write_phase = !write_phase;
+
+    return req;
+}
+
+void request_queue_impl_qwqr::notify_worker()
+{
+    if (m_worker_sleeping && cas_int(&m_worker_sleeping, 1, 0))
+        m_sem++;
+}
+
 void request_queue_impl_qwqr::add_request(request_ptr& req)
 {
     if (req.empty())
         STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
     if (m_thread_state() != RUNNING)
         STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
-    if (!dynamic_cast<serving_request*>(req.get()))
-        STXXL_ERRMSG("Incompatible request submitted to running queue.");
 
-    if (req.get()->get_type() == request::READ)
-    {
+    serving_request* sreq = dynamic_cast<serving_request*>(req.get());
+    if (!sreq)
+        STXXL_THROW_INVALID_ARGUMENT("Incompatible request submitted to running queue.");
+    if (!cas_int(&sreq->m_queue_state,
+                 serving_request::NOT_QUEUED, serving_request::QUEUED))
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to disk_queue twice.");
+
 #if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    if (req->get_type() != request::FLUSH)
+    {
+        scoped_mutex_lock Lock(m_pending_mutex);
+        std::pair<file*, request::offset_type> key(req->get_file(), req->get_offset());
+        if (req->get_type() == request::READ)
         {
-            scoped_mutex_lock Lock(m_write_mutex);
-            if (std::find_if(m_write_queue.begin(), m_write_queue.end(),
-                             bind2nd(file_offset_match(), req) _STXXL_FORCE_SEQUENTIAL)
-                != m_write_queue.end())
-            {
+            if (m_pending_writes.find(key) != m_pending_writes.end())
                 STXXL_ERRMSG("READ request submitted for a BID with a pending WRITE request");
-            }
+            m_pending_reads.insert(key);
         }
-#endif
-        scoped_mutex_lock Lock(m_read_mutex);
-        m_read_queue.push_back(req);
-    }
-    else
-    {
-#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+        else
         {
-            scoped_mutex_lock Lock(m_read_mutex);
-            if (std::find_if(m_read_queue.begin(), m_read_queue.end(),
-                             bind2nd(file_offset_match(), req) _STXXL_FORCE_SEQUENTIAL)
-                != m_read_queue.end())
-            {
+            if (m_pending_reads.find(key) != m_pending_reads.end())
                 STXXL_ERRMSG("WRITE request submitted for a BID with a pending READ request");
-            }
+            m_pending_writes.insert(key);
         }
-#endif
-        scoped_mutex_lock Lock(m_write_mutex);
-        m_write_queue.push_back(req);
     }
+#endif
 
-    m_sem++;
+    // the queue holds a reference until the worker dequeues the request
+    sreq->inc_reference();
+    sreq->m_queue_time = timestamp();
+
+    // flushes are queued with the writes, which are served in submission
+    // order, hence after all writes submitted before them.
+    if (req->get_type() == request::READ)
+        push(&m_read_stack, sreq, &serving_request::m_queue_next);
+    else
+        push(&m_write_stack, sreq, &serving_request::m_queue_next);
+
+    notify_worker();
 }
 
 bool request_queue_impl_qwqr::cancel_request(request_ptr& req)
@@ -100,38 +341,56 @@ bool request_queue_impl_qwqr::cancel_request(request_ptr& req)
         STXXL_THROW_INVALID_ARGUMENT("Empty request canceled disk_queue.");
     if (m_thread_state() != RUNNING)
         STXXL_THROW_INVALID_ARGUMENT("Request canceled to not running queue.");
-    if (!dynamic_cast<serving_request*>(req.get()))
-        STXXL_ERRMSG("Incompatible request submitted to running queue.");
 
-    bool was_still_in_queue = false;
-    if (req.get()->get_type() == request::READ)
-    {
-        scoped_mutex_lock Lock(m_read_mutex);
-        queue_type::iterator pos
-            = std::find(m_read_queue.begin(), m_read_queue.end(),
-                        req _STXXL_FORCE_SEQUENTIAL);
-        if (pos != m_read_queue.end())
-        {
-            m_read_queue.erase(pos);
-            was_still_in_queue = true;
-            m_sem--;
-        }
+    serving_request* sreq = dynamic_cast<serving_request*>(req.get());
+    if (!sreq) {
+        STXXL_ERRMSG("Incompatible request submitted to running queue.");
+        return false;
     }
-    else
+
+    // the request stays in the queue, the worker skips it
+    if (!cas_int(&sreq->m_queue_state,
+                 serving_request::QUEUED, serving_request::CANCELED))
+        return false;
+
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    if (req->get_type() != request::FLUSH)
     {
-        scoped_mutex_lock Lock(m_write_mutex);
-        queue_type::iterator pos
-            = std::find(m_write_queue.begin(), m_write_queue.end(),
-                        req _STXXL_FORCE_SEQUENTIAL);
-        if (pos != m_write_queue.end())
-        {
-            m_write_queue.erase(pos);
-            was_still_in_queue = true;
-            m_sem--;
-        }
+        scoped_mutex_lock Lock(m_pending_mutex);
+        pending_type& pending = (req->get_type() == request::READ)
+                                ? m_pending_reads : m_pending_writes;
+        pending.erase(pending.find(
+                          std::make_pair(req->get_file(), req->get_offset())));
     }
+#endif
 
-    return was_still_in_queue;
+    return true;
+}
+
+bool request_queue_impl_qwqr::promote_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request promoted in disk_queue.");
+
+    serving_request* sreq = dynamic_cast<serving_request*>(req.get());
+    if (!sreq)
+        return false;
+
+    if (sreq->m_queue_state != serving_request::QUEUED)
+        return false;
+    // a promoted flush would overtake the writes it has to wait for
+    if (sreq->get_type() == request::FLUSH)
+        return false;
+    if (!cas_int(&sreq->m_promoted, 0, 1))
+        return false;
+
+    // the urgent stack holds another reference, the request is served from
+    // whichever queue the worker reaches first.
+    sreq->inc_reference();
+    push(&m_urgent_stack, sreq, &serving_request::m_urgent_next);
+
+    notify_worker();
+    return true;
 }
 
 request_queue_impl_qwqr::~request_queue_impl_qwqr()
@@ -143,74 +402,78 @@ void* request_queue_impl_qwqr::worker(void* arg)
 {
     self* pthis = static_cast<self*>(arg);
 
+    // adjacent requests coalesced into one vectored I/O
+    std::vector<request_ptr> batch;
+    std::vector<serving_request*> batch_ptrs;
+
     bool write_phase = true;
     for ( ; ; )
     {
-        pthis->m_sem--;
+        request_ptr req = pthis->next_request(write_phase);
 
-        if (write_phase)
+        if (req.valid() && STXXL_QWQR_COALESCE_MAX_REQUESTS > 1 &&
+            req->get_type() != request::FLUSH &&
+            req->get_file()->has_vector_io())
         {
-            scoped_mutex_lock WriteLock(pthis->m_write_mutex);
-            if (!pthis->m_write_queue.empty())
-            {
-                request_ptr req = pthis->m_write_queue.front();
-                pthis->m_write_queue.pop_front();
+            batch.clear();
+            batch.push_back(req);
+            request::size_type bytes = req->get_size();
 
-                WriteLock.unlock();
+            const bool is_read = (req->get_type() == request::READ);
+            serving_request* volatile* stack = is_read ? &pthis->m_read_stack : &pthis->m_write_stack;
+            fifo_type& fifo = is_read ? pthis->m_read_queue : pthis->m_write_queue;
 
-                //assert(req->get_reference_count()) > 1);
-                dynamic_cast<serving_request*>(req.get())->serve();
-            }
-            else
+            while (batch.size() < STXXL_QWQR_COALESCE_MAX_REQUESTS &&
+                   bytes < STXXL_QWQR_COALESCE_MAX_BYTES)
             {
-                WriteLock.unlock();
-
-                pthis->m_sem++;
-
-                if (pthis->m_priority_op == WRITE)
-                    write_phase = false;
+                request_ptr next = pthis->dequeue_adjacent(
+                    stack, fifo, batch.back(), STXXL_QWQR_COALESCE_MAX_BYTES - bytes);
+                if (!next.valid())
+                    break;
+                bytes += next->get_size();
+                batch.push_back(next);
             }
 
-            if (pthis->m_priority_op == NONE || pthis->m_priority_op == READ)
-                write_phase = false;
-        }
-        else
-        {
-            scoped_mutex_lock ReadLock(pthis->m_read_mutex);
-
-            if (!pthis->m_read_queue.empty())
+            if (batch.size() > 1)
             {
-                request_ptr req = pthis->m_read_queue.front();
-                pthis->m_read_queue.pop_front();
-
-                ReadLock.unlock();
-
-                STXXL_VERBOSE2("queue: before serve request has " << req->get_reference_count() << " references ");
-                //assert(req->get_reference_count() > 1);
-                dynamic_cast<serving_request*>(req.get())->serve();
-                STXXL_VERBOSE2("queue: after serve request has " << req->get_reference_count() << " references ");
-            }
-            else
-            {
-                ReadLock.unlock();
-
-                pthis->m_sem++;
-
-                if (pthis->m_priority_op == READ)
-                    write_phase = true;
+                batch_ptrs.resize(batch.size());
+                for (size_t i = 0; i < batch.size(); ++i)
+                    batch_ptrs[i] = static_cast<serving_request*>(batch[i].get());
+
+                STXXL_VERBOSE2("queue: serving " << batch.size() << " coalesced requests");
+                serving_request::serve_coalesced(&batch_ptrs[0], batch_ptrs.size());
+                batch.clear();
+                continue;
             }
+            batch.clear();
+        }
 
-            if (pthis->m_priority_op == NONE || pthis->m_priority_op == WRITE)
-                write_phase = true;
+        if (req.valid())
+        {
+            STXXL_VERBOSE2("queue: before serve request has " << req->get_reference_count() << " references ");
+            static_cast<serving_request*>(req.get())->serve();
+            STXXL_VERBOSE2("queue: after serve request has " << req->get_reference_count() << " references ");
+            continue;
         }
 
         // terminate if it has been requested and queues are empty
-        if (pthis->m_thread_state() == TERMINATING) {
-            if ((pthis->m_sem--) == 0)
-                break;
-            else
-                pthis->m_sem++;
+        if (pthis->m_thread_state() == TERMINATING)
+            break;
+
+        // announce going to sleep, then check again for requests pushed
+        // meanwhile: either we see them, or the producer sees the flag.
+        cas_int(&pthis->m_worker_sleeping, 0, 1);
+
+        if (pthis->m_write_stack || pthis->m_read_stack ||
+            pthis->m_urgent_stack || pthis->m_thread_state() == TERMINATING)
+        {
+            // if a producer already cleared the flag, consume its signal
+            if (!cas_int(&pthis->m_worker_sleeping, 1, 0))
+                pthis->m_sem--;
+            continue;
         }
+
+        pthis->m_sem--;
     }
 
     pthis->m_thread_state.set_to(TERMINATED);
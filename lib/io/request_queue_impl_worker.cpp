@@ -14,6 +14,7 @@
  **************************************************************************/
 
 #include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/common/semaphore.h>
 #include <stxxl/bits/common/state.h>
 #include <stxxl/bits/config.h>
@@ -50,6 +51,11 @@ void request_queue_impl_worker::stop_thread(thread_type& t, state<thread_state>&
     assert(s() == RUNNING);
     s.set_to(TERMINATING);
     sem++;
+    join_thread(t, s);
+}
+
+void request_queue_impl_worker::join_thread(thread_type& t, state<thread_state>& s)
+{
 #if STXXL_STD_THREADS
 #if STXXL_MSVC >= 1700
     // In the Visual C++ Runtime 2012 and 2013, there is a deadlock bug, which
@@ -80,5 +86,19 @@ void request_queue_impl_worker::stop_thread(thread_type& t, state<thread_state>&
     s.set_to(NOT_RUNNING);
 }
 
+void request_queue_impl_worker::bind_thread(thread_type& t, int node)
+{
+#if STXXL_HAVE_LIBNUMA
+#if STXXL_STD_THREADS || STXXL_BOOST_THREADS
+    numa::bind_thread(t->native_handle(), node);
+#else
+    numa::bind_thread(t, node);
+#endif
+#else
+    STXXL_UNUSED(t);
+    STXXL_UNUSED(node);
+#endif
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
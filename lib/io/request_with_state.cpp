@@ -16,6 +16,7 @@
 #include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/io/file.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iotrace.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/request_with_state.h>
 #include <stxxl/bits/singleton.h>
@@ -44,6 +45,14 @@ void request_with_state::wait(bool measure_time)
 
     stats::scoped_wait_timer wait_timer(m_type == READ ? stats::WAIT_OP_READ : stats::WAIT_OP_WRITE, measure_time);
 
+    // somebody blocks on this request: let it overtake queued requests
+    file* f = m_file;
+    if (f && m_state() == OP)
+    {
+        request_ptr rp(this);
+        disk_queues::get_instance()->promote_request(rp, f->get_queue_id());
+    }
+
     m_state.wait_for(READY2DIE);
 
     check_errors();
@@ -58,6 +67,7 @@ bool request_with_state::cancel()
         request_ptr rp(this);
         if (disk_queues::get_instance()->cancel_request(rp, m_file->get_queue_id()))
         {
+            iotrace::request_completed(this, true);
             m_state.set_to(DONE);
             notify_waiters();
             m_file->delete_request_ref();
@@ -81,6 +91,7 @@ bool request_with_state::poll()
 void request_with_state::completed(bool canceled)
 {
     STXXL_VERBOSE3_THIS("request_with_state::completed()");
+    iotrace::request_completed(this, canceled);
     m_state.set_to(DONE);
     if (!canceled)
         m_on_complete(this);
@@ -14,13 +14,16 @@
 #include <stxxl/bits/common/exceptions.h>
 #include <stxxl/bits/common/state.h>
 #include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/iotrace.h>
 #include <stxxl/bits/io/request_interface.h>
 #include <stxxl/bits/io/request_with_state.h>
 #include <stxxl/bits/io/serving_request.h>
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/verbose.h>
 
+#include <cassert>
 #include <iomanip>
+#include <vector>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -31,7 +34,9 @@ serving_request::serving_request(
     offset_type off,
     size_type b,
     request_type t)
-    : request_with_state(on_cmpl, f, buf, off, b, t)
+    : request_with_state(on_cmpl, f, buf, off, b, t),
+      m_queue_next(NULL), m_queue_state(NOT_QUEUED),
+      m_urgent_next(NULL), m_promoted(0), m_queue_time(0.0)
 {
 #ifdef STXXL_CHECK_BLOCK_ALIGNING
     // Direct I/O requires file system block size alignment for file offsets,
@@ -49,12 +54,16 @@ void serving_request::serve()
         m_buffer << " @ [" <<
         m_file << "|" << m_file->get_allocator_id() << "]0x" <<
         std::hex << std::setfill('0') << std::setw(8) <<
-        m_offset << "/0x" << m_bytes <<
-        ((m_type == request::READ) ? " READ" : " WRITE"));
+        m_offset << "/0x" << m_bytes << " " << type_name(m_type));
+
+    iotrace::request_started(this);
 
     try
     {
-        m_file->serve(m_buffer, m_offset, m_bytes, m_type);
+        if (m_type == request::FLUSH)
+            m_file->flush();
+        else
+            m_file->serve(m_buffer, m_offset, m_bytes, m_type);
     }
     catch (const io_error& ex)
     {
@@ -66,6 +75,49 @@ void serving_request::serve()
     completed(false);
 }
 
+void serving_request::serve_coalesced(serving_request* const* reqs, size_t count)
+{
+    assert(count > 0);
+    if (count == 1)
+        return reqs[0]->serve();
+
+    file* f = reqs[0]->m_file;
+    std::vector<file::io_vector> vec(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        reqs[i]->check_nref();
+        assert(reqs[i]->m_file == f);
+        assert(reqs[i]->m_type == reqs[0]->m_type);
+        assert(reqs[i]->m_type != request::FLUSH);
+        assert(i == 0 || reqs[i]->m_offset == reqs[i - 1]->m_offset + reqs[i - 1]->m_bytes);
+        vec[i].buffer = reqs[i]->m_buffer;
+        vec[i].bytes = reqs[i]->m_bytes;
+        iotrace::request_started(reqs[i]);
+    }
+
+    STXXL_VERBOSE2(
+        "serving_request::serve_coalesced(): " << count << " requests @ [" <<
+        f << "|" << f->get_allocator_id() << "]0x" <<
+        std::hex << std::setfill('0') << std::setw(8) <<
+        reqs[0]->m_offset << std::dec << " " << type_name(reqs[0]->m_type));
+
+    try
+    {
+        f->serve_vector(&vec[0], count, reqs[0]->m_offset, reqs[0]->m_type);
+    }
+    catch (const io_error& ex)
+    {
+        for (size_t i = 0; i < count; ++i)
+            reqs[i]->error_occured(ex.what());
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        reqs[i]->check_nref(true);
+        reqs[i]->completed(false);
+    }
+}
+
 const char* serving_request::io_type() const
 {
     return m_file->io_type();
@@ -21,6 +21,11 @@
 #include <stxxl/bits/io/syscall_file.h>
 #include "ufs_platform.h"
 
+#if STXXL_HAVE_PREADV
+ #include <sys/uio.h>
+ #include <vector>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 void syscall_file::serve(void* buffer, offset_type offset, size_type bytes,
@@ -111,6 +116,70 @@ void syscall_file::serve(void* buffer, offset_type offset, size_type bytes,
     }
 }
 
+#if STXXL_HAVE_PREADV
+void syscall_file::serve_vector(const io_vector* vec, size_t count,
+                                offset_type offset, request::request_type type)
+{
+    scoped_mutex_lock fd_lock(fd_mutex);
+
+    std::vector<struct iovec> iov(count);
+    size_type bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = vec[i].buffer;
+        iov[i].iov_len = vec[i].bytes;
+        bytes += vec[i].bytes;
+    }
+
+    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE);
+
+    struct iovec* cur = &iov[0];
+    int left = (int)count;
+
+    while (left > 0)
+    {
+        ssize_t rc = (type == request::READ)
+                     ? ::preadv(file_des, cur, left, offset)
+                     : ::pwritev(file_des, cur, left, offset);
+
+        if (rc == 0 && type == request::READ && offset >= this->_size())
+        {
+            // read request extends past end-of-file
+            // fill reminder with zeroes
+            for ( ; left > 0; ++cur, --left)
+                memset(cur->iov_base, 0, cur->iov_len);
+            break;
+        }
+        if (rc <= 0)
+        {
+            STXXL_THROW_ERRNO
+                (io_error,
+                " this=" << this <<
+                " call=" << ((type == request::READ) ? "::preadv" : "::pwritev") <<
+                "(fd,iov,count,offset)" <<
+                " path=" << filename <<
+                " fd=" << file_des <<
+                " offset=" << offset <<
+                " count=" << left <<
+                " bytes=" << bytes <<
+                " type=" << ((type == request::READ) ? "READ" : "WRITE") <<
+                " rc=" << rc);
+        }
+
+        offset += rc;
+
+        // skip fully transferred buffers, adjust partially transferred one
+        while (left > 0 && (size_t)rc >= cur->iov_len) {
+            rc -= cur->iov_len;
+            ++cur, --left;
+        }
+        if (left > 0) {
+            cur->iov_base = static_cast<char*>(cur->iov_base) + rc;
+            cur->iov_len -= rc;
+        }
+    }
+}
+#endif
+
 const char* syscall_file::io_type() const
 {
     return "syscall";
@@ -0,0 +1,447 @@
+/***************************************************************************
+ *  lib/io/tiered_file.cpp
+ *
+ *  a pseudo file keeping hot blocks of a slow file on a fast tier
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/tiered_file.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/verbose.h>
+#include <stxxl/aligned_alloc>
+
+#ifndef STXXL_VERBOSE_TIERED
+#define STXXL_VERBOSE_TIERED STXXL_VERBOSE2
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! number of read counters kept for blocks on the slow file, all are reset
+//! when it is exceeded
+static const size_t tiered_file_read_history = 64 * 1024;
+
+static inline file::size_type align_up(file::size_type size)
+{
+    return div_ceil(size, STXXL_BLOCK_ALIGN) * STXXL_BLOCK_ALIGN;
+}
+
+tiered_file::tiered_file(
+    file* slow_file, file* fast_file,
+    offset_type fast_capacity,
+    policy_type policy,
+    unsigned int promote_reads,
+    int queue_id, int allocator_id, unsigned int device_id)
+    : file(device_id),
+      disk_queued_file(queue_id, allocator_id),
+      m_slow(slow_file), m_fast(fast_file),
+      m_fast_capacity(fast_capacity / STXXL_BLOCK_ALIGN * STXXL_BLOCK_ALIGN),
+      m_policy(policy), m_promote_reads(promote_reads),
+      m_buffer(NULL), m_buffer_capacity(0)
+{
+    m_size = m_slow->size();
+
+    m_fast->set_size(m_fast_capacity);
+    if (m_fast_capacity > 0)
+        m_free[0] = (size_type)m_fast_capacity;
+
+    m_counters.hits = m_counters.misses = 0;
+    m_counters.promotions = m_counters.demotions = m_counters.writebacks = 0;
+}
+
+tiered_file::~tiered_file()
+{
+    STXXL_VERBOSE1("tiered_file: hits=" << m_counters.hits <<
+                   " misses=" << m_counters.misses <<
+                   " promotions=" << m_counters.promotions <<
+                   " demotions=" << m_counters.demotions <<
+                   " writebacks=" << m_counters.writebacks);
+
+    // the fast tier is removed, dirty blocks only live there
+    write_back_all();
+
+    if (m_buffer)
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(m_buffer);
+
+    m_fast->close_remove();
+    delete m_fast;
+    m_fast = NULL;
+    delete m_slow;
+    m_slow = NULL;
+}
+
+void tiered_file::serve(void* buffer, offset_type offset, size_type bytes,
+                        request::request_type type)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    if (type == request::READ)
+        sread(static_cast<char*>(buffer), offset, bytes);
+    else
+        swrite(static_cast<const char*>(buffer), offset, bytes);
+}
+
+void tiered_file::lock()
+{
+    m_slow->lock();
+    m_fast->lock();
+}
+
+void tiered_file::flush()
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // blocks are written synchronously in serve(), but the dirty ones only
+    // to the fast tier, which may be volatile
+    write_back_all();
+    m_slow->flush();
+}
+
+tiered_file::offset_type tiered_file::size()
+{
+    return m_size;
+}
+
+void tiered_file::set_size(offset_type newsize)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    if (newsize < m_size)
+    {
+        // drop blocks beyond the new end, demote those crossing it
+        entry_map_type::iterator it = m_entries.lower_bound(newsize);
+        if (it != m_entries.begin()) {
+            entry_map_type::iterator pred = it;
+            --pred;
+            if (pred->first + pred->second.bytes > newsize)
+                demote(pred);
+        }
+        while (it != m_entries.end())
+        {
+            deallocate(it->second.fast, align_up(it->second.bytes));
+            m_order.erase(it->second.order);
+            m_entries.erase(it++);
+        }
+        m_reads.erase(m_reads.lower_bound(newsize), m_reads.end());
+    }
+
+    m_slow->set_size(newsize);
+    m_size = newsize;
+}
+
+void tiered_file::discard(offset_type offset, offset_type size)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // drop blocks completely inside the region, keep partially covered ones
+    entry_map_type::iterator it = m_entries.lower_bound(offset);
+    while (it != m_entries.end() && it->first + it->second.bytes <= offset + size)
+    {
+        deallocate(it->second.fast, align_up(it->second.bytes));
+        m_order.erase(it->second.order);
+        m_entries.erase(it++);
+    }
+    m_reads.erase(m_reads.lower_bound(offset), m_reads.lower_bound(offset + size));
+
+    m_slow->discard(offset, size);
+}
+
+void tiered_file::close_remove()
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    // nothing is to be written back to the removed file
+    m_entries.clear();
+    m_order.clear();
+    m_reads.clear();
+    m_free.clear();
+    if (m_fast_capacity > 0)
+        m_free[0] = (size_type)m_fast_capacity;
+
+    m_slow->close_remove();
+}
+
+const char* tiered_file::io_type() const
+{
+    return "tiered";
+}
+
+tiered_file::counters tiered_file::get_counters()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_counters;
+}
+
+tiered_file::offset_type tiered_file::get_fast_usage()
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    offset_type usage = 0;
+    for (entry_map_type::const_iterator it = m_entries.begin();
+         it != m_entries.end(); ++it)
+        usage += it->second.bytes;
+    return usage;
+}
+
+void tiered_file::sread(char* buffer, offset_type offset, size_type bytes)
+{
+    entry_map_type::iterator it = isolate(offset, bytes);
+
+    if (it != m_entries.end())
+    {
+        m_fast->serve(buffer, it->second.fast, bytes, request::READ);
+        touch(it->second);
+        ++m_counters.hits;
+        return;
+    }
+
+    m_slow->serve(buffer, offset, bytes, request::READ);
+    ++m_counters.misses;
+
+    if (m_promote_reads == 0)
+        return;
+
+    if (m_reads.size() >= tiered_file_read_history)
+        m_reads.clear();
+
+    if (++m_reads[offset] < m_promote_reads)
+        return;
+
+    m_reads.erase(offset);
+
+    if (insert(buffer, offset, bytes, false)) {
+        STXXL_VERBOSE_TIERED("tiered_file: promoted [" << offset << "," << offset + bytes << ")");
+        ++m_counters.promotions;
+    }
+}
+
+void tiered_file::swrite(const char* buffer, offset_type offset, size_type bytes)
+{
+    entry_map_type::iterator it = isolate(offset, bytes);
+
+    if (it != m_entries.end())
+    {
+        m_fast->serve(const_cast<char*>(buffer), it->second.fast, bytes,
+                      request::WRITE);
+        it->second.dirty = true;
+        touch(it->second);
+        ++m_counters.hits;
+    }
+    else
+    {
+        m_reads.erase(offset);
+
+        if (insert(buffer, offset, bytes, true)) {
+            ++m_counters.hits;
+        }
+        else {
+            m_slow->serve(const_cast<char*>(buffer), offset, bytes,
+                          request::WRITE);
+            ++m_counters.misses;
+        }
+    }
+
+    if (offset + bytes > m_size)
+        m_size = offset + bytes;
+}
+
+void tiered_file::touch(entry& e)
+{
+    if (m_policy == POLICY_LRU)
+        m_order.splice(m_order.end(), m_order, e.order);
+    else
+        e.referenced = true;
+}
+
+bool tiered_file::insert(const char* buffer, offset_type offset, size_type bytes,
+                         bool dirty)
+{
+    const size_type alloc = align_up(bytes);
+    if (alloc > m_fast_capacity)
+        return false;
+
+    // the fast tier is completely free at the latest when it is empty
+    offset_type fast;
+    while (!allocate(alloc, fast))
+        demote(victim());
+
+    m_fast->serve(const_cast<char*>(buffer), fast, bytes, request::WRITE);
+
+    entry e;
+    e.fast = fast;
+    e.bytes = bytes;
+    e.dirty = dirty;
+    e.referenced = false;
+    e.order = m_order.insert(m_order.end(), offset);
+    m_entries[offset] = e;
+
+    return true;
+}
+
+void tiered_file::write_back(entry_map_type::iterator it)
+{
+    entry& e = it->second;
+    if (!e.dirty)
+        return;
+
+    if (m_buffer_capacity < e.bytes)
+    {
+        if (m_buffer)
+            aligned_dealloc<STXXL_BLOCK_ALIGN>(m_buffer);
+        m_buffer_capacity = align_up(std::max(e.bytes, 2 * m_buffer_capacity));
+        m_buffer = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(m_buffer_capacity));
+    }
+
+    m_fast->serve(m_buffer, e.fast, e.bytes, request::READ);
+    m_slow->serve(m_buffer, it->first, e.bytes, request::WRITE);
+    e.dirty = false;
+    ++m_counters.writebacks;
+}
+
+void tiered_file::write_back_all()
+{
+    for (entry_map_type::iterator it = m_entries.begin();
+         it != m_entries.end(); ++it)
+        write_back(it);
+}
+
+void tiered_file::demote(entry_map_type::iterator it)
+{
+    entry& e = it->second;
+
+    STXXL_VERBOSE_TIERED("tiered_file: demoting [" << it->first << "," << it->first + e.bytes << ")"
+                         << (e.dirty ? " dirty" : ""));
+
+    write_back(it);
+
+    deallocate(e.fast, align_up(e.bytes));
+    m_order.erase(e.order);
+    m_entries.erase(it);
+    ++m_counters.demotions;
+}
+
+tiered_file::entry_map_type::iterator
+tiered_file::isolate(offset_type offset, size_type bytes)
+{
+    const offset_type end = offset + bytes;
+
+    // first block overlapping [offset, end)
+    entry_map_type::iterator it = m_entries.upper_bound(offset);
+    if (it != m_entries.begin()) {
+        --it;
+        if (it->first + it->second.bytes <= offset)
+            ++it;
+    }
+
+    entry_map_type::iterator match = m_entries.end();
+    while (it != m_entries.end() && it->first < end)
+    {
+        if (it->first == offset && it->second.bytes == bytes)
+            match = it++;
+        else
+            demote(it++);
+    }
+
+    return match;
+}
+
+tiered_file::entry_map_type::iterator tiered_file::victim()
+{
+    assert(!m_order.empty());
+
+    if (m_policy == POLICY_CLOCK)
+    {
+        // give referenced blocks a second chance
+        for ( ; ; )
+        {
+            entry& e = m_entries[m_order.front()];
+            if (!e.referenced)
+                break;
+            e.referenced = false;
+            m_order.splice(m_order.end(), m_order, m_order.begin());
+        }
+    }
+
+    return m_entries.find(m_order.front());
+}
+
+bool tiered_file::allocate(size_type size, offset_type& offset)
+{
+    // first fit
+    for (free_map_type::iterator it = m_free.begin(); it != m_free.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+
+        offset = it->first;
+        size_type rest = it->second - size;
+        m_free.erase(it);
+        if (rest > 0)
+            m_free[offset + size] = rest;
+        return true;
+    }
+
+    return false;
+}
+
+void tiered_file::deallocate(offset_type offset, size_type size)
+{
+    free_map_type::iterator succ = m_free.upper_bound(offset);
+
+    // merge with successor
+    if (succ != m_free.end() && offset + size == succ->first) {
+        size += succ->second;
+        m_free.erase(succ++);
+    }
+
+    // merge with predecessor
+    if (succ != m_free.begin()) {
+        free_map_type::iterator pred = succ;
+        --pred;
+        assert(pred->first + pred->second <= offset);
+        if (pred->first + pred->second == offset) {
+            pred->second += size;
+            return;
+        }
+    }
+
+    m_free[offset] = size;
+}
+
+const char* tiered_file::policy_name(policy_type policy)
+{
+    switch (policy) {
+    case POLICY_LRU:
+        return "lru";
+    case POLICY_CLOCK:
+        return "clock";
+    }
+    return "unknown";
+}
+
+tiered_file::policy_type tiered_file::parse_policy(const std::string& name)
+{
+    policy_type policy;
+
+    if (name == "lru")
+        policy = POLICY_LRU;
+    else if (name == "clock")
+        policy = POLICY_CLOCK;
+    else
+        STXXL_THROW(std::runtime_error,
+                    "Unknown tier replacement policy '" << name << "'.");
+
+    return policy;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -22,6 +22,11 @@
 #include <stxxl/bits/verbose.h>
 #include "ufs_platform.h"
 
+#if STXXL_HAVE_BLKDISCARD
+ #include <sys/ioctl.h>
+ #include <linux/fs.h>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 const char* ufs_file_base::io_type() const
@@ -193,6 +198,72 @@ void ufs_file_base::lock()
 #endif
 }
 
+void ufs_file_base::flush()
+{
+    // no fd_mutex: the descriptor is valid for the lifetime of the file and
+    // serving requests must not be blocked by a long flush.
+#if STXXL_WINDOWS || defined(__MINGW32__)
+    if (::_commit(file_des) != 0)
+        STXXL_THROW_ERRNO(io_error, "_commit() path=" << filename << " fd=" << file_des);
+#elif defined(__linux__)
+    if (::fdatasync(file_des) != 0)
+        STXXL_THROW_ERRNO(io_error, "fdatasync() path=" << filename << " fd=" << file_des);
+#else
+    if (::fsync(file_des) != 0)
+        STXXL_THROW_ERRNO(io_error, "fsync() path=" << filename << " fd=" << file_des);
+#endif
+}
+
+void ufs_file_base::discard(offset_type offset, offset_type size)
+{
+    if (size == 0)
+        return;
+    {
+        // m_mode is changed below by whichever I/O thread fails first
+        scoped_mutex_lock fd_lock(fd_mutex);
+        if (!(m_mode & DISCARD))
+            return;
+    }
+
+    // no fd_mutex held: neither call uses the file position.
+    int rc = -1;
+    const char* method = "discard";
+
+    if (m_is_device) {
+#if STXXL_HAVE_BLKDISCARD
+        uint64 range[2] = { (uint64)offset, (uint64)size };
+        method = "ioctl(BLKDISCARD)";
+        rc = ::ioctl(file_des, BLKDISCARD, &range);
+#else
+        errno = EOPNOTSUPP;
+#endif
+    }
+    else {
+#if STXXL_HAVE_FALLOCATE_PUNCH_HOLE
+        method = "fallocate(FALLOC_FL_PUNCH_HOLE)";
+        rc = ::fallocate(file_des, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                         offset, size);
+#else
+        errno = EOPNOTSUPP;
+#endif
+    }
+
+    if (rc == 0) {
+        STXXL_VERBOSE2("ufs_file_base::discard " << method << " path=" << filename <<
+                       " offset=" << offset << " size=" << size);
+        return;
+    }
+
+    // discarding is only a hint, stop trying after the first failure
+    const int error = errno;
+    scoped_mutex_lock fd_lock(fd_mutex);
+    if (!(m_mode & DISCARD))
+        return;
+    STXXL_ERRMSG(method << " failed on path=" << filename << " fd=" << file_des <<
+                 " : " << strerror(error) << ", disabling discard.");
+    m_mode &= ~DISCARD;
+}
+
 file::offset_type ufs_file_base::_size()
 {
     // We use lseek SEEK_END to find the file size. This works for raw devices
@@ -194,6 +194,24 @@ void wbtl_file::_add_free_region(offset_type offset, offset_type size)
     STXXL_VERBOSE_WBTL("wbtl:free    p" << FMT_A_S(region_pos, region_size) << " F => f" << FMT_A_C(free_bytes, free_space.size()));
 }
 
+void wbtl_file::flush()
+{
+    scoped_mutex_lock buffer_lock(buffer_mutex);
+
+    if (backend_request.get())
+        backend_request->wait(false);
+
+    // write the filled part of the current write buffer, it stays current
+    // and is written again in full later.
+    if (buffer_address[curbuf] != offset_type(-1) && curpos > 0) {
+        STXXL_VERBOSE_WBTL("wbtl:flush   p" << FMT_A_S(buffer_address[curbuf], curpos));
+        storage->serve(write_buffer[curbuf], buffer_address[curbuf], curpos,
+                       request::WRITE);
+    }
+
+    storage->flush();
+}
+
 void wbtl_file::sread(void* buffer, offset_type offset, size_type bytes)
 {
     scoped_mutex_lock buffer_lock(buffer_mutex);
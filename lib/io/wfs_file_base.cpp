@@ -173,6 +173,12 @@ void wfs_file_base::lock()
     locked = true;
 }
 
+void wfs_file_base::flush()
+{
+    if (!FlushFileBuffers(file_des))
+        STXXL_THROW_WIN_LASTERROR(io_error, "FlushFileBuffers() fd=" << file_des);
+}
+
 file::offset_type wfs_file_base::_size()
 {
     LARGE_INTEGER result;
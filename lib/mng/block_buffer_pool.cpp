@@ -0,0 +1,340 @@
+/***************************************************************************
+ *  lib/mng/block_buffer_pool.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/mng/block_buffer_pool.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/unused.h>
+#include <stxxl/bits/verbose.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if STXXL_HAVE_MMAP_FILE
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+#if STXXL_HAVE_MMAP_FILE && defined(MAP_HUGETLB)
+ #ifndef MAP_HUGE_SHIFT
+  #define MAP_HUGE_SHIFT 26
+ #endif
+ #ifndef MAP_HUGE_2MB
+  #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+ #endif
+ #ifndef MAP_HUGE_1GB
+  #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+ #endif
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+static const uint64 huge_page_size = 2 * 1024 * 1024;
+static const uint64 giant_page_size = 1024 * 1024 * 1024;
+
+block_buffer_pool::block_buffer_pool()
+    : m_base(NULL), m_size(0), m_pages(PAGES_NORMAL), m_locked(false),
+      m_used_bytes(0), m_peak_bytes(0), m_hits(0), m_misses(0)
+{
+    const char* env = getenv("STXXL_BUFFER_POOL");
+    if (!env || !*env)
+        return;
+
+    std::vector<std::string> options = split(env, ",");
+
+    uint64 size;
+    if (!parse_SI_IEC_size(options[0], size)) {
+        STXXL_ERRMSG("Invalid size in STXXL_BUFFER_POOL='" << env << "', the pool is disabled.");
+        return;
+    }
+
+    page_type pages = PAGES_THP;
+    bool prefault = true, lock = false;
+    for (size_t i = 1; i < options.size(); ++i)
+    {
+        if (parse_pages(options[i], pages))
+            continue;
+        else if (options[i] == "noprefault")
+            prefault = false;
+        else if (options[i] == "mlock")
+            lock = true;
+        else
+            STXXL_ERRMSG("Unknown option '" << options[i] << "' in STXXL_BUFFER_POOL, ignored.");
+    }
+
+    init(size, pages, prefault, lock);
+
+    if (enabled())
+        STXXL_MSG("Block buffer pool: " << format_IEC_size(m_size) << "B of " <<
+                  pages_name(m_pages) << " pages" << (m_locked ? ", locked" : ""));
+}
+
+block_buffer_pool::block_buffer_pool(uint64 size, page_type pages,
+                                     bool prefault, bool lock)
+    : m_base(NULL), m_size(0), m_pages(PAGES_NORMAL), m_locked(false),
+      m_used_bytes(0), m_peak_bytes(0), m_hits(0), m_misses(0)
+{
+    init(size, pages, prefault, lock);
+}
+
+block_buffer_pool::~block_buffer_pool()
+{
+    if (!m_base)
+        return;
+
+    if (!m_used.empty())
+        STXXL_ERRMSG("block_buffer_pool: " << m_used.size() << " buffers still in use on destruction.");
+
+#if STXXL_HAVE_MMAP_FILE
+    if (m_locked)
+        munlock(m_base, m_size);
+    munmap(m_base, m_size);
+#endif
+}
+
+void block_buffer_pool::init(uint64 size, page_type pages, bool prefault, bool lock)
+{
+    if (size == 0)
+        return;
+
+#if STXXL_HAVE_MMAP_FILE
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* area = MAP_FAILED;
+
+    if (pages == PAGES_HUGETLB || pages == PAGES_HUGETLB_1G)
+    {
+  #if defined(MAP_HUGETLB)
+        const uint64 page_size =
+            (pages == PAGES_HUGETLB_1G) ? giant_page_size : huge_page_size;
+        m_size = div_ceil(size, page_size) * page_size;
+        int huge_flags = MAP_HUGETLB |
+                         ((pages == PAGES_HUGETLB_1G) ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+   #if defined(MAP_POPULATE)
+        if (prefault)
+            huge_flags |= MAP_POPULATE;
+   #endif
+        area = mmap(NULL, m_size, prot, flags | huge_flags, -1, 0);
+        if (area == MAP_FAILED)
+            STXXL_ERRMSG("block_buffer_pool: mapping " << format_IEC_size(m_size) <<
+                         "B of " << pages_name(pages) << " pages failed: " <<
+                         strerror(errno) << ", falling back to transparent huge pages.");
+  #else
+        STXXL_ERRMSG("block_buffer_pool: MAP_HUGETLB is not supported, falling back to transparent huge pages.");
+  #endif
+        if (area == MAP_FAILED)
+            pages = PAGES_THP;
+    }
+
+    if (pages == PAGES_THP)
+    {
+        // map an extra huge page to align the area to huge page boundaries,
+        // where the kernel can back it by huge pages
+        m_size = div_ceil(size, huge_page_size) * huge_page_size;
+        char* raw = (char*)mmap(NULL, m_size + huge_page_size, prot, flags, -1, 0);
+        if (raw != (char*)MAP_FAILED)
+        {
+            char* aligned = raw + (huge_page_size - (uint64)raw % huge_page_size) % huge_page_size;
+            if (aligned > raw)
+                munmap(raw, aligned - raw);
+            if (aligned + m_size < raw + m_size + huge_page_size)
+                munmap(aligned + m_size, raw + m_size + huge_page_size - (aligned + m_size));
+            area = aligned;
+  #if defined(MADV_HUGEPAGE)
+            if (madvise(area, m_size, MADV_HUGEPAGE) != 0)
+                STXXL_ERRMSG("block_buffer_pool: madvise(MADV_HUGEPAGE) failed: " << strerror(errno));
+  #endif
+        }
+    }
+
+    if (pages == PAGES_NORMAL)
+    {
+        m_size = div_ceil(size, alignment) * alignment;
+        area = mmap(NULL, m_size, prot, flags, -1, 0);
+    }
+
+    if (area == MAP_FAILED) {
+        STXXL_ERRMSG("block_buffer_pool: mapping " << format_IEC_size(m_size) <<
+                     "B failed: " << strerror(errno) << ", the pool is disabled.");
+        m_size = 0;
+        return;
+    }
+
+    m_base = (char*)area;
+    m_pages = pages;
+
+    if (prefault && pages != PAGES_HUGETLB && pages != PAGES_HUGETLB_1G)
+    {
+        // touch every page to take the page faults now, after madvise() so
+        // that they are served by huge pages
+        const long page_size = sysconf(_SC_PAGESIZE);
+        for (uint64 i = 0; i < m_size; i += page_size)
+            m_base[i] = 0;
+    }
+
+    if (lock)
+    {
+        if (mlock(m_base, m_size) == 0)
+            m_locked = true;
+        else
+            STXXL_ERRMSG("block_buffer_pool: mlock() of " << format_IEC_size(m_size) <<
+                         "B failed: " << strerror(errno) << ", check ulimit -l.");
+    }
+
+    insert_chunk(0, m_size);
+#else
+    STXXL_UNUSED(size);
+    STXXL_UNUSED(pages);
+    STXXL_UNUSED(prefault);
+    STXXL_UNUSED(lock);
+    STXXL_ERRMSG("block_buffer_pool: not supported on this platform, the pool is disabled.");
+#endif
+}
+
+void* block_buffer_pool::allocate(size_t size, size_t meta_info_size)
+{
+    // the meta info is put right in front of the aligned data
+    const uint64 offset = div_ceil(meta_info_size, alignment) * alignment;
+    const uint64 chunk_size = offset + div_ceil(std::max<size_t>(size, 1), alignment) * alignment;
+
+    scoped_mutex_lock lock(m_mutex);
+
+    size_index_type::iterator fit =
+        m_free_by_size.lower_bound(std::make_pair(chunk_size, uint64(0)));
+    if (fit == m_free_by_size.end()) {
+        ++m_misses;
+        STXXL_VERBOSE2("block_buffer_pool: no chunk of " << chunk_size << " bytes free");
+        return NULL;
+    }
+
+    // best fit, lowest offset among equal sizes
+    free_map_type::iterator chunk = m_free.find(fit->second);
+    const uint64 start = chunk->first, free_size = chunk->second;
+    erase_chunk(chunk);
+    if (free_size > chunk_size)
+        insert_chunk(start + chunk_size, free_size - chunk_size);
+
+    char* result = m_base + start + offset - meta_info_size;
+    m_used[result] = std::make_pair(start, chunk_size);
+
+    ++m_hits;
+    m_used_bytes += chunk_size;
+    m_peak_bytes = std::max(m_peak_bytes, m_used_bytes);
+
+    return result;
+}
+
+void block_buffer_pool::deallocate(void* ptr)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    used_map_type::iterator used = m_used.find((const char*)ptr);
+    assert(used != m_used.end());
+    if (used == m_used.end()) {
+        STXXL_ERRMSG("block_buffer_pool: deallocate() of unknown buffer " << ptr);
+        return;
+    }
+
+    uint64 start = used->second.first, size = used->second.second;
+    m_used.erase(used);
+    m_used_bytes -= size;
+
+    // coalesce with the neighboring free chunks
+    free_map_type::iterator succ = m_free.lower_bound(start);
+    if (succ != m_free.end() && succ->first == start + size) {
+        size += succ->second;
+        free_map_type::iterator next = succ;
+        ++next;
+        erase_chunk(succ);
+        succ = next;
+    }
+    if (succ != m_free.begin()) {
+        free_map_type::iterator pred = succ;
+        --pred;
+        if (pred->first + pred->second == start) {
+            start = pred->first;
+            size += pred->second;
+            erase_chunk(pred);
+        }
+    }
+    insert_chunk(start, size);
+}
+
+uint64 block_buffer_pool::get_used() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_used_bytes;
+}
+
+uint64 block_buffer_pool::get_peak() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_peak_bytes;
+}
+
+uint64 block_buffer_pool::get_hits() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_hits;
+}
+
+uint64 block_buffer_pool::get_misses() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_misses;
+}
+
+bool block_buffer_pool::parse_pages(const std::string& name, page_type& pages)
+{
+    if (name == "normal")
+        pages = PAGES_NORMAL;
+    else if (name == "thp")
+        pages = PAGES_THP;
+    else if (name == "hugetlb")
+        pages = PAGES_HUGETLB;
+    else if (name == "hugetlb1g")
+        pages = PAGES_HUGETLB_1G;
+    else
+        return false;
+    return true;
+}
+
+const char* block_buffer_pool::pages_name(page_type pages)
+{
+    switch (pages) {
+    case PAGES_NORMAL: return "normal";
+    case PAGES_THP: return "thp";
+    case PAGES_HUGETLB: return "hugetlb";
+    case PAGES_HUGETLB_1G: return "hugetlb1g";
+    }
+    return "unknown";
+}
+
+void block_buffer_pool::print_stats(std::ostream& o) const
+{
+    if (!enabled()) {
+        o << "Block buffer pool: disabled" << std::endl;
+        return;
+    }
+
+    scoped_mutex_lock lock(m_mutex);
+    o << "Block buffer pool: " << format_IEC_size(m_size) << "B of "
+      << pages_name(m_pages) << " pages" << (m_locked ? ", locked" : "")
+      << ", used " << format_IEC_size(m_used_bytes) << "B"
+      << ", peak " << format_IEC_size(m_peak_bytes) << "B"
+      << ", " << m_hits << " allocations, " << m_misses << " fallbacks"
+      << std::endl;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
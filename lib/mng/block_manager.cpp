@@ -12,9 +12,12 @@
  *  http://www.boost.org/LICENSE_1_0.txt)
  **************************************************************************/
 
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/binary_buffer.h>
 #include <stxxl/bits/common/types.h>
 #include <stxxl/bits/io/create_file.h>
 #include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/request_operations.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/mng/disk_allocator.h>
@@ -22,14 +25,134 @@
 #include <stxxl/bits/verbose.h>
 
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <string>
 
+#if STXXL_MNG_THREAD_CACHE && STXXL_POSIX_THREADS
+ #include <pthread.h>
+#elif STXXL_MNG_THREAD_CACHE && STXXL_BOOST_THREADS
+ #include <boost/thread/tss.hpp>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 class io_error;
 
+#if STXXL_MNG_THREAD_CACHE
+
+//! protects the list of thread caches and their owner pointers, which are
+//! modified when threads exit and when the block manager is destroyed
+static mutex s_thread_cache_mutex;
+
+#if STXXL_POSIX_THREADS
+
+static pthread_key_t s_thread_cache_key;
+static pthread_once_t s_thread_cache_once = PTHREAD_ONCE_INIT;
+
+static void thread_cache_key_create()
+{
+    STXXL_CHECK_PTHREAD_CALL(pthread_key_create(&s_thread_cache_key,
+                                                block_manager::thread_cache_exit));
+}
+
+static block_manager::thread_cache* get_thread_cache_ptr()
+{
+    pthread_once(&s_thread_cache_once, thread_cache_key_create);
+    return static_cast<block_manager::thread_cache*>(
+        pthread_getspecific(s_thread_cache_key));
+}
+
+static void set_thread_cache_ptr(block_manager::thread_cache* tc)
+{
+    STXXL_CHECK_PTHREAD_CALL(pthread_setspecific(s_thread_cache_key, tc));
+}
+
+#elif STXXL_STD_THREADS
+
+//! calls thread_cache_exit() when the thread exits
+struct thread_cache_holder
+{
+    block_manager::thread_cache* tc;
+
+    thread_cache_holder() : tc(NULL) { }
+
+    ~thread_cache_holder()
+    {
+        if (tc)
+            block_manager::thread_cache_exit(tc);
+    }
+};
+
+static thread_local thread_cache_holder s_thread_cache;
+
+static block_manager::thread_cache* get_thread_cache_ptr()
+{
+    return s_thread_cache.tc;
+}
+
+static void set_thread_cache_ptr(block_manager::thread_cache* tc)
+{
+    s_thread_cache.tc = tc;
+}
+
+#elif STXXL_BOOST_THREADS
+
+static void thread_cache_cleanup(block_manager::thread_cache* tc)
+{
+    block_manager::thread_cache_exit(tc);
+}
+
+static boost::thread_specific_ptr<block_manager::thread_cache> s_thread_cache(
+    thread_cache_cleanup);
+
+static block_manager::thread_cache* get_thread_cache_ptr()
+{
+    return s_thread_cache.get();
+}
+
+static void set_thread_cache_ptr(block_manager::thread_cache* tc)
+{
+    s_thread_cache.reset(tc);
+}
+
+#endif
+
+#endif // STXXL_MNG_THREAD_CACHE
+
+//! bytes reserved for the superblocks at the beginning of the first disk
+static const int64 catalog_reserved_bytes = 1024 * 1024;
+
+//! size of each superblock, they are written alternately
+static const size_t superblock_size = 4096;
+static const unsigned int superblock_slots = 2;
+
+//! the catalog is written in blocks of this size
+static const unsigned int catalog_block_size = 1024 * 1024;
+
+//! "STXXLCAT" and the version of the catalog format, version 2 added the
+//! flags of the roots
+static const uint64 catalog_magic = 0x5441434c58585453ull;
+static const uint32 catalog_version = 2;
+
+//! flag of a root which may have been written in place since it was set
+static const uint64 root_flag_modified = 1;
+
+//! number of catalog blocks fitting into a superblock
+static const size_t catalog_max_blocks = (superblock_size - 64) / sizeof(uint64);
+
+//! 64-bit FNV-1a hash to detect torn or corrupted writes
+static uint64 catalog_checksum(const char* data, size_t size)
+{
+    uint64 hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+    return hash;
+}
+
 block_manager::block_manager()
+    : m_persistent(false),
+      m_catalog_seq(0)
 {
     config* config = config::get_instance();
 
@@ -70,6 +193,11 @@ block_manager::block_manager()
         total_size += cfg.size;
 
         disk_allocators[i] = new disk_allocator(disk_files[i], cfg);
+
+        // disk threads are pinned to their node: keep buffers on the node of
+        // the thread using them instead of where the I/O first touches them
+        if (cfg.numa_node >= 0)
+            aligned_alloc_settings<int>::numa_local = true;
     }
 
     if (ndisks > 1)
@@ -79,6 +207,19 @@ block_manager::block_manager()
                   " MiB");
     }
 
+    size_t npersistent = 0;
+    for (unsigned i = 0; i < ndisks; ++i)
+        npersistent += config->disk(i).persistent;
+
+    if (npersistent != 0 && npersistent != ndisks)
+        STXXL_THROW(std::runtime_error,
+                    "Either all or no disks must be configured as persistent.");
+
+    if (npersistent != 0) {
+        m_persistent = true;
+        load_catalog();
+    }
+
 #if STXXL_MNG_COUNT_ALLOCATION
     m_current_allocation = 0;
     m_total_allocation = 0;
@@ -89,6 +230,31 @@ block_manager::block_manager()
 block_manager::~block_manager()
 {
     STXXL_VERBOSE1("Block manager destructor");
+
+    if (m_persistent)
+    {
+        try {
+            commit();
+        }
+        catch (std::exception& e) {
+            STXXL_ERRMSG("Exception thrown committing the catalog in ~block_manager(): " << e.what());
+        }
+    }
+
+#if STXXL_MNG_THREAD_CACHE
+    {
+        // the caches of running threads (and the main thread) stay alive
+        scoped_mutex_lock lock(s_thread_cache_mutex);
+        for (std::set<thread_cache*>::iterator it = m_thread_caches.begin();
+             it != m_thread_caches.end(); ++it)
+        {
+            release_thread_cache(**it);
+            (*it)->bm = NULL;
+        }
+        m_thread_caches.clear();
+    }
+#endif // STXXL_MNG_THREAD_CACHE
+
     for (size_t i = ndisks; i > 0; )
     {
         --i;
@@ -99,6 +265,481 @@ block_manager::~block_manager()
     delete[] disk_files;
 }
 
+void block_manager::aflush(std::vector<request_ptr>& requests,
+                           const completion_handler& on_cmpl)
+{
+    for (size_t i = 0; i < ndisks; ++i)
+        requests.push_back(disk_files[i]->aflush(on_cmpl));
+}
+
+void block_manager::flush()
+{
+    std::vector<request_ptr> requests;
+    aflush(requests);
+    wait_all(requests.begin(), requests.end());
+}
+
+void block_manager::discard_regions(std::vector<discard_region>& regions)
+{
+    std::sort(regions.begin(), regions.end());
+
+    for (size_t i = 0; i < regions.size(); )
+    {
+        const int disk = regions[i].disk;
+        const int64 begin = regions[i].offset;
+        int64 end = begin + regions[i].size;
+
+        for (++i; i < regions.size() && regions[i].disk == disk &&
+             regions[i].offset == end; ++i)
+            end += regions[i].size;
+
+        disk_files[disk]->discard(begin, end - begin);
+    }
+}
+
+#if STXXL_MNG_THREAD_CACHE
+
+block_manager::thread_cache& block_manager::get_thread_cache()
+{
+    thread_cache* tc = get_thread_cache_ptr();
+
+    if (tc && tc->bm == this)
+        return *tc;
+
+    if (!tc) {
+        tc = new thread_cache;
+        set_thread_cache_ptr(tc);
+    }
+
+    scoped_mutex_lock lock(s_thread_cache_mutex);
+    tc->bm = this;
+    tc->blocks.clear();
+    tc->blocks.resize(ndisks);
+    m_thread_caches.insert(tc);
+
+    return *tc;
+}
+
+bool block_manager::release_thread_cache(thread_cache& tc)
+{
+    scoped_mutex_lock lock(tc.mutex);
+    bool released = false;
+
+    for (size_t i = 0; i < tc.blocks.size(); ++i)
+    {
+        std::map<unsigned, std::vector<int64> >& sizes = tc.blocks[i];
+        for (std::map<unsigned, std::vector<int64> >::iterator it = sizes.begin();
+             it != sizes.end(); ++it)
+        {
+            std::vector<int64>& cache = it->second;
+            if (cache.empty())
+                continue;
+            return_blocks(i, &cache[0], &cache[0] + cache.size(), it->first);
+            cache.clear();
+            released = true;
+        }
+    }
+
+    return released;
+}
+
+void block_manager::return_blocks(size_t disk, const int64* begin,
+                                  const int64* end, unsigned block_size)
+{
+    std::vector<discard_region> regions(end - begin);
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        regions[i].disk = (int)disk;
+        regions[i].offset = begin[i];
+        regions[i].size = block_size;
+    }
+    discard_regions(regions);
+
+    disk_allocators[disk]->delete_blocks(begin, end, block_size);
+}
+
+bool block_manager::drain_thread_caches()
+{
+    scoped_mutex_lock lock(s_thread_cache_mutex);
+    bool released = false;
+
+    for (std::set<thread_cache*>::iterator it = m_thread_caches.begin();
+         it != m_thread_caches.end(); ++it)
+    {
+        if (release_thread_cache(**it))
+            released = true;
+    }
+
+    return released;
+}
+
+void block_manager::thread_cache_exit(void* ptr)
+{
+    thread_cache* tc = static_cast<thread_cache*>(ptr);
+    {
+        scoped_mutex_lock lock(s_thread_cache_mutex);
+        if (tc->bm) {
+            tc->bm->release_thread_cache(*tc);
+            tc->bm->m_thread_caches.erase(tc);
+        }
+    }
+    delete tc;
+}
+
+#endif // STXXL_MNG_THREAD_CACHE
+
+void block_manager::release_thread_cache()
+{
+#if STXXL_MNG_THREAD_CACHE
+    thread_cache* tc = get_thread_cache_ptr();
+    if (tc && tc->bm == this)
+        release_thread_cache(*tc);
+#endif // STXXL_MNG_THREAD_CACHE
+}
+
+void block_manager::load_catalog()
+{
+    file* f = disk_files[0];
+
+    char* buffer = static_cast<char*>(
+        aligned_alloc<STXXL_BLOCK_ALIGN>(superblock_size * superblock_slots));
+    f->aread(buffer, 0, superblock_size * superblock_slots)->wait();
+
+    // parse the superblocks, try the newest valid one first
+    std::vector<std::pair<uint64, std::vector<int64> > > candidates;
+    std::vector<std::pair<uint64, uint64> > catalog_info;
+    std::vector<uint32> catalog_versions;
+
+    for (unsigned int slot = 0; slot < superblock_slots; ++slot)
+    {
+        const char* sb = buffer + slot * superblock_size;
+        uint64 stored;
+        memcpy(&stored, sb + superblock_size - sizeof(uint64), sizeof(uint64));
+        if (stored != catalog_checksum(sb, superblock_size - sizeof(uint64)))
+            continue;
+
+        binary_reader br(sb, superblock_size);
+        if (br.get<uint64>() != catalog_magic)
+            continue;
+        uint32 version = br.get<uint32>();
+        if (version < 1 || version > catalog_version)
+            continue;
+
+        uint64 seq = br.get<uint64>();
+        uint64 bytes = br.get<uint64>();
+        uint64 checksum = br.get<uint64>();
+        uint32 nblocks = br.get<uint32>();
+        if (nblocks > catalog_max_blocks)
+            continue;
+
+        std::vector<int64> blocks(nblocks);
+        for (uint32 i = 0; i < nblocks; ++i)
+            blocks[i] = br.get<int64>();
+
+        candidates.push_back(std::make_pair(seq, blocks));
+        catalog_info.push_back(std::make_pair(bytes, checksum));
+        catalog_versions.push_back(version);
+    }
+
+    aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+    while (!candidates.empty())
+    {
+        size_t best = 0;
+        for (size_t i = 1; i < candidates.size(); ++i)
+            if (candidates[i].first > candidates[best].first)
+                best = i;
+
+        const std::vector<int64>& blocks = candidates[best].second;
+        const uint64 bytes = catalog_info[best].first;
+
+        char* data = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(
+                                            std::max<size_t>(blocks.size(), 1) * catalog_block_size));
+
+        std::vector<request_ptr> reqs;
+        for (size_t i = 0; i < blocks.size(); ++i)
+            reqs.push_back(f->aread(data + i * catalog_block_size,
+                                    blocks[i], catalog_block_size));
+        wait_all(reqs.begin(), reqs.end());
+
+        if (bytes <= blocks.size() * catalog_block_size &&
+            catalog_checksum(data, (size_t)bytes) == catalog_info[best].second)
+        {
+            binary_reader br(data, (size_t)bytes);
+
+            if (br.get_varint64() != ndisks) {
+                aligned_dealloc<STXXL_BLOCK_ALIGN>(data);
+                STXXL_THROW(std::runtime_error,
+                            "The catalog on the persistent disks was written "
+                            "with a different number of disks.");
+            }
+
+            uint64 nroots = br.get_varint64();
+            for (uint64 r = 0; r < nroots; ++r)
+            {
+                std::string name = br.get_string();
+                root_type& root = m_roots[name];
+                root.header = br.get_string();
+                root.blocks.resize((size_t)br.get_varint64());
+                for (size_t i = 0; i < root.blocks.size(); ++i)
+                {
+                    root.blocks[i].disk = (unsigned int)br.get_varint64();
+                    root.blocks[i].offset = (int64)br.get_varint64();
+                    root.blocks[i].size = (unsigned int)br.get_varint64();
+                }
+                if (catalog_versions[best] >= 2)
+                    root.modified = (br.get_varint64() & root_flag_modified) != 0;
+            }
+            aligned_dealloc<STXXL_BLOCK_ALIGN>(data);
+
+            m_catalog_seq = candidates[best].first;
+            m_catalog_blocks = blocks;
+            break;
+        }
+
+        STXXL_ERRMSG("Catalog " << candidates[best].first << " on disk '" <<
+                     config::get_instance()->disk(0).path <<
+                     "' is corrupted, trying the previous one.");
+
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(data);
+        candidates.erase(candidates.begin() + best);
+        catalog_info.erase(catalog_info.begin() + best);
+        catalog_versions.erase(catalog_versions.begin() + best);
+    }
+
+    // everything not referenced by the catalog is free
+    disk_allocators[0]->reserve(0, catalog_reserved_bytes);
+
+    for (size_t i = 0; i < m_catalog_blocks.size(); ++i)
+        disk_allocators[0]->reserve(m_catalog_blocks[i], catalog_block_size);
+
+    uint64 nblocks = 0;
+    for (root_map_type::const_iterator it = m_roots.begin();
+         it != m_roots.end(); ++it)
+    {
+        const std::vector<root_block>& blocks = it->second.blocks;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            if (blocks[i].disk >= ndisks)
+                STXXL_THROW(std::runtime_error,
+                            "Root '" << it->first << "' references disk " <<
+                            blocks[i].disk << " which is not configured.");
+
+            disk_allocators[blocks[i].disk]->reserve(blocks[i].offset, blocks[i].size);
+#if STXXL_MNG_COUNT_ALLOCATION
+            m_current_allocation += blocks[i].size;
+#endif // STXXL_MNG_COUNT_ALLOCATION
+        }
+        nblocks += blocks.size();
+    }
+
+    collect_committed();
+
+    if (m_catalog_seq == 0)
+        STXXL_MSG("Persistent disks: starting with an empty catalog");
+    else
+        STXXL_MSG("Persistent disks: restored catalog " << m_catalog_seq <<
+                  " with " << m_roots.size() << " roots of " << nblocks << " blocks");
+}
+
+void block_manager::collect_committed()
+{
+    m_committed.clear();
+    for (root_map_type::const_iterator it = m_roots.begin();
+         it != m_roots.end(); ++it)
+    {
+        m_committed.insert(m_committed.end(),
+                           it->second.blocks.begin(), it->second.blocks.end());
+    }
+    std::sort(m_committed.begin(), m_committed.end());
+}
+
+bool block_manager::is_committed_locked(int disk, int64 offset) const
+{
+    root_block b;
+    b.disk = (unsigned int)disk;
+    b.offset = offset;
+    b.size = 0;
+    return std::binary_search(m_committed.begin(), m_committed.end(), b);
+}
+
+bool block_manager::defer_release(int disk, int64 offset, unsigned int size)
+{
+    scoped_mutex_lock lock(m_catalog_mutex);
+
+    if (!is_committed_locked(disk, offset))
+        return false;
+
+    root_block b;
+    b.disk = (unsigned int)disk;
+    b.offset = offset;
+    b.size = size;
+    m_pending_free.push_back(b);
+
+#if STXXL_MNG_COUNT_ALLOCATION
+    m_current_allocation -= size;
+#endif // STXXL_MNG_COUNT_ALLOCATION
+    return true;
+}
+
+void block_manager::commit()
+{
+    if (!m_persistent)
+        return;
+
+    scoped_mutex_lock lock(m_catalog_mutex);
+    commit_locked();
+}
+
+void block_manager::commit_locked()
+{
+    // serialize the catalog
+    binary_buffer bb;
+    bb.put_varint((uint64)ndisks);
+    bb.put_varint((uint64)m_roots.size());
+    for (root_map_type::const_iterator it = m_roots.begin();
+         it != m_roots.end(); ++it)
+    {
+        bb.put_string(it->first);
+        bb.put_string(it->second.header);
+        const std::vector<root_block>& blocks = it->second.blocks;
+        bb.put_varint((uint64)blocks.size());
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            bb.put_varint((uint64)blocks[i].disk);
+            bb.put_varint((uint64)blocks[i].offset);
+            bb.put_varint((uint64)blocks[i].size);
+        }
+        bb.put_varint(it->second.modified ? root_flag_modified : 0);
+    }
+
+    const size_t nblocks = div_ceil(bb.size(), catalog_block_size);
+    if (nblocks > catalog_max_blocks)
+        STXXL_THROW(std::runtime_error,
+                    "block_manager::commit(): the catalog of " << bb.size() <<
+                    " bytes is too large.");
+
+    // write the catalog into new blocks, the previous one stays valid until
+    // the superblock points to the new one
+    BIDArray<catalog_block_size> blocks(nblocks);
+    disk_allocators[0]->new_blocks(blocks);
+
+    char* data = static_cast<char*>(
+        aligned_alloc<STXXL_BLOCK_ALIGN>(nblocks * catalog_block_size));
+    memcpy(data, bb.data(), bb.size());
+    memset(data + bb.size(), 0, nblocks * catalog_block_size - bb.size());
+
+    std::vector<request_ptr> reqs;
+    for (size_t i = 0; i < nblocks; ++i)
+        reqs.push_back(disk_files[0]->awrite(data + i * catalog_block_size,
+                                             blocks[i].offset, catalog_block_size));
+    wait_all(reqs.begin(), reqs.end());
+    aligned_dealloc<STXXL_BLOCK_ALIGN>(data);
+
+    // the blocks of the roots and the catalog must be durable before the
+    // superblock references them
+    flush();
+
+    binary_buffer sb;
+    sb.put<uint64>(catalog_magic);
+    sb.put<uint32>(catalog_version);
+    sb.put<uint64>(m_catalog_seq + 1);
+    sb.put<uint64>(bb.size());
+    sb.put<uint64>(catalog_checksum(bb.data(), bb.size()));
+    sb.put<uint32>((uint32)nblocks);
+    for (size_t i = 0; i < nblocks; ++i)
+        sb.put<int64>(blocks[i].offset);
+
+    char* super = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(superblock_size));
+    memset(super, 0, superblock_size);
+    memcpy(super, sb.data(), sb.size());
+    uint64 checksum = catalog_checksum(super, superblock_size - sizeof(uint64));
+    memcpy(super + superblock_size - sizeof(uint64), &checksum, sizeof(uint64));
+
+    const unsigned int slot = (unsigned int)((m_catalog_seq + 1) % superblock_slots);
+    disk_files[0]->awrite(super, slot * superblock_size, superblock_size)->wait();
+    disk_files[0]->flush();
+    aligned_dealloc<STXXL_BLOCK_ALIGN>(super);
+
+    // release the previous catalog
+    if (!m_catalog_blocks.empty())
+        disk_allocators[0]->delete_blocks(
+            &m_catalog_blocks[0], &m_catalog_blocks[0] + m_catalog_blocks.size(),
+            catalog_block_size);
+
+    ++m_catalog_seq;
+    m_catalog_blocks.resize(nblocks);
+    for (size_t i = 0; i < nblocks; ++i)
+        m_catalog_blocks[i] = blocks[i].offset;
+
+    // release the deleted blocks the new catalog no longer references
+    collect_committed();
+
+    std::vector<root_block> pending;
+    std::vector<discard_region> regions;
+    for (size_t i = 0; i < m_pending_free.size(); ++i)
+    {
+        const root_block& b = m_pending_free[i];
+        if (is_committed_locked(b.disk, b.offset)) {
+            pending.push_back(b);
+            continue;
+        }
+        discard_region r;
+        r.disk = (int)b.disk;
+        r.offset = b.offset;
+        r.size = b.size;
+        regions.push_back(r);
+    }
+    discard_regions(regions);
+
+    for (size_t i = 0; i < regions.size(); ++i)
+        disk_allocators[regions[i].disk]->delete_blocks(
+            &regions[i].offset, &regions[i].offset + 1, regions[i].size);
+    m_pending_free.swap(pending);
+
+    STXXL_VERBOSE1("block_manager: committed catalog " << m_catalog_seq <<
+                   " with " << m_roots.size() << " roots");
+}
+
+bool block_manager::has_root(const std::string& name) const
+{
+    scoped_mutex_lock lock(m_catalog_mutex);
+    return m_roots.find(name) != m_roots.end();
+}
+
+bool block_manager::remove_root(const std::string& name)
+{
+    scoped_mutex_lock lock(m_catalog_mutex);
+    return m_roots.erase(name) != 0;
+}
+
+void block_manager::modify_root(const std::string& name)
+{
+    if (!m_persistent)
+        return;
+
+    scoped_mutex_lock lock(m_catalog_mutex);
+
+    root_map_type::iterator it = m_roots.find(name);
+    if (it == m_roots.end() || it->second.modified)
+        return;
+
+    // write ahead: the flag must be durable before any block is overwritten
+    it->second.modified = true;
+    commit_locked();
+}
+
+std::vector<std::string> block_manager::get_root_names() const
+{
+    scoped_mutex_lock lock(m_catalog_mutex);
+
+    std::vector<std::string> names;
+    for (root_map_type::const_iterator it = m_roots.begin();
+         it != m_roots.end(); ++it)
+        names.push_back(it->first);
+    return names;
+}
+
 uint64 block_manager::get_total_bytes() const
 {
     uint64 total = 0;
@@ -220,7 +220,11 @@ disk_config::disk_config()
       device_id(file::DEFAULT_DEVICE_ID),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      discard(false),
+      queue_length(0),
+      numa_node(-1),
+      tier_size(0),
+      persistent(false)
 { }
 
 disk_config::disk_config(const std::string& _path, uint64 _size,
@@ -236,7 +240,11 @@ disk_config::disk_config(const std::string& _path, uint64 _size,
       device_id(file::DEFAULT_DEVICE_ID),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      discard(false),
+      queue_length(0),
+      numa_node(-1),
+      tier_size(0),
+      persistent(false)
 {
     parse_fileio();
 }
@@ -251,7 +259,11 @@ disk_config::disk_config(const std::string& line)
       device_id(file::DEFAULT_DEVICE_ID),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      discard(false),
+      queue_length(0),
+      numa_node(-1),
+      tier_size(0),
+      persistent(false)
 {
     parse_line(line);
 }
@@ -281,6 +293,13 @@ void disk_config::parse_line(const std::string& line)
     queue = file::DEFAULT_QUEUE;
     device_id = file::DEFAULT_DEVICE_ID;
     unlink_on_open = false;
+    discard = false;
+    persistent = false;
+    numa_node = -1;
+    compress.clear();
+    tier.clear();
+    tier_size = 0;
+    tier_policy.clear();
 
     // *** Save Basic Options ***
 
@@ -364,10 +383,44 @@ void disk_config::parse_fileio()
                             "Invalid parameter '" << *p << "' in disk configuration file.");
             }
         }
+        else if (eq[0] == "compress")
+        {
+            if (!(io_impl == "syscall" || io_impl == "mmap" ||
+                  io_impl == "boostfd" || io_impl == "wincall" ||
+                  io_impl == "memory"))
+            {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+            if (eq[1] != "lz4" && eq[1] != "zstd" && eq[1] != "zlib") {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+
+            compress = eq[1];
+        }
         else if (*p == "delete" || *p == "delete_on_exit")
         {
             delete_on_exit = true;
         }
+        else if (*p == "discard" || eq[0] == "discard")
+        {
+            if (!(io_impl == "syscall" || io_impl == "mmap" ||
+                  io_impl == "linuxaio" || io_impl == "io_uring"))
+            {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+
+            if (*p == "discard") discard = true;
+            else if (eq[1] == "off") discard = false;
+            else if (eq[1] == "on") discard = true;
+            else if (eq[1] == "no") discard = false;
+            else if (eq[1] == "yes") discard = true;
+            else
+            {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
         else if (*p == "direct" || *p == "nodirect" || eq[0] == "direct")
         {
             // io_impl is not checked here, but I guess that is okay for DIRECT
@@ -388,7 +441,7 @@ void disk_config::parse_fileio()
         }
         else if (eq[0] == "queue")
         {
-            if (io_impl == "linuxaio") {
+            if (io_impl == "linuxaio" || io_impl == "io_uring") {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
 
@@ -401,9 +454,9 @@ void disk_config::parse_fileio()
         }
         else if (eq[0] == "queue_length")
         {
-            if (io_impl != "linuxaio") {
+            if (io_impl != "linuxaio" && io_impl != "io_uring") {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' "
-                            "is only valid for fileio linuxaio "
+                            "is only valid for fileio linuxaio and io_uring "
                             "in disk configuration file.");
             }
 
@@ -423,18 +476,75 @@ void disk_config::parse_fileio()
                             "Invalid parameter '" << *p << "' in disk configuration file.");
             }
         }
+        else if (eq[0] == "numa")
+        {
+            if (eq[1] == "off" || eq[1] == "no") {
+                numa_node = NUMA_OFF;
+            }
+            else {
+                char* endp;
+                numa_node = (int)strtol(eq[1].c_str(), &endp, 10);
+                if (eq[1].empty() || (endp && *endp != 0) || numa_node < -1) {
+                    STXXL_THROW(std::runtime_error,
+                                "Invalid parameter '" << *p << "' in disk configuration file.");
+                }
+            }
+        }
+        else if (*p == "persistent")
+        {
+            if (!(io_impl == "syscall" || io_impl == "mmap" ||
+                  io_impl == "linuxaio" || io_impl == "io_uring" ||
+                  io_impl == "boostfd" || io_impl == "wincall"))
+            {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+
+            persistent = true;
+        }
         else if (*p == "raw_device")
         {
-            if (!(io_impl == "syscall")) {
+            if (!(io_impl == "syscall" || io_impl == "io_uring")) {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
 
             raw_device = true;
         }
+        else if (eq[0] == "tier" || eq[0] == "tier_size" ||
+                 eq[0] == "tier_policy")
+        {
+            if (!(io_impl == "syscall" || io_impl == "mmap" ||
+                  io_impl == "boostfd" || io_impl == "wincall" ||
+                  io_impl == "memory"))
+            {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+
+            if (eq[0] == "tier") {
+                if (eq[1].empty()) {
+                    STXXL_THROW(std::runtime_error,
+                                "Invalid parameter '" << *p << "' in disk configuration file.");
+                }
+                tier = eq[1];
+            }
+            else if (eq[0] == "tier_size") {
+                if (!parse_SI_IEC_size(eq[1], tier_size) || tier_size == 0) {
+                    STXXL_THROW(std::runtime_error,
+                                "Invalid parameter '" << *p << "' in disk configuration file.");
+                }
+            }
+            else {
+                if (eq[1] != "lru" && eq[1] != "clock") {
+                    STXXL_THROW(std::runtime_error,
+                                "Invalid parameter '" << *p << "' in disk configuration file.");
+                }
+                tier_policy = eq[1];
+            }
+        }
         else if (*p == "unlink" || *p == "unlink_on_open")
         {
             if (!(io_impl == "syscall" || io_impl == "linuxaio" ||
-                  io_impl == "mmap" || io_impl == "wbtl"))
+                  io_impl == "io_uring" || io_impl == "mmap" ||
+                  io_impl == "wbtl"))
             {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
@@ -447,6 +557,21 @@ void disk_config::parse_fileio()
                         "Invalid optional parameter '" << *p << "' in disk configuration file.");
         }
     }
+
+    if (tier.empty() != (tier_size == 0)) {
+        STXXL_THROW(std::runtime_error,
+                    "Parameters 'tier' and 'tier_size' must be given together in disk configuration file.");
+    }
+    if (!tier_policy.empty() && tier.empty()) {
+        STXXL_THROW(std::runtime_error,
+                    "Parameter 'tier_policy' requires 'tier' in disk configuration file.");
+    }
+    if (persistent && (unlink_on_open || delete_on_exit ||
+                       !compress.empty() || !tier.empty())) {
+        STXXL_THROW(std::runtime_error,
+                    "Parameter 'persistent' cannot be combined with 'unlink', "
+                    "'delete', 'compress' or 'tier' in disk configuration file.");
+    }
 }
 
 std::string disk_config::fileio_string() const
@@ -474,7 +599,8 @@ std::string disk_config::fileio_string() const
     if (flash)
         oss << " flash";
 
-    if (queue != file::DEFAULT_QUEUE && queue != file::DEFAULT_LINUXAIO_QUEUE)
+    if (queue != file::DEFAULT_QUEUE && queue != file::DEFAULT_LINUXAIO_QUEUE &&
+        queue != file::DEFAULT_IO_URING_QUEUE)
         oss << " queue=" << queue;
 
     if (device_id != file::DEFAULT_DEVICE_ID)
@@ -486,9 +612,29 @@ std::string disk_config::fileio_string() const
     if (unlink_on_open)
         oss << " unlink_on_open";
 
+    if (discard)
+        oss << " discard=on";
+
+    if (persistent)
+        oss << " persistent";
+
     if (queue_length != 0)
         oss << " queue_length=" << queue_length;
 
+    if (numa_node == NUMA_OFF)
+        oss << " numa=off";
+    else if (numa_node >= 0)
+        oss << " numa=" << numa_node;
+
+    if (!compress.empty())
+        oss << " compress=" << compress;
+
+    if (!tier.empty())
+        oss << " tier=" << tier << " tier_size=" << tier_size;
+
+    if (!tier_policy.empty())
+        oss << " tier_policy=" << tier_policy;
+
     return oss.str();
 }
 
@@ -38,125 +38,74 @@ void disk_allocator::dump() const
     STXXL_ERRMSG("Total bytes: " << total);
 }
 
-void disk_allocator::deallocation_error(
-    stxxl::int64 block_pos, stxxl::int64 block_size,
-    const sortseq::iterator& pred, const sortseq::iterator& succ) const
-{
-    STXXL_ERRMSG("Error deallocating block at " << block_pos << " size " << block_size);
-    STXXL_ERRMSG(((pred == succ) ? "pred==succ" : "pred!=succ"));
-    if (pred == free_space.end()) {
-        STXXL_ERRMSG("pred==free_space.end()");
-    }
-    else {
-        if (pred == free_space.begin())
-            STXXL_ERRMSG("pred==free_space.begin()");
-        STXXL_ERRMSG("pred: begin=" << pred->first << " size=" << pred->second);
-    }
-    if (succ == free_space.end()) {
-        STXXL_ERRMSG("succ==free_space.end()");
-    }
-    else {
-        if (succ == free_space.begin())
-            STXXL_ERRMSG("succ==free_space.begin()");
-        STXXL_ERRMSG("succ: begin=" << succ->first << " size=" << succ->second);
-    }
-    dump();
-}
-
 void disk_allocator::add_free_region(stxxl::int64 block_pos, stxxl::int64 block_size)
 {
-    //assert(block_size);
-    //dump();
     STXXL_VERBOSE2("Deallocating a block with size: " << block_size << " position: " << block_pos);
     stxxl::int64 region_pos = block_pos;
     stxxl::int64 region_size = block_size;
-    if (!free_space.empty())
+
+    sortseq::iterator succ = free_space.upper_bound(region_pos);
+    sortseq::iterator pred = succ;
+    if (pred != free_space.begin())
     {
-        sortseq::iterator succ = free_space.upper_bound(region_pos);
-        sortseq::iterator pred = succ;
-        if (pred != free_space.begin())
-            pred--;
-        if (pred != free_space.end())
+        --pred;
+        if (pred->first + pred->second > region_pos)
         {
-            if (pred->first <= region_pos && pred->first + pred->second > region_pos)
-            {
-                STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  in empty space [" << pred->first << " + " << pred->second << "]");
-            }
-        }
-        if (succ != free_space.end())
-        {
-            if (region_pos <= succ->first && region_pos + region_size > succ->first)
-            {
-                STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  which overlaps empty space [" << succ->first << " + " << succ->second << "]");
-            }
-        }
-        if (succ == free_space.end())
-        {
-            if (pred == free_space.end())
-            {
-                deallocation_error(block_pos, block_size, pred, succ);
-                assert(pred != free_space.end());
-            }
-            if ((*pred).first + (*pred).second == region_pos)
-            {
-                // coalesce with predecessor
-                region_size += (*pred).second;
-                region_pos = (*pred).first;
-                free_space.erase(pred);
-            }
-        }
-        else
-        {
-            if (free_space.size() > 1)
-            {
-#if 0
-                if (pred == succ)
-                {
-                    deallocation_error(block_pos, block_size, pred, succ);
-                    assert(pred != succ);
-                }
-#endif
-                bool succ_is_not_the_first = (succ != free_space.begin());
-                if ((*succ).first == region_pos + region_size)
-                {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
-                    //-tb: set succ to pred afterwards due to iterator invalidation
-                    succ = pred;
-                }
-                if (succ_is_not_the_first)
-                {
-                    if (pred == free_space.end())
-                    {
-                        deallocation_error(block_pos, block_size, pred, succ);
-                        assert(pred != free_space.end());
-                    }
-                    if ((*pred).first + (*pred).second == region_pos)
-                    {
-                        // coalesce with predecessor
-                        region_size += (*pred).second;
-                        region_pos = (*pred).first;
-                        free_space.erase(pred);
-                    }
-                }
-            }
-            else
-            {
-                if ((*succ).first == region_pos + region_size)
-                {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
-                }
-            }
+            STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  in empty space [" << pred->first << " + " << pred->second << "]");
         }
     }
+    else
+        pred = free_space.end();
 
-    free_space[region_pos] = region_size;
+    if (succ != free_space.end() && region_pos + region_size > succ->first)
+    {
+        STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  which overlaps empty space [" << succ->first << " + " << succ->second << "]");
+    }
+
+    if (succ != free_space.end() && succ->first == region_pos + region_size)
+    {
+        // coalesce with successor
+        region_size += succ->second;
+        erase_region(succ);
+    }
+
+    if (pred != free_space.end() && pred->first + pred->second == region_pos)
+    {
+        // coalesce with predecessor
+        region_size += pred->second;
+        region_pos = pred->first;
+        erase_region(pred);
+    }
+
+    insert_region(region_pos, region_size);
     free_bytes += block_size;
+}
+
+void disk_allocator::reserve(int64 pos, int64 size)
+{
+    scoped_mutex_lock lock(mutex);
+
+    // grow the file if the region is beyond its end
+    if (pos + size > disk_bytes)
+        grow_file(pos + size - disk_bytes);
+
+    sortseq::iterator region = free_space.upper_bound(pos);
+    if (region == free_space.begin() ||
+        (--region)->first + region->second < pos + size)
+    {
+        STXXL_THROW2(bad_ext_alloc, "disk_allocator::reserve",
+                     "Error: trying to reserve region " << pos << " + " << size <<
+                     " which is not completely free");
+    }
+
+    int64 region_pos = region->first, region_size = region->second;
+    erase_region(region);
+    if (region_pos < pos)
+        insert_region(region_pos, pos - region_pos);
+    if (pos + size < region_pos + region_size)
+        insert_region(pos + size, region_pos + region_size - pos - size);
 
-    //dump();
+    free_bytes -= size;
 }
 
 STXXL_END_NAMESPACE
@@ -0,0 +1,280 @@
+/***************************************************************************
+ *  lib/mng/memory_arbiter.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/mng/memory_arbiter.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/verbose.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+
+STXXL_BEGIN_NAMESPACE
+
+/******************************************************************************/
+// memory_consumer
+
+memory_consumer::memory_consumer(const std::string& name, bool shrinkable)
+    : m_name(name),
+      m_shrinkable(shrinkable),
+      m_granted(0),
+      m_reclaim(0)
+{
+    memory_arbiter::get_instance()->add(this);
+}
+
+memory_consumer::~memory_consumer()
+{
+    memory_arbiter::get_instance()->remove(this);
+}
+
+uint64 memory_consumer::request(uint64 bytes, uint64 min_bytes)
+{
+    return memory_arbiter::get_instance()->request(this, bytes, min_bytes);
+}
+
+void memory_consumer::release(uint64 bytes)
+{
+    memory_arbiter::get_instance()->release(this, bytes);
+}
+
+uint64 memory_consumer::reclaim() const
+{
+    memory_arbiter* arbiter = memory_arbiter::get_instance();
+    scoped_mutex_lock lock(arbiter->m_mutex);
+    return m_reclaim;
+}
+
+void memory_consumer::reclaim_done()
+{
+    memory_arbiter* arbiter = memory_arbiter::get_instance();
+    scoped_mutex_lock lock(arbiter->m_mutex);
+    m_reclaim = 0;
+}
+
+uint64 memory_consumer::granted() const
+{
+    memory_arbiter* arbiter = memory_arbiter::get_instance();
+    scoped_mutex_lock lock(arbiter->m_mutex);
+    return m_granted;
+}
+
+void memory_consumer::swap(memory_consumer& other)
+{
+    memory_arbiter* arbiter = memory_arbiter::get_instance();
+    scoped_mutex_lock lock(arbiter->m_mutex);
+
+    // move the memory between the usage entries, if the names differ
+    uint64 granted = m_granted, other_granted = other.m_granted;
+    arbiter->account(this, granted, false);
+    arbiter->account(&other, other_granted, false);
+    std::swap(m_reclaim, other.m_reclaim);
+    arbiter->account(this, other_granted, true);
+    arbiter->account(&other, granted, true);
+}
+
+/******************************************************************************/
+// memory_arbiter
+
+memory_arbiter::memory_arbiter()
+    : m_limit(0),
+      m_granted(0),
+      m_peak(0)
+{
+    const char* limit = getenv("STXXL_MEMORY_LIMIT");
+    if (limit && !parse_SI_IEC_size(limit, m_limit)) {
+        STXXL_ERRMSG("Invalid STXXL_MEMORY_LIMIT '" << limit << "', the memory is not limited.");
+        m_limit = 0;
+    }
+}
+
+void memory_arbiter::add(memory_consumer* c)
+{
+    scoped_mutex_lock lock(m_mutex);
+    m_consumers.insert(c);
+
+    usage& u = m_usage[c->m_name];
+    u.name = c->m_name;
+    ++u.count;
+}
+
+void memory_arbiter::remove(memory_consumer* c)
+{
+    scoped_mutex_lock lock(m_mutex);
+    account(c, c->m_granted, false);
+    m_consumers.erase(c);
+    --m_usage[c->m_name].count;
+    distribute_reclaim();
+}
+
+uint64 memory_arbiter::request(memory_consumer* c, uint64 bytes, uint64 min_bytes)
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    uint64 grant = bytes;
+    if (m_limit != 0)
+    {
+        uint64 free = (m_granted < m_limit) ? m_limit - m_granted : 0;
+        grant = std::max(std::min(bytes, free), std::min(bytes, min_bytes));
+    }
+
+    account(c, grant, true);
+    distribute_reclaim();
+
+    STXXL_VERBOSE1("memory_arbiter: " << c->m_name << " requested " << bytes <<
+                   " min " << min_bytes << " granted " << grant <<
+                   " total " << m_granted << " limit " << m_limit);
+    return grant;
+}
+
+void memory_arbiter::release(memory_consumer* c, uint64 bytes)
+{
+    scoped_mutex_lock lock(m_mutex);
+    assert(bytes <= c->m_granted);
+
+    account(c, bytes, false);
+    c->m_reclaim -= std::min(c->m_reclaim, bytes);
+    distribute_reclaim();
+}
+
+void memory_arbiter::account(memory_consumer* c, uint64 bytes, bool add)
+{
+    usage& u = m_usage[c->m_name];
+    if (add) {
+        c->m_granted += bytes;
+        u.granted += bytes;
+        m_granted += bytes;
+        u.peak = std::max(u.peak, u.granted);
+        m_peak = std::max(m_peak, m_granted);
+    }
+    else {
+        c->m_granted -= bytes;
+        u.granted -= bytes;
+        m_granted -= bytes;
+    }
+}
+
+void memory_arbiter::distribute_reclaim()
+{
+    typedef std::set<memory_consumer*>::iterator iterator;
+
+    if (m_limit == 0 || m_granted <= m_limit)
+    {
+        // nothing to reclaim (anymore)
+        for (iterator it = m_consumers.begin(); it != m_consumers.end(); ++it)
+            (*it)->m_reclaim = 0;
+        return;
+    }
+
+    uint64 pending = 0, held = 0;
+    for (iterator it = m_consumers.begin(); it != m_consumers.end(); ++it)
+    {
+        if (!(*it)->m_shrinkable) continue;
+        pending += (*it)->m_reclaim;
+        held += (*it)->m_granted - (*it)->m_reclaim;
+    }
+
+    const uint64 excess = m_granted - m_limit;
+    if (excess <= pending || held == 0)
+        return;
+
+    // ask for the rest in proportion to the memory not yet asked back
+    const double fraction = double(excess - pending) / double(held);
+    for (iterator it = m_consumers.begin(); it != m_consumers.end(); ++it)
+    {
+        memory_consumer* c = *it;
+        if (!c->m_shrinkable) continue;
+        uint64 share = c->m_granted - c->m_reclaim;
+        c->m_reclaim += std::min(share, (uint64)std::ceil(fraction * double(share)));
+    }
+}
+
+void memory_arbiter::set_limit(uint64 limit)
+{
+    scoped_mutex_lock lock(m_mutex);
+    m_limit = limit;
+    distribute_reclaim();
+}
+
+uint64 memory_arbiter::get_limit() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_limit;
+}
+
+uint64 memory_arbiter::get_granted() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_granted;
+}
+
+uint64 memory_arbiter::get_peak() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_peak;
+}
+
+uint64 memory_arbiter::get_free() const
+{
+    scoped_mutex_lock lock(m_mutex);
+    return (m_granted < m_limit) ? m_limit - m_granted : 0;
+}
+
+std::vector<memory_arbiter::usage> memory_arbiter::get_usage() const
+{
+    scoped_mutex_lock lock(m_mutex);
+
+    usage_map_type usage_map = m_usage;
+    for (std::set<memory_consumer*>::const_iterator it = m_consumers.begin();
+         it != m_consumers.end(); ++it)
+    {
+        usage_map[(*it)->m_name].reclaim += (*it)->m_reclaim;
+    }
+
+    std::vector<usage> result;
+    for (usage_map_type::const_iterator it = usage_map.begin();
+         it != usage_map.end(); ++it)
+    {
+        result.push_back(it->second);
+    }
+    return result;
+}
+
+void memory_arbiter::print_usage(std::ostream& o) const
+{
+    std::vector<usage> usages = get_usage();
+
+    o << "STXXL memory budget: limit "
+      << (get_limit() ? format_IEC_size(get_limit()) + "B" : std::string("unlimited"))
+      << ", granted " << format_IEC_size(get_granted()) << "B"
+      << ", peak " << format_IEC_size(get_peak()) << "B" << std::endl;
+
+    o << "  " << std::left << std::setw(24) << "component" << std::right
+      << std::setw(6) << "count"
+      << std::setw(16) << "granted"
+      << std::setw(16) << "peak"
+      << std::setw(16) << "reclaim" << std::endl;
+
+    for (size_t i = 0; i < usages.size(); ++i)
+    {
+        o << "  " << std::left << std::setw(24) << usages[i].name << std::right
+          << std::setw(6) << usages[i].count
+          << std::setw(16) << format_IEC_size(usages[i].granted) + "B"
+          << std::setw(16) << format_IEC_size(usages[i].peak) + "B"
+          << std::setw(16) << format_IEC_size(usages[i].reclaim) + "B"
+          << std::endl;
+    }
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -0,0 +1,229 @@
+/***************************************************************************
+ *  tests/algo/test_radix_sort.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example algo/test_radix_sort.cpp
+//! This tests radix_sort() on several key distributions, and its automatic
+//! use by stxxl::sort and stream::sort for comparators exposing key_of().
+
+#include <limits>
+#include <vector>
+
+#include <stxxl/sort>
+#include <stxxl/stream>
+#include <stxxl/vector>
+#include <stxxl/bits/algo/radix_sort.h>
+
+typedef std::pair<stxxl::uint64, stxxl::uint64> value_type;
+
+//! compares the first components, exposing them as key
+struct key_cmp
+{
+    typedef stxxl::uint64 key_type;
+
+    key_type key_of(const value_type& v) const
+    {
+        return v.first;
+    }
+    bool operator () (const value_type& a, const value_type& b) const
+    {
+        return a.first < b.first;
+    }
+    value_type min_value() const
+    {
+        return value_type(std::numeric_limits<key_type>::min(), 0);
+    }
+    value_type max_value() const
+    {
+        return value_type(std::numeric_limits<key_type>::max(), 0);
+    }
+};
+
+//! the same order without key_of()
+struct plain_cmp
+{
+    bool operator () (const value_type& a, const value_type& b) const
+    {
+        return a.first < b.first;
+    }
+    value_type min_value() const
+    {
+        return key_cmp().min_value();
+    }
+    value_type max_value() const
+    {
+        return key_cmp().max_value();
+    }
+};
+
+//! a signed key is not used for radix sorting
+struct signed_key_cmp : public plain_cmp
+{
+    typedef stxxl::int64 key_type;
+
+    key_type key_of(const value_type& v) const
+    {
+        return (key_type)v.first;
+    }
+};
+
+//! a 32-bit key
+struct key32_cmp
+{
+    typedef stxxl::uint32 key_type;
+
+    key_type key_of(const stxxl::uint32& v) const
+    {
+        return v;
+    }
+    bool operator () (const stxxl::uint32& a, const stxxl::uint32& b) const
+    {
+        return a < b;
+    }
+};
+
+static stxxl::uint64 rng_state = 42;
+
+static stxxl::uint64 next_random()
+{
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return rng_state ^ (rng_state >> 29);
+}
+
+//! radix sort the values and compare with std::sort
+void check_radix_sort(std::vector<value_type> v)
+{
+    std::vector<value_type> check = v;
+
+    stxxl::radix_sort(v.begin(), v.end(), key_cmp());
+
+    for (stxxl::unsigned_type i = 1; i < v.size(); ++i)
+        STXXL_CHECK(v[i - 1].first <= v[i].first);
+
+    // the result is a permutation of the input
+    std::sort(v.begin(), v.end());
+    std::sort(check.begin(), check.end());
+    STXXL_CHECK(v == check);
+}
+
+//! n values with key mask & random and payload i
+std::vector<value_type> make_input(stxxl::unsigned_type n, stxxl::uint64 mask)
+{
+    std::vector<value_type> v(n);
+    for (stxxl::unsigned_type i = 0; i < n; ++i)
+        v[i] = value_type(next_random() & mask, i);
+    return v;
+}
+
+int main()
+{
+    STXXL_CHECK((stxxl::has_key_of<key_cmp, value_type>::value));
+    STXXL_CHECK((stxxl::has_key_of<key32_cmp, stxxl::uint32>::value));
+    STXXL_CHECK(!(stxxl::has_key_of<plain_cmp, value_type>::value));
+    STXXL_CHECK(!(stxxl::has_key_of<signed_key_cmp, value_type>::value));
+    STXXL_CHECK(!(stxxl::has_key_of<std::less<stxxl::uint64>, stxxl::uint64>::value));
+
+    const stxxl::uint64 all = std::numeric_limits<stxxl::uint64>::max();
+    const stxxl::unsigned_type sizes[] = { 0, 1, 127, 128, 1000, 100000, 2000000 };
+
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        check_radix_sort(make_input(sizes[i], all));            // random keys
+        check_radix_sort(make_input(sizes[i], 0xFFFFF));        // small keys
+        check_radix_sort(make_input(sizes[i], 0xF));            // duplicates
+        check_radix_sort(make_input(sizes[i], 0xF0000000000F)); // sparse bits
+        check_radix_sort(make_input(sizes[i], 0));              // all equal
+    }
+
+    // sorted and reverse sorted input
+    {
+        std::vector<value_type> v(300000);
+        for (stxxl::unsigned_type i = 0; i < v.size(); ++i)
+            v[i] = value_type(i << 20, i);
+        check_radix_sort(v);
+        std::reverse(v.begin(), v.end());
+        check_radix_sort(v);
+    }
+
+    // presorted input is sorted by comparisons
+    {
+        using stxxl::radix_sort_local::is_presorted;
+
+        std::vector<value_type> v(300000);
+        for (stxxl::unsigned_type i = 0; i < v.size(); ++i)
+            v[i] = value_type(i / 3, i);
+        STXXL_CHECK(is_presorted(v.begin(), v.end(), key_cmp()));
+        std::reverse(v.begin(), v.end());
+        STXXL_CHECK(is_presorted(v.begin(), v.end(), key_cmp()));
+
+        stxxl::potentially_radix_sort(v.begin(), v.end(), key_cmp());
+        for (stxxl::unsigned_type i = 0; i < v.size(); ++i)
+            STXXL_CHECK_EQUAL(v[i].first, i / 3);
+
+        // nearly sorted and random input is not
+        for (stxxl::unsigned_type i = 0; i < v.size(); ++i)
+            v[i] = value_type(16 * i + next_random() % (16 * 4096), i);
+        STXXL_CHECK(!is_presorted(v.begin(), v.end(), key_cmp()));
+        v = make_input(300000, all);
+        STXXL_CHECK(!is_presorted(v.begin(), v.end(), key_cmp()));
+    }
+
+    // 32-bit keys
+    {
+        std::vector<stxxl::uint32> v(500000);
+        for (stxxl::unsigned_type i = 0; i < v.size(); ++i)
+            v[i] = (stxxl::uint32)next_random();
+        std::vector<stxxl::uint32> check = v;
+
+        stxxl::radix_sort(v.begin(), v.end(), key32_cmp());
+        std::sort(check.begin(), check.end());
+        STXXL_CHECK(v == check);
+    }
+
+    const stxxl::unsigned_type memory = 32 * 1024 * 1024;
+    const stxxl::uint64 n = 4 * memory / sizeof(value_type);
+
+    // stxxl::sort on a vector
+    {
+        typedef stxxl::VECTOR_GENERATOR<value_type>::result vector_type;
+        vector_type v(n);
+        stxxl::uint64 sum = 0;
+        for (vector_type::iterator it = v.begin(); it != v.end(); ++it)
+        {
+            *it = value_type(next_random(), 1);
+            sum += it->first;
+        }
+
+        stxxl::sort(v.begin(), v.end(), key_cmp(), memory);
+
+        stxxl::uint64 check_sum = 0;
+        for (vector_type::const_iterator it = v.begin(); it != v.end(); ++it)
+        {
+            STXXL_CHECK(it == v.begin() || (it - 1)->first <= it->first);
+            check_sum += it->first;
+        }
+        STXXL_CHECK_EQUAL(sum, check_sum);
+    }
+
+    // stream::sort
+    {
+        std::vector<value_type> in = make_input(n, all);
+        typedef stxxl::stream::iterator2stream<std::vector<value_type>::const_iterator> input_type;
+        input_type input(in.begin(), in.end());
+
+        stxxl::stream::sort<input_type, key_cmp> sorted(input, key_cmp(), memory);
+
+        std::sort(in.begin(), in.end(), plain_cmp());
+        for (stxxl::unsigned_type i = 0; i < n; ++i, ++sorted)
+            STXXL_CHECK_EQUAL(sorted->first, in[i].first);
+        STXXL_CHECK(sorted.empty());
+    }
+
+    return 0;
+}
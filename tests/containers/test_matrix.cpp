@@ -380,6 +380,7 @@ int main(int argc, char** argv)
                "   0: online LRU\n"
                "   1: offline LFD\n"
                "   2: offline LRU prefetching\n"
+               "   3: offline LFD prefetching\n"
                "  default: 1");
 
     if (!cp.process(argc, argv))
@@ -392,7 +393,7 @@ int main(int argc, char** argv)
 
         for (int mult_algo = 0; mult_algo <= 6; ++mult_algo)
         {
-            for (int sched_algo = 0; sched_algo <= 2; ++sched_algo)
+            for (int sched_algo = 0; sched_algo <= 3; ++sched_algo)
             {
                 test2(rank, mult_algo, sched_algo);
             }
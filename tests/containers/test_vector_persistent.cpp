@@ -0,0 +1,181 @@
+/***************************************************************************
+ *  tests/containers/test_vector_persistent.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/vector>
+
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//! \example containers/test_vector_persistent.cpp
+//! This tests storing a vector in the catalog of persistent disks and opening
+//! it again in later program runs, each run is a child process.
+
+typedef stxxl::VECTOR_GENERATOR<stxxl::uint64, 2, 2, 64 * 1024>::result vector_type;
+
+static const stxxl::uint64 num_elements = 1000000;
+
+static void configure(const char* path)
+{
+    stxxl::disk_config disk(path, 64 * 1024 * 1024, "syscall persistent direct=off");
+    stxxl::config::get_instance()->add_disk(disk);
+}
+
+//! run func in a child process and check that it exited successfully
+static void run(void (* func)(const char*), const char* path)
+{
+    pid_t pid = fork();
+    STXXL_CHECK(pid >= 0);
+    if (pid == 0) {
+        configure(path);
+        func(path);
+        exit(0);
+    }
+
+    int status;
+    STXXL_CHECK(waitpid(pid, &status, 0) == pid);
+    STXXL_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void check(const vector_type& v, stxxl::uint64 n)
+{
+    STXXL_CHECK_EQUAL(v.size(), n);
+    for (stxxl::uint64 i = 0; i < n; ++i)
+        STXXL_CHECK_EQUAL(v[i], i * i);
+}
+
+static void write_run(const char*)
+{
+    vector_type v;
+    for (stxxl::uint64 i = 0; i < num_elements; ++i)
+        v.push_back(i * i);
+    v.save("squares");
+
+    // a temporary vector is not kept
+    vector_type tmp(num_elements);
+}
+
+static void append_run(const char*)
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    STXXL_CHECK(bm->is_persistent());
+    STXXL_CHECK(bm->has_root("squares"));
+
+    vector_type v;
+    v.open("squares");
+    check(v, num_elements);
+
+    // committed by the destructor
+    for (stxxl::uint64 i = num_elements; i < 2 * num_elements; ++i)
+        v.push_back(i * i);
+}
+
+static void crash_run(const char*)
+{
+    vector_type v;
+    v.open("squares");
+    check(v, 2 * num_elements);
+
+    // not committed: the next run sees the previous catalog, the new blocks
+    // are free again
+    for (stxxl::uint64 i = 0; i < num_elements; ++i)
+        v.push_back(0);
+    v.flush();
+    _exit(0);
+}
+
+static void overwrite_run(const char*)
+{
+    vector_type v;
+    v.open("squares");
+
+    // pages are written copy-on-write, and released blocks are not reused
+    // before the next commit
+    for (stxxl::uint64 i = 0; i < 2 * num_elements; ++i)
+        v[i] = 0;
+    v.resize(num_elements / 2, true);
+    v.flush();
+
+    vector_type tmp(2 * num_elements);
+    for (stxxl::uint64 i = 0; i < tmp.size(); ++i)
+        tmp[i] = 0;
+    tmp.flush();
+    _exit(0);
+}
+
+static void bufwriter_run(const char*)
+{
+    {
+        vector_type w(num_elements);
+        for (stxxl::uint64 i = 0; i < num_elements; ++i)
+            w[i] = i;
+        w.save("written");
+    }
+
+    // the bufwriter writes the blocks in place, the root is marked modified
+    vector_type w;
+    w.open("written");
+    vector_type::bufwriter_type writer(w.begin());
+    for (stxxl::uint64 i = 0; i < num_elements; ++i)
+        writer << 0;
+    writer.finish();
+    _exit(0);
+}
+
+static void remove_run(const char*)
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    stxxl::uint64 free_bytes = bm->get_free_bytes();
+
+    {
+        vector_type v;
+        v.open("squares");
+        check(v, 2 * num_elements);
+
+        vector_type other;
+        STXXL_CHECK_THROW(other.open("cubes"), std::runtime_error);
+        STXXL_CHECK_THROW(v.open("squares"), std::runtime_error);
+
+        // the crashed run left the written root partially overwritten
+        STXXL_CHECK(bm->has_root("written"));
+        STXXL_CHECK_THROW(other.open("written"), std::runtime_error);
+        STXXL_CHECK(bm->remove_root("written"));
+
+        v.detach();
+    }
+
+    STXXL_CHECK(!bm->has_root("squares"));
+    STXXL_CHECK(bm->get_root_names().empty());
+    bm->release_thread_cache();
+    STXXL_CHECK(bm->get_free_bytes() > free_bytes);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempfile");
+        return -1;
+    }
+
+    unlink(argv[1]);
+
+    run(write_run, argv[1]);
+    run(append_run, argv[1]);
+    run(crash_run, argv[1]);
+    run(overwrite_run, argv[1]);
+    run(bufwriter_run, argv[1]);
+    run(remove_run, argv[1]);
+
+    unlink(argv[1]);
+
+    return 0;
+}
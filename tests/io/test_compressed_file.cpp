@@ -0,0 +1,154 @@
+/***************************************************************************
+ *  tests/io/test_compressed_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/random>
+#include <cstring>
+#include <vector>
+
+//! \example io/test_compressed_file.cpp
+//! This tests reading and writing compressible and incompressible blocks
+//! through a compressed_file, including overwrites of parts of blocks. Codecs
+//! not found at build time are skipped.
+
+using stxxl::file;
+
+#if STXXL_HAVE_COMPRESSED_FILE
+//! whether the codec name is known and was found at build time
+static bool is_available(const std::string& name)
+{
+    typedef stxxl::compressed_file compressed_file;
+
+    for (int c = compressed_file::CODEC_LZ4; c <= compressed_file::CODEC_ZLIB; ++c)
+    {
+        compressed_file::codec_type codec = (compressed_file::codec_type)c;
+        if (name == compressed_file::codec_name(codec))
+            return compressed_file::is_available(codec);
+    }
+    return false;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile codec" << std::endl;
+        return -1;
+    }
+
+    const std::string io_impl = std::string(argv[1]) + " compress=" + argv[3];
+    const stxxl::unsigned_type block_size = 256 * 1024, num_blocks = 32;
+
+    bool available = false;
+#if STXXL_HAVE_COMPRESSED_FILE
+    available = is_available(argv[3]);
+#endif
+    if (!available)
+    {
+        STXXL_CHECK_THROW(
+            delete stxxl::create_file(io_impl, argv[2], file::CREAT | file::RDWR),
+            std::runtime_error);
+        STXXL_MSG("Codec " << argv[3] << " was not found at build time, skipped.");
+        return 0;
+    }
+
+    stxxl::compat_unique_ptr<stxxl::file>::result file(
+        stxxl::create_file(io_impl, argv[2],
+                           file::CREAT | file::RDWR | file::DIRECT)
+        );
+    STXXL_CHECK(std::string(file->io_type()) == "compressed");
+    file->set_size(block_size * num_blocks);
+
+    // even blocks are compressible, odd blocks are random
+    stxxl::random_number32 rnd;
+    std::vector<char*> buffers(num_blocks);
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i) {
+        buffers[i] = (char*)stxxl::aligned_alloc<4096>(block_size);
+        for (stxxl::unsigned_type j = 0; j < block_size; ++j)
+            buffers[i][j] = (i % 2 == 0) ? (char)(i + j / 1024) : (char)(rnd() >> 24);
+    }
+
+    stxxl::stats_data stats_begin(*stxxl::stats::get_instance());
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        reqs[i] = file->awrite(buffers[i], i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    // overwrite the middle of two blocks spanning their boundary
+    const stxxl::unsigned_type part = 64 * 1024;
+    char* patch = (char*)stxxl::aligned_alloc<4096>(2 * part);
+    memset(patch, 'x', 2 * part);
+    file->awrite(patch, 5 * block_size - part, 2 * part)->wait();
+    memcpy(buffers[4] + block_size - part, patch, part);
+    memcpy(buffers[5], patch, part);
+
+    // read back and compare
+    char* check = (char*)stxxl::aligned_alloc<4096>(block_size);
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+    {
+        file->aread(check, i * block_size, block_size)->wait();
+        STXXL_CHECK(memcmp(check, buffers[i], block_size) == 0);
+    }
+
+    // read spanning several extents
+    file->aread(check, 3 * block_size + part, block_size)->wait();
+    STXXL_CHECK(memcmp(check, buffers[3] + part, block_size - part) == 0);
+    STXXL_CHECK(memcmp(check + block_size - part, buffers[4], part) == 0);
+
+    stxxl::stats_data stats = stxxl::stats_data(*stxxl::stats::get_instance()) - stats_begin;
+
+    // the compressible half is stored in much less space
+    const stxxl::int64 total_bytes = (stxxl::int64)(block_size * num_blocks);
+    STXXL_CHECK(stats.get_compressed_raw_volume() >= total_bytes);
+    STXXL_CHECK(stats.get_compressed_stored_volume() < stats.get_compressed_raw_volume());
+    STXXL_CHECK(stats.get_written_volume() < total_bytes * 3 / 4);
+
+    // discarded blocks read as zeros
+    file->discard(0, 2 * block_size);
+    file->aread(check, block_size, block_size)->wait();
+    for (stxxl::unsigned_type j = 0; j < block_size; ++j)
+        STXXL_CHECK(check[j] == 0);
+
+    std::cout << stats;
+
+    // the extent map is not stored: a reopened file starts empty instead of
+    // exposing stale data
+    if (strcmp(argv[1], "memory") != 0)
+    {
+        file.reset();
+        file.reset(stxxl::create_file(io_impl, argv[2],
+                                      file::CREAT | file::RDWR | file::DIRECT));
+        STXXL_CHECK_EQUAL(file->size(), 0);
+        {
+            stxxl::compat_unique_ptr<stxxl::file>::result backend(
+                stxxl::create_file(argv[1], argv[2],
+                                   file::RDONLY | file::NO_LOCK));
+            STXXL_CHECK_EQUAL(backend->size(), 0);
+        }
+
+        file->set_size(block_size);
+        file->aread(check, 0, block_size)->wait();
+        for (stxxl::unsigned_type j = 0; j < block_size; ++j)
+            STXXL_CHECK(check[j] == 0);
+    }
+
+    stxxl::aligned_dealloc<4096>(check);
+    stxxl::aligned_dealloc<4096>(patch);
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        stxxl::aligned_dealloc<4096>(buffers[i]);
+
+    file->close_remove();
+
+    return 0;
+}
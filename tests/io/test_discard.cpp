@@ -0,0 +1,100 @@
+/***************************************************************************
+ *  tests/io/test_discard.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//! \example io/test_discard.cpp
+//! This tests that discard() on a file opened with file::DISCARD releases the
+//! region and keeps the data around it.
+
+using stxxl::file;
+
+static stxxl::uint64 allocated_bytes(const char* path)
+{
+    struct stat st;
+    STXXL_CHECK(stat(path, &st) == 0);
+    return (stxxl::uint64)st.st_blocks * 512;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile" << std::endl;
+        return -1;
+    }
+
+    const stxxl::uint64 size = 1024 * 1024, num_blocks = 16;
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(size * num_blocks);
+    memset(buffer, 'x', size * num_blocks);
+
+    stxxl::compat_unique_ptr<stxxl::file>::result file(
+        stxxl::create_file(
+            argv[1], argv[2],
+            stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::TRUNC |
+            stxxl::file::DISCARD)
+        );
+
+    file->set_size(num_blocks * size);
+    file->awrite(buffer, 0, size * num_blocks)->wait();
+    file->flush();
+
+    stxxl::uint64 before = allocated_bytes(argv[2]);
+    STXXL_MSG("allocated before discard: " << before);
+
+    // release blocks 4..11
+    file->discard(4 * size, 8 * size);
+    file->flush();
+
+    stxxl::uint64 after = allocated_bytes(argv[2]);
+    STXXL_MSG("allocated after discard: " << after);
+
+#if STXXL_HAVE_FALLOCATE_PUNCH_HOLE
+    STXXL_CHECK(after + 8 * size <= before);
+#endif
+    STXXL_CHECK(file->size() == num_blocks * size);
+
+    // the region around the hole is unchanged, the hole reads as zeros
+    memset(buffer, 0, size * num_blocks);
+    file->aread(buffer, 0, size * num_blocks)->wait();
+    for (stxxl::uint64 i = 0; i < size * num_blocks; ++i)
+    {
+        if (i < 4 * size || i >= 12 * size)
+            STXXL_CHECK(buffer[i] == 'x');
+#if STXXL_HAVE_FALLOCATE_PUNCH_HOLE
+        else
+            STXXL_CHECK(buffer[i] == 0);
+#endif
+    }
+
+    // without DISCARD the call is a no-op
+    stxxl::compat_unique_ptr<stxxl::file>::result plain(
+        stxxl::create_file(argv[1], std::string(argv[2]) + ".plain",
+                           stxxl::file::CREAT | stxxl::file::RDWR));
+    plain->set_size(size);
+    memset(buffer, 'y', size);
+    plain->awrite(buffer, 0, size)->wait();
+    plain->discard(0, size);
+    memset(buffer, 0, size);
+    plain->aread(buffer, 0, size)->wait();
+    STXXL_CHECK(buffer[0] == 'y' && buffer[size - 1] == 'y');
+
+    plain->close_remove();
+    file->close_remove();
+
+    stxxl::aligned_dealloc<4096>(buffer);
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *  tests/io/test_flush.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/mng/block_manager.h>
+#include <cstring>
+
+//! \example io/test_flush.cpp
+//! This tests that flush requests complete after all writes posted before.
+
+using stxxl::file;
+
+static stxxl::mutex count_mutex;
+static unsigned writes_completed = 0;
+static unsigned writes_at_flush = 0;
+
+struct count_write
+{
+    void operator () (stxxl::request*)
+    {
+        stxxl::scoped_mutex_lock lock(count_mutex);
+        ++writes_completed;
+    }
+};
+
+struct check_flush
+{
+    void operator () (stxxl::request*)
+    {
+        stxxl::scoped_mutex_lock lock(count_mutex);
+        writes_at_flush = writes_completed;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile" << std::endl;
+        return -1;
+    }
+
+    const stxxl::uint64 size = 1024 * 1024;
+    const unsigned num_blocks = 64, rounds = 4;
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(size * num_blocks);
+    for (stxxl::uint64 i = 0; i < size * num_blocks; ++i)
+        buffer[i] = (char)(i * 7);
+
+    stxxl::compat_unique_ptr<stxxl::file>::result file(
+        stxxl::create_file(
+            argv[1], argv[2],
+            stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::DIRECT)
+        );
+
+    file->set_size(num_blocks * size);
+    stxxl::request_ptr req[num_blocks];
+
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        writes_completed = writes_at_flush = 0;
+
+        for (unsigned i = 0; i < num_blocks; ++i)
+            req[i] = file->awrite(buffer + i * size, i * size, size, count_write());
+
+        stxxl::request_ptr flush = file->aflush(check_flush());
+        STXXL_CHECK(flush->get_type() == stxxl::request::FLUSH);
+        flush->wait();
+
+        STXXL_CHECK(writes_at_flush == num_blocks);
+        for (unsigned i = 0; i < num_blocks; ++i)
+            STXXL_CHECK(req[i]->poll());
+    }
+
+    // flush without pending writes and the synchronous path
+    file->aflush()->wait();
+    file->flush();
+
+    // reading back must return the data written
+    char* check = (char*)stxxl::aligned_alloc<4096>(size * num_blocks);
+    for (unsigned i = 0; i < num_blocks; ++i)
+        req[i] = file->aread(check + i * size, i * size, size);
+    wait_all(req, num_blocks);
+    STXXL_CHECK(memcmp(check, buffer, size * num_blocks) == 0);
+
+    // flush all disks of the block manager
+    stxxl::block_manager::get_instance()->flush();
+
+    stxxl::aligned_dealloc<4096>(check);
+    stxxl::aligned_dealloc<4096>(buffer);
+
+    file->close_remove();
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *  tests/io/test_io_coalescing.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/semaphore.h>
+#include <cstring>
+#include <vector>
+
+//! \example io/test_io_coalescing.cpp
+//! This tests that adjacent requests are served correctly, and by fewer I/O
+//! calls, when the disk queue coalesces them into vectored I/O calls.
+
+using stxxl::file;
+
+//! released once all requests of a phase are queued
+static stxxl::semaphore queued(0);
+
+//! holds up the I/O thread after the first request of a phase, such that the
+//! following ones are waiting in the queue and can be coalesced
+static void wait_queued(stxxl::request*)
+{
+    queued--;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile" << std::endl;
+        return -1;
+    }
+
+    const stxxl::unsigned_type block_size = 256 * 1024, num_blocks = 64;
+
+    stxxl::compat_unique_ptr<stxxl::file>::result file(
+        stxxl::create_file(
+            argv[1], argv[2],
+            file::CREAT | file::RDWR | file::DIRECT)
+        );
+    file->set_size(block_size * num_blocks);
+
+    std::vector<char*> buffers(num_blocks);
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i) {
+        buffers[i] = (char*)stxxl::aligned_alloc<4096>(block_size);
+        memset(buffers[i], (int)(i + 1), block_size);
+    }
+
+    stxxl::stats_data stats_begin(*stxxl::stats::get_instance());
+
+    // write adjacent blocks, block 32 is written last
+    reqs[0] = file->awrite(buffers[0], 0, block_size, &wait_queued);
+    for (stxxl::unsigned_type i = 1; i < num_blocks; ++i) {
+        if (i == 32) continue;
+        reqs[i] = file->awrite(buffers[i], i * block_size, block_size);
+    }
+    reqs[32] = file->awrite(buffers[32], 32 * block_size, block_size);
+    queued++;
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        memset(buffers[i], 0, block_size);
+
+    // read them back in reverse and forward order
+    const stxxl::unsigned_type half = num_blocks / 2;
+    reqs[half - 1] = file->aread(buffers[half - 1], (half - 1) * block_size,
+                                 block_size, &wait_queued);
+    for (stxxl::unsigned_type i = half - 1; i > 0; --i)
+        reqs[i - 1] = file->aread(buffers[i - 1], (i - 1) * block_size, block_size);
+    for (stxxl::unsigned_type i = half; i < num_blocks; ++i)
+        reqs[i] = file->aread(buffers[i], i * block_size, block_size);
+    queued++;
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    stxxl::stats_data stats_end(*stxxl::stats::get_instance());
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i) {
+        for (stxxl::unsigned_type j = 0; j < block_size; ++j)
+            STXXL_CHECK(buffers[i][j] == (char)(i + 1));
+    }
+
+    const stxxl::stats_data stats = stats_end - stats_begin;
+    STXXL_MSG("Served " << 2 * num_blocks << " requests using " <<
+              stats.get_writes() << " writes and " <<
+              stats.get_reads() << " reads");
+
+    // adjacent requests of each direction were served by fewer I/O calls
+    if (file->has_vector_io()) {
+        STXXL_CHECK(stats.get_writes() > 0 && stats.get_writes() < num_blocks);
+        STXXL_CHECK(stats.get_reads() > 0 && stats.get_reads() < num_blocks);
+    }
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        stxxl::aligned_dealloc<4096>(buffers[i]);
+
+    file->close_remove();
+
+    return 0;
+}
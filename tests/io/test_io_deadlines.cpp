@@ -0,0 +1,93 @@
+/***************************************************************************
+ *  tests/io/test_io_deadlines.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/semaphore.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/io/request_queue_impl_qwqr.h>
+#include <cstring>
+#include <vector>
+
+//! \example io/test_io_deadlines.cpp
+//! This tests that the disk queue serves the request queued first when both a
+//! read and a write passed their deadlines, although reads take priority.
+
+using stxxl::file;
+
+//! released once all requests are queued
+static stxxl::semaphore queued(0);
+
+//! counts the completed requests
+static stxxl::semaphore completed(0);
+
+//! order in which the requests were served
+static std::vector<stxxl::request::request_type> served;
+
+//! holds up the I/O thread until the other requests are queued
+static void wait_queued(stxxl::request*)
+{
+    queued--;
+}
+
+static void record(stxxl::request* req)
+{
+    served.push_back(req->get_type());
+    completed++;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile" << std::endl;
+        return -1;
+    }
+
+    const stxxl::unsigned_type block_size = 4096;
+
+    stxxl::compat_unique_ptr<stxxl::file>::result file(
+        stxxl::create_file(argv[1], argv[2], file::CREAT | file::RDWR));
+    file->set_size(4 * block_size);
+
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(3 * block_size);
+    memset(buffer, 0, 3 * block_size);
+
+    stxxl::disk_queues::get_instance()->set_priority_op(stxxl::request_queue::READ);
+
+    stxxl::request_ptr hold = file->awrite(buffer, 0, block_size, &wait_queued);
+
+    stxxl::request_queue_impl_qwqr* queue =
+        dynamic_cast<stxxl::request_queue_impl_qwqr*>(
+            stxxl::disk_queues::get_instance()->get_queue(file->get_queue_id()));
+    STXXL_CHECK(queue != NULL);
+    queue->set_deadlines(0, 0);
+
+    // the write is queued before the read, both expire immediately
+    file->awrite(buffer + block_size, 2 * block_size, block_size, &record);
+    const double ts = stxxl::timestamp();
+    while (stxxl::timestamp() - ts < 0.01) { }
+    file->aread(buffer + 2 * block_size, 3 * block_size, block_size, &record);
+    queued++;
+
+    // wait without promoting the requests
+    completed--;
+    completed--;
+    hold->wait();
+
+    STXXL_CHECK_EQUAL(served.size(), 2u);
+    STXXL_CHECK(served[0] == stxxl::request::WRITE);
+    STXXL_CHECK(served[1] == stxxl::request::READ);
+
+    stxxl::aligned_dealloc<4096>(buffer);
+    file->close_remove();
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/***************************************************************************
+ *  tests/io/test_iotrace.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <sstream>
+#include <vector>
+
+//! \example io/test_iotrace.cpp
+//! This tests recording of latency histograms and the request trace, and
+//! writing and reading back the trace.
+
+int main()
+{
+    const stxxl::unsigned_type block_size = 64 * 1024, num_blocks = 32;
+
+    stxxl::mem_file file;
+    file.set_size(block_size * num_blocks);
+
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size * num_blocks);
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+
+    stxxl::iotrace* trace = stxxl::iotrace::get_instance();
+    trace->start(num_blocks + num_blocks / 2);
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        reqs[i] = file.awrite(buffer + i * block_size, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    for (stxxl::unsigned_type i = 0; i < num_blocks; ++i)
+        reqs[i] = file.aread(buffer + i * block_size, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    trace->stop();
+
+    // requests after stop() are not recorded
+    file.awrite(buffer, 0, block_size)->wait();
+
+    stxxl::iotrace::disk_map_type disks = trace->get_disk_stats();
+    STXXL_CHECK(disks.size() == 1);
+
+    const stxxl::iotrace::disk_stats& ds = disks.begin()->second;
+    STXXL_CHECK(ds.write_latency.count() == num_blocks);
+    STXXL_CHECK(ds.read_latency.count() == num_blocks);
+    STXXL_CHECK(ds.depth == 0);
+    STXXL_CHECK(ds.max_depth >= 1 && ds.max_depth <= num_blocks);
+    STXXL_CHECK(ds.read_latency.quantile(0.5) <= ds.read_latency.max());
+
+    // ring buffer keeps the latest requests: half of the writes and all reads
+    std::vector<stxxl::iotrace::entry> entries = trace->get_trace();
+    STXXL_CHECK(entries.size() == num_blocks + num_blocks / 2);
+    STXXL_CHECK(entries.front().type == stxxl::request::WRITE);
+    STXXL_CHECK(entries.back().type == stxxl::request::READ);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        STXXL_CHECK(entries[i].size == block_size);
+        STXXL_CHECK(entries[i].submit <= entries[i].start);
+        STXXL_CHECK(entries[i].start <= entries[i].complete);
+        STXXL_CHECK(i == 0 || entries[i - 1].complete <= entries[i].complete);
+    }
+
+    // round trip through the text format
+    std::stringstream ss;
+    stxxl::iotrace::write_trace(ss, entries);
+
+    std::vector<stxxl::iotrace::entry> entries2;
+    STXXL_CHECK(stxxl::iotrace::read_trace(ss, entries2));
+    STXXL_CHECK(entries2.size() == entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        STXXL_CHECK(entries2[i].type == entries[i].type);
+        STXXL_CHECK(entries2[i].offset == entries[i].offset);
+    }
+
+    stxxl::iotrace::disk_map_type disks2 = stxxl::iotrace::summarize(entries2);
+    STXXL_CHECK(disks2.begin()->second.read_latency.count() == num_blocks);
+    STXXL_CHECK(disks2.begin()->second.write_latency.count() == num_blocks / 2);
+
+    std::ostringstream json;
+    stxxl::iotrace::write_chrome_trace(json, entries2);
+    STXXL_CHECK(json.str().find("\"traceEvents\"") != std::string::npos);
+
+    stxxl::iotrace::print_summary(std::cout, disks);
+
+    stxxl::aligned_dealloc<4096>(buffer);
+
+    return 0;
+}
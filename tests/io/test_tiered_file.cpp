@@ -0,0 +1,173 @@
+/***************************************************************************
+ *  tests/io/test_tiered_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/rand.h>
+#include <cstring>
+#include <vector>
+
+//! \example io/test_tiered_file.cpp
+//! This tests placement, demotion, promotion and write-back of blocks in
+//! tiered_file.
+
+using stxxl::file;
+using stxxl::tiered_file;
+
+static const size_t block_size = 256 * 1024;
+static const size_t num_blocks = 16;
+static const size_t fast_blocks = 4;
+
+static std::vector<char> reference(block_size * num_blocks);
+
+static void write_block(file* f, char* buffer, size_t i, size_t n, unsigned seed)
+{
+    stxxl::random_number32_r rnd(seed);
+    for (size_t j = 0; j < n * block_size; ++j)
+        buffer[j] = (char)(rnd() >> 24);
+    memcpy(&reference[i * block_size], buffer, n * block_size);
+    f->awrite(buffer, i * block_size, n * block_size)->wait();
+}
+
+static void check_block(file* f, char* buffer, size_t i, size_t n)
+{
+    f->aread(buffer, i * block_size, n * block_size)->wait();
+    STXXL_CHECK(memcmp(buffer, &reference[i * block_size], n * block_size) == 0);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "Usage: " << argv[0] << " filetype tempfile policy" << std::endl;
+        return -1;
+    }
+
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(2 * block_size);
+
+    // whether the slow file can be opened again to check its contents
+    const bool reopen = (strcmp(argv[1], "memory") != 0);
+
+    file* slow = stxxl::create_file(
+        argv[1], argv[2],
+        stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::DIRECT);
+    slow->set_size(num_blocks * block_size);
+
+    tiered_file* tf = new tiered_file(
+        slow, new stxxl::mem_file(), fast_blocks * block_size,
+        tiered_file::parse_policy(argv[3]));
+
+    STXXL_CHECK(tf->size() == num_blocks * block_size);
+
+    // writes are placed on the fast tier, older blocks are demoted
+    for (size_t i = 0; i < num_blocks; ++i)
+        write_block(tf, buffer, i, 1, (unsigned)i);
+
+    tiered_file::counters c = tf->get_counters();
+    STXXL_CHECK_EQUAL(c.hits, num_blocks);
+    STXXL_CHECK_EQUAL(c.demotions, num_blocks - fast_blocks);
+    STXXL_CHECK_EQUAL(c.writebacks, num_blocks - fast_blocks);
+    STXXL_CHECK(tf->get_fast_usage() == fast_blocks * block_size);
+
+    for (size_t i = 0; i < num_blocks; ++i)
+        check_block(tf, buffer, i, 1);
+
+    // the second read of block 0 promotes it, the third is served from the
+    // fast tier
+    c = tf->get_counters();
+    check_block(tf, buffer, 0, 1);
+    check_block(tf, buffer, 0, 1);
+    STXXL_CHECK_EQUAL(tf->get_counters().promotions, c.promotions + 1);
+    c = tf->get_counters();
+    check_block(tf, buffer, 0, 1);
+    STXXL_CHECK_EQUAL(tf->get_counters().hits, c.hits + 1);
+
+    // a hot block referenced between the evictions stays on the fast tier
+    for (size_t i = 1; i < num_blocks; ++i)
+    {
+        write_block(tf, buffer, i, 1, (unsigned)(100 + i));
+        check_block(tf, buffer, 0, 1);
+    }
+    c = tf->get_counters();
+    check_block(tf, buffer, 0, 1);
+    STXXL_CHECK_EQUAL(tf->get_counters().hits, c.hits + 1);
+
+    // requests overlapping cached blocks without matching them
+    check_block(tf, buffer, num_blocks - 2, 2);
+    write_block(tf, buffer, num_blocks - 3, 2, 1000);
+    for (size_t i = 0; i < num_blocks; ++i)
+        check_block(tf, buffer, i, 1);
+    check_block(tf, buffer, num_blocks - 3, 2);
+
+    STXXL_CHECK(tf->get_fast_usage() <= fast_blocks * block_size);
+
+    // flush() writes the dirty blocks back to the slow file, they stay on the
+    // fast tier
+    {
+        file::offset_type usage = tf->get_fast_usage();
+        tf->flush();
+        STXXL_CHECK(tf->get_fast_usage() == usage);
+
+        if (reopen)
+        {
+            file* check = stxxl::create_file(
+                argv[1], argv[2],
+                stxxl::file::RDONLY | stxxl::file::DIRECT | stxxl::file::NO_LOCK);
+            for (size_t i = 0; i < num_blocks; ++i)
+                check_block(check, buffer, i, 1);
+            delete check;
+        }
+
+        c = tf->get_counters();
+        tf->flush();
+        STXXL_CHECK_EQUAL(tf->get_counters().writebacks, c.writebacks);
+    }
+
+    // discarded blocks are dropped without being written back
+    c = tf->get_counters();
+    tf->discard(0, num_blocks * block_size);
+    STXXL_CHECK(tf->get_fast_usage() == 0);
+    STXXL_CHECK_EQUAL(tf->get_counters().writebacks, c.writebacks);
+
+    write_block(tf, buffer, 1, 1, 2000);
+    tf->set_size(block_size);
+    STXXL_CHECK(tf->size() == block_size);
+    STXXL_CHECK(tf->get_fast_usage() == 0);
+
+    STXXL_CHECK_THROW(tiered_file::parse_policy("fifo"), std::runtime_error);
+
+    tf->close_remove();
+    delete tf;
+
+    // the destructor writes the dirty blocks back before removing the fast
+    // tier
+    if (reopen)
+    {
+        slow = stxxl::create_file(
+            argv[1], argv[2],
+            stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::DIRECT);
+        slow->set_size(num_blocks * block_size);
+        tf = new tiered_file(
+            slow, new stxxl::mem_file(), fast_blocks * block_size,
+            tiered_file::parse_policy(argv[3]));
+        write_block(tf, buffer, 2, 1, 3000);
+        delete tf;
+
+        slow = stxxl::create_file(
+            argv[1], argv[2], stxxl::file::RDWR | stxxl::file::DIRECT);
+        check_block(slow, buffer, 2, 1);
+        slow->close_remove();
+        delete slow;
+    }
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+    return 0;
+}
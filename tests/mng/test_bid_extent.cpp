@@ -0,0 +1,90 @@
+/***************************************************************************
+ *  tests/mng/test_bid_extent.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/request>
+
+//! \example mng/test_bid_extent.cpp
+//! This tests allocation of extents and reading and writing blocks with one
+//! request per extent.
+
+static const unsigned block_size = 128 * 1024;
+typedef stxxl::typed_block<block_size, int> block_type;
+typedef block_type::bid_type bid_type;
+
+int main()
+{
+    const unsigned nblocks = 64;
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+
+    // blocks on one disk are allocated as one extent
+    std::vector<stxxl::bid_extent> extents;
+    bm->new_extents<block_type>(nblocks, stxxl::single_disk(), extents);
+    STXXL_CHECK(!extents.empty());
+
+    unsigned count = 0;
+    for (size_t i = 0; i < extents.size(); ++i) {
+        STXXL_MSG("extent " << extents[i]);
+        count += extents[i].num_blocks<block_size>();
+    }
+    STXXL_CHECK_EQUAL(count, nblocks);
+
+    std::vector<bid_type> bids(nblocks);
+    stxxl::extents_to_bids<block_size>(extents.begin(), extents.end(), bids.begin());
+    for (unsigned i = 1; i < nblocks; ++i)
+        STXXL_CHECK(bids[i].storage != bids[i - 1].storage ||
+                    bids[i].offset != bids[i - 1].offset);
+
+    std::vector<stxxl::bid_extent> regrouped;
+    stxxl::make_extents(bids.begin(), bids.end(), regrouped);
+    STXXL_CHECK_EQUAL(regrouped.size(), extents.size());
+
+    block_type* blocks = new block_type[nblocks];
+    stxxl::request_ptr reqs[nblocks];
+
+    for (unsigned i = 0; i < nblocks; ++i)
+        for (unsigned j = 0; j < block_type::size; ++j)
+            blocks[i][j] = i * block_type::size + j;
+
+    // one request per extent, each block gets the request of its extent
+    stxxl::unsigned_type nreqs = stxxl::write_extents(blocks, bids.begin(), bids.end(), reqs);
+    STXXL_CHECK_EQUAL(nreqs, extents.size());
+    stxxl::wait_all(reqs, nblocks);
+    for (unsigned i = 1; i < nblocks; ++i)
+        STXXL_CHECK(reqs[i].get());
+
+    std::fill(blocks[0].begin(), blocks[0].end(), 0);
+    std::fill(blocks[nblocks - 1].begin(), blocks[nblocks - 1].end(), 0);
+
+    nreqs = stxxl::read_extents(blocks, bids.begin(), bids.end(), reqs);
+    STXXL_CHECK_EQUAL(nreqs, extents.size());
+    stxxl::wait_all(reqs, nblocks);
+
+    for (unsigned i = 0; i < nblocks; ++i)
+        for (unsigned j = 0; j < block_type::size; ++j)
+            STXXL_CHECK_EQUAL(blocks[i][j], (int)(i * block_type::size + j));
+
+    // blocks in reverse order are not adjacent in memory and on disk
+    std::reverse(bids.begin(), bids.end());
+    nreqs = stxxl::read_extents(blocks, bids.begin(), bids.end(), reqs);
+    STXXL_CHECK_EQUAL(nreqs, (stxxl::unsigned_type)nblocks);
+    stxxl::wait_all(reqs, nblocks);
+    for (unsigned i = 0; i < nblocks; ++i)
+        STXXL_CHECK_EQUAL(blocks[i][0], (int)((nblocks - 1 - i) * block_type::size));
+
+    delete[] blocks;
+
+    bm->delete_extents<block_size>(extents.begin(), extents.end());
+
+    return 0;
+}
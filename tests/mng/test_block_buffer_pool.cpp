@@ -0,0 +1,106 @@
+/***************************************************************************
+ *  tests/mng/test_block_buffer_pool.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <cstring>
+#include <vector>
+
+#include <stxxl/mng>
+
+//! \example mng/test_block_buffer_pool.cpp
+//! This tests carving, recycling and coalescing of buffers in a
+//! block_buffer_pool.
+
+typedef stxxl::block_buffer_pool pool_type;
+
+static const size_t KiB = 1024;
+static const size_t MiB = 1024 * 1024;
+
+void test_pool(pool_type::page_type pages)
+{
+    pool_type pool(8 * MiB, pages);
+    STXXL_CHECK(pool.enabled());
+    STXXL_CHECK(pool.get_size() >= 8 * MiB);
+    STXXL_MSG("pool of " << pool_type::pages_name(pool.get_pages()) << " pages");
+
+    const size_t capacity = pool.get_size();
+
+    // buffers are aligned, also with meta info in front
+    char* a = (char*)pool.allocate(1 * MiB);
+    char* b = (char*)pool.allocate(1 * MiB, 16);
+    char* c = (char*)pool.allocate(100);
+    STXXL_CHECK(a && b && c);
+    STXXL_CHECK((size_t)a % pool_type::alignment == 0);
+    STXXL_CHECK((size_t)(b + 16) % pool_type::alignment == 0);
+    STXXL_CHECK(pool.contains(a) && pool.contains(b) && pool.contains(c));
+    STXXL_CHECK(!pool.contains(&capacity));
+    memset(a, 1, 1 * MiB);
+    memset(b, 2, 1 * MiB + 16);
+    STXXL_CHECK_EQUAL(pool.get_used(), 2 * MiB + 2 * 4 * KiB);
+
+    // freed buffers are recycled, best fit
+    pool.deallocate(a);
+    char* d = (char*)pool.allocate(512 * KiB);
+    STXXL_CHECK_EQUAL((void*)d, (void*)a);
+
+    // too large
+    STXXL_CHECK(pool.allocate(capacity) == NULL);
+    STXXL_CHECK_EQUAL(pool.get_misses(), 1);
+
+    // after freeing everything the free chunks are coalesced again
+    pool.deallocate(b);
+    pool.deallocate(c);
+    pool.deallocate(d);
+    STXXL_CHECK_EQUAL(pool.get_used(), 0);
+
+    std::vector<void*> blocks;
+    while (void* p = pool.allocate(256 * KiB))
+        blocks.push_back(p);
+    STXXL_CHECK_EQUAL(blocks.size(), capacity / (256 * KiB));
+    for (size_t i = 0; i < blocks.size(); i += 2)
+        pool.deallocate(blocks[i]);
+    STXXL_CHECK(pool.allocate(512 * KiB) == NULL);
+    for (size_t i = 1; i < blocks.size(); i += 2)
+        pool.deallocate(blocks[i]);
+
+    void* all = pool.allocate(capacity);
+    STXXL_CHECK(all != NULL);
+    pool.deallocate(all);
+
+    STXXL_CHECK_EQUAL(pool.get_peak(), capacity);
+    pool.print_stats(std::cout);
+}
+
+void test_typed_block()
+{
+    // the global pool is only enabled by STXXL_BUFFER_POOL, the blocks work
+    // either way
+    typedef stxxl::typed_block<64 * KiB, int> block_type;
+
+    block_type* blocks = new block_type[16];
+    block_type* block = new block_type;
+    STXXL_CHECK((size_t)blocks % pool_type::alignment == 0);
+    STXXL_CHECK((size_t)block % pool_type::alignment == 0);
+    for (int i = 0; i < 16; ++i)
+        blocks[i][0] = i;
+    (*block)[0] = 42;
+    delete[] blocks;
+    delete block;
+
+    pool_type::get_instance()->print_stats(std::cout);
+}
+
+int main()
+{
+    test_pool(pool_type::PAGES_NORMAL);
+    test_pool(pool_type::PAGES_THP);
+    test_typed_block();
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/***************************************************************************
+ *  tests/mng/test_block_manager_threads.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/mng>
+#include <stxxl/aligned_alloc>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if STXXL_PARALLEL
+ #include <omp.h>
+#endif
+#if STXXL_POSIX_THREADS
+ #include <pthread.h>
+#elif STXXL_STD_THREADS
+ #include <thread>
+#endif
+
+//! \example mng/test_block_manager_threads.cpp
+//! This tests concurrent allocation of blocks via the per-thread caches of
+//! the block manager, and that they are drained when the disks run full.
+
+static const unsigned block_size = 64 * 1024;
+typedef stxxl::BID<block_size> bid_type;
+
+static const unsigned num_threads = 4;
+static const unsigned num_blocks = 1000;
+static const stxxl::uint64 disk_size = 256 * 1024 * 1024;
+
+struct bid_less
+{
+    bool operator () (const bid_type& a, const bid_type& b) const
+    {
+        return a.storage < b.storage ||
+               (a.storage == b.storage && a.offset < b.offset);
+    }
+};
+
+//! allocate, partially free and reallocate striped blocks
+static void churn(std::vector<bid_type>& bids)
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    stxxl::striping striping;
+
+    bids.resize(num_blocks);
+    for (unsigned i = 0; i < num_blocks; ++i)
+        bm->new_block(striping, bids[i], i);
+
+    for (unsigned i = 0; i < num_blocks; i += 3)
+        bm->delete_block(bids[i]);
+    for (unsigned i = 0; i < num_blocks; i += 3)
+        bm->new_block(striping, bids[i], i);
+
+    // the disk of each block is chosen by the allocation strategy
+    for (unsigned i = 0; i < num_blocks; ++i)
+        STXXL_CHECK(bids[i].storage->get_allocator_id() == (int)striping(i));
+}
+
+static void* thread_main(void* arg)
+{
+    std::vector<bid_type>* bids = static_cast<std::vector<bid_type>*>(arg);
+    churn(*bids);
+    stxxl::block_manager::get_instance()->delete_blocks(bids->begin(), bids->end());
+    return NULL;
+}
+
+int main()
+{
+    // two disks of fixed size, such that allocations can fail, which discard
+    // freed blocks
+    stxxl::config* config = stxxl::config::get_instance();
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        stxxl::disk_config disk("/tmp/stxxl-###-" + stxxl::to_str(i) + ".tmp",
+                                disk_size, "syscall autogrow=no");
+        disk.unlink_on_open = true;
+        disk.direct = stxxl::disk_config::DIRECT_OFF;
+        disk.discard = true;
+        config->add_disk(disk);
+    }
+
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    const stxxl::uint64 free_bytes = bm->get_free_bytes();
+    STXXL_CHECK_EQUAL(free_bytes, 2 * disk_size);
+
+    // consecutive single block allocations are contiguous
+    {
+        stxxl::single_disk one(0);
+        bid_type bids[4];
+        for (unsigned i = 0; i < 4; ++i)
+            bm->new_block(one, bids[i]);
+        for (unsigned i = 1; i < 4; ++i)
+            STXXL_CHECK(bids[i].offset == bids[i - 1].offset + block_size);
+
+        // deleted blocks are reused in address order
+        bm->delete_block(bids[0]);
+        bm->delete_block(bids[1]);
+        bid_type again[2];
+        for (unsigned i = 0; i < 2; ++i)
+            bm->new_block(one, again[i]);
+        for (unsigned i = 0; i < 2; ++i)
+            STXXL_CHECK(again[i].offset == bids[i].offset);
+
+        bm->delete_blocks(bids + 0, bids + 4);
+    }
+
+    // cached blocks are only discarded when returned to the disk allocator
+    {
+        stxxl::single_disk one(0);
+        char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size);
+        memset(buffer, 'x', block_size);
+
+        bid_type bid, again;
+        bm->new_block(one, bid);
+        bid.storage->awrite(buffer, bid.offset, block_size)->wait();
+        bm->delete_block(bid);
+        bm->new_block(one, again);
+        STXXL_CHECK(again.offset == bid.offset);
+
+        memset(buffer, 0, block_size);
+        bid.storage->aread(buffer, bid.offset, block_size)->wait();
+#if STXXL_MNG_THREAD_CACHE
+        STXXL_CHECK(buffer[0] == 'x' && buffer[block_size - 1] == 'x');
+#endif
+
+        bm->delete_block(again);
+        bm->release_thread_cache();
+        bid.storage->aread(buffer, bid.offset, block_size)->wait();
+#if STXXL_HAVE_FALLOCATE_PUNCH_HOLE
+        STXXL_CHECK(buffer[0] == 0 && buffer[block_size - 1] == 0);
+#endif
+
+        stxxl::aligned_dealloc<4096>(buffer);
+    }
+
+    // concurrent allocation yields distinct blocks
+    std::vector<bid_type> bids[num_threads];
+
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(num_threads)
+#endif
+    for (int t = 0; t < (int)num_threads; ++t)
+        churn(bids[t]);
+
+    std::vector<bid_type> all;
+    for (unsigned t = 0; t < num_threads; ++t)
+        all.insert(all.end(), bids[t].begin(), bids[t].end());
+    std::sort(all.begin(), all.end(), bid_less());
+    for (size_t i = 1; i < all.size(); ++i)
+        STXXL_CHECK(all[i - 1].storage != all[i].storage ||
+                    all[i - 1].offset + block_size <= all[i].offset);
+
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(num_threads)
+#endif
+    for (int t = 0; t < (int)num_threads; ++t)
+    {
+        bm->delete_blocks(bids[t].begin(), bids[t].end());
+        bm->release_thread_cache();
+    }
+
+    bm->release_thread_cache();
+    STXXL_CHECK_EQUAL(bm->get_free_bytes(), free_bytes);
+
+    // the caches of exiting threads are released
+#if STXXL_POSIX_THREADS
+    pthread_t threads[num_threads];
+    for (unsigned t = 0; t < num_threads; ++t)
+        STXXL_CHECK(pthread_create(&threads[t], NULL, thread_main, &bids[t]) == 0);
+    for (unsigned t = 0; t < num_threads; ++t)
+        STXXL_CHECK(pthread_join(threads[t], NULL) == 0);
+#elif STXXL_STD_THREADS
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < num_threads; ++t)
+        threads.push_back(std::thread(thread_main, &bids[t]));
+    for (unsigned t = 0; t < num_threads; ++t)
+        threads[t].join();
+#else
+    for (unsigned t = 0; t < num_threads; ++t)
+        thread_main(&bids[t]);
+    bm->release_thread_cache();
+#endif
+
+    STXXL_CHECK_EQUAL(bm->get_free_bytes(), free_bytes);
+
+    // the blocks cached by another (still running) thread are drained when
+    // a disk runs full
+    const stxxl::unsigned_type disk_blocks = disk_size / block_size;
+    std::vector<bid_type> full(disk_blocks);
+
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(2)
+#endif
+    for (int t = 0; t < 2; ++t)
+    {
+        if (t != 1) continue;
+        bid_type bid;
+        bm->new_block(stxxl::single_disk(1), bid);
+        bm->delete_block(bid);
+    }
+
+    bm->new_blocks(stxxl::single_disk(1), full.begin(), full.end());
+    STXXL_CHECK_EQUAL(bm->get_free_bytes(), disk_size);
+
+    // a request failing on one disk releases the blocks taken on the others,
+    // both for small requests served by the caches and for large ones
+    const unsigned sizes[] = { 2, 1024 };
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        std::vector<bid_type> striped(sizes[i]);
+        bool failed = false;
+        try {
+            bm->new_blocks(stxxl::striping(), striped.begin(), striped.end());
+        }
+        catch (stxxl::bad_ext_alloc&) {
+            failed = true;
+        }
+        STXXL_CHECK(failed);
+        bm->release_thread_cache();
+        STXXL_CHECK_EQUAL(bm->get_free_bytes(), disk_size);
+    }
+
+    bm->delete_blocks(full.begin(), full.end());
+    bm->release_thread_cache();
+    STXXL_CHECK_EQUAL(bm->get_free_bytes(), free_bytes);
+
+    return 0;
+}
+
@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <limits>
+#include <vector>
 
 using stxxl::int_type;
 using stxxl::unsigned_type;
@@ -343,6 +344,58 @@ void test3()
     }
 }
 
+void test4()
+{
+    // ---------- acquire and release concurrently ---------------------
+    STXXL_MSG("next test: acquire and release from several threads");
+
+    const int num_threads = 4;
+    const int_type num_sbids = 256;
+    const int_type num_ops = 4096;
+
+    // less internal memory than two blocks per thread, threads have to wait
+    block_scheduler_type bs((2 * num_threads - 1) * block_size * sizeof(value_type));
+    STXXL_CHECK(bs.is_thread_safe());
+
+    std::vector<swappable_block_identifier_type> sbids(num_sbids);
+    for (int_type i = 0; i < num_sbids; ++i)
+        sbids[i] = bs.allocate_swappable_block();
+
+    // every block is written by one thread
+    int_type num_err = 0;
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(num_threads) reduction(+:num_err)
+#endif
+    for (int_type i = 0; i < num_sbids; ++i)
+    {
+        internal_block_type& ib = bs.acquire(sbids[i], true);
+        for (int_type j = 0; j < block_size; ++j)
+            ib[j] = i * block_size + j;
+        bs.release(sbids[i], true);
+        num_err += ! bs.is_initialized(sbids[i]);
+    }
+    STXXL_CHECK(num_err == 0);
+
+    // and read by all threads, two blocks at once
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(num_threads) reduction(+:num_err)
+#endif
+    for (int_type op = 0; op < num_ops; ++op)
+    {
+        const int_type a = (op * 7919) % num_sbids, b = (op * 104729 + 1) % num_sbids;
+        internal_block_type& ia = bs.acquire(sbids[a]);
+        internal_block_type& ib = bs.acquire(sbids[b]);
+        for (int_type j = 0; j < block_size; ++j)
+            num_err += (ia[j] != a * block_size + j) + (ib[j] != b * block_size + j);
+        bs.release(sbids[b], false);
+        bs.release(sbids[a], false);
+    }
+    STXXL_CHECK(num_err == 0);
+
+    for (int_type i = 0; i < num_sbids; ++i)
+        bs.free_swappable_block(sbids[i]);
+}
+
 int main(int argc, char** argv)
 {
     int test_case = -1;
@@ -368,6 +421,7 @@ int main(int argc, char** argv)
     test1();
     test2();
     test3();
+    test4();
 
     STXXL_MSG("end of test");
 
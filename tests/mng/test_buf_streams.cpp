@@ -14,10 +14,12 @@
 //! This is an example of use of \c stxxl::buf_istream and \c stxxl::buf_ostream
 
 #include <iostream>
+#include <vector>
 #include <stxxl/mng>
 #include <stxxl/bits/mng/buf_ostream.h>
 #include <stxxl/bits/mng/buf_istream.h>
 #include <stxxl/bits/mng/buf_istream_reverse.h>
+#include <stxxl/bits/mng/block_prefetcher.h>
 
 #define BLOCK_SIZE (1024 * 512)
 
@@ -27,11 +29,29 @@ typedef stxxl::BIDArray<BLOCK_SIZE>::iterator bid_iterator_type;
 typedef stxxl::buf_ostream<block_type, bid_iterator_type> buf_ostream_type;
 typedef stxxl::buf_istream<block_type, bid_iterator_type> buf_istream_type;
 typedef stxxl::buf_istream_reverse<block_type, bid_iterator_type> buf_istream_reverse_type;
+typedef stxxl::block_prefetcher<block_type, bid_iterator_type> prefetcher_type;
 
 // forced instantiations
 template class stxxl::buf_ostream<block_type, stxxl::BIDArray<BLOCK_SIZE>::iterator>;
 template class stxxl::buf_istream<block_type, stxxl::BIDArray<BLOCK_SIZE>::iterator>;
 template class stxxl::buf_istream_reverse<block_type, stxxl::BIDArray<BLOCK_SIZE>::iterator>;
+template class stxxl::block_prefetcher<block_type, stxxl::BIDArray<BLOCK_SIZE>::iterator>;
+
+//! spin for the given number of seconds
+static void busy_wait(double seconds)
+{
+    double start = stxxl::timestamp();
+    while (stxxl::timestamp() - start < seconds) { }
+}
+
+//! whether completed reads hold up the I/O thread, delaying the next reads
+static volatile bool slow_reads = false;
+
+static void stall_reads(stxxl::request*)
+{
+    if (slow_reads)
+        busy_wait(0.002);
+}
 
 int main()
 {
@@ -46,6 +66,38 @@ int main()
         for (unsigned i = 0; i < nelements; i++)
             out << i;
     }
+    {
+        // write-behind with one write in flight per disk, the blocks of
+        // each group of four in reverse order
+        stxxl::BIDArray<BLOCK_SIZE> bids2(nblocks);
+        bm->new_blocks(stxxl::striping(), bids2.begin(), bids2.end());
+
+        stxxl::buffered_writer<block_type> writer(16, 8);
+        writer.set_disk_budget(1);
+        const unsigned ndisks = stxxl::config::get_instance()->get_max_device_id();
+
+        block_type* blk = writer.get_free_block();
+        for (unsigned i = 0; i < nblocks; ++i)
+        {
+            unsigned b = (i / 4) * 4 + 3 - i % 4;
+            for (unsigned j = 0; j < block_type::size; ++j)
+                (*blk)[j] = b * block_type::size + j;
+            blk = writer.write(blk, bids2[b]);
+            STXXL_CHECK(writer.get_writes_in_flight() <= ndisks + 1);
+        }
+        writer.flush();
+        STXXL_CHECK_EQUAL(writer.get_writes_in_flight(), 0u);
+
+        buf_istream_type in(bids2.begin(), bids2.end(), 2);
+        for (unsigned i = 0; i < nelements; i++)
+        {
+            unsigned value;
+            in >> value;
+            STXXL_CHECK2(value == i, "Error at position " << i << " (" << value << ")");
+        }
+
+        bm->delete_blocks(bids2.begin(), bids2.end());
+    }
     {
         buf_istream_type in(bids.begin(), bids.end(), 2);
         for (unsigned i = 0; i < nelements; i++)
@@ -72,6 +124,80 @@ int main()
             STXXL_CHECK(prevalue == value);
         }
     }
+    {
+        // adaptive prefetching with a consumer slower than the disk
+        buf_istream_type in(bids.begin(), bids.end(), 16, true);
+        for (unsigned i = 0; i < nelements; i++)
+        {
+            unsigned value;
+            in >> value;
+            STXXL_CHECK(value == i);
+
+            if (i % block_type::size == 0) {
+                STXXL_CHECK(in.prefetch_depth() >= 1);
+                STXXL_CHECK(in.prefetch_depth() <= 16);
+                busy_wait(0.0005);
+            }
+        }
+    }
+    {
+        // the depth grows while the consumer waits for stalled reads, and
+        // shrinks again when the consumer is the bottleneck
+        std::vector<stxxl::int_type> prefetch_seq(nblocks);
+        for (unsigned i = 0; i < nblocks; ++i)
+            prefetch_seq[i] = i;
+
+        const stxxl::int_type budget = 32;
+        slow_reads = true;
+        prefetcher_type prefetcher(bids.begin(), bids.end(), &prefetch_seq[0], budget,
+                                   &stall_reads, true);
+        const stxxl::int_type initial_depth = prefetcher.prefetch_depth();
+        stxxl::int_type max_depth = initial_depth, compute_depth = 0;
+
+        block_type* blk = prefetcher.pull_block();
+        unsigned b = 0;
+        do {
+            STXXL_CHECK((*blk)[0] == b * block_type::size);
+            if (b < nblocks / 4) {
+                max_depth = std::max(max_depth, prefetcher.prefetch_depth());
+            }
+            else {
+                slow_reads = false;
+                busy_wait(0.01);
+                // measured while all buffers are still in use
+                if (b == nblocks - budget - 8)
+                    compute_depth = prefetcher.prefetch_depth();
+            }
+            ++b;
+        } while (prefetcher.block_consumed(blk));
+        STXXL_CHECK_EQUAL(b, nblocks);
+
+        STXXL_MSG("adaptive prefetch depth: initial " << initial_depth <<
+                  ", I/O-bound " << max_depth << ", compute-bound " << compute_depth);
+        STXXL_CHECK(max_depth >= std::min(budget, 2 * initial_depth));
+        STXXL_CHECK(compute_depth < max_depth);
+        STXXL_CHECK(compute_depth <= std::max<stxxl::int_type>(
+                        stxxl::config::get_instance()->disks_number(), 3));
+    }
+    {
+        // a prefetch schedule reversing groups of four blocks, which needs
+        // more buffers than the initial depth of the adaptive mode
+        std::vector<stxxl::int_type> prefetch_seq(nblocks);
+        for (unsigned i = 0; i < nblocks; ++i)
+            prefetch_seq[i] = (i / 4) * 4 + 3 - i % 4;
+
+        prefetcher_type prefetcher(bids.begin(), bids.end(), &prefetch_seq[0], 8,
+                                   stxxl::completion_handler(), true);
+        block_type* blk = prefetcher.pull_block();
+        unsigned b = 0;
+        do {
+            STXXL_CHECK((*blk)[0] == b * block_type::size);
+            STXXL_CHECK(prefetcher.prefetch_depth() <= prefetcher.max_prefetch_depth());
+            ++b;
+        } while (prefetcher.block_consumed(blk));
+        STXXL_CHECK_EQUAL(b, nblocks);
+        STXXL_CHECK(prefetcher.get_read_latency() >= 0.0);
+    }
     bm->delete_blocks(bids.begin(), bids.end());
 
     return 0;
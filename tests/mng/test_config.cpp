@@ -35,8 +35,82 @@ void test1()
     STXXL_CHECK_EQUAL(cfg.queue, 5);
     STXXL_CHECK_EQUAL(cfg.direct, stxxl::disk_config::DIRECT_ON);
 
+    // test NUMA node options
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall numa=1");
+    STXXL_CHECK_EQUAL(cfg.numa_node, 1);
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall numa=1");
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall numa=off");
+    STXXL_CHECK_EQUAL(cfg.numa_node, stxxl::disk_config::NUMA_OFF);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall");
+    STXXL_CHECK_EQUAL(cfg.numa_node, -1);
+    STXXL_CHECK(cfg.compress.empty());
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall compress=zstd");
+    STXXL_CHECK_EQUAL(cfg.compress, "zstd");
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall compress=zstd");
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , linuxaio discard=on");
+    STXXL_CHECK(cfg.discard);
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "linuxaio discard=on");
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall discard=off");
+    STXXL_CHECK(!cfg.discard);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall tier=/ssd/stxxl.tier tier_size=4GiB tier_policy=lru");
+    STXXL_CHECK_EQUAL(cfg.tier, "/ssd/stxxl.tier");
+    STXXL_CHECK_EQUAL(cfg.tier_size, 4 * 1024 * 1024 * 1024LLU);
+    STXXL_CHECK_EQUAL(cfg.tier_policy, "lru");
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall tier=/ssd/stxxl.tier tier_size=4294967296 tier_policy=lru");
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , linuxaio persistent");
+    STXXL_CHECK(cfg.persistent);
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "linuxaio persistent");
+
     // bad configurations
 
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall numa=x"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall compress=gzip"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, linuxaio compress=lz4"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, memory discard=on"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, memory persistent"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall unlink persistent"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall tier=memory"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall tier=memory tier_size=1GiB tier_policy=fifo"),
+        std::runtime_error
+        );
+
     STXXL_CHECK_THROW(
         cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, wincall_fileperblock unlink direct=on"),
         std::runtime_error
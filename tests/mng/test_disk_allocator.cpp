@@ -0,0 +1,91 @@
+/***************************************************************************
+ *  tests/mng/test_disk_allocator.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/io>
+#include <stxxl/bits/mng/disk_allocator.h>
+
+//! \example mng/test_disk_allocator.cpp
+//! This tests best-fit allocation and coalescing of free regions in
+//! disk_allocator.
+
+using stxxl::int64;
+
+static const unsigned block_size = 1024 * 1024;
+typedef stxxl::BID<block_size> bid_type;
+
+int main()
+{
+    const int64 num_blocks = 64;
+
+    stxxl::mem_file file;
+    stxxl::disk_config cfg("memory", num_blocks * block_size, "memory");
+    cfg.autogrow = false;
+    stxxl::disk_allocator alloc(&file, cfg);
+
+    STXXL_CHECK_EQUAL(alloc.get_free_regions(), 1u);
+    STXXL_CHECK_EQUAL(alloc.get_fragmentation(), 0.0);
+
+    // allocate everything in one request: contiguous
+    stxxl::BIDArray<block_size> bids(num_blocks);
+    alloc.new_blocks(bids);
+    for (int64 i = 0; i < num_blocks; ++i)
+        STXXL_CHECK_EQUAL(bids[i].offset, i * block_size);
+    STXXL_CHECK_EQUAL(alloc.get_free_bytes(), 0);
+    STXXL_CHECK_EQUAL(alloc.get_free_regions(), 0u);
+
+    // free every other block
+    for (int64 i = 0; i < num_blocks; i += 2)
+        alloc.delete_block(bids[i]);
+    STXXL_CHECK_EQUAL(alloc.get_free_regions(), (size_t)num_blocks / 2);
+    STXXL_CHECK_EQUAL(alloc.get_largest_free_region(), block_size);
+    STXXL_CHECK(alloc.get_fragmentation() > 0.9);
+
+    // freeing the blocks in between coalesces with both neighbours
+    alloc.delete_block(bids[1]);
+    STXXL_CHECK_EQUAL(alloc.get_free_regions(), (size_t)num_blocks / 2 - 1);
+    STXXL_CHECK_EQUAL(alloc.get_largest_free_region(), 3 * block_size);
+    alloc.delete_block(bids[3]);
+    STXXL_CHECK_EQUAL(alloc.get_largest_free_region(), 5 * block_size);
+
+    // best fit: a single block goes into a one block hole, not into the
+    // five block region at offset 0
+    bid_type bid;
+    alloc.new_blocks(&bid, &bid + 1);
+    STXXL_CHECK_EQUAL(bid.offset, 6 * block_size);
+
+    // four blocks fit only into the five block region
+    stxxl::BIDArray<block_size> four(4);
+    alloc.new_blocks(four);
+    STXXL_CHECK_EQUAL(four[0].offset, 0);
+    STXXL_CHECK_EQUAL(four[3].offset, 3 * block_size);
+
+    // double deallocation is detected
+    STXXL_CHECK_THROW(alloc.delete_block(bids[10]), stxxl::bad_ext_alloc);
+
+    // a request larger than any free region is split
+    stxxl::BIDArray<block_size> many(8);
+    alloc.new_blocks(many);
+    for (unsigned i = 0; i < many.size(); ++i)
+        STXXL_CHECK(many[i].offset % (2 * block_size) == 0);
+
+    // release everything: one region again
+    alloc.delete_block(bid);
+    for (unsigned i = 0; i < four.size(); ++i)
+        alloc.delete_block(four[i]);
+    for (unsigned i = 0; i < many.size(); ++i)
+        alloc.delete_block(many[i]);
+    for (int64 i = 5; i < num_blocks; i += 2)
+        alloc.delete_block(bids[i]);
+    STXXL_CHECK_EQUAL(alloc.get_free_regions(), 1u);
+    STXXL_CHECK_EQUAL(alloc.get_free_bytes(), num_blocks * block_size);
+    STXXL_CHECK_EQUAL(alloc.get_fragmentation(), 0.0);
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/***************************************************************************
+ *  tests/mng/test_memory_arbiter.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <iostream>
+#include <limits>
+
+#include <stxxl/map>
+#include <stxxl/mng>
+#include <stxxl/random>
+#include <stxxl/unordered_map>
+#include <stxxl/vector>
+
+//! \example mng/test_memory_arbiter.cpp
+//! This tests the process-wide memory budget: caches of containers shrink when
+//! other components need memory and grow again when it is free.
+
+typedef stxxl::memory_arbiter::usage usage_type;
+
+static const stxxl::uint64 MiB = 1024 * 1024;
+
+//! current usage of the components with the given name
+static usage_type get_usage(const std::string& name)
+{
+    std::vector<usage_type> usages = stxxl::memory_arbiter::get_instance()->get_usage();
+    for (size_t i = 0; i < usages.size(); ++i)
+        if (usages[i].name == name)
+            return usages[i];
+    return usage_type();
+}
+
+void test_consumers()
+{
+    stxxl::memory_arbiter* arbiter = stxxl::memory_arbiter::get_instance();
+    arbiter->set_limit(10 * MiB);
+
+    stxxl::memory_consumer cache("test_cache", true);
+    stxxl::memory_consumer fixed("test_fixed");
+
+    // growing is limited to the free memory
+    STXXL_CHECK_EQUAL(cache.request(8 * MiB), 8 * MiB);
+    STXXL_CHECK_EQUAL(cache.request(8 * MiB), 2 * MiB);
+    STXXL_CHECK_EQUAL(cache.granted(), 10 * MiB);
+    STXXL_CHECK_EQUAL(arbiter->get_free(), 0);
+    STXXL_CHECK_EQUAL(cache.reclaim(), 0);
+
+    // a reservation is granted and reclaimed from the cache
+    fixed.reserve(4 * MiB);
+    STXXL_CHECK_EQUAL(fixed.granted(), 4 * MiB);
+    STXXL_CHECK_EQUAL(cache.reclaim(), 4 * MiB);
+    STXXL_CHECK_EQUAL(get_usage("test_cache").reclaim, 4 * MiB);
+
+    cache.release(3 * MiB);
+    STXXL_CHECK_EQUAL(cache.reclaim(), 1 * MiB);
+    cache.release(1 * MiB);
+    STXXL_CHECK_EQUAL(cache.reclaim(), 0);
+    STXXL_CHECK_EQUAL(arbiter->get_granted(), 10 * MiB);
+
+    // releasing the reservation clears the reclaim requests
+    fixed.reserve(1 * MiB);
+    STXXL_CHECK_EQUAL(cache.reclaim(), 1 * MiB);
+    fixed.release_all();
+    STXXL_CHECK_EQUAL(cache.reclaim(), 0);
+    STXXL_CHECK_EQUAL(arbiter->get_free(), 4 * MiB);
+
+    usage_type u = get_usage("test_cache");
+    STXXL_CHECK_EQUAL(u.count, 1);
+    STXXL_CHECK_EQUAL(u.granted, 6 * MiB);
+    STXXL_CHECK_EQUAL(u.peak, 10 * MiB);
+
+    cache.release_all();
+    arbiter->set_limit(0);
+}
+
+void test_vector()
+{
+    typedef stxxl::VECTOR_GENERATOR<stxxl::uint64, 4, 8, 64 * 1024>::result vector_type;
+    const stxxl::uint64 page_bytes = 4 * 64 * 1024;
+    const stxxl::uint64 num_elements = 32 * MiB / sizeof(stxxl::uint64);
+
+    stxxl::memory_arbiter* arbiter = stxxl::memory_arbiter::get_instance();
+    arbiter->set_limit(4 * MiB);
+
+    vector_type v(num_elements);
+    for (stxxl::uint64 i = 0; i < num_elements; ++i)
+        v[i] = i;
+
+    STXXL_CHECK_EQUAL(get_usage("vector").granted, 8 * page_bytes);
+
+    stxxl::random_number32 rnd;
+    {
+        // take 3 MiB: the vector is asked to return 1 MiB at its next fault
+        stxxl::memory_consumer other("test_other");
+        other.reserve(3 * MiB);
+        STXXL_CHECK_EQUAL(get_usage("vector").reclaim, 1 * MiB);
+
+        // shrinking the cache evicts the least recently used pages only, a
+        // reference into the page used last stays valid
+        stxxl::uint64& ref = v[0];
+        STXXL_CHECK_EQUAL(v[num_elements - 1], num_elements - 1);
+        STXXL_CHECK_EQUAL(get_usage("vector").granted, 4 * page_bytes);
+        ref = 42;
+        STXXL_CHECK_EQUAL(v[0], 42u);
+        v[0] = 0;
+
+        for (unsigned i = 0; i < 1000; ++i) {
+            stxxl::uint64 j = rnd() % num_elements;
+            STXXL_CHECK_EQUAL(v[j], j);
+        }
+
+        usage_type u = get_usage("vector");
+        STXXL_CHECK_EQUAL(u.granted, 4 * page_bytes);
+        STXXL_CHECK_EQUAL(u.reclaim, 0);
+        STXXL_CHECK(arbiter->get_granted() <= 4 * MiB);
+
+        stxxl::memory_arbiter::get_instance()->print_usage(std::cout);
+    }
+
+    // the memory is free again, the vector grows back after some faults
+    // without moving the page kept in use
+    stxxl::uint64& ref = v[0];
+    for (unsigned i = 0; i < 1000; ++i) {
+        stxxl::uint64 j = rnd() % num_elements;
+        STXXL_CHECK_EQUAL(v[j], j);
+        STXXL_CHECK_EQUAL(v[0], 0u);
+    }
+    STXXL_CHECK_EQUAL(get_usage("vector").granted, 8 * page_bytes);
+    ref = 42;
+    STXXL_CHECK_EQUAL(v[0], 42u);
+    v[0] = 0;
+
+    arbiter->set_limit(0);
+}
+
+struct hash_int
+{
+    size_t operator () (int key) const
+    {
+        return (size_t)(key * 2654435761u);
+    }
+};
+
+struct cmp_int : public std::less<int>
+{
+    static int min_value() { return std::numeric_limits<int>::min(); }
+    static int max_value() { return std::numeric_limits<int>::max(); }
+};
+
+void test_caches()
+{
+    typedef stxxl::map<int, int, cmp_int, 4096, 4096> map_type;
+
+    typedef stxxl::unordered_map<int, int, hash_int, cmp_int, 4096, 4> hash_map_type;
+
+    stxxl::memory_arbiter* arbiter = stxxl::memory_arbiter::get_instance();
+
+    map_type map(16 * 4096, 16 * 4096);
+    hash_map_type hash_map;
+    const int n = 100000;
+    for (int i = 0; i < n; ++i)
+        map[i] = i;
+
+    usage_type u = get_usage("btree::node_cache");
+    STXXL_CHECK_EQUAL(u.count, 2);
+    STXXL_CHECK_EQUAL(u.granted, 32 * 4096);
+    STXXL_CHECK(get_usage("hash_map::block_cache").granted > 0);
+
+    {
+        // leave no room for the node caches
+        arbiter->set_limit(arbiter->get_granted());
+        stxxl::memory_consumer other("test_other");
+        other.reserve(16 * 4096);
+        STXXL_CHECK(get_usage("btree::node_cache").reclaim > 0);
+
+        for (int i = 0; i < n; i += 7)
+            STXXL_CHECK_EQUAL(map[i], i);
+        STXXL_CHECK(get_usage("btree::node_cache").granted < 32 * 4096);
+    }
+    arbiter->set_limit(0);
+
+    for (int i = 0; i < n; ++i)
+        STXXL_CHECK_EQUAL(map[i], i);
+
+    hash_map.insert(std::make_pair(1, 2));
+    STXXL_CHECK_EQUAL(hash_map.find(1)->second, 2);
+}
+
+int main()
+{
+    test_consumers();
+    test_vector();
+    test_caches();
+
+    return 0;
+}
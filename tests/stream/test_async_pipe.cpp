@@ -0,0 +1,157 @@
+/***************************************************************************
+ *  tests/stream/test_async_pipe.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example stream/test_async_pipe.cpp
+//! This tests stream::async_pipe: a pipeline of two sorts, where the merging
+//! of the first sort runs on a separate thread concurrently to the run
+//! formation of the second.
+
+#include <limits>
+#include <stdexcept>
+
+#include <stxxl/stream>
+#include <stxxl/random>
+
+typedef stxxl::uint64 value_type;
+
+struct cmp_less : public std::less<value_type>
+{
+    value_type min_value() const
+    {
+        return std::numeric_limits<value_type>::min();
+    }
+    value_type max_value() const
+    {
+        return std::numeric_limits<value_type>::max();
+    }
+};
+
+struct cmp_greater : public std::greater<value_type>
+{
+    value_type min_value() const
+    {
+        return std::numeric_limits<value_type>::max();
+    }
+    value_type max_value() const
+    {
+        return std::numeric_limits<value_type>::min();
+    }
+};
+
+//! generates pseudo-random numbers
+struct random_stream
+{
+    typedef stxxl::uint64 value_type;
+
+    value_type state;
+    value_type count;
+
+    random_stream(value_type n)
+        : state(42), count(n)
+    { }
+
+    const value_type& operator * () const
+    {
+        return state;
+    }
+
+    random_stream& operator ++ ()
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        --count;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+};
+
+//! throws after some elements
+struct failing_stream : public random_stream
+{
+    failing_stream(value_type n) : random_stream(n) { }
+
+    failing_stream& operator ++ ()
+    {
+        random_stream::operator ++ ();
+        if (count == 1000)
+            throw std::runtime_error("failing_stream");
+        return *this;
+    }
+};
+
+int main()
+{
+    const stxxl::unsigned_type memory = 64 * 1024 * 1024;
+    const value_type n = 8 * 1024 * 1024;
+
+    {
+        // elements are passed on in order, with small blocks
+        random_stream input(12345);
+        stxxl::stream::async_pipe<random_stream> pipe(input, 100 * sizeof(value_type), 2);
+
+        random_stream check(12345);
+        for ( ; !pipe.empty(); ++pipe, ++check)
+            STXXL_CHECK_EQUAL(*pipe, *check);
+        STXXL_CHECK(check.empty());
+    }
+
+    {
+        // sort ascending, then pipe into sort descending
+        typedef stxxl::stream::sort<random_stream, cmp_less> sort_up_type;
+        typedef stxxl::stream::async_pipe<sort_up_type> pipe_type;
+        typedef stxxl::stream::sort<pipe_type, cmp_greater> sort_down_type;
+
+        random_stream input(n);
+        sort_up_type sort_up(input, cmp_less(), memory);
+
+        value_type last = std::numeric_limits<value_type>::max(), count = 0;
+        {
+            pipe_type pipe(sort_up);
+            sort_down_type sort_down(pipe, cmp_greater(), memory);
+
+            for ( ; !sort_down.empty(); ++sort_down, ++count)
+            {
+                STXXL_CHECK(*sort_down <= last);
+                last = *sort_down;
+            }
+        }
+        STXXL_CHECK_EQUAL(count, n);
+    }
+
+    {
+        // destroying the pipe before the input is empty stops the thread
+        random_stream input(n);
+        stxxl::stream::async_pipe<random_stream> pipe(input, 4096, 2);
+        for (int i = 0; i < 100; ++i)
+            ++pipe;
+        STXXL_CHECK(!pipe.empty());
+    }
+
+    {
+        // exceptions are passed on to the consumer
+        failing_stream input(n);
+        stxxl::stream::async_pipe<failing_stream> pipe(input, 4096, 2);
+
+        bool caught = false;
+        try {
+            while (!pipe.empty())
+                ++pipe;
+        }
+        catch (std::runtime_error&) {
+            caught = true;
+        }
+        STXXL_CHECK(caught);
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *  tests/stream/test_bulk_pull.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example stream/test_bulk_pull.cpp
+//! This tests the bulk stream protocol stream::pull() with the native bulk
+//! methods of vector_iterator2stream, transform, sort and async_pipe, and its
+//! element-wise fallback, mixed with element-wise access.
+
+#include <limits>
+#include <vector>
+
+#include <stxxl/stream>
+#include <stxxl/vector>
+
+typedef stxxl::uint64 value_type;
+typedef stxxl::VECTOR_GENERATOR<value_type, 2, 2, 64* 1024>::result vector_type;
+
+struct cmp_less : public std::less<value_type>
+{
+    value_type min_value() const
+    {
+        return std::numeric_limits<value_type>::min();
+    }
+    value_type max_value() const
+    {
+        return std::numeric_limits<value_type>::max();
+    }
+};
+
+struct times_three
+{
+    typedef stxxl::uint64 value_type;
+
+    value_type operator () (const value_type& v) const
+    {
+        return 3 * v;
+    }
+};
+
+//! pull the whole stream, alternating bulk and element-wise access with
+//! varying chunk sizes
+template <class Stream>
+std::vector<value_type> pull_all(Stream& s)
+{
+    std::vector<value_type> res, buf(5000);
+    for (stxxl::unsigned_type round = 0; !s.empty(); ++round)
+    {
+        if (round % 3 == 2) {
+            res.push_back(*s);
+            ++s;
+            continue;
+        }
+        const stxxl::unsigned_type max = (round * 997) % buf.size() + 1;
+        const stxxl::unsigned_type n = stxxl::stream::pull(s, &buf[0], max);
+        STXXL_CHECK(n == max || s.empty());
+        res.insert(res.end(), buf.begin(), buf.begin() + n);
+    }
+    STXXL_CHECK_EQUAL(stxxl::stream::pull(s, &buf[0], buf.size()), (stxxl::unsigned_type)0);
+    return res;
+}
+
+int main()
+{
+    STXXL_CHECK(stxxl::stream::has_bulk_pull<stxxl::stream::vector_iterator2stream<vector_type::iterator> >::value);
+    STXXL_CHECK(!stxxl::stream::has_bulk_pull<stxxl::stream::counter<value_type> >::value);
+
+    const stxxl::unsigned_type n = 300000;
+    vector_type v(n);
+    for (stxxl::unsigned_type i = 0; i < n; ++i)
+        v[i] = (i * 7919) % n;
+
+    // native: vector_iterator2stream, starting in the middle of a block
+    {
+        stxxl::stream::vector_iterator2stream<vector_type::iterator> s(v.begin() + 1234, v.end());
+        std::vector<value_type> res = pull_all(s);
+        STXXL_CHECK_EQUAL(res.size(), n - 1234);
+        for (stxxl::unsigned_type i = 0; i < res.size(); ++i)
+            STXXL_CHECK_EQUAL(res[i], v[1234 + i]);
+    }
+
+    // fallback: iterator2stream
+    {
+        std::vector<value_type> in(12345);
+        for (stxxl::unsigned_type i = 0; i < in.size(); ++i)
+            in[i] = i * i;
+        stxxl::stream::iterator2stream<std::vector<value_type>::const_iterator> s(in.begin(), in.end());
+        STXXL_CHECK(pull_all(s) == in);
+    }
+
+    // native: transform
+    {
+        stxxl::stream::vector_iterator2stream<vector_type::iterator> s(v.begin(), v.end());
+        times_three op;
+        stxxl::stream::transform<times_three, stxxl::stream::vector_iterator2stream<vector_type::iterator> > t(op, s);
+        std::vector<value_type> res = pull_all(t);
+        STXXL_CHECK_EQUAL(res.size(), n);
+        for (stxxl::unsigned_type i = 0; i < n; ++i)
+            STXXL_CHECK_EQUAL(res[i], 3 * v[i]);
+    }
+
+    // native: sort, through async_pipe
+    {
+        stxxl::stream::vector_iterator2stream<vector_type::iterator> s(v.begin(), v.end());
+        typedef stxxl::stream::sort<stxxl::stream::vector_iterator2stream<vector_type::iterator>, cmp_less> sort_type;
+        sort_type sorted(s, cmp_less(), 16 * 1024 * 1024);
+        stxxl::stream::async_pipe<sort_type> pipe(sorted, 10000 * sizeof(value_type), 2);
+        std::vector<value_type> res = pull_all(pipe);
+        STXXL_CHECK_EQUAL(res.size(), n);
+        for (stxxl::unsigned_type i = 0; i < n; ++i)
+            STXXL_CHECK_EQUAL(res[i], i);
+    }
+
+    // materialize with bulk pull into a vector range, not block aligned
+    {
+        vector_type out(n);
+        stxxl::stream::vector_iterator2stream<vector_type::iterator> s(v.begin(), v.end());
+        times_three op;
+        stxxl::stream::transform<times_three, stxxl::stream::vector_iterator2stream<vector_type::iterator> > t(op, s);
+
+        vector_type::iterator end = stxxl::stream::materialize(t, out.begin() + 100, out.end() - 100);
+        STXXL_CHECK(end == out.end() - 100);
+        STXXL_CHECK(!t.empty());
+        for (stxxl::unsigned_type i = 0; i < n - 200; ++i)
+            STXXL_CHECK_EQUAL(out[100 + i], 3 * v[i]);
+
+        end = stxxl::stream::materialize(t, out.begin());
+        STXXL_CHECK(end == out.begin() + 200);
+        STXXL_CHECK(t.empty());
+    }
+
+    // materialize with element-wise fallback and value conversion
+    {
+        stxxl::VECTOR_GENERATOR<double>::result out(n);
+        stxxl::stream::vector_iterator2stream<vector_type::iterator> s(v.begin(), v.end());
+        stxxl::stream::materialize(s, out.begin(), out.end());
+        for (stxxl::unsigned_type i = 0; i < n; ++i)
+            STXXL_CHECK_EQUAL(out[i], (double)v[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/***************************************************************************
+ *  tests/stream/test_overlap_run_formation.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example stream/test_overlap_run_formation.cpp
+//! This tests the run formation of stream::sort and stxxl::sorter with the
+//! runs sorted on a separate thread, forced by STXXL_OVERLAP_RUN_FORMATION=1
+//! also on single core machines, and compares it with the inline mode.
+
+#include <cstdlib>
+#include <limits>
+#include <stxxl/sorter>
+#include <stxxl/stream>
+
+typedef stxxl::uint64 value_type;
+
+static const unsigned block_size = 64 * 1024;
+static const stxxl::unsigned_type memory_to_use = 3 * 1024 * 1024;
+static const stxxl::uint64 num_elements = 1024 * 1024;
+
+struct value_cmp : public std::less<value_type>
+{
+    value_type min_value() const
+    {
+        return std::numeric_limits<value_type>::min();
+    }
+    value_type max_value() const
+    {
+        return std::numeric_limits<value_type>::max();
+    }
+};
+
+//! generates count pseudo random numbers
+struct random_stream
+{
+    typedef stxxl::uint64 value_type;
+
+    value_type m_state;
+    stxxl::uint64 m_index, m_count;
+
+    random_stream(stxxl::uint64 count, value_type seed)
+        : m_state(seed), m_index(0), m_count(count)
+    {
+        ++*this;
+    }
+
+    const value_type& operator * () const
+    {
+        return m_state;
+    }
+
+    random_stream& operator ++ ()
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        m_state ^= m_state >> 29;
+        ++m_index;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return m_index > m_count;
+    }
+};
+
+//! sum of the elements of an input
+static value_type checksum(stxxl::uint64 count, value_type seed)
+{
+    value_type sum = 0;
+    for (random_stream input(count, seed); !input.empty(); ++input)
+        sum += *input;
+    return sum;
+}
+
+//! check that a stream is sorted and holds the elements of the input
+template <class Stream>
+static void check_sorted(Stream& s, stxxl::uint64 count, value_type seed)
+{
+    value_type sum = 0, prev = 0;
+    stxxl::uint64 n = 0;
+    for ( ; !s.empty(); ++s, ++n)
+    {
+        STXXL_CHECK(prev <= *s);
+        prev = *s;
+        sum += *s;
+    }
+    STXXL_CHECK_EQUAL(n, count);
+    STXXL_CHECK_EQUAL(sum, checksum(count, seed));
+}
+
+typedef stxxl::stream::runs_creator<random_stream, value_cmp, block_size> runs_creator_type;
+typedef stxxl::stream::run_pipeline<runs_creator_type::sorted_runs_data_type,
+                                    value_cmp, STXXL_DEFAULT_ALLOC_STRATEGY> run_pipeline_type;
+
+//! number of runs formed from the input
+static stxxl::unsigned_type count_runs()
+{
+    random_stream input(num_elements, 1);
+    runs_creator_type creator(input, value_cmp(), memory_to_use);
+    STXXL_CHECK_EQUAL(creator.result()->elements, num_elements);
+    return creator.result()->runs.size();
+}
+
+int main()
+{
+    static char overlap_off[] = "STXXL_OVERLAP_RUN_FORMATION=0";
+    static char overlap_on[] = "STXXL_OVERLAP_RUN_FORMATION=1";
+
+    // runs are a half of the memory inline, a third with overlap
+    putenv(overlap_off);
+    STXXL_CHECK(!run_pipeline_type(value_cmp(), 3).overlapped());
+    const stxxl::unsigned_type inline_runs = count_runs();
+
+    putenv(overlap_on);
+    STXXL_CHECK(run_pipeline_type(value_cmp(), 3).overlapped());
+    const stxxl::unsigned_type overlap_runs = count_runs();
+
+    STXXL_MSG("runs inline: " << inline_runs << " overlapped: " << overlap_runs);
+    STXXL_CHECK(overlap_runs > inline_runs);
+
+    // stream::sort
+    {
+        random_stream input(num_elements, 2);
+        stxxl::stream::sort<random_stream, value_cmp, block_size> sorted(
+            input, value_cmp(), memory_to_use);
+        check_sorted(sorted, num_elements, 2);
+    }
+
+    typedef stxxl::sorter<value_type, value_cmp, block_size> sorter_type;
+
+    // sorter, cleared while runs are being sorted
+    {
+        sorter_type sorter(value_cmp(), memory_to_use);
+
+        for (random_stream input(num_elements / 2, 3); !input.empty(); ++input)
+            sorter.push(*input);
+        sorter.clear();
+
+        for (random_stream input(num_elements, 4); !input.empty(); ++input)
+            sorter.push(*input);
+        sorter.sort();
+        check_sorted(sorter, num_elements, 4);
+
+        // and reused after sorting
+        sorter.clear();
+        for (random_stream input(num_elements / 3, 5); !input.empty(); ++input)
+            sorter.push(*input);
+        sorter.sort();
+        check_sorted(sorter, num_elements / 3, 5);
+    }
+
+    // sorter destroyed in the middle of the input
+    {
+        sorter_type sorter(value_cmp(), memory_to_use);
+        for (random_stream input(num_elements / 2, 6); !input.empty(); ++input)
+            sorter.push(*input);
+    }
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+/***************************************************************************
+ *  tests/stream/test_replacement_selection.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example stream/test_replacement_selection.cpp
+//! This tests run formation by replacement selection on random, nearly sorted
+//! and reverse sorted input, in stream::sort and in stxxl::sorter.
+
+#include <limits>
+
+#include <stxxl/stream>
+#include <stxxl/sorter>
+
+typedef stxxl::uint64 value_type;
+
+static const unsigned block_size = 64 * 1024;
+
+struct cmp_less : public std::less<value_type>
+{
+    value_type min_value() const
+    {
+        return std::numeric_limits<value_type>::min();
+    }
+    value_type max_value() const
+    {
+        return std::numeric_limits<value_type>::max();
+    }
+};
+
+//! generates random, nearly sorted or reverse sorted numbers
+struct input_stream
+{
+    typedef stxxl::uint64 value_type;
+
+    enum order_type { random, nearly_sorted, reverse };
+
+    order_type order;
+    value_type state;
+    value_type i, count;
+
+    input_stream(order_type o, value_type n)
+        : order(o), state(42), i(0), count(n)
+    { }
+
+    value_type operator * () const
+    {
+        switch (order)
+        {
+        case random:
+            return state;
+        case nearly_sorted:
+            return 16 * i + state % 1024;
+        default:
+            return count - i;
+        }
+    }
+
+    input_stream& operator ++ ()
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        state ^= state >> 29;
+        ++i;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return i == count;
+    }
+};
+
+typedef stxxl::stream::replacement_selection_runs_creator<
+        input_stream, cmp_less, block_size> runs_creator_type;
+typedef stxxl::stream::runs_merger<
+        runs_creator_type::sorted_runs_type, cmp_less> runs_merger_type;
+
+//! check that the runs merge to the sorted input, return the number of runs
+stxxl::unsigned_type check_runs(input_stream::order_type order, value_type n,
+                                stxxl::unsigned_type memory)
+{
+    input_stream input(order, n);
+    runs_creator_type creator(input, cmp_less(), memory);
+    runs_creator_type::sorted_runs_type runs = creator.result();
+
+    STXXL_CHECK(stxxl::stream::check_sorted_runs(runs, cmp_less()));
+    STXXL_CHECK_EQUAL(runs->elements, n);
+    const stxxl::unsigned_type num_runs = runs->runs.size();
+
+    runs_merger_type merger(runs, cmp_less(), memory);
+    value_type count = 0, last = 0, sum = 0, check_sum = 0;
+    for ( ; !merger.empty(); ++merger, ++count)
+    {
+        STXXL_CHECK(*merger >= last);
+        last = *merger;
+        sum += *merger;
+    }
+    for (input_stream check(order, n); !check.empty(); ++check)
+        check_sum += *check;
+
+    STXXL_CHECK_EQUAL(count, n);
+    STXXL_CHECK_EQUAL(sum, check_sum);
+    return num_runs;
+}
+
+int main()
+{
+    const stxxl::unsigned_type memory = 16 * 1024 * 1024;
+    const value_type memory_elements = memory / stxxl::sort_memory_usage_factor() / sizeof(value_type);
+    const value_type n = 8 * memory_elements;
+
+    {
+        // random input: runs are longer than the memory
+        stxxl::unsigned_type runs = check_runs(input_stream::random, n, memory);
+        STXXL_MSG("random input: " << runs << " runs");
+        STXXL_CHECK(runs < 8);
+    }
+    {
+        // nearly sorted input: a single run
+        stxxl::unsigned_type runs = check_runs(input_stream::nearly_sorted, n, memory);
+        STXXL_MSG("nearly sorted input: " << runs << " runs");
+        STXXL_CHECK_EQUAL(runs, 1u);
+    }
+    {
+        // reverse input: runs as long as the workspace
+        stxxl::unsigned_type runs = check_runs(input_stream::reverse, n, memory);
+        STXXL_MSG("reverse input: " << runs << " runs");
+        STXXL_CHECK(runs >= 8);
+    }
+    {
+        // small input is kept in memory
+        STXXL_CHECK_EQUAL(check_runs(input_stream::random, 1000, memory), 0u);
+        STXXL_CHECK_EQUAL(check_runs(input_stream::random, 0, memory), 0u);
+        STXXL_CHECK_EQUAL(check_runs(input_stream::random, block_size / sizeof(value_type), memory), 1u);
+    }
+    {
+        // in stream::sort
+        typedef stxxl::stream::sort<input_stream, cmp_less, block_size,
+                                    STXXL_DEFAULT_ALLOC_STRATEGY, runs_creator_type> sort_type;
+
+        input_stream input(input_stream::reverse, n / 2);
+        sort_type sorted(input, cmp_less(), memory);
+        for (value_type i = 1; i <= n / 2; ++i, ++sorted)
+            STXXL_CHECK_EQUAL(*sorted, i);
+        STXXL_CHECK(sorted.empty());
+    }
+    {
+        // in stxxl::sorter, with clear() and rewind()
+        typedef stxxl::stream::replacement_selection_runs_creator<
+                stxxl::stream::use_push<value_type>, cmp_less, block_size> push_creator_type;
+        typedef stxxl::sorter<value_type, cmp_less, block_size,
+                              STXXL_DEFAULT_ALLOC_STRATEGY, push_creator_type> sorter_type;
+
+        sorter_type sorter(cmp_less(), memory);
+        for (value_type round = 0; round < 2; ++round)
+        {
+            const value_type size = round ? 100 : n / 2;
+            for (input_stream input(input_stream::reverse, size); !input.empty(); ++input)
+                sorter.push(*input);
+            STXXL_CHECK_EQUAL(sorter.size(), size);
+
+            sorter.sort();
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (value_type i = 1; i <= size; ++i, ++sorter)
+                    STXXL_CHECK_EQUAL(*sorter, i);
+                STXXL_CHECK(sorter.empty());
+                sorter.rewind();
+            }
+            sorter.clear();
+        }
+    }
+
+    return 0;
+}
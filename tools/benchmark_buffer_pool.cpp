@@ -0,0 +1,260 @@
+/***************************************************************************
+ *  tools/benchmark_buffer_pool.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   This benchmark compares block buffers from aligned_alloc() with buffers
+   from a block_buffer_pool backed by normal pages, transparent huge pages and
+   hugetlbfs pages. Each round allocates the given amount of memory as blocks,
+   fills them sequentially like run formation does, reads random words from
+   all blocks like merging many runs does, and frees the blocks again. For
+   each variant it prints the times of the phases, the minor page faults and,
+   if the perf events are accessible, the dTLB read misses.
+ */
+
+#include <cstring>
+#include <iomanip>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/cmdline>
+#include <stxxl/bits/common/timer.h>
+
+#if STXXL_HAVE_MMAP_FILE
+ #include <sys/resource.h>
+#endif
+#if defined(__linux__)
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+using stxxl::block_buffer_pool;
+using stxxl::timestamp;
+using stxxl::uint64;
+
+//! minor page faults of the process so far
+static uint64 minor_faults()
+{
+#if STXXL_HAVE_MMAP_FILE
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+#else
+    return 0;
+#endif
+}
+
+//! counts dTLB read misses of this thread with perf_event_open(), if allowed
+class tlb_counter
+{
+    int fd;
+
+public:
+    tlb_counter()
+        : fd(-1)
+    {
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~tlb_counter()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64 stop()
+    {
+        uint64 count = 0;
+#if defined(__linux__)
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+};
+
+//! results of one variant
+struct result_type
+{
+    double fill_time, random_time;
+    uint64 faults, tlb_misses;
+};
+
+static void run_variant(const std::string& name, block_buffer_pool* pool,
+                        uint64 size, uint64 block_size, unsigned rounds,
+                        uint64 reads, bool have_tlb)
+{
+    const uint64 num_blocks = size / block_size;
+    const uint64 words = block_size / sizeof(uint64);
+
+    std::vector<uint64*> blocks(num_blocks);
+    tlb_counter tlb;
+
+    result_type res = { 0, 0, 0, 0 };
+    uint64 checksum = 0;
+
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        uint64 faults = minor_faults();
+
+        for (uint64 i = 0; i < num_blocks; ++i) {
+            void* p = pool ? pool->allocate(block_size) : NULL;
+            blocks[i] = (uint64*)(p ? p : stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(block_size));
+        }
+
+        // fill sequentially
+        double start = timestamp();
+        for (uint64 i = 0; i < num_blocks; ++i)
+            for (uint64 j = 0; j < words; ++j)
+                blocks[i][j] = i * words + j;
+        res.fill_time += timestamp() - start;
+
+        // read randomly, positions from a cheap xorshift generator
+        uint64 state = 88172645463325252ull + r;
+        tlb.start();
+        start = timestamp();
+        for (uint64 k = 0; k < reads; ++k) {
+            state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+            uint64 pos = state % (num_blocks * words);
+            checksum += blocks[pos / words][pos % words];
+        }
+        res.random_time += timestamp() - start;
+        res.tlb_misses += tlb.stop();
+
+        for (uint64 i = 0; i < num_blocks; ++i) {
+            if (pool && pool->contains(blocks[i]))
+                pool->deallocate(blocks[i]);
+            else
+                stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(blocks[i]);
+        }
+
+        res.faults += minor_faults() - faults;
+    }
+
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::fixed << std::setprecision(3)
+              << std::setw(12) << res.fill_time / rounds
+              << std::setw(12) << res.random_time / rounds
+              << std::setw(14) << res.faults / rounds;
+    if (have_tlb && tlb.available())
+        std::cout << std::setw(14) << res.tlb_misses / rounds;
+    else
+        std::cout << std::setw(14) << "n/a";
+    std::cout << "   (checksum " << (checksum & 0xFFFF) << ")" << std::endl;
+}
+
+int benchmark_buffer_pool(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Compare block buffers from aligned_alloc() with a pre-faulted "
+        "block_buffer_pool backed by normal, transparent huge and hugetlbfs "
+        "pages: time to fill and to randomly read the blocks, minor page "
+        "faults and dTLB misses per round.");
+
+    uint64 size = 1024 * 1024 * 1024;
+    cp.add_bytes('s', "size", size,
+                 "Memory allocated per round, default: 1 GiB.");
+
+    uint64 block_size = 2 * 1024 * 1024;
+    cp.add_bytes('b', "block_size", block_size,
+                 "Size of the blocks, default: 2 MiB.");
+
+    unsigned int rounds = 4;
+    cp.add_uint('r', "rounds", rounds,
+                "Number of allocate/fill/read/free rounds, default: 4.");
+
+    uint64 reads = 16 * 1024 * 1024;
+    cp.add_bytes('n', "reads", reads,
+                 "Number of random reads per round, default: 16 Mi.");
+
+    bool lock = false;
+    cp.add_flag('l', "mlock", lock,
+                "Lock the pools into memory.");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    if (block_size < sizeof(uint64) || size < block_size || rounds == 0) {
+        cp.print_usage();
+        return -1;
+    }
+
+    tlb_counter probe;
+    if (!probe.available())
+        STXXL_MSG("dTLB miss counter is not accessible, check /proc/sys/kernel/perf_event_paranoid.");
+
+    std::cout << std::left << std::setw(10) << "variant" << std::right
+              << std::setw(12) << "fill [s]"
+              << std::setw(12) << "random [s]"
+              << std::setw(14) << "page faults"
+              << std::setw(14) << "dTLB misses" << std::endl;
+
+    run_variant("malloc", NULL, size, block_size, rounds, reads, probe.available());
+
+    static const block_buffer_pool::page_type pages[] = {
+        block_buffer_pool::PAGES_NORMAL,
+        block_buffer_pool::PAGES_THP,
+        block_buffer_pool::PAGES_HUGETLB
+    };
+
+    for (size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i)
+    {
+        block_buffer_pool pool(size, pages[i], true, lock);
+        if (!pool.enabled())
+            continue;
+
+        // a hugetlb pool may have fallen back to other pages
+        if (pool.get_pages() != pages[i]) {
+            STXXL_MSG("Skipping " << block_buffer_pool::pages_name(pages[i]) << " pages, which are not available.");
+            continue;
+        }
+
+        run_variant(block_buffer_pool::pages_name(pages[i]), &pool,
+                    size, block_size, rounds, reads, probe.available());
+    }
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,225 @@
+/***************************************************************************
+ *  tools/benchmark_discard.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   This benchmark simulates a long-running workload which keeps a file filled
+   to a given degree: each round writes a batch of blocks into random free
+   slots and then frees as many random occupied slots, like the runs of large
+   sorts. It is run with and without file::DISCARD, so freed slots are either
+   released to the file system / SSD via hole punching (or BLKDISCARD on raw
+   devices) or left as dead data. On SSDs the sustained write throughput
+   shows the cost of the garbage collection copying dead data.
+
+   example gnuplot command for the output of this program:
+   (x-axis: round, y-axis: write bandwidth in MiB/s)
+
+   plot \
+        "< grep 'discard on' discard.log" using 5:7 w l title "discard", \
+        "< grep 'discard off' discard.log" using 5:7 w l title "no discard"
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <cstring>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/cmdline>
+#include <stxxl/bits/common/rand.h>
+
+#if !STXXL_WINDOWS
+ #include <sys/types.h>
+ #include <sys/stat.h>
+#endif
+
+using stxxl::request_ptr;
+using stxxl::file;
+using stxxl::timestamp;
+using stxxl::uint64;
+
+#define MiB (1024 * 1024)
+
+//! bytes allocated by the file system for path, 0 if unknown
+static uint64 allocated_bytes(const std::string& path)
+{
+#if !STXXL_WINDOWS
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        return (uint64)st.st_blocks * 512;
+#else
+    STXXL_UNUSED(path);
+#endif
+    return 0;
+}
+
+static double run_discard(const std::string& io_impl, const std::string& path,
+                          uint64 span, uint64 block_size, unsigned rounds,
+                          unsigned fill, bool discard)
+{
+    const size_t bs = (size_t)block_size;
+    const size_t slots = (size_t)(span / block_size);
+    const size_t occupied_max = slots * fill / 100;
+    const size_t batch = std::max<size_t>(1, slots / 16);
+
+    int mode = file::CREAT | file::RDWR | file::DIRECT | file::TRUNC;
+    if (discard) mode |= file::DISCARD;
+
+    file* f = stxxl::create_file(io_impl, path, mode);
+    f->set_size(slots * block_size);
+
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(batch * bs);
+    for (size_t i = 0; i < batch * bs; ++i)
+        buffer[i] = (char)i;
+
+    std::vector<size_t> free_slots(slots), used_slots;
+    for (size_t i = 0; i < slots; ++i)
+        free_slots[i] = i;
+
+    stxxl::random_number32_r rnd(12345);
+    std::vector<request_ptr> reqs(batch);
+    std::vector<size_t> freed;
+
+    double sustained = 0.0;
+    unsigned sustained_rounds = 0;
+
+    for (unsigned round = 0; round < rounds; ++round)
+    {
+        // write a batch of blocks into random free slots
+        double begin = timestamp();
+        size_t n = 0;
+        for ( ; n < batch && !free_slots.empty(); ++n)
+        {
+            size_t j = rnd() % free_slots.size();
+            size_t slot = free_slots[j];
+            free_slots[j] = free_slots.back();
+            free_slots.pop_back();
+            used_slots.push_back(slot);
+
+            reqs[n] = f->awrite(buffer + n * bs, slot * block_size, bs);
+        }
+        stxxl::wait_all(reqs.begin(), reqs.begin() + n);
+        double elapsed = timestamp() - begin;
+        double rate = (double)(n * bs) / MiB / elapsed;
+
+        // rounds after the file was filled once are sustained throughput
+        if (used_slots.size() >= occupied_max) {
+            sustained += rate;
+            ++sustained_rounds;
+        }
+
+        // free random slots down to the fill degree, adjacent slots are
+        // discarded with one call like block_manager::delete_blocks() does
+        freed.clear();
+        while (used_slots.size() > occupied_max)
+        {
+            size_t j = rnd() % used_slots.size();
+            freed.push_back(used_slots[j]);
+            used_slots[j] = used_slots.back();
+            used_slots.pop_back();
+        }
+        std::sort(freed.begin(), freed.end());
+
+        size_t discards = 0;
+        for (size_t i = 0; i < freed.size(); )
+        {
+            size_t k = i + 1;
+            while (k < freed.size() && freed[k] == freed[k - 1] + 1) ++k;
+            f->discard(freed[i] * block_size, (k - i) * block_size);
+            ++discards;
+            i = k;
+        }
+        free_slots.insert(free_slots.end(), freed.begin(), freed.end());
+
+        std::cout << "discard " << (discard ? "on " : "off")
+                  << " round " << std::setw(5) << round
+                  << " write_MiB/s " << std::fixed << std::setw(9)
+                  << std::setprecision(1) << rate
+                  << " freed_blocks " << std::setw(7) << freed.size()
+                  << " discard_calls " << std::setw(7) << discards
+                  << " allocated_MiB " << std::setw(9)
+                  << std::setprecision(1)
+                  << (double)allocated_bytes(path) / MiB
+                  << std::endl;
+    }
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+    f->close_remove();
+    delete f;
+
+    return sustained_rounds ? sustained / sustained_rounds : 0.0;
+}
+
+int benchmark_discard(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Measure sustained write throughput of a long-running workload, which "
+        "frees random blocks after writing, with and without releasing freed "
+        "blocks via hole punching / discard.");
+
+    std::string path;
+    cp.add_param_string("filename", path,
+                        "Path of the test file or raw device.");
+
+    uint64 span = 0;
+    cp.add_param_bytes("span", span,
+                       "Size of the file, e.g. the size of the SSD.");
+
+    uint64 block_size = 8 * MiB;
+    cp.add_bytes('b', "block_size", block_size,
+                 "Size of blocks written and freed, default: 8 MiB.");
+
+    unsigned int rounds = 64;
+    cp.add_uint('r', "rounds", rounds,
+                "Number of rounds, each writes 1/16 of the span, default: 64.");
+
+    unsigned int fill = 75;
+    cp.add_uint('f', "fill", fill,
+                "Percentage of the span kept occupied, default: 75.");
+
+    std::string io_impl = "syscall";
+    cp.add_string('i', "io_impl", io_impl,
+                  "File I/O implementation, default: syscall.");
+
+    std::string mode = "both";
+    cp.add_string('m', "mode", mode,
+                  "Run with discard \"on\", \"off\" or \"both\" (default).");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    if (span < 2 * block_size || fill > 100 ||
+        (mode != "on" && mode != "off" && mode != "both"))
+    {
+        cp.print_usage();
+        return -1;
+    }
+
+    double rate_off = 0.0, rate_on = 0.0;
+
+    if (mode != "on")
+        rate_off = run_discard(io_impl, path, span, block_size, rounds, fill, false);
+    if (mode != "off")
+        rate_on = run_discard(io_impl, path, span, block_size, rounds, fill, true);
+
+    std::cout << "# sustained write throughput:";
+    if (mode != "on")
+        std::cout << " without discard " << std::setprecision(1) << rate_off << " MiB/s";
+    if (mode != "off")
+        std::cout << " with discard " << std::setprecision(1) << rate_on << " MiB/s";
+    std::cout << std::endl;
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
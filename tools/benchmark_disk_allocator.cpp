@@ -0,0 +1,244 @@
+/***************************************************************************
+ *  tools/benchmark_disk_allocator.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   This benchmark stresses the free space management of disk_allocator: it
+   allocates batches of blocks of mixed sizes until the given fill degree is
+   reached and then keeps freeing random batches and allocating new ones. No
+   data is written, the file is only grown sparsely. After each phase it
+   prints the latency of new_blocks() calls, the number of free regions and
+   the fragmentation ratio, i.e. 1 - largest free region / free bytes.
+
+   example gnuplot command for the output of this program:
+   (x-axis: phase, y-axis: average allocation latency in microseconds)
+
+   plot "disk_allocator.log" using 2:4 w l title "avg latency"
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/cmdline>
+#include <stxxl/bits/mng/disk_allocator.h>
+#include <stxxl/bits/common/rand.h>
+
+using stxxl::disk_allocator;
+using stxxl::timestamp;
+using stxxl::int64;
+using stxxl::uint64;
+
+#define KiB (1024)
+#define MiB (1024 * 1024)
+
+//! block sizes of the allocated batches
+static const unsigned num_classes = 4;
+static const int64 class_size[num_classes] = {
+    64 * KiB, 256 * KiB, 1 * MiB, 4 * MiB
+};
+
+//! a batch of blocks allocated with one new_blocks() call
+struct batch_type
+{
+    unsigned size_class;
+    std::vector<int64> offsets;
+};
+
+template <unsigned BlockSize>
+static void alloc_batch(disk_allocator& alloc, unsigned size_class,
+                        unsigned n, batch_type& batch)
+{
+    stxxl::BIDArray<BlockSize> bids(n);
+    alloc.new_blocks(bids);
+
+    batch.size_class = size_class;
+    batch.offsets.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+        batch.offsets[i] = bids[i].offset;
+}
+
+template <unsigned BlockSize>
+static void free_batch(disk_allocator& alloc, const batch_type& batch)
+{
+    stxxl::BID<BlockSize> bid;
+    for (size_t i = 0; i < batch.offsets.size(); ++i) {
+        bid.offset = batch.offsets[i];
+        alloc.delete_block(bid);
+    }
+}
+
+static void alloc_batch(disk_allocator& alloc, unsigned size_class,
+                        unsigned n, batch_type& batch)
+{
+    switch (size_class) {
+    case 0: return alloc_batch<64 * KiB>(alloc, size_class, n, batch);
+    case 1: return alloc_batch<256 * KiB>(alloc, size_class, n, batch);
+    case 2: return alloc_batch<1 * MiB>(alloc, size_class, n, batch);
+    default: return alloc_batch<4 * MiB>(alloc, size_class, n, batch);
+    }
+}
+
+static void free_batch(disk_allocator& alloc, const batch_type& batch)
+{
+    switch (batch.size_class) {
+    case 0: return free_batch<64 * KiB>(alloc, batch);
+    case 1: return free_batch<256 * KiB>(alloc, batch);
+    case 2: return free_batch<1 * MiB>(alloc, batch);
+    default: return free_batch<4 * MiB>(alloc, batch);
+    }
+}
+
+static int64 batch_bytes(const batch_type& batch)
+{
+    return class_size[batch.size_class] * (int64)batch.offsets.size();
+}
+
+int benchmark_disk_allocator(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Measure allocation latency and fragmentation of the disk_allocator "
+        "under a churn of mixed block sizes. The file is grown sparsely, no "
+        "data is written.");
+
+    std::string path;
+    cp.add_param_string("filename", path,
+                        "Path of the (sparse) test file.");
+
+    uint64 span = 64 * uint64(1024) * MiB;
+    cp.add_bytes('s', "span", span,
+                 "Size of the managed file, default: 64 GiB.");
+
+    unsigned int phases = 20;
+    cp.add_uint('p', "phases", phases,
+                "Number of churn phases, default: 20.");
+
+    unsigned int ops = 10000;
+    cp.add_uint('o', "ops", ops,
+                "Number of free/allocate pairs per phase, default: 10000.");
+
+    unsigned int fill = 80;
+    cp.add_uint('f', "fill", fill,
+                "Percentage of the span kept allocated, default: 80.");
+
+    unsigned int max_batch = 16;
+    cp.add_uint('b', "max_batch", max_batch,
+                "Maximum number of blocks per new_blocks() call, default: 16.");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    if (fill == 0 || fill >= 100 || max_batch == 0 || ops == 0 ||
+        span < (uint64)(100 * max_batch * class_size[num_classes - 1]))
+    {
+        cp.print_usage();
+        return -1;
+    }
+
+    stxxl::file* f = stxxl::create_file(
+        "syscall", path,
+        stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::TRUNC);
+
+    stxxl::disk_config cfg(path, span, "syscall");
+    cfg.autogrow = false;
+
+    {
+        disk_allocator alloc(f, cfg);
+
+        const int64 target = (int64)(span / 100 * fill);
+        int64 allocated = 0;
+
+        stxxl::random_number32_r rnd(12345);
+        std::vector<batch_type> batches;
+        std::vector<double> latency;
+
+        // fill up to the target fill degree
+        double begin = timestamp();
+        while (allocated < target)
+        {
+            batches.push_back(batch_type());
+            alloc_batch(alloc, rnd() % num_classes, 1 + rnd() % max_batch,
+                        batches.back());
+            allocated += batch_bytes(batches.back());
+        }
+        std::cout << "# filled " << allocated / MiB << " MiB in "
+                  << batches.size() << " batches in "
+                  << std::fixed << std::setprecision(3)
+                  << timestamp() - begin << " s" << std::endl;
+
+        for (unsigned int phase = 0; phase < phases; ++phase)
+        {
+            latency.clear();
+
+            for (unsigned int op = 0; op < ops; ++op)
+            {
+                // free a random batch
+                size_t j = rnd() % batches.size();
+                free_batch(alloc, batches[j]);
+                allocated -= batch_bytes(batches[j]);
+                std::swap(batches[j], batches.back());
+                batches.pop_back();
+
+                // allocate new batches back to the fill degree
+                while (allocated < target)
+                {
+                    unsigned size_class = rnd() % num_classes;
+                    unsigned n = 1 + rnd() % max_batch;
+                    if (alloc.get_free_bytes() < class_size[size_class] * n)
+                        break;
+
+                    batches.push_back(batch_type());
+                    double t = timestamp();
+                    alloc_batch(alloc, size_class, n, batches.back());
+                    latency.push_back(timestamp() - t);
+                    allocated += batch_bytes(batches.back());
+                }
+            }
+
+            std::sort(latency.begin(), latency.end());
+
+            double sum = 0.0;
+            for (size_t i = 0; i < latency.size(); ++i)
+                sum += latency[i];
+
+            double avg = latency.empty() ? 0.0 : sum / latency.size();
+            double p99 = latency.empty() ? 0.0
+                         : latency[latency.size() * 99 / 100];
+            double max = latency.empty() ? 0.0 : latency.back();
+
+            std::cout << "phase " << std::setw(4) << phase
+                      << " avg_us " << std::setw(9) << std::setprecision(3)
+                      << avg * 1e6
+                      << " p99_us " << std::setw(9) << p99 * 1e6
+                      << " max_us " << std::setw(9) << max * 1e6
+                      << " free_regions " << std::setw(8)
+                      << alloc.get_free_regions()
+                      << " largest_free_MiB " << std::setw(9)
+                      << std::setprecision(1)
+                      << (double)alloc.get_largest_free_region() / MiB
+                      << " fragmentation " << std::setprecision(4)
+                      << alloc.get_fragmentation()
+                      << std::endl;
+        }
+
+        for (size_t i = 0; i < batches.size(); ++i)
+            free_batch(alloc, batches[i]);
+    }
+
+    f->close_remove();
+    delete f;
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -26,12 +26,19 @@
         "disk.log" using ($2/1024):($4)  w l title "write"
  */
 
+#include <algorithm>
 #include <iomanip>
 #include <vector>
 
 #include <stxxl/io>
 #include <stxxl/mng>
 #include <stxxl/bits/common/cmdline.h>
+#include <stxxl/bits/common/numa.h>
+#include <stxxl/bits/common/rand.h>
+
+#if !STXXL_WINDOWS
+ #include <unistd.h>
+#endif
 
 using stxxl::timestamp;
 using stxxl::unsigned_type;
@@ -52,7 +59,8 @@ using stxxl::uint64;
 
 template <unsigned_type RawBlockSize, typename AllocStrategy>
 int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 batch_size,
-                                    std::string optrw)
+                                    std::string optrw, bool promote,
+                                    int numa_node)
 {
     uint64 endpos = start_offset + length;
 
@@ -61,6 +69,7 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
 
     bool do_read = (optrw.find('r') != std::string::npos);
     bool do_write = (optrw.find('w') != std::string::npos);
+    bool do_mixed = (optrw.find('m') != std::string::npos);
 
     // initialize disk configuration
     stxxl::block_manager::get_instance();
@@ -88,6 +97,11 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
     double totaltimeread = 0, totaltimewrite = 0;
     uint64 totalsizeread = 0, totalsizewrite = 0;
 
+    // mixed mode: latencies of single reads issued during bulk writes
+    block_type* read_buffer = do_mixed ? new block_type : NULL;
+    std::vector<double> read_latency;
+    stxxl::random_number32 rng;
+
     std::cout << "# Batch size: "
               << stxxl::add_IEC_binary_multiplier(batch_size, "B") << " ("
               << num_blocks_per_batch << " blocks of "
@@ -95,6 +109,18 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
               << " using " << AllocStrategy().name()
               << std::endl;
 
+    if (numa_node != stxxl::numa::NO_NODE)
+    {
+        // place buffers before they are touched
+        stxxl::numa::bind_memory(buffer, num_blocks_per_batch * sizeof(block_type), numa_node);
+        if (read_buffer)
+            stxxl::numa::bind_memory(read_buffer, sizeof(block_type), numa_node);
+
+        std::cout << "# Buffers placed on NUMA node " << numa_node << " of "
+                  << stxxl::numa::num_nodes() << ", benchmark thread runs on node "
+                  << stxxl::numa::current_node() << std::endl;
+    }
+
     // touch data, so it is actually allcoated
     for (unsigned j = 0; j < num_blocks_per_batch; ++j)
         for (unsigned i = 0; i < block_size; ++i)
@@ -123,6 +149,44 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
 
             double begin = timestamp(), end, elapsed;
 
+            if (do_mixed)
+            {
+                // submit a batch of bulk writes, meanwhile read random,
+                // previously written blocks one at a time.
+                for (unsigned j = 0; j < current_num_blocks_per_batch; j++)
+                    reqs[j] = buffer[j].write(blocks[num_total_blocks + j]);
+
+                unsigned_type num_reads = 0;
+                for (unsigned j = 0; j < current_num_blocks_per_batch && num_total_blocks > 0; j++)
+                {
+                    double read_begin = timestamp();
+                    stxxl::request_ptr req = read_buffer->read(blocks[rng() % num_total_blocks]);
+                    if (promote) {
+                        req->wait();
+                    }
+                    else {
+                        // poll to keep the request from being promoted
+                        while (!req->poll())
+                            usleep(POLL_DELAY / 10);
+                    }
+                    read_latency.push_back(timestamp() - read_begin);
+                    ++num_reads;
+                }
+
+                wait_all(reqs, current_num_blocks_per_batch);
+
+                end = timestamp();
+                elapsed = end - begin;
+                totalsizewrite += current_batch_size;
+                totaltimewrite += elapsed;
+                totalsizeread += num_reads * raw_block_size;
+                totaltimeread += elapsed;
+
+                std::cout << std::setw(5) << std::setprecision(1) << (double(current_batch_size) / MiB / elapsed) << " MiB/s write, "
+                          << std::setw(5) << std::setprecision(1) << (double(num_reads * raw_block_size) / MiB / elapsed) << " MiB/s read" << std::endl;
+                continue;
+            }
+
             if (do_write)
             {
                 for (unsigned j = 0; j < current_num_blocks_per_batch; j++)
@@ -191,6 +255,20 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
     std::cout << std::setw(5) << std::setprecision(1) << (double(totalsizewrite) / MiB / totaltimewrite) << " MiB/s write, ";
     std::cout << std::setw(5) << std::setprecision(1) << (double(totalsizeread) / MiB / totaltimeread) << " MiB/s read" << std::endl;
 
+    if (read_latency.size())
+    {
+        std::sort(read_latency.begin(), read_latency.end());
+        const size_t n = read_latency.size();
+        std::cout << "# Read latency over " << n << " reads during writes:"
+                  << std::setprecision(3)
+                  << " p50 " << read_latency[n / 2] * 1000.0 << " ms,"
+                  << " p90 " << read_latency[n * 90 / 100] * 1000.0 << " ms,"
+                  << " p99 " << read_latency[n * 99 / 100] * 1000.0 << " ms,"
+                  << " max " << read_latency[n - 1] * 1000.0 << " ms"
+                  << std::endl;
+    }
+
+    delete read_buffer;
     delete[] reqs;
     delete[] buffer;
 
@@ -199,9 +277,10 @@ int benchmark_disks_blocksize_alloc(uint64 length, uint64 start_offset, uint64 b
 
 template <typename AllocStrategy>
 int benchmark_disks_alloc(uint64 length, uint64 offset, uint64 batch_size,
-                          unsigned_type block_size, std::string optrw)
+                          unsigned_type block_size, std::string optrw,
+                          bool promote, int numa_node)
 {
-#define run(bs) benchmark_disks_blocksize_alloc<bs, AllocStrategy>(length, offset, batch_size, optrw)
+#define run(bs) benchmark_disks_blocksize_alloc<bs, AllocStrategy>(length, offset, batch_size, optrw, promote, numa_node)
     if (block_size == 4 * KiB)
         run(4 * KiB);
     else if (block_size == 8 * KiB)
@@ -252,13 +331,18 @@ int benchmark_disks(int argc, char* argv[])
     uint64 length = 0, offset = 0;
     unsigned int batch_size = 0;
     unsigned_type block_size = 8 * MiB;
-    std::string optrw = "rw", allocstr;
+    std::string optrw = "rw", allocstr, fileio, priority;
+    bool no_promote = false;
+    int numa_node = stxxl::numa::NO_NODE;
+    bool numa_off = false;
 
     cp.add_param_bytes("size", length,
                        "Amount of data to write/read from disks (e.g. 10GiB)");
     cp.add_opt_param_string(
-        "r|w", optrw,
-        "Only read or write blocks (default: both write and read)");
+        "r|w|m", optrw,
+        "Only read or write blocks (default: both write and read), or m for "
+        "mixed: read single random blocks while writing a batch, and report "
+        "read latency percentiles");
     cp.add_opt_param_string(
         "alloc", allocstr,
         "Block allocation strategy: RC, SR, FR, striping. (default: RC)");
@@ -269,6 +353,22 @@ int benchmark_disks(int argc, char* argv[])
                  "Size of blocks written in one syscall. (default: B = 8MiB)");
     cp.add_bytes('o', "offset", offset,
                  "Starting offset of operation range. (default: 0)");
+    cp.add_string('i', "fileio", fileio,
+                  "Override the fileio implementation of all configured "
+                  "disks, e.g. syscall, linuxaio or io_uring, to compare "
+                  "them on the same disks. (default: as configured)");
+    cp.add_string('p', "priority", priority,
+                  "I/O scheduling mode of the disk queues: read, write or "
+                  "fair. (default: write)");
+    cp.add_flag('n', "no-promote", no_promote,
+                "In mixed mode, poll reads instead of waiting for them, "
+                "which would promote them in the disk queue.");
+    cp.add_int('N', "numa", numa_node,
+               "Place the I/O buffers on this NUMA node, compare the disk's "
+               "node with a remote one. (default: node of first touch)");
+    cp.add_flag(0, "numa-off", numa_off,
+                "Do not pin the disk queue threads to the NUMA node of their "
+                "disk, i.e. numa=off for all disks.");
 
     cp.set_description(
         "This program will benchmark the disks configured by the standard "
@@ -282,20 +382,69 @@ int benchmark_disks(int argc, char* argv[])
     if (!cp.process(argc, argv))
         return -1;
 
+    if (numa_off)
+    {
+        // must happen before block_manager opens the disks
+        stxxl::config* cfg = stxxl::config::get_instance();
+        for (size_t i = 0; i < cfg->disks_number(); ++i)
+            cfg->disk(i).numa_node = stxxl::disk_config::NUMA_OFF;
+    }
+
+    if (numa_node != stxxl::numa::NO_NODE &&
+        (numa_node < 0 || (unsigned)numa_node >= stxxl::numa::num_nodes()))
+    {
+        std::cout << "Invalid NUMA node " << numa_node << ", there are "
+                  << stxxl::numa::num_nodes() << " nodes." << std::endl;
+        return -1;
+    }
+
+    if (fileio.size())
+    {
+        // must happen before block_manager opens the disks
+        stxxl::config* cfg = stxxl::config::get_instance();
+        for (size_t i = 0; i < cfg->disks_number(); ++i)
+        {
+            stxxl::disk_config& disk = cfg->disk(i);
+            disk.io_impl = fileio;
+            disk.queue = stxxl::file::DEFAULT_QUEUE;
+            std::cout << "# Using fileio " << disk.fileio_string()
+                      << " for disk " << disk.path << std::endl;
+        }
+    }
+
+    if (priority.size())
+    {
+        stxxl::request_queue::priority_op op;
+        if (priority == "read")
+            op = stxxl::request_queue::READ;
+        else if (priority == "write")
+            op = stxxl::request_queue::WRITE;
+        else if (priority == "fair")
+            op = stxxl::request_queue::NONE;
+        else {
+            std::cout << "Unknown priority '" << priority << "'" << std::endl;
+            cp.print_usage();
+            return -1;
+        }
+        stxxl::disk_queues::get_instance()->set_priority_op(op);
+    }
+
+    bool promote = !no_promote;
+
     if (allocstr.size())
     {
         if (allocstr == "RC")
             return benchmark_disks_alloc<stxxl::RC>(
-                length, offset, batch_size, block_size, optrw);
+                length, offset, batch_size, block_size, optrw, promote, numa_node);
         if (allocstr == "SR")
             return benchmark_disks_alloc<stxxl::SR>(
-                length, offset, batch_size, block_size, optrw);
+                length, offset, batch_size, block_size, optrw, promote, numa_node);
         if (allocstr == "FR")
             return benchmark_disks_alloc<stxxl::FR>(
-                length, offset, batch_size, block_size, optrw);
+                length, offset, batch_size, block_size, optrw, promote, numa_node);
         if (allocstr == "striping")
             return benchmark_disks_alloc<stxxl::striping>(
-                length, offset, batch_size, block_size, optrw);
+                length, offset, batch_size, block_size, optrw, promote, numa_node);
 
         std::cout << "Unknown allocation strategy '" << allocstr << "'" << std::endl;
         cp.print_usage();
@@ -303,5 +452,5 @@ int benchmark_disks(int argc, char* argv[])
     }
 
     return benchmark_disks_alloc<STXXL_DEFAULT_ALLOC_STRATEGY>(
-        length, offset, batch_size, block_size, optrw);
+        length, offset, batch_size, block_size, optrw, promote, numa_node);
 }
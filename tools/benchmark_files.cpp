@@ -239,6 +239,15 @@ int benchmark_files(int argc, char* argv[])
         files[i] = stxxl::create_file(file_type, files_arr[i], openmode, i);
         if (resize_after_open)
             files[i]->set_size(endpos);
+
+#if STXXL_HAVE_IO_URING_FILE
+        // register the I/O buffer as fixed buffer, once is enough since all
+        // io_uring files share one queue.
+        if (i == 0) {
+            if (stxxl::io_uring_file* uf = dynamic_cast<stxxl::io_uring_file*>(files[i]))
+                uf->register_buffer(buffer, step_size * nfiles);
+        }
+#endif
     }
 
     std::cout << "# Step size: "
@@ -450,6 +459,12 @@ int benchmark_files(int argc, char* argv[])
     delete[] w_finish_times;
 #endif
     delete[] reqs;
+#if STXXL_HAVE_IO_URING_FILE
+    if (nfiles > 0) {
+        if (stxxl::io_uring_file* uf = dynamic_cast<stxxl::io_uring_file*>(files[0]))
+            uf->unregister_buffer(buffer);
+    }
+#endif
     for (unsigned i = 0; i < nfiles; i++)
         delete files[i];
     delete[] files;
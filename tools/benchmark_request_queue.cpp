@@ -0,0 +1,151 @@
+/***************************************************************************
+ *  tools/benchmark_request_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   This microbenchmark measures how fast requests can be submitted to the
+   default request queue (request_queue_impl_qwqr) by multiple threads. The
+   requests are small transfers on a memory file, hence the measured time is
+   dominated by the submission path.
+
+   example gnuplot command for the output of this program:
+   (x-axis: number of submitting threads, y-axis: million requests/s)
+
+   plot "submission.log" using 2:($8/1e6) w lp title "submit"
+ */
+
+#include <iomanip>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/cmdline>
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/io/request_queue_impl_qwqr.h>
+
+#if STXXL_PARALLEL
+  #include <omp.h>
+#endif
+
+using stxxl::request_ptr;
+using stxxl::timestamp;
+
+int benchmark_request_queue(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Measure request submission throughput of the default request queue "
+        "against the number of submitting threads. Requests are served by a "
+        "memory file, the worker serves them concurrently.");
+
+    unsigned int max_threads = 0;
+    cp.add_uint('t', "threads", max_threads,
+                "Maximum number of submitting threads, "
+                "default: number of OpenMP threads.");
+
+    unsigned int num_requests = 100000;
+    cp.add_uint('n', "requests", num_requests,
+                "Number of requests submitted by each thread, default: 100000.");
+
+    stxxl::uint64 block_size = 4096;
+    cp.add_bytes('b', "block_size", block_size,
+                 "Size of each request, default: 4 KiB.");
+
+    unsigned int batch = 64;
+    cp.add_uint('w', "window", batch,
+                "Number of outstanding requests per thread before waiting "
+                "for them, 0 = wait only at the end, default: 64.");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+#if STXXL_PARALLEL
+    if (max_threads == 0)
+        max_threads = omp_get_max_threads();
+#else
+    if (max_threads > 1)
+        STXXL_MSG("Compiled without OpenMP, using one submitting thread only.");
+    max_threads = 1;
+#endif
+    if (max_threads == 0) max_threads = 1;
+    if (batch == 0) batch = num_requests;
+
+    std::cout << "# Submission is "
+              << (stxxl::request_queue_impl_qwqr::is_lock_free()
+          ? "lock-free" : "mutex-based")
+              << ", " << num_requests << " requests of "
+              << block_size << " bytes per thread." << std::endl;
+
+    const size_t bs = (size_t)block_size;
+
+    for (unsigned int threads = 1; ; threads = std::min(2 * threads, max_threads))
+    {
+        // one block slot per thread, each thread has its own buffer
+        stxxl::mem_file file;
+        file.set_size(threads * bs);
+
+        char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(threads * bs);
+        memset(buffer, 0, threads * bs);
+
+        double submit_time = 0.0;
+        double begin = timestamp();
+
+#if STXXL_PARALLEL
+        #pragma omp parallel num_threads(threads) reduction(+:submit_time)
+#endif
+        {
+#if STXXL_PARALLEL
+            const unsigned int id = omp_get_thread_num();
+#else
+            const unsigned int id = 0;
+#endif
+            std::vector<request_ptr> reqs(batch);
+            char* tbuffer = buffer + id * bs;
+            stxxl::file::offset_type offset = id * bs;
+
+            for (unsigned int i = 0; i < num_requests; i += batch)
+            {
+                unsigned int n = std::min(batch, num_requests - i);
+
+                double t0 = timestamp();
+                for (unsigned int j = 0; j < n; ++j)
+                    reqs[j] = file.awrite(tbuffer, offset, bs);
+                submit_time += timestamp() - t0;
+
+                stxxl::wait_all(reqs.begin(), reqs.begin() + n);
+            }
+        }
+
+        double elapsed = timestamp() - begin;
+        double total = (double)threads * num_requests;
+
+        // average time each thread spent inside awrite()
+        submit_time /= threads;
+
+        std::cout << "threads " << std::setw(3) << threads
+                  << " requests " << std::setw(10) << (stxxl::uint64)total
+                  << " submit_time " << std::fixed << std::setprecision(6)
+                  << submit_time
+                  << " submit_rate " << std::setprecision(0)
+                  << total / submit_time
+                  << " total_time " << std::setprecision(6) << elapsed
+                  << " total_rate " << std::setprecision(0)
+                  << total / elapsed
+                  << std::endl;
+
+        stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+        if (threads == max_threads) break;
+    }
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,199 @@
+/***************************************************************************
+ *  tools/benchmark_run_formation.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   This benchmark compares run formation by sorting memory sized runs
+   (stream::runs_creator) with run formation by replacement selection
+   (stream::replacement_selection_runs_creator) on random, nearly sorted and
+   reverse sorted 64-bit integers, each with a plain comparator and with one
+   exposing its key, such that the runs are sorted by radix_sort(). For each
+   input and run formation it prints the time of the run formation alone, the
+   number of runs created and the time of a complete stream::sort including
+   merging.
+ */
+
+#include <iomanip>
+#include <limits>
+
+#include <stxxl/cmdline>
+#include <stxxl/stream>
+#include <stxxl/bits/common/timer.h>
+
+using stxxl::timestamp;
+using stxxl::uint64;
+using stxxl::unsigned_type;
+
+struct value_less : public std::less<uint64>
+{
+    uint64 min_value() const
+    {
+        return std::numeric_limits<uint64>::min();
+    }
+    uint64 max_value() const
+    {
+        return std::numeric_limits<uint64>::max();
+    }
+};
+
+//! the same order, exposing the key for radix sorting
+struct value_key_less : public value_less
+{
+    typedef uint64 key_type;
+
+    key_type key_of(const uint64& v) const
+    {
+        return v;
+    }
+};
+
+//! generates random, nearly sorted or reverse sorted numbers
+struct input_stream
+{
+    typedef uint64 value_type;
+
+    enum order_type { random, nearly_sorted, reverse };
+
+    order_type m_order;
+    uint64 m_state;
+    uint64 m_index, m_count;
+
+    input_stream(order_type order, uint64 count)
+        : m_order(order), m_state(42), m_index(0), m_count(count)
+    { }
+
+    value_type operator * () const
+    {
+        switch (m_order)
+        {
+        case random:
+            return m_state;
+        case nearly_sorted:
+            // each element is displaced by at most 4096 positions
+            return 16 * m_index + m_state % (16 * 4096);
+        default:
+            return m_count - m_index;
+        }
+    }
+
+    input_stream& operator ++ ()
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        m_state ^= m_state >> 29;
+        ++m_index;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return m_index == m_count;
+    }
+};
+
+static const char* order_names[] = { "random", "nearly sorted", "reverse" };
+
+//! time run formation and sorting of one input with RunsCreator
+template <class RunsCreator>
+static void run_variant(const char* name, input_stream::order_type order,
+                        uint64 count, unsigned_type memsize)
+{
+    typedef typename RunsCreator::cmp_type cmp_type;
+
+    double runs_time, sort_time;
+    unsigned_type runs;
+    {
+        double ts1 = timestamp();
+
+        input_stream input(order, count);
+        RunsCreator creator(input, cmp_type(), memsize);
+        runs = creator.result()->runs.size();
+
+        runs_time = timestamp() - ts1;
+    }
+    {
+        double ts1 = timestamp();
+
+        typedef stxxl::stream::sort<input_stream, cmp_type,
+                                    STXXL_DEFAULT_BLOCK_SIZE(uint64),
+                                    STXXL_DEFAULT_ALLOC_STRATEGY,
+                                    RunsCreator> sort_type;
+
+        input_stream input(order, count);
+        sort_type sorted(input, cmp_type(), memsize);
+        stxxl::stream::discard(sorted);
+
+        sort_time = timestamp() - ts1;
+    }
+
+    std::cout << std::left << std::setw(15) << order_names[order]
+              << std::setw(28) << name << std::right
+              << std::fixed << std::setprecision(3)
+              << std::setw(12) << runs_time
+              << std::setw(8) << runs
+              << std::setw(12) << sort_time << std::endl;
+}
+
+int benchmark_run_formation(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Compare run formation by sorting memory sized runs with run "
+        "formation by replacement selection on random, nearly sorted and "
+        "reverse sorted 64-bit integers, sorting runs by comparisons and by "
+        "radix sort: time of run formation, number of runs and time of a "
+        "complete stream::sort.");
+
+    uint64 length = 0;
+    cp.add_param_bytes("size", length,
+                       "Amount of data to sort (e.g. 1GiB)");
+
+    uint64 memsize = 256 * 1024 * 1024;
+    cp.add_bytes('M', "ram", memsize,
+                 "Amount of RAM to use when sorting, default: 256 MiB");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    const uint64 count = length / sizeof(uint64);
+
+    typedef stxxl::stream::runs_creator<input_stream, value_less>
+        runs_creator_type;
+    typedef stxxl::stream::replacement_selection_runs_creator<input_stream, value_less>
+        replacement_selection_type;
+    typedef stxxl::stream::runs_creator<input_stream, value_key_less>
+        radix_runs_creator_type;
+    typedef stxxl::stream::replacement_selection_runs_creator<input_stream, value_key_less>
+        radix_replacement_selection_type;
+
+    std::cout << std::left << std::setw(15) << "# input"
+              << std::setw(28) << "run formation" << std::right
+              << std::setw(12) << "runs [s]"
+              << std::setw(8) << "runs"
+              << std::setw(12) << "sort [s]" << std::endl;
+
+    for (int order = input_stream::random; order <= input_stream::reverse; ++order)
+    {
+        run_variant<runs_creator_type>(
+            "runs_creator", (input_stream::order_type)order,
+            count, (unsigned_type)memsize);
+        run_variant<replacement_selection_type>(
+            "replacement_selection", (input_stream::order_type)order,
+            count, (unsigned_type)memsize);
+        run_variant<radix_runs_creator_type>(
+            "runs_creator radix", (input_stream::order_type)order,
+            count, (unsigned_type)memsize);
+        run_variant<radix_replacement_selection_type>(
+            "replacement_selection radix", (input_stream::order_type)order,
+            count, (unsigned_type)memsize);
+    }
+
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include <stxxl/sort>
 #include <stxxl/ksort>
 #include <stxxl/stream>
+#include <stxxl/sorter>
 #include <stxxl/bits/common/tuple.h>
 
 using stxxl::timestamp;
@@ -187,6 +188,36 @@ public:
             double elapsed = timestamp() - ts1;
             output_result(elapsed, vec_size);
         }
+        {
+            std::cout << "# stxxl::stream::runs_creator (run formation only) of size " << vec_size << std::endl;
+            double ts1 = timestamp();
+
+            typedef stxxl::stream::runs_creator<random_stream, value_less>
+                random_stream_runs_creator_type;
+
+            random_stream stream(vec_size);
+            random_stream_runs_creator_type runs_creator(stream, value_less(), memsize);
+
+            runs_creator.result();
+
+            double elapsed = timestamp() - ts1;
+            output_result(elapsed, vec_size);
+        }
+        {
+            std::cout << "# stxxl::sorter push and sort of size " << vec_size << std::endl;
+            double ts1 = timestamp();
+
+            stxxl::sorter<value_type, value_less> sorter(value_less(), memsize);
+
+            for (random_stream stream(vec_size); !stream.empty(); ++stream)
+                sorter.push(*stream);
+
+            sorter.sort();
+            stxxl::stream::discard(sorter);
+
+            double elapsed = timestamp() - ts1;
+            output_result(elapsed, vec_size);
+        }
 
         std::cout << std::endl;
     }
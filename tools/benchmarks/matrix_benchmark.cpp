@@ -60,6 +60,7 @@ int main(int argc, char** argv)
                "   0: online LRU\n"
                "   1: offline LFD\n"
                "   2: offline LRU prefetching\n"
+               "   3: offline LFD prefetching\n"
                "  default: 2");
 
     cp.set_description("stxxl matrix test");
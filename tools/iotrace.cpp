@@ -0,0 +1,77 @@
+/***************************************************************************
+ *  tools/iotrace.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+/*
+   Converts an I/O trace recorded with the environment variable STXXLIOTRACE
+   into the Chrome trace event JSON format, which can be opened in
+   chrome://tracing or https://ui.perfetto.dev, and prints per-disk latency
+   histograms and queue depths of the trace.
+
+   example:
+   STXXLIOTRACE=io.trace stxxl_tool benchmark_disks 1GiB
+   stxxl_tool iotrace io.trace io.json
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/cmdline>
+
+int do_iotrace(int argc, char* argv[])
+{
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(
+        "Print latency histograms and queue depths of an I/O trace recorded "
+        "with STXXLIOTRACE=<file>, and optionally convert it to Chrome trace "
+        "event JSON for chrome://tracing or Perfetto.");
+
+    std::string input, output;
+    cp.add_param_string("trace", input,
+                        "I/O trace file written by STXXLIOTRACE");
+    cp.add_opt_param_string("json", output,
+                            "Output Chrome trace / Perfetto JSON file");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    std::ifstream in(input.c_str());
+    if (!in.good()) {
+        STXXL_ERRMSG("Could not open " << input);
+        return -1;
+    }
+
+    std::vector<stxxl::iotrace::entry> trace;
+    if (!stxxl::iotrace::read_trace(in, trace)) {
+        STXXL_ERRMSG("Error parsing I/O trace " << input);
+        return -1;
+    }
+
+    std::cout << "# " << trace.size() << " requests in " << input << std::endl;
+    stxxl::iotrace::print_summary(std::cout, stxxl::iotrace::summarize(trace));
+
+    if (!output.empty())
+    {
+        std::ofstream out(output.c_str());
+        stxxl::iotrace::write_chrome_trace(out, trace);
+        if (!out.good()) {
+            STXXL_ERRMSG("Error writing " << output);
+            return -1;
+        }
+        std::cout << "# wrote Chrome trace to " << output << std::endl;
+    }
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -16,6 +16,7 @@
 #include <stxxl/version.h>
 #include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/common/cmdline.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/parallel.h>
 
 int stxxl_info(int, char**)
@@ -39,6 +40,17 @@ int stxxl_info(int, char**)
 #if defined(STXXL_HAVE_LINUXAIO_FILE)
     STXXL_MSG("STXXL_HAVE_LINUXAIO_FILE = " << STXXL_HAVE_LINUXAIO_FILE);
 #endif
+#if defined(STXXL_HAVE_IO_URING_FILE)
+    STXXL_MSG("STXXL_HAVE_IO_URING_FILE = " << STXXL_HAVE_IO_URING_FILE);
+#endif
+#if defined(STXXL_HAVE_LIBNUMA)
+    STXXL_MSG("STXXL_HAVE_LIBNUMA = " << STXXL_HAVE_LIBNUMA <<
+              ", NUMA nodes = " << stxxl::numa::num_nodes());
+#endif
+
+    stxxl::uint64 limit = stxxl::memory_arbiter::get_instance()->get_limit();
+    STXXL_MSG("STXXL_MEMORY_LIMIT = " <<
+              (limit ? stxxl::format_IEC_size(limit) + "B" : std::string("unlimited")));
 
     return 0;
 }
@@ -49,6 +61,12 @@ extern int benchmark_files(int argc, char* argv[]);
 extern int benchmark_sort(int argc, char* argv[]);
 extern int benchmark_disks_random(int argc, char* argv[]);
 extern int benchmark_pqueue(int argc, char* argv[]);
+extern int benchmark_request_queue(int argc, char* argv[]);
+extern int benchmark_discard(int argc, char* argv[]);
+extern int benchmark_disk_allocator(int argc, char* argv[]);
+extern int benchmark_buffer_pool(int argc, char* argv[]);
+extern int benchmark_run_formation(int argc, char* argv[]);
+extern int do_iotrace(int argc, char* argv[]);
 extern int do_mlock(int argc, char* argv[]);
 extern int do_mallinfo(int argc, char* argv[]);
 
@@ -91,6 +109,35 @@ struct SubTool subtools[] = {
         "benchmark_pqueue", &benchmark_pqueue, false,
         "Benchmark priority queue implementation using sequence of operations."
     },
+    {
+        "benchmark_request_queue", &benchmark_request_queue, false,
+        "Benchmark request submission throughput against number of threads."
+    },
+    {
+        "benchmark_discard", &benchmark_discard, false,
+        "Benchmark sustained write throughput with and without releasing "
+        "freed blocks via hole punching / discard."
+    },
+    {
+        "benchmark_disk_allocator", &benchmark_disk_allocator, false,
+        "Benchmark allocation latency and fragmentation of the disk "
+        "allocator under a churn of mixed block sizes."
+    },
+    {
+        "benchmark_buffer_pool", &benchmark_buffer_pool, false,
+        "Benchmark page faults and TLB misses of block buffers from malloc "
+        "and from huge page buffer pools."
+    },
+    {
+        "benchmark_run_formation", &benchmark_run_formation, false,
+        "Compare run formation by sorting and by replacement selection on "
+        "random, nearly sorted and reverse sorted input."
+    },
+    {
+        "iotrace", &do_iotrace, false,
+        "Print latency histograms of an I/O trace and convert it to Chrome "
+        "trace / Perfetto JSON."
+    },
     {
         "mlock", &do_mlock, true,
         "Lock physical memory."
@@ -152,7 +199,14 @@ int main(int argc, char** argv)
                 // replace argv[1] with call string of subtool.
                 snprintf(progsub, sizeof(progsub), "%s %s", argv[0], argv[1]);
                 argv[1] = progsub;
-                return subtools[i].func(argc - 1, argv + 1);
+                int ret = subtools[i].func(argc - 1, argv + 1);
+
+                // report the internal memory used by the components
+                stxxl::memory_arbiter* arbiter = stxxl::memory_arbiter::get_instance();
+                if (!arbiter->get_usage().empty())
+                    arbiter->print_usage(std::cout);
+
+                return ret;
             }
         }
         std::cout << "Unknown subtool '" << argv[1] << "'" << std::endl;